@@ -0,0 +1,225 @@
+// Measures glass-to-glass latency through an MjpegServer.
+//
+// A test pattern source stamps each frame with its capture time; this
+// program streams it from the server like any other client, decodes each
+// JPEG, and reads the stamp back.  The server's X-Frame-Times header
+// (requested with "timing=1") splits the total into stages:
+//
+//   put      capture -> source hands the frame to its sinks
+//   convert  put -> BGR to JPEG conversion finished
+//   send     convert -> server starts writing to the socket
+//   network  send -> last byte received by this client
+//   decode   received -> JPEG decoded and stamp read
+//   total    stamp (capture) -> decode, read from the image itself
+//
+// All times are on the wpi::Now() clock, so server and client must be the
+// same process (as here) or at least the same host.
+//
+// Usage: latencyprobe [frames [width height fps]]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "cscore.h"
+#include "cscore_stamp.h"
+#include "llvm/SmallVector.h"
+#include "llvm/StringRef.h"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+#include "support/Logger.h"
+#include "support/timestamp.h"
+#include "tcpsockets/NetworkStream.h"
+#include "tcpsockets/TCPConnector.h"
+
+static const int kPort = 8086;
+
+// Minimal buffered reader for the multipart stream.
+class StreamReader {
+ public:
+  explicit StreamReader(wpi::NetworkStream& stream) : m_stream(stream) {}
+
+  bool ReadLine(std::string* line) {
+    line->clear();
+    for (;;) {
+      if (m_pos == m_len && !Fill()) return false;
+      char c = m_buf[m_pos++];
+      if (c == '\n') break;
+      if (c != '\r') line->push_back(c);
+    }
+    return true;
+  }
+
+  bool Read(char* data, std::size_t len) {
+    while (len > 0) {
+      if (m_pos == m_len && !Fill()) return false;
+      std::size_t n = std::min(len, m_len - m_pos);
+      std::memcpy(data, m_buf + m_pos, n);
+      m_pos += n;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+ private:
+  bool Fill() {
+    wpi::NetworkStream::Error err;
+    m_len = m_stream.receive(m_buf, sizeof(m_buf), &err);
+    m_pos = 0;
+    return m_len > 0;
+  }
+
+  wpi::NetworkStream& m_stream;
+  char m_buf[65536];
+  std::size_t m_pos{0};
+  std::size_t m_len{0};
+};
+
+enum Stage { kPut, kConvert, kSend, kNetwork, kDecode, kTotal, kNumStages };
+static const char* kStageNames[kNumStages] = {"put",     "convert", "send",
+                                              "network", "decode",  "total"};
+
+static double Percentile(std::vector<int64_t>& v, double p) {
+  std::size_t i =
+      std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i] / 1000.0;
+}
+
+static void Report(std::vector<int64_t> (&stages)[kNumStages]) {
+  std::printf("%-8s %8s %8s %8s %8s  (ms, %zu frames)\n", "stage", "p50",
+              "p99", "p999", "max", stages[kTotal].size());
+  for (int i = 0; i < kNumStages; ++i) {
+    auto& v = stages[i];
+    if (v.empty()) continue;
+    double p50 = Percentile(v, 0.5);
+    double p99 = Percentile(v, 0.99);
+    double p999 = Percentile(v, 0.999);
+    double max = *std::max_element(v.begin(), v.end()) / 1000.0;
+    std::printf("%-8s %8.3f %8.3f %8.3f %8.3f\n", kStageNames[i], p50, p99,
+                p999, max);
+    v.clear();
+  }
+  std::fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  std::size_t frames = argc > 1 ? std::atoi(argv[1]) : 1000;
+  int width = argc > 4 ? std::atoi(argv[2]) : 640;
+  int height = argc > 4 ? std::atoi(argv[3]) : 480;
+  int fps = argc > 4 ? std::atoi(argv[4]) : 30;
+  if (frames == 0) frames = 1000;
+
+  cs::TestPatternSource source{"probe", cs::VideoMode::kBGR, width, height,
+                               fps};
+  cs::MjpegServer server{"probeserver", kPort};
+  server.SetSource(source);
+
+  // The server starts listening in the background; retry until it's up.
+  wpi::Logger logger;
+  std::unique_ptr<wpi::NetworkStream> stream;
+  for (int i = 0; i < 50 && !stream; ++i) {
+    stream = wpi::TCPConnector::connect("127.0.0.1", kPort, logger, 1);
+    if (!stream) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  if (!stream) {
+    std::fprintf(stderr, "could not connect to port %d\n", kPort);
+    return 1;
+  }
+  stream->setNoDelay();
+
+  static const char request[] =
+      "GET /?action=stream&timing=1 HTTP/1.0\r\n\r\n";
+  wpi::NetworkStream::Error err;
+  stream->send(request, sizeof(request) - 1, &err);
+
+  StreamReader reader{*stream};
+  std::vector<int64_t> stages[kNumStages];
+  std::vector<char> jpeg;
+  std::string line;
+  cv::Mat image;
+  uint32_t lastCount = 0;
+  std::size_t skipped = 0;
+
+  while (reader.ReadLine(&line)) {
+    // Part headers follow each boundary
+    if (!llvm::StringRef{line}.startswith("--")) continue;
+    std::size_t size = 0;
+    int64_t capture = 0, put = 0, convert = 0, send = 0;
+    while (reader.ReadLine(&line) && !line.empty()) {
+      llvm::StringRef name, value;
+      std::tie(name, value) = llvm::StringRef{line}.split(':');
+      value = value.trim();
+      if (name.equals_lower("Content-Length")) {
+        value.getAsInteger(10, size);
+      } else if (name.equals_lower("X-Frame-Times")) {
+        llvm::SmallVector<llvm::StringRef, 4> fields;
+        value.split(fields, ";", -1, false);
+        for (auto field : fields) {
+          llvm::StringRef key, num;
+          std::tie(key, num) = field.split('=');
+          int64_t val = 0;
+          num.getAsInteger(10, val);
+          if (key == "capture")
+            capture = val;
+          else if (key == "put")
+            put = val;
+          else if (key == "convert")
+            convert = val;
+          else if (key == "send")
+            send = val;
+        }
+      }
+    }
+    if (size == 0) continue;
+
+    jpeg.resize(size);
+    if (!reader.Read(jpeg.data(), size)) break;
+    int64_t received = wpi::Now() / 10;
+
+    image = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+    uint32_t count, stamp;
+    if (image.empty() ||
+        CS_ReadStamp(image.ptr<unsigned char>(), image.cols, image.rows,
+                     image.step, &count, &stamp) != 0) {
+      std::fprintf(stderr, "could not read frame stamp\n");
+      continue;
+    }
+    int64_t decoded = wpi::Now() / 10;
+    if (lastCount != 0 && count != lastCount + 1)
+      skipped += count - lastCount - 1;
+    lastCount = count;
+
+    // convert is 0 if the server sent the source image as-is
+    if (convert == 0) convert = put;
+    stages[kPut].push_back(put - capture);
+    stages[kConvert].push_back(convert - put);
+    stages[kSend].push_back(send - convert);
+    stages[kNetwork].push_back(received - send);
+    stages[kDecode].push_back(decoded - received);
+    // the stamp only holds the low 32 bits of the capture time
+    stages[kTotal].push_back(
+        static_cast<uint32_t>(static_cast<uint32_t>(decoded) - stamp));
+
+    if (stages[kTotal].size() >= frames) {
+      Report(stages);
+      if (skipped != 0) {
+        std::printf("%zu frames skipped by the server\n", skipped);
+        skipped = 0;
+      }
+    }
+  }
+
+  std::fprintf(stderr, "stream ended\n");
+  return 1;
+}
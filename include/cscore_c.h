@@ -111,7 +111,10 @@ enum CS_SourceKind {
   CS_SOURCE_UNKNOWN = 0,
   CS_SOURCE_USB = 1,
   CS_SOURCE_HTTP = 2,
-  CS_SOURCE_CV = 4
+  CS_SOURCE_CV = 4,
+  CS_SOURCE_SHM = 8,
+  CS_SOURCE_FILE = 16,
+  CS_SOURCE_TEST_PATTERN = 32
 };
 
 //
@@ -124,13 +127,25 @@ enum CS_HttpCameraKind {
   CS_HTTP_AXIS = 3
 };
 
+//
+// File source playback modes
+//
+enum CS_FilePlaybackMode {
+  CS_FILE_PLAYBACK_REALTIME = 0,    /* at the recorded frame times */
+  CS_FILE_PLAYBACK_FIXED_RATE = 1,  /* at a given frame rate */
+  CS_FILE_PLAYBACK_FAST = 2         /* as fast as possible */
+};
+
 //
 // Sink kinds
 //
 enum CS_SinkKind {
   CS_SINK_UNKNOWN = 0,
   CS_SINK_MJPEG = 2,
-  CS_SINK_CV = 4
+  CS_SINK_CV = 4,
+  CS_SINK_SHM = 8,
+  CS_SINK_RTP = 16,
+  CS_SINK_RECORDING = 32
 };
 
 //
@@ -208,6 +223,14 @@ CS_Source CS_CreateHttpCameraMulti(const char* name, const char** urls,
                                    CS_Status* status);
 CS_Source CS_CreateCvSource(const char* name, const CS_VideoMode* mode,
                             CS_Status* status);
+CS_Source CS_CreateShmSource(const char* name, const char* shmName,
+                             CS_Status* status);
+CS_Source CS_CreateFileSource(const char* name, const char* path,
+                              enum CS_FilePlaybackMode mode, int fps,
+                              CS_Status* status);
+CS_Source CS_CreateTestPatternSource(const char* name,
+                                     const CS_VideoMode* mode,
+                                     CS_Status* status);
 
 //
 // Source Functions
@@ -269,6 +292,16 @@ void CS_SetHttpCameraUrls(CS_Source source, const char** urls, int count,
                           CS_Status* status);
 char** CS_GetHttpCameraUrls(CS_Source source, int* count, CS_Status* status);
 
+//
+// Shared Memory Source Functions
+//
+char* CS_GetShmSourceName(CS_Source source, CS_Status* status);
+
+//
+// File Source Functions
+//
+char* CS_GetFileSourcePath(CS_Source source, CS_Status* status);
+
 //
 // OpenCV Source Functions
 //
@@ -292,6 +325,17 @@ void CS_SetSourceEnumPropertyChoices(CS_Source source, CS_Property property,
 //
 CS_Sink CS_CreateMjpegServer(const char* name, const char* listenAddress,
                              int port, CS_Status* status);
+CS_Sink CS_CreateMjpegServerRouted(const char* name, const char* listenAddress,
+                                   int port, CS_Status* status);
+CS_Sink CS_CreateMjpegServerUnix(const char* name, const char* path,
+                                 CS_Bool routed, CS_Status* status);
+CS_Sink CS_CreateShmSink(const char* name, const char* shmName,
+                         const CS_VideoMode* mode, int numSlots,
+                         CS_Status* status);
+CS_Sink CS_CreateRtpSink(const char* name, const char* address, int port,
+                         CS_Status* status);
+CS_Sink CS_CreateRecordingSink(const char* name, const char* directory,
+                               int segmentSeconds, CS_Status* status);
 CS_Sink CS_CreateCvSink(const char* name, CS_Status* status);
 CS_Sink CS_CreateCvSinkCallback(const char* name, void* data,
                                 void (*processFrame)(void* data, uint64_t time),
@@ -316,6 +360,22 @@ void CS_ReleaseSink(CS_Sink sink, CS_Status* status);
 char* CS_GetMjpegServerListenAddress(CS_Sink sink, CS_Status* status);
 int CS_GetMjpegServerPort(CS_Sink sink, CS_Status* status);
 
+//
+// Shared Memory Sink Functions
+//
+char* CS_GetShmSinkName(CS_Sink sink, CS_Status* status);
+
+//
+// RTP Sink Functions
+//
+char* CS_GetRtpSinkAddress(CS_Sink sink, CS_Status* status);
+int CS_GetRtpSinkPort(CS_Sink sink, CS_Status* status);
+
+//
+// Recording Sink Functions
+//
+char* CS_GetRecordingSinkDirectory(CS_Sink sink, CS_Status* status);
+
 //
 // OpenCV Sink Functions
 //
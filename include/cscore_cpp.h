@@ -168,6 +168,13 @@ CS_Source CreateHttpCamera(llvm::StringRef name,
                            CS_HttpCameraKind kind, CS_Status* status);
 CS_Source CreateCvSource(llvm::StringRef name, const VideoMode& mode,
                          CS_Status* status);
+CS_Source CreateShmSource(llvm::StringRef name, llvm::StringRef shmName,
+                          CS_Status* status);
+CS_Source CreateFileSource(llvm::StringRef name, llvm::StringRef path,
+                           CS_FilePlaybackMode mode, int fps,
+                           CS_Status* status);
+CS_Source CreateTestPatternSource(llvm::StringRef name, const VideoMode& mode,
+                                  CS_Status* status);
 
 //
 // Source Functions
@@ -229,6 +236,16 @@ void SetHttpCameraUrls(CS_Source source, llvm::ArrayRef<std::string> urls,
                        CS_Status* status);
 std::vector<std::string> GetHttpCameraUrls(CS_Source source, CS_Status* status);
 
+//
+// Shared Memory Source Functions
+//
+std::string GetShmSourceName(CS_Source source, CS_Status* status);
+
+//
+// File Source Functions
+//
+std::string GetFileSourcePath(CS_Source source, CS_Status* status);
+
 //
 // OpenCV Source Functions
 //
@@ -251,6 +268,17 @@ void SetSourceEnumPropertyChoices(CS_Source source, CS_Property property,
 //
 CS_Sink CreateMjpegServer(llvm::StringRef name, llvm::StringRef listenAddress,
                           int port, CS_Status* status);
+CS_Sink CreateMjpegServerRouted(llvm::StringRef name,
+                                llvm::StringRef listenAddress, int port,
+                                CS_Status* status);
+CS_Sink CreateMjpegServerUnix(llvm::StringRef name, llvm::StringRef path,
+                              bool routed, CS_Status* status);
+CS_Sink CreateShmSink(llvm::StringRef name, llvm::StringRef shmName,
+                      const VideoMode& mode, int numSlots, CS_Status* status);
+CS_Sink CreateRtpSink(llvm::StringRef name, llvm::StringRef address, int port,
+                      CS_Status* status);
+CS_Sink CreateRecordingSink(llvm::StringRef name, llvm::StringRef directory,
+                            int segmentSeconds, CS_Status* status);
 CS_Sink CreateCvSink(llvm::StringRef name, CS_Status* status);
 CS_Sink CreateCvSinkCallback(llvm::StringRef name,
                              std::function<void(uint64_t time)> processFrame,
@@ -280,6 +308,22 @@ void ReleaseSink(CS_Sink sink, CS_Status* status);
 std::string GetMjpegServerListenAddress(CS_Sink sink, CS_Status* status);
 int GetMjpegServerPort(CS_Sink sink, CS_Status* status);
 
+//
+// Shared Memory Sink Functions
+//
+std::string GetShmSinkName(CS_Sink sink, CS_Status* status);
+
+//
+// RTP Sink Functions
+//
+std::string GetRtpSinkAddress(CS_Sink sink, CS_Status* status);
+int GetRtpSinkPort(CS_Sink sink, CS_Status* status);
+
+//
+// Recording Sink Functions
+//
+std::string GetRecordingSinkDirectory(CS_Sink sink, CS_Status* status);
+
 //
 // OpenCV Sink Functions
 //
@@ -89,7 +89,10 @@ class VideoSource {
     kUnknown = CS_SOURCE_UNKNOWN,
     kUsb = CS_SOURCE_USB,
     kHttp = CS_SOURCE_HTTP,
-    kCv = CS_SOURCE_CV
+    kCv = CS_SOURCE_CV,
+    kShm = CS_SOURCE_SHM,
+    kFile = CS_SOURCE_FILE,
+    kTestPattern = CS_SOURCE_TEST_PATTERN
   };
 
   VideoSource() noexcept : m_handle(0) {}
@@ -422,6 +425,75 @@ class CvSource : public VideoSource {
                               std::initializer_list<T> choices);
 };
 
+/// A source that receives frames from another process on the same machine
+/// through a shared memory ring buffer (as written by a ShmSink).  Frames are
+/// used in place, without copying.
+class ShmSource : public VideoSource {
+ public:
+  ShmSource() = default;
+
+  /// Create a shared memory source.  Not supported on Windows.
+  /// The source connects once the producer has created the segment, and
+  /// reconnects if the producer restarts.
+  /// @param name Source name (arbitrary unique identifier)
+  /// @param shmName Shared memory segment name (as given to the producer)
+  ShmSource(llvm::StringRef name, llvm::StringRef shmName);
+
+  /// Get the shared memory segment name.
+  std::string GetShmName() const;
+};
+
+/// A source that plays back a recording made by a RecordingSink, looping at
+/// the end.  Frames are used in place from the memory-mapped file, without
+/// copying, which makes it suitable for repeatable load tests.
+class FileSource : public VideoSource {
+ public:
+  enum PlaybackMode {
+    kRealtime = CS_FILE_PLAYBACK_REALTIME,
+    kFixedRate = CS_FILE_PLAYBACK_FIXED_RATE,
+    kFast = CS_FILE_PLAYBACK_FAST
+  };
+
+  FileSource() = default;
+
+  /// Create a file source.  Not supported on Windows.
+  /// @param name Source name (arbitrary unique identifier)
+  /// @param path Path to a recording segment (.csrec file)
+  /// @param mode Playback timing: as recorded, at fps, or as fast as
+  ///             possible
+  /// @param fps Frame rate (kFixedRate only)
+  FileSource(llvm::StringRef name, llvm::StringRef path,
+             PlaybackMode mode = kRealtime, int fps = 0);
+
+  /// Get the path of the file being played.
+  std::string GetPath() const;
+};
+
+/// A source that generates a moving test pattern, for testing without a
+/// camera.  The top left of each frame is stamped with the frame count and
+/// time (see TestPattern.h); MJPEG frames repeat every 64 frames and aren't
+/// time stamped.
+class TestPatternSource : public VideoSource {
+ public:
+  TestPatternSource() = default;
+
+  /// Create a test pattern source.  Any resolution (with an even width),
+  /// pixel format and frame rate can be used, and changed later with
+  /// SetVideoMode().
+  /// @param name Source name (arbitrary unique identifier)
+  /// @param mode Video mode being generated
+  TestPatternSource(llvm::StringRef name, const VideoMode& mode);
+
+  /// Create a test pattern source.
+  /// @param name Source name (arbitrary unique identifier)
+  /// @param pixelFormat Pixel format
+  /// @param width width
+  /// @param height height
+  /// @param fps fps
+  TestPatternSource(llvm::StringRef name, VideoMode::PixelFormat pixelFormat,
+                    int width, int height, int fps);
+};
+
 /// A sink for video that accepts a sequence of frames.
 class VideoSink {
   friend class VideoEvent;
@@ -431,7 +503,10 @@ class VideoSink {
   enum Kind {
     kUnknown = CS_SINK_UNKNOWN,
     kMjpeg = CS_SINK_MJPEG,
-    kCv = CS_SINK_CV
+    kCv = CS_SINK_CV,
+    kShm = CS_SINK_SHM,
+    kRtp = CS_SINK_RTP,
+    kRecording = CS_SINK_RECORDING
   };
 
   VideoSink() noexcept : m_handle(0) {}
@@ -511,6 +586,25 @@ class MjpegServer : public VideoSink {
   /// @param port TCP port number
   MjpegServer(llvm::StringRef name, int port) : MjpegServer(name, "", port) {}
 
+  /// Create a MJPEG-over-HTTP server sink that serves every source by name
+  /// (/stream/<name>.mjpg, /snapshot/<name>.jpg, /settings/<name>.json) in
+  /// addition to the source connected with SetSource().
+  /// @param name Sink name (arbitrary unique identifier)
+  /// @param listenAddress TCP listen address (empty string for all addresses)
+  /// @param port TCP port number
+  static MjpegServer CreateRouted(llvm::StringRef name,
+                                  llvm::StringRef listenAddress, int port);
+
+  /// Create a MJPEG-over-HTTP server sink that listens on a Unix domain
+  /// socket rather than TCP, for clients on the same machine.  Not supported
+  /// on Windows.
+  /// @param name Sink name (arbitrary unique identifier)
+  /// @param path Socket path; if it starts with '@', the socket is in the
+  ///             (Linux-only) abstract namespace rather than the filesystem
+  /// @param routed Serve every source by name (see CreateRouted())
+  static MjpegServer CreateUnix(llvm::StringRef name, llvm::StringRef path,
+                                bool routed = false);
+
   /// Get the listen address of the server.
   std::string GetListenAddress() const;
 
@@ -518,6 +612,68 @@ class MjpegServer : public VideoSink {
   int GetPort() const;
 };
 
+/// A sink that publishes frames to other processes on the same machine
+/// through a shared memory ring buffer.  Readers can use the frames in place,
+/// without copying; see cscore_shm_reader.h.
+class ShmSink : public VideoSink {
+ public:
+  ShmSink() = default;
+
+  /// Create a shared memory sink.  Not supported on Windows.
+  /// @param name Sink name (arbitrary unique identifier)
+  /// @param shmName Shared memory segment name (as used by readers)
+  /// @param mode Pixel format and resolution frames are converted to (fps is
+  ///             ignored); compressed formats are not supported
+  /// @param numSlots Number of frames in the ring
+  ShmSink(llvm::StringRef name, llvm::StringRef shmName,
+          const VideoMode& mode, int numSlots = 4);
+
+  /// Get the shared memory segment name.
+  std::string GetShmName() const;
+};
+
+/// A sink that sends frames as RTP/JPEG (RFC 2435) over UDP.  Unlike an
+/// MjpegServer, a lost packet only loses the frame it belongs to.
+class RtpSink : public VideoSink {
+ public:
+  RtpSink() = default;
+
+  /// Create an RTP sink.  Not supported on Windows.
+  /// Multicast packets are limited to the local network, and are also
+  /// delivered to receivers on the same host.  RTCP sender reports are sent
+  /// to port + 1.
+  /// @param name Sink name (arbitrary unique identifier)
+  /// @param address Destination unicast or multicast IPv4 address/host name
+  /// @param port Destination port
+  RtpSink(llvm::StringRef name, llvm::StringRef address, int port);
+
+  /// Get the destination address.
+  std::string GetAddress() const;
+
+  /// Get the destination port.
+  int GetPort() const;
+};
+
+/// A sink that records frames as JPEG to files on disk.  A new file
+/// (segment) is started every segmentSeconds; see cscore_recording.h for
+/// the file format.  Frames are dropped rather than delayed if the disk
+/// can't keep up.
+class RecordingSink : public VideoSink {
+ public:
+  RecordingSink() = default;
+
+  /// Create a recording sink.  Not supported on Windows.
+  /// Files are named "<name>-<date>-<time>-<segment>.csrec".
+  /// @param name Sink name (arbitrary unique identifier)
+  /// @param directory Directory to write files to (must exist)
+  /// @param segmentSeconds Length of each segment in seconds
+  RecordingSink(llvm::StringRef name, llvm::StringRef directory,
+                int segmentSeconds = 60);
+
+  /// Get the directory files are written to.
+  std::string GetDirectory() const;
+};
+
 /// A sink for user code to accept video frames as OpenCV images.
 class CvSink : public VideoSink {
  public:
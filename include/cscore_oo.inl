@@ -385,6 +385,38 @@ inline void CvSource::SetEnumPropertyChoices(const VideoProperty& property,
   SetSourceEnumPropertyChoices(m_handle, property.m_handle, vec, &m_status);
 }
 
+inline ShmSource::ShmSource(llvm::StringRef name, llvm::StringRef shmName) {
+  m_handle = CreateShmSource(name, shmName, &m_status);
+}
+
+inline std::string ShmSource::GetShmName() const {
+  m_status = 0;
+  return GetShmSourceName(m_handle, &m_status);
+}
+
+inline FileSource::FileSource(llvm::StringRef name, llvm::StringRef path,
+                              PlaybackMode mode, int fps) {
+  m_handle = CreateFileSource(
+      name, path, static_cast<CS_FilePlaybackMode>(mode), fps, &m_status);
+}
+
+inline std::string FileSource::GetPath() const {
+  m_status = 0;
+  return GetFileSourcePath(m_handle, &m_status);
+}
+
+inline TestPatternSource::TestPatternSource(llvm::StringRef name,
+                                            const VideoMode& mode) {
+  m_handle = CreateTestPatternSource(name, mode, &m_status);
+}
+
+inline TestPatternSource::TestPatternSource(llvm::StringRef name,
+                                            VideoMode::PixelFormat format,
+                                            int width, int height, int fps) {
+  m_handle = CreateTestPatternSource(
+      name, VideoMode{format, width, height, fps}, &m_status);
+}
+
 inline VideoSink::VideoSink(const VideoSink& sink)
     : m_handle(sink.m_handle == 0 ? 0 : CopySink(sink.m_handle, &m_status)) {}
 
@@ -441,6 +473,23 @@ inline MjpegServer::MjpegServer(llvm::StringRef name,
   m_handle = CreateMjpegServer(name, listenAddress, port, &m_status);
 }
 
+inline MjpegServer MjpegServer::CreateRouted(llvm::StringRef name,
+                                             llvm::StringRef listenAddress,
+                                             int port) {
+  MjpegServer server;
+  server.m_handle =
+      CreateMjpegServerRouted(name, listenAddress, port, &server.m_status);
+  return server;
+}
+
+inline MjpegServer MjpegServer::CreateUnix(llvm::StringRef name,
+                                           llvm::StringRef path, bool routed) {
+  MjpegServer server;
+  server.m_handle =
+      CreateMjpegServerUnix(name, path, routed, &server.m_status);
+  return server;
+}
+
 inline std::string MjpegServer::GetListenAddress() const {
   m_status = 0;
   return cs::GetMjpegServerListenAddress(m_handle, &m_status);
@@ -451,6 +500,42 @@ inline int MjpegServer::GetPort() const {
   return cs::GetMjpegServerPort(m_handle, &m_status);
 }
 
+inline ShmSink::ShmSink(llvm::StringRef name, llvm::StringRef shmName,
+                        const VideoMode& mode, int numSlots) {
+  m_handle = CreateShmSink(name, shmName, mode, numSlots, &m_status);
+}
+
+inline std::string ShmSink::GetShmName() const {
+  m_status = 0;
+  return GetShmSinkName(m_handle, &m_status);
+}
+
+inline RtpSink::RtpSink(llvm::StringRef name, llvm::StringRef address,
+                        int port) {
+  m_handle = CreateRtpSink(name, address, port, &m_status);
+}
+
+inline std::string RtpSink::GetAddress() const {
+  m_status = 0;
+  return GetRtpSinkAddress(m_handle, &m_status);
+}
+
+inline int RtpSink::GetPort() const {
+  m_status = 0;
+  return GetRtpSinkPort(m_handle, &m_status);
+}
+
+inline RecordingSink::RecordingSink(llvm::StringRef name,
+                                    llvm::StringRef directory,
+                                    int segmentSeconds) {
+  m_handle = CreateRecordingSink(name, directory, segmentSeconds, &m_status);
+}
+
+inline std::string RecordingSink::GetDirectory() const {
+  m_status = 0;
+  return GetRecordingSinkDirectory(m_handle, &m_status);
+}
+
 inline CvSink::CvSink(llvm::StringRef name) {
   m_handle = CreateCvSink(name, &m_status);
 }
@@ -0,0 +1,101 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CSCORE_RAW_H_
+#define CSCORE_RAW_H_
+
+#include <stdint.h>
+
+/*
+ * Formats used to pass uncompressed frames to local consumers.  This header
+ * only depends on the C standard library so it can be used by consumers that
+ * don't link cscore.
+ */
+
+/*
+ * Wire format of the MJPEG server's raw stream
+ * (/raw.stream?format=gray|bgr|yuyv).
+ *
+ * The HTTP response body is a sequence of frames, each consisting of a
+ * CS_RawFrameHeader followed by dataSize bytes of pixel data (height rows of
+ * stride bytes each).  All fields are in the byte order of the server; as
+ * the raw stream is intended for local consumers, this is also the byte
+ * order of the client.
+ */
+
+#define CS_RAW_FRAME_MAGIC 0x57415243u /* "CRAW" in little-endian */
+
+typedef struct CS_RawFrameHeader {
+  uint32_t magic;       /* CS_RAW_FRAME_MAGIC */
+  uint32_t headerSize;  /* size of this header; pixel data starts after */
+  uint64_t time;        /* frame time, as returned by CS_GrabSinkFrame() */
+  uint32_t pixelFormat; /* enum CS_PixelFormat */
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;      /* bytes per row */
+  uint32_t dataSize;    /* bytes of pixel data */
+  uint32_t reserved;
+} CS_RawFrameHeader;
+
+/*
+ * Layout of the shared memory ring written by a shared memory sink
+ * (CS_CreateShmSink).  See cscore_shm_reader.h for a reader implementation.
+ *
+ * The segment starts with a CS_ShmHeader, followed by numSlots slots of
+ * slotSize bytes each, starting at slotOffset.  Each slot is a
+ * CS_ShmSlotHeader followed (at dataOffset from the slot start) by the
+ * pixel data.  All offsets are multiples of 64 bytes.
+ *
+ * Synchronization (all accesses atomic, sequentially consistent unless
+ * noted):
+ * - Each slot's lock is a sequence lock: odd while the writer is updating the
+ *   slot, even otherwise.
+ * - A reader pins a slot by incrementing pins and then checking that lock is
+ *   even.  The writer makes lock odd and then checks pins; if the slot is
+ *   pinned, it restores lock and uses another slot.  A pinned slot is thus
+ *   never modified, so readers can use the pixel data in place.
+ * - latest holds (seq << 16) | slot for the most recently written frame;
+ *   seq starts at 1 and increases by one for each frame.
+ * - After each frame the writer increments futex and, on Linux, wakes any
+ *   waiters (readers increment waiters around FUTEX_WAIT on futex).
+ * - closed is set to 1 when the writer goes away; readers should close and
+ *   later reopen the segment.
+ */
+
+#define CS_SHM_MAGIC 0x4d485343u /* "CSHM" in little-endian */
+#define CS_SHM_VERSION 1
+#define CS_SHM_MAX_SLOTS 256
+
+typedef struct CS_ShmHeader {
+  uint32_t magic;      /* CS_SHM_MAGIC */
+  uint32_t version;    /* CS_SHM_VERSION */
+  uint32_t numSlots;
+  uint32_t dataOffset; /* offset of pixel data from the start of a slot */
+  uint64_t slotSize;   /* bytes per slot, including the slot header */
+  uint64_t slotOffset; /* offset of the first slot from the segment start */
+  uint64_t latest;     /* (seq << 16) | slot of the newest frame; 0 if none */
+  uint32_t futex;      /* incremented after each frame */
+  uint32_t waiters;    /* number of readers waiting on futex */
+  uint32_t closed;     /* nonzero once the writer has gone away */
+  uint32_t writerPid;
+  uint32_t reserved[2];
+} CS_ShmHeader;
+
+typedef struct CS_ShmSlotHeader {
+  uint32_t lock;        /* sequence lock; odd while being written */
+  uint32_t pins;        /* number of readers using the slot */
+  uint64_t seq;         /* frame sequence number */
+  uint64_t time;        /* frame time, as returned by CS_GrabSinkFrame() */
+  uint32_t pixelFormat; /* enum CS_PixelFormat */
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;      /* bytes per row */
+  uint32_t dataSize;    /* bytes of pixel data */
+  uint32_t reserved[5];
+} CS_ShmSlotHeader;
+
+#endif /* CSCORE_RAW_H_ */
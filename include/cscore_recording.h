@@ -0,0 +1,65 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CSCORE_RECORDING_H_
+#define CSCORE_RECORDING_H_
+
+#include <stdint.h>
+
+/*
+ * File format written by a recording sink (CS_CreateRecordingSink).  This
+ * header only depends on the C standard library so it can be used by
+ * players that don't link cscore.
+ *
+ * A recording is a series of segment files, each holding:
+ * - a CS_RecFileHeader
+ * - frames, each a CS_RecFrameHeader followed by size bytes of JPEG data
+ * - an index of CS_RecIndexEntry, one per frame, in frame order
+ * - a CS_RecFooter, which is the last thing in the file
+ *
+ * All fields are in the byte order of the writer.  If the writer stopped
+ * before finishing a segment (e.g. a crash), the index and footer are
+ * missing; the frames can still be found by walking the frame headers from
+ * the start of the file until a header doesn't have the frame magic (the
+ * rest of the file may be zero-filled preallocated space).
+ */
+
+#define CS_REC_FILE_MAGIC 0x43455243u  /* "CREC" in little-endian */
+#define CS_REC_FRAME_MAGIC 0x4d415246u /* "FRAM" in little-endian */
+#define CS_REC_INDEX_MAGIC 0x58444e49u /* "INDX" in little-endian */
+#define CS_REC_VERSION 1
+
+typedef struct CS_RecFileHeader {
+  uint32_t magic;          /* CS_REC_FILE_MAGIC */
+  uint32_t version;        /* CS_REC_VERSION */
+  uint64_t startTime;      /* wall clock time, microseconds since 1970 */
+  uint64_t startFrameTime; /* frame time corresponding to startTime */
+  uint32_t segment;        /* segment number within the recording */
+  uint32_t reserved;
+} CS_RecFileHeader;
+
+typedef struct CS_RecFrameHeader {
+  uint32_t magic; /* CS_REC_FRAME_MAGIC */
+  uint32_t size;  /* bytes of JPEG data following this header */
+  uint64_t time;  /* frame time, as returned by CS_GrabSinkFrame() */
+  uint16_t width;
+  uint16_t height;
+  uint32_t reserved;
+} CS_RecFrameHeader;
+
+typedef struct CS_RecIndexEntry {
+  uint64_t time;   /* frame time */
+  uint64_t offset; /* file offset of the CS_RecFrameHeader */
+} CS_RecIndexEntry;
+
+typedef struct CS_RecFooter {
+  uint32_t magic;       /* CS_REC_INDEX_MAGIC */
+  uint32_t count;       /* number of index entries */
+  uint64_t indexOffset; /* file offset of the first index entry */
+} CS_RecFooter;
+
+#endif /* CSCORE_RECORDING_H_ */
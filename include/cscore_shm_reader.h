@@ -0,0 +1,213 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CSCORE_SHM_READER_H_
+#define CSCORE_SHM_READER_H_
+
+/*
+ * Header-only reader for the shared memory ring written by a shared memory
+ * sink (CS_CreateShmSink).  It does not depend on the rest of cscore, so it
+ * can be copied into other programs.  POSIX only (Linux for futex wakeups;
+ * elsewhere waiting readers poll).  Requires GCC or Clang atomic builtins.
+ * In strict ISO C modes (e.g. -std=c99), define _DEFAULT_SOURCE before
+ * including any system header.
+ *
+ * Typical use:
+ *
+ *   CS_ShmReader reader;
+ *   CS_ShmFrame frame;
+ *   uint64_t last = 0;
+ *   if (CS_ShmReaderOpen(&reader, "camera") != 0) ...;
+ *   while (CS_ShmReaderAcquire(&reader, last, 1000, &frame) == 0) {
+ *     ... use frame.data, frame.header->width etc in place ...
+ *     last = frame.seq;
+ *     CS_ShmReaderRelease(&reader, &frame);
+ *   }
+ *   CS_ShmReaderClose(&reader);
+ *
+ * While a frame is acquired its slot is not reused by the writer, so frames
+ * should be released promptly; holding more frames than the ring has slots
+ * (less one) makes the writer drop frames.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cscore_raw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CS_ShmReader {
+  CS_ShmHeader* header;
+  size_t size;
+} CS_ShmReader;
+
+typedef struct CS_ShmFrame {
+  const CS_ShmSlotHeader* header; /* format, size, time */
+  const void* data;               /* pixel data */
+  uint64_t seq;                   /* frame sequence number */
+  uint32_t slot;
+} CS_ShmFrame;
+
+#define CS_SHM_LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define CS_SHM_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define CS_SHM_SUB(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+
+static inline CS_ShmSlotHeader* CS_ShmReaderSlot(const CS_ShmReader* reader,
+                                                 uint32_t slot) {
+  return (CS_ShmSlotHeader*)((char*)reader->header +
+                             reader->header->slotOffset +
+                             reader->header->slotSize * slot);
+}
+
+/*
+ * Map the segment created by a shared memory sink.
+ * @param name Segment name, as given to CS_CreateShmSink()
+ * @return 0 on success, otherwise a negative errno value
+ */
+static inline int CS_ShmReaderOpen(CS_ShmReader* reader, const char* name) {
+  char path[256];
+  struct stat st;
+  void* addr;
+  int fd;
+
+  reader->header = NULL;
+  reader->size = 0;
+  if (strlen(name) + 2 > sizeof(path)) return -ENAMETOOLONG;
+  path[0] = '/';
+  strcpy(path + 1, name);
+
+  fd = shm_open(path, O_RDWR, 0);
+  if (fd < 0) return -errno;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CS_ShmHeader)) {
+    close(fd);
+    return -EINVAL;
+  }
+  addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return -errno;
+
+  reader->header = (CS_ShmHeader*)addr;
+  reader->size = st.st_size;
+  if (reader->header->magic != CS_SHM_MAGIC ||
+      reader->header->version != CS_SHM_VERSION ||
+      reader->header->slotOffset +
+              reader->header->slotSize * reader->header->numSlots >
+          reader->size) {
+    munmap(addr, reader->size);
+    reader->header = NULL;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static inline void CS_ShmReaderClose(CS_ShmReader* reader) {
+  if (reader->header) munmap(reader->header, reader->size);
+  reader->header = NULL;
+  reader->size = 0;
+}
+
+/* Wait until futex no longer has the given value, or timeout. */
+static inline void CS_ShmReaderWait(CS_ShmReader* reader, uint32_t value,
+                                    int timeoutMs) {
+  struct timespec ts;
+#ifdef __linux__
+  ts.tv_sec = timeoutMs / 1000;
+  ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+  CS_SHM_ADD(&reader->header->waiters, 1);
+  syscall(SYS_futex, &reader->header->futex, FUTEX_WAIT, value,
+          timeoutMs < 0 ? NULL : &ts, NULL, 0);
+  CS_SHM_SUB(&reader->header->waiters, 1);
+#else
+  (void)value;
+  ts.tv_sec = 0;
+  ts.tv_nsec = (timeoutMs >= 0 && timeoutMs < 1) ? 0 : 1000000L;
+  nanosleep(&ts, NULL);
+#endif
+}
+
+/*
+ * Acquire the newest frame, if it is newer than lastSeq.  The frame is
+ * pinned in place until released with CS_ShmReaderRelease().
+ * @param lastSeq Sequence number of the last frame processed (0 for any)
+ * @param timeoutMs Time to wait for a new frame; 0 to not wait, -1 forever
+ * @return 0 on success, -EAGAIN if no new frame is available without
+ *         waiting, -ETIMEDOUT on timeout, or -EPIPE if the writer has gone
+ *         away (close and reopen the segment)
+ */
+static inline int CS_ShmReaderAcquire(CS_ShmReader* reader, uint64_t lastSeq,
+                                      int timeoutMs, CS_ShmFrame* frame) {
+  CS_ShmHeader* header = reader->header;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (;;) {
+    uint32_t futex = CS_SHM_LOAD(&header->futex);
+    uint64_t latest = CS_SHM_LOAD(&header->latest);
+    uint64_t seq = latest >> 16;
+    uint32_t slot = (uint32_t)(latest & 0xffff);
+    int elapsed;
+
+    if (seq > lastSeq && slot < header->numSlots) {
+      CS_ShmSlotHeader* slotHeader = CS_ShmReaderSlot(reader, slot);
+      CS_SHM_ADD(&slotHeader->pins, 1);
+      /* The writer may have reused the slot for a newer frame since latest
+       * was read, which is fine as long as it isn't being written now. */
+      if ((CS_SHM_LOAD(&slotHeader->lock) & 1) == 0 &&
+          slotHeader->seq > lastSeq) {
+        frame->header = slotHeader;
+        frame->data = (const char*)slotHeader + header->dataOffset;
+        frame->seq = slotHeader->seq;
+        frame->slot = slot;
+        return 0;
+      }
+      CS_SHM_SUB(&slotHeader->pins, 1);
+    }
+
+    if (CS_SHM_LOAD(&header->closed)) return -EPIPE;
+    if (timeoutMs == 0) return -EAGAIN;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (int)((now.tv_sec - start.tv_sec) * 1000 +
+                    (now.tv_nsec - start.tv_nsec) / 1000000L);
+    if (timeoutMs > 0 && elapsed >= timeoutMs) return -ETIMEDOUT;
+    CS_ShmReaderWait(reader, futex, timeoutMs < 0 ? -1 : timeoutMs - elapsed);
+  }
+}
+
+/* Release a frame acquired with CS_ShmReaderAcquire(). */
+static inline void CS_ShmReaderRelease(CS_ShmReader* reader,
+                                       CS_ShmFrame* frame) {
+  (void)reader;
+  CS_SHM_SUB(&((CS_ShmSlotHeader*)frame->header)->pins, 1);
+  frame->header = NULL;
+  frame->data = NULL;
+}
+
+#undef CS_SHM_LOAD
+#undef CS_SHM_ADD
+#undef CS_SHM_SUB
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* CSCORE_SHM_READER_H_ */
@@ -0,0 +1,70 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CSCORE_STAMP_H_
+#define CSCORE_STAMP_H_
+
+/*
+ * Layout of the stamp a test pattern source (CS_CreateTestPatternSource)
+ * draws on each frame, and a header-only decoder for it.  It does not depend
+ * on the rest of cscore, so clients measuring latency can read the stamp
+ * from the images they receive.
+ *
+ * The stamp is two rows of CS_STAMP_BITS square blocks at the top left,
+ * most significant bit first, white for 1: the frame count, then the low 32
+ * bits of the frame time in microseconds.  Blocks are 8 pixels (less for
+ * images narrower than 256 pixels), aligned to JPEG blocks so the stamp
+ * survives compression.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CS_STAMP_BITS 32
+
+/* Size (in pixels) of the stamp blocks, or 0 if the image is too small. */
+static inline int CS_GetStampBlockSize(int width, int height) {
+  int size = (width / CS_STAMP_BITS) & ~1;
+  if (size > 8) size = 8;
+  if (size < 2 || height < 2 * size) return 0;
+  return size;
+}
+
+/*
+ * Read the stamp from a BGR image with rows stride bytes apart.
+ * Returns 0 on success, or -1 if the image is too small to hold a stamp.
+ */
+static inline int CS_ReadStamp(const unsigned char* bgr, int width,
+                               int height, size_t stride, uint32_t* count,
+                               uint32_t* time) {
+  int blockSize = CS_GetStampBlockSize(width, height);
+  uint32_t values[2] = {0, 0};
+  int row, bit;
+  if (blockSize == 0) return -1;
+  for (row = 0; row < 2; ++row) {
+    /* sample the middle of each block */
+    int y = row * blockSize + blockSize / 2;
+    for (bit = 0; bit < CS_STAMP_BITS; ++bit) {
+      int x = bit * blockSize + blockSize / 2;
+      const unsigned char* p = bgr + y * stride + x * 3;
+      values[row] = (values[row] << 1) | ((p[0] + p[1] + p[2]) > 384 ? 1 : 0);
+    }
+  }
+  *count = values[0];
+  *time = values[1];
+  return 0;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* CSCORE_STAMP_H_ */
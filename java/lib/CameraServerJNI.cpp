@@ -513,6 +513,77 @@ JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createCvSource
   return val;
 }
 
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createShmSource
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createShmSource
+  (JNIEnv *env, jclass, jstring name, jstring shmName)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!shmName) {
+    nullPointerEx.Throw(env, "shmName cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateShmSource(JStringRef{env, name},
+                                 JStringRef{env, shmName}, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createFileSource
+ * Signature: (Ljava/lang/String;Ljava/lang/String;II)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createFileSource
+  (JNIEnv *env, jclass, jstring name, jstring path, jint mode, jint fps)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!path) {
+    nullPointerEx.Throw(env, "path cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateFileSource(JStringRef{env, name}, JStringRef{env, path},
+                                  static_cast<CS_FilePlaybackMode>(mode), fps,
+                                  &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createTestPatternSource
+ * Signature: (Ljava/lang/String;IIII)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createTestPatternSource
+  (JNIEnv *env, jclass, jstring name, jint pixelFormat, jint width, jint height,
+   jint fps)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateTestPatternSource(
+      JStringRef{env, name},
+      cs::VideoMode{static_cast<cs::VideoMode::PixelFormat>(pixelFormat),
+                    static_cast<int>(width), static_cast<int>(height),
+                    static_cast<int>(fps)},
+      &status);
+  CheckStatus(env, status);
+  return val;
+}
+
 /*
  * Class:     edu_wpi_cscore_CameraServerJNI
  * Method:    getSourceKind
@@ -938,6 +1009,34 @@ JNIEXPORT jobjectArray JNICALL Java_edu_wpi_cscore_CameraServerJNI_getHttpCamera
   return MakeJStringArray(env, arr);
 }
 
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getShmSourceName
+ * Signature: (I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_edu_wpi_cscore_CameraServerJNI_getShmSourceName
+  (JNIEnv *env, jclass, jint source)
+{
+  CS_Status status = 0;
+  auto str = cs::GetShmSourceName(source, &status);
+  if (!CheckStatus(env, status)) return nullptr;
+  return MakeJString(env, str);
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getFileSourcePath
+ * Signature: (I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_edu_wpi_cscore_CameraServerJNI_getFileSourcePath
+  (JNIEnv *env, jclass, jint source)
+{
+  CS_Status status = 0;
+  auto str = cs::GetFileSourcePath(source, &status);
+  if (!CheckStatus(env, status)) return nullptr;
+  return MakeJString(env, str);
+}
+
 /*
  * Class:     edu_wpi_cscore_CameraServerJNI
  * Method:    putSourceFrame
@@ -1067,6 +1166,127 @@ JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createMjpegServer
   return val;
 }
 
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createMjpegServerRouted
+ * Signature: (Ljava/lang/String;Ljava/lang/String;I)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createMjpegServerRouted
+  (JNIEnv *env, jclass, jstring name, jstring listenAddress, jint port)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!listenAddress) {
+    nullPointerEx.Throw(env, "listenAddress cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateMjpegServerRouted(
+      JStringRef{env, name}, JStringRef{env, listenAddress}, port, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createMjpegServerUnix
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Z)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createMjpegServerUnix
+  (JNIEnv *env, jclass, jstring name, jstring path, jboolean routed)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!path) {
+    nullPointerEx.Throw(env, "path cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateMjpegServerUnix(
+      JStringRef{env, name}, JStringRef{env, path}, routed, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createShmSink
+ * Signature: (Ljava/lang/String;Ljava/lang/String;IIIII)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createShmSink
+  (JNIEnv *env, jclass, jstring name, jstring shmName, jint pixelFormat,
+   jint width, jint height, jint fps, jint numSlots)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!shmName) {
+    nullPointerEx.Throw(env, "shmName cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateShmSink(
+      JStringRef{env, name}, JStringRef{env, shmName},
+      cs::VideoMode{static_cast<cs::VideoMode::PixelFormat>(pixelFormat),
+                    static_cast<int>(width), static_cast<int>(height),
+                    static_cast<int>(fps)},
+      numSlots, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createRtpSink
+ * Signature: (Ljava/lang/String;Ljava/lang/String;I)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createRtpSink
+  (JNIEnv *env, jclass, jstring name, jstring address, jint port)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!address) {
+    nullPointerEx.Throw(env, "address cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateRtpSink(JStringRef{env, name}, JStringRef{env, address},
+                               port, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    createRecordingSink
+ * Signature: (Ljava/lang/String;Ljava/lang/String;I)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_createRecordingSink
+  (JNIEnv *env, jclass, jstring name, jstring directory, jint segmentSeconds)
+{
+  if (!name) {
+    nullPointerEx.Throw(env, "name cannot be null");
+    return 0;
+  }
+  if (!directory) {
+    nullPointerEx.Throw(env, "directory cannot be null");
+    return 0;
+  }
+  CS_Status status = 0;
+  auto val = cs::CreateRecordingSink(JStringRef{env, name},
+                                     JStringRef{env, directory},
+                                     segmentSeconds, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
 /*
  * Class:     edu_wpi_cscore_CameraServerJNI
  * Method:    createCvSink
@@ -1229,6 +1449,62 @@ JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_getMjpegServerPort
   return val;
 }
 
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getShmSinkName
+ * Signature: (I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_edu_wpi_cscore_CameraServerJNI_getShmSinkName
+  (JNIEnv *env, jclass, jint sink)
+{
+  CS_Status status = 0;
+  auto str = cs::GetShmSinkName(sink, &status);
+  if (!CheckStatus(env, status)) return nullptr;
+  return MakeJString(env, str);
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getRtpSinkAddress
+ * Signature: (I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_edu_wpi_cscore_CameraServerJNI_getRtpSinkAddress
+  (JNIEnv *env, jclass, jint sink)
+{
+  CS_Status status = 0;
+  auto str = cs::GetRtpSinkAddress(sink, &status);
+  if (!CheckStatus(env, status)) return nullptr;
+  return MakeJString(env, str);
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getRtpSinkPort
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_edu_wpi_cscore_CameraServerJNI_getRtpSinkPort
+  (JNIEnv *env, jclass, jint sink)
+{
+  CS_Status status = 0;
+  auto val = cs::GetRtpSinkPort(sink, &status);
+  CheckStatus(env, status);
+  return val;
+}
+
+/*
+ * Class:     edu_wpi_cscore_CameraServerJNI
+ * Method:    getRecordingSinkDirectory
+ * Signature: (I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_edu_wpi_cscore_CameraServerJNI_getRecordingSinkDirectory
+  (JNIEnv *env, jclass, jint sink)
+{
+  CS_Status status = 0;
+  auto str = cs::GetRecordingSinkDirectory(sink, &status);
+  if (!CheckStatus(env, status)) return nullptr;
+  return MakeJString(env, str);
+}
+
 /*
  * Class:     edu_wpi_cscore_CameraServerJNI
  * Method:    setSinkDescription
@@ -107,6 +107,9 @@ public class CameraServerJNI {
   public static native int createHttpCamera(String name, String url, int kind);
   public static native int createHttpCameraMulti(String name, String[] urls, int kind);
   public static native int createCvSource(String name, int pixelFormat, int width, int height, int fps);
+  public static native int createShmSource(String name, String shmName);
+  public static native int createFileSource(String name, String path, int mode, int fps);
+  public static native int createTestPatternSource(String name, int pixelFormat, int width, int height, int fps);
 
   //
   // Source Functions
@@ -152,6 +155,16 @@ public class CameraServerJNI {
   public static native void setHttpCameraUrls(int source, String[] urls);
   public static native String[] getHttpCameraUrls(int source);
 
+  //
+  // Shared Memory Source Functions
+  //
+  public static native String getShmSourceName(int source);
+
+  //
+  // File Source Functions
+  //
+  public static native String getFileSourcePath(int source);
+
   //
   // OpenCV Source Functions
   //
@@ -166,6 +179,11 @@ public class CameraServerJNI {
   // Sink Creation Functions
   //
   public static native int createMjpegServer(String name, String listenAddress, int port);
+  public static native int createMjpegServerRouted(String name, String listenAddress, int port);
+  public static native int createMjpegServerUnix(String name, String path, boolean routed);
+  public static native int createShmSink(String name, String shmName, int pixelFormat, int width, int height, int fps, int numSlots);
+  public static native int createRtpSink(String name, String address, int port);
+  public static native int createRecordingSink(String name, String directory, int segmentSeconds);
   public static native int createCvSink(String name);
   //public static native int createCvSinkCallback(String name,
   //                            void (*processFrame)(long time));
@@ -188,6 +206,22 @@ public class CameraServerJNI {
   public static native String getMjpegServerListenAddress(int sink);
   public static native int getMjpegServerPort(int sink);
 
+  //
+  // Shared Memory Sink Functions
+  //
+  public static native String getShmSinkName(int sink);
+
+  //
+  // RTP Sink Functions
+  //
+  public static native String getRtpSinkAddress(int sink);
+  public static native int getRtpSinkPort(int sink);
+
+  //
+  // Recording Sink Functions
+  //
+  public static native String getRecordingSinkDirectory(int sink);
+
   //
   // OpenCV Sink Functions
   //
@@ -0,0 +1,56 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A source that plays back a recording made by a RecordingSink, looping at
+ * the end.  Frames are used in place from the memory-mapped file, without
+ * copying, which makes it suitable for repeatable load tests.
+ */
+public class FileSource extends VideoSource {
+  public enum PlaybackMode {
+    kRealtime(0), kFixedRate(1), kFast(2);
+    private int value;
+
+    private PlaybackMode(int value) {
+      this.value = value;
+    }
+
+    public int getValue() {
+      return value;
+    }
+  }
+
+  /**
+   * Create a file source that plays at the recorded frame times.
+   * Not supported on Windows.
+   * @param name Source name (arbitrary unique identifier)
+   * @param path Path to a recording segment (.csrec file)
+   */
+  public FileSource(String name, String path) {
+    this(name, path, PlaybackMode.kRealtime, 0);
+  }
+
+  /**
+   * Create a file source.  Not supported on Windows.
+   * @param name Source name (arbitrary unique identifier)
+   * @param path Path to a recording segment (.csrec file)
+   * @param mode Playback timing: as recorded, at fps, or as fast as possible
+   * @param fps Frame rate (kFixedRate only)
+   */
+  public FileSource(String name, String path, PlaybackMode mode, int fps) {
+    super(CameraServerJNI.createFileSource(name, path, mode.getValue(), fps));
+  }
+
+  /**
+   * Get the path of the file being played.
+   */
+  public String getPath() {
+    return CameraServerJNI.getFileSourcePath(m_handle);
+  }
+}
@@ -30,6 +30,36 @@ public class MjpegServer extends VideoSink {
     this(name, "", port);
   }
 
+  private MjpegServer(int handle) {
+    super(handle);
+  }
+
+  /**
+   * Create a MJPEG-over-HTTP server sink that serves every source by name
+   * (/stream/&lt;name&gt;.mjpg, /snapshot/&lt;name&gt;.jpg,
+   * /settings/&lt;name&gt;.json) in addition to the source connected with
+   * setSource().
+   * @param name Sink name (arbitrary unique identifier)
+   * @param listenAddress TCP listen address (empty string for all addresses)
+   * @param port TCP port number
+   */
+  public static MjpegServer createRouted(String name, String listenAddress, int port) {
+    return new MjpegServer(CameraServerJNI.createMjpegServerRouted(name, listenAddress, port));
+  }
+
+  /**
+   * Create a MJPEG-over-HTTP server sink that listens on a Unix domain
+   * socket rather than TCP, for clients on the same machine.  Not supported
+   * on Windows.
+   * @param name Sink name (arbitrary unique identifier)
+   * @param path Socket path; if it starts with '@', the socket is in the
+   *             (Linux-only) abstract namespace rather than the filesystem
+   * @param routed Serve every source by name (see createRouted())
+   */
+  public static MjpegServer createUnix(String name, String path, boolean routed) {
+    return new MjpegServer(CameraServerJNI.createMjpegServerUnix(name, path, routed));
+  }
+
   /**
    * Get the listen address of the server.
    */
@@ -0,0 +1,43 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A sink that records frames as JPEG to files on disk.  A new file
+ * (segment) is started every segmentSeconds; see cscore_recording.h for
+ * the file format.  Frames are dropped rather than delayed if the disk
+ * can't keep up.
+ */
+public class RecordingSink extends VideoSink {
+  /**
+   * Create a recording sink.  Not supported on Windows.
+   * Files are named "&lt;name&gt;-&lt;date&gt;-&lt;time&gt;-&lt;segment&gt;.csrec".
+   * @param name Sink name (arbitrary unique identifier)
+   * @param directory Directory to write files to (must exist)
+   * @param segmentSeconds Length of each segment in seconds
+   */
+  public RecordingSink(String name, String directory, int segmentSeconds) {
+    super(CameraServerJNI.createRecordingSink(name, directory, segmentSeconds));
+  }
+
+  /**
+   * Create a recording sink with 60 second segments.
+   * @param name Sink name (arbitrary unique identifier)
+   * @param directory Directory to write files to (must exist)
+   */
+  public RecordingSink(String name, String directory) {
+    this(name, directory, 60);
+  }
+
+  /**
+   * Get the directory files are written to.
+   */
+  public String getDirectory() {
+    return CameraServerJNI.getRecordingSinkDirectory(m_handle);
+  }
+}
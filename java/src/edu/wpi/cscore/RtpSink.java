@@ -0,0 +1,41 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A sink that sends frames as RTP/JPEG (RFC 2435) over UDP.  Unlike an
+ * MjpegServer, a lost packet only loses the frame it belongs to.
+ */
+public class RtpSink extends VideoSink {
+  /**
+   * Create an RTP sink.  Not supported on Windows.
+   * Multicast packets are limited to the local network, and are also
+   * delivered to receivers on the same host.  RTCP sender reports are sent
+   * to port + 1.
+   * @param name Sink name (arbitrary unique identifier)
+   * @param address Destination unicast or multicast IPv4 address/host name
+   * @param port Destination port
+   */
+  public RtpSink(String name, String address, int port) {
+    super(CameraServerJNI.createRtpSink(name, address, port));
+  }
+
+  /**
+   * Get the destination address.
+   */
+  public String getAddress() {
+    return CameraServerJNI.getRtpSinkAddress(m_handle);
+  }
+
+  /**
+   * Get the destination port.
+   */
+  public int getPort() {
+    return CameraServerJNI.getRtpSinkPort(m_handle);
+  }
+}
@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A sink that publishes frames to other processes on the same machine
+ * through a shared memory ring buffer.  Readers can use the frames in place,
+ * without copying; see cscore_shm_reader.h.
+ */
+public class ShmSink extends VideoSink {
+  /**
+   * Create a shared memory sink.  Not supported on Windows.
+   * @param name Sink name (arbitrary unique identifier)
+   * @param shmName Shared memory segment name (as used by readers)
+   * @param mode Pixel format and resolution frames are converted to (fps is
+   *             ignored); compressed formats are not supported
+   * @param numSlots Number of frames in the ring
+   */
+  public ShmSink(String name, String shmName, VideoMode mode, int numSlots) {
+    super(CameraServerJNI.createShmSink(name, shmName, mode.pixelFormat.getValue(), mode.width, mode.height, mode.fps, numSlots));
+  }
+
+  /**
+   * Create a shared memory sink with 4 slots.  Not supported on Windows.
+   * @param name Sink name (arbitrary unique identifier)
+   * @param shmName Shared memory segment name (as used by readers)
+   * @param mode Pixel format and resolution frames are converted to (fps is
+   *             ignored); compressed formats are not supported
+   */
+  public ShmSink(String name, String shmName, VideoMode mode) {
+    this(name, shmName, mode, 4);
+  }
+
+  /**
+   * Get the shared memory segment name.
+   */
+  public String getShmName() {
+    return CameraServerJNI.getShmSinkName(m_handle);
+  }
+}
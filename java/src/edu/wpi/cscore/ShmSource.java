@@ -0,0 +1,33 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A source that receives frames from another process on the same machine
+ * through a shared memory ring buffer (as written by a ShmSink).  Frames are
+ * used in place, without copying.
+ */
+public class ShmSource extends VideoSource {
+  /**
+   * Create a shared memory source.  Not supported on Windows.
+   * The source connects once the producer has created the segment, and
+   * reconnects if the producer restarts.
+   * @param name Source name (arbitrary unique identifier)
+   * @param shmName Shared memory segment name (as given to the producer)
+   */
+  public ShmSource(String name, String shmName) {
+    super(CameraServerJNI.createShmSource(name, shmName));
+  }
+
+  /**
+   * Get the shared memory segment name.
+   */
+  public String getShmName() {
+    return CameraServerJNI.getShmSourceName(m_handle);
+  }
+}
@@ -0,0 +1,38 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+package edu.wpi.cscore;
+
+/**
+ * A source that generates a moving test pattern, for testing without a
+ * camera.  The top left of each frame is stamped with the frame count and
+ * time; MJPEG frames repeat every 64 frames and aren't time stamped.
+ */
+public class TestPatternSource extends VideoSource {
+  /**
+   * Create a test pattern source.  Any resolution (with an even width),
+   * pixel format and frame rate can be used, and changed later with
+   * setVideoMode().
+   * @param name Source name (arbitrary unique identifier)
+   * @param mode Video mode being generated
+   */
+  public TestPatternSource(String name, VideoMode mode) {
+    super(CameraServerJNI.createTestPatternSource(name, mode.pixelFormat.getValue(), mode.width, mode.height, mode.fps));
+  }
+
+  /**
+   * Create a test pattern source.
+   * @param name Source name (arbitrary unique identifier)
+   * @param pixelFormat Pixel format
+   * @param width width
+   * @param height height
+   * @param fps fps
+   */
+  public TestPatternSource(String name, VideoMode.PixelFormat pixelFormat, int width, int height, int fps) {
+    super(CameraServerJNI.createTestPatternSource(name, pixelFormat.getValue(), width, height, fps));
+  }
+}
@@ -14,7 +14,7 @@ package edu.wpi.cscore;
  */
 public class VideoSink {
   public enum Kind {
-    kUnknown(0), kMjpeg(2), kCv(4);
+    kUnknown(0), kMjpeg(2), kCv(4), kShm(8), kRtp(16), kRecording(32);
     private int value;
 
     private Kind(int value) {
@@ -30,6 +30,9 @@ public class VideoSink {
     switch (kind) {
       case 2: return Kind.kMjpeg;
       case 4: return Kind.kCv;
+      case 8: return Kind.kShm;
+      case 16: return Kind.kRtp;
+      case 32: return Kind.kRecording;
       default: return Kind.kUnknown;
     }
   }
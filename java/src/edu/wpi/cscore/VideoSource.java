@@ -14,7 +14,7 @@ package edu.wpi.cscore;
  */
 public class VideoSource {
   public enum Kind {
-    kUnknown(0), kUsb(1), kHttp(2), kCv(4);
+    kUnknown(0), kUsb(1), kHttp(2), kCv(4), kShm(8), kFile(16), kTestPattern(32);
     private int value;
 
     private Kind(int value) {
@@ -31,6 +31,9 @@ public class VideoSource {
       case 1: return Kind.kUsb;
       case 2: return Kind.kHttp;
       case 4: return Kind.kCv;
+      case 8: return Kind.kShm;
+      case 16: return Kind.kFile;
+      case 32: return Kind.kTestPattern;
       default: return Kind.kUnknown;
     }
   }
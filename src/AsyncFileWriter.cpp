@@ -0,0 +1,477 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "AsyncFileWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(IOSQE_IO_DRAIN) && defined(__NR_io_uring_setup)
+#define CS_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#include "llvm/ArrayRef.h"
+
+#include "Log.h"
+
+using namespace cs;
+
+// Writes are refused (and the data dropped by the caller) once this much is
+// waiting for the disk, rather than letting memory grow without bound
+static const std::size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+
+// Submission queue size; further operations wait in m_pending
+static const unsigned kRingEntries = 64;
+
+// Largest number of pieces in a single write
+static const std::size_t kMaxPieces = 64;
+
+struct AsyncFileWriter::Op {
+  enum Type { kWrite, kSync, kFinish };
+
+  Type type;
+  int fd;
+  uint64_t offset;  // write offset, or final size for kFinish
+  std::vector<llvm::StringRef> pieces;
+  std::size_t size{0};  // total bytes written
+  std::shared_ptr<void> keepalive;
+#ifndef _WIN32
+  std::vector<struct iovec> iov;
+#endif
+};
+
+#ifndef _WIN32
+
+// Writes all of the pieces, starting at the given number of bytes into them
+// (after a short write).
+static int64_t WritePieces(int fd, uint64_t offset,
+                           llvm::ArrayRef<llvm::StringRef> pieces,
+                           std::size_t skip) {
+  struct iovec iov[kMaxPieces];
+  for (;;) {
+    // build the iovec for the remaining data
+    int count = 0;
+    std::size_t pos = 0;
+    for (auto&& piece : pieces) {
+      if (pos + piece.size() > skip) {
+        std::size_t start = skip > pos ? skip - pos : 0;
+        iov[count].iov_base = const_cast<char*>(piece.data() + start);
+        iov[count].iov_len = piece.size() - start;
+        ++count;
+      }
+      pos += piece.size();
+    }
+    if (count == 0) return skip;
+    ssize_t rv = ::pwritev(fd, iov, count, offset + skip);
+    if (rv < 0) {
+      if (errno == EINTR) continue;
+      return -errno;
+    }
+    if (rv == 0) return -EIO;
+    skip += rv;
+  }
+}
+
+static int FinishFile(int fd, uint64_t size) {
+  int err = 0;
+  if (::ftruncate(fd, size) < 0) err = errno;
+  if (::fdatasync(fd) < 0 && err == 0) err = errno;
+  ::close(fd);
+  return -err;
+}
+
+#endif  // _WIN32
+
+#ifdef CS_HAVE_IO_URING
+
+// Minimal io_uring wrapper using the raw system calls, so liburing isn't
+// needed.  Push() and Submit() are called with the writer mutex held; Wait()
+// and Reap() are only called from the reaper thread.
+class AsyncFileWriter::Ring {
+ public:
+  Ring() = default;
+  ~Ring();
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  bool Init(unsigned entries);
+
+  // Add an operation to the submission queue.
+  // @return False if the queue is full
+  bool Push(Op* op);
+
+  // Tell the kernel about pushed operations.
+  void Submit();
+
+  // Wait for at least one completion.
+  void Wait();
+
+  // Call func(op, result) for each completion.
+  template <typename F>
+  void Reap(F func);
+
+ private:
+  int m_fd{-1};
+  void* m_sqMap{MAP_FAILED};
+  std::size_t m_sqMapSize{0};
+  void* m_cqMap{MAP_FAILED};
+  std::size_t m_cqMapSize{0};
+  struct io_uring_sqe* m_sqes{static_cast<struct io_uring_sqe*>(MAP_FAILED)};
+  std::size_t m_sqesSize{0};
+
+  unsigned* m_sqHead;
+  unsigned* m_sqTail;
+  unsigned m_sqMask;
+  unsigned m_sqEntries;
+  unsigned* m_sqArray;
+  unsigned* m_cqHead;
+  unsigned* m_cqTail;
+  unsigned m_cqMask;
+  struct io_uring_cqe* m_cqes;
+
+  unsigned m_toSubmit{0};
+};
+
+AsyncFileWriter::Ring::~Ring() {
+  if (m_sqes != MAP_FAILED) ::munmap(m_sqes, m_sqesSize);
+  if (m_cqMap != MAP_FAILED) ::munmap(m_cqMap, m_cqMapSize);
+  if (m_sqMap != MAP_FAILED) ::munmap(m_sqMap, m_sqMapSize);
+  if (m_fd >= 0) ::close(m_fd);
+}
+
+bool AsyncFileWriter::Ring::Init(unsigned entries) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  m_fd = ::syscall(__NR_io_uring_setup, entries, &params);
+  if (m_fd < 0) {
+    // Not supported by the kernel, or blocked (e.g. by seccomp)
+    DEBUG("AsyncFileWriter: io_uring_setup(): " << std::strerror(errno));
+    return false;
+  }
+
+  m_sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_sqMap = ::mmap(nullptr, m_sqMapSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  m_cqMapSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  m_cqMap = ::mmap(nullptr, m_cqMapSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+  m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  m_sqes = static_cast<struct io_uring_sqe*>(
+      ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+  if (m_sqMap == MAP_FAILED || m_cqMap == MAP_FAILED || m_sqes == MAP_FAILED) {
+    ERROR("AsyncFileWriter: could not map io_uring: " << std::strerror(errno));
+    return false;
+  }
+
+  char* sq = static_cast<char*>(m_sqMap);
+  m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  m_sqEntries = params.sq_entries;
+  m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(m_cqMap);
+  m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  return true;
+}
+
+bool AsyncFileWriter::Ring::Push(Op* op) {
+  unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  unsigned tail = *m_sqTail;
+  if (tail - head >= m_sqEntries) return false;
+
+  unsigned index = tail & m_sqMask;
+  struct io_uring_sqe* sqe = &m_sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = op->fd;
+  sqe->user_data = reinterpret_cast<uintptr_t>(op);
+  switch (op->type) {
+    case Op::kWrite:
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->off = op->offset;
+      sqe->addr = reinterpret_cast<uintptr_t>(op->iov.data());
+      sqe->len = op->iov.size();
+      break;
+    case Op::kSync:
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+      break;
+    case Op::kFinish:
+      // Completes once everything submitted before it has; the file is then
+      // truncated and closed by the reaper thread
+      sqe->opcode = IORING_OP_NOP;
+      sqe->flags = IOSQE_IO_DRAIN;
+      break;
+  }
+  m_sqArray[index] = index;
+  __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++m_toSubmit;
+  return true;
+}
+
+void AsyncFileWriter::Ring::Submit() {
+  while (m_toSubmit > 0) {
+    int rv = ::syscall(__NR_io_uring_enter, m_fd, m_toSubmit, 0, 0, nullptr,
+                       0);
+    if (rv < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) return;
+      ERROR("AsyncFileWriter: io_uring_enter(): " << std::strerror(errno));
+      return;
+    }
+    m_toSubmit -= std::min<unsigned>(rv, m_toSubmit);
+    if (rv == 0) return;
+  }
+}
+
+void AsyncFileWriter::Ring::Wait() {
+  if (__atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != *m_cqHead) return;
+  int rv = ::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     nullptr, 0);
+  if (rv < 0 && errno != EINTR)
+    ERROR("AsyncFileWriter: io_uring_enter(): " << std::strerror(errno));
+}
+
+template <typename F>
+void AsyncFileWriter::Ring::Reap(F func) {
+  unsigned head = *m_cqHead;
+  unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    struct io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+    Op* op = reinterpret_cast<Op*>(static_cast<uintptr_t>(cqe->user_data));
+    int res = cqe->res;
+    // release the slot before running the callback
+    __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+    func(op, res);
+  }
+}
+
+#else
+
+class AsyncFileWriter::Ring {};
+
+#endif  // CS_HAVE_IO_URING
+
+AsyncFileWriter::AsyncFileWriter() = default;
+
+AsyncFileWriter::~AsyncFileWriter() { Stop(); }
+
+bool AsyncFileWriter::Start(bool useRing) {
+#ifdef _WIN32
+  ERROR("AsyncFileWriter: not supported on this platform");
+  return false;
+#else
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_started) return true;
+#ifdef CS_HAVE_IO_URING
+  if (useRing) {
+    m_ring.reset(new Ring);
+    if (!m_ring->Init(kRingEntries)) m_ring.reset();
+  }
+#endif
+  m_stopping = false;
+  m_started = true;
+  m_thread = std::thread(&AsyncFileWriter::ThreadMain, this);
+  DEBUG("AsyncFileWriter: using " << GetBackendName());
+  return true;
+#endif
+}
+
+void AsyncFileWriter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_started) return;
+    m_stopping = true;
+  }
+  m_cond.notify_all();
+  if (m_thread.joinable()) m_thread.join();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ring.reset();
+  m_started = false;
+}
+
+const char* AsyncFileWriter::GetBackendName() const {
+  return m_ring ? "io_uring" : "thread";
+}
+
+bool AsyncFileWriter::Write(int fd, uint64_t offset,
+                            std::vector<llvm::StringRef> pieces,
+                            std::shared_ptr<void> keepalive) {
+#ifdef _WIN32
+  return false;
+#else
+  if (pieces.empty() || pieces.size() > kMaxPieces) return false;
+  std::unique_ptr<Op> op{new Op};
+  op->type = Op::kWrite;
+  op->fd = fd;
+  op->offset = offset;
+  op->pieces = std::move(pieces);
+  op->keepalive = std::move(keepalive);
+  op->iov.reserve(op->pieces.size());
+  for (auto&& piece : op->pieces) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(piece.data());
+    iov.iov_len = piece.size();
+    op->iov.push_back(iov);
+    op->size += piece.size();
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_started || m_stopping ||
+      m_queuedBytes + op->size > kMaxQueuedBytes)
+    return false;
+  m_queuedBytes += op->size;
+  Queue(std::move(op));
+  return true;
+#endif
+}
+
+void AsyncFileWriter::Sync(int fd) {
+  std::unique_ptr<Op> op{new Op};
+  op->type = Op::kSync;
+  op->fd = fd;
+  op->offset = 0;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_started || m_stopping) return;
+  Queue(std::move(op));
+}
+
+void AsyncFileWriter::Finish(int fd, uint64_t size) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!m_started || m_stopping) {
+    // nothing can be queued for the file, so it can be finished now
+    lock.unlock();
+#ifndef _WIN32
+    FinishFile(fd, size);
+#endif
+    return;
+  }
+  std::unique_ptr<Op> op{new Op};
+  op->type = Op::kFinish;
+  op->fd = fd;
+  op->offset = size;
+  Queue(std::move(op));
+}
+
+// Called with m_mutex held.
+void AsyncFileWriter::Queue(std::unique_ptr<Op> op) {
+  m_pending.emplace_back(std::move(op));
+#ifdef CS_HAVE_IO_URING
+  if (m_ring) {
+    // Submit in order, so a Finish never overtakes earlier writes
+    while (!m_pending.empty() && m_ring->Push(m_pending.front().get())) {
+      m_pending.front().release();
+      m_pending.pop_front();
+      ++m_inFlight;
+    }
+    m_ring->Submit();
+  }
+#endif
+  m_cond.notify_all();
+}
+
+// Called without m_mutex held.
+void AsyncFileWriter::Complete(Op& op, int64_t result) {
+#ifndef _WIN32
+  switch (op.type) {
+    case Op::kWrite:
+      if (result >= 0 && static_cast<std::size_t>(result) < op.size) {
+        // short write (e.g. interrupted); finish it synchronously
+        result = WritePieces(op.fd, op.offset, op.pieces, result);
+      }
+      if (result < 0)
+        ERROR("AsyncFileWriter: write failed: "
+              << std::strerror(static_cast<int>(-result)));
+      break;
+    case Op::kSync:
+      if (result < 0)
+        ERROR("AsyncFileWriter: sync failed: "
+              << std::strerror(static_cast<int>(-result)));
+      break;
+    case Op::kFinish:
+      result = FinishFile(op.fd, op.offset);
+      if (result < 0)
+        ERROR("AsyncFileWriter: finish failed: "
+              << std::strerror(static_cast<int>(-result)));
+      break;
+  }
+#endif
+  // release the data before taking the lock
+  op.keepalive.reset();
+}
+
+void AsyncFileWriter::ThreadMain() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+#ifdef CS_HAVE_IO_URING
+  if (m_ring) {
+    // Reap completions until stopped and everything has completed
+    for (;;) {
+      m_cond.wait(lock, [&] { return m_inFlight > 0 || m_stopping; });
+      if (m_inFlight == 0) break;
+      lock.unlock();
+      m_ring->Wait();
+      std::vector<std::pair<Op*, int>> done;
+      m_ring->Reap([&](Op* op, int res) { done.emplace_back(op, res); });
+      for (auto&& d : done) Complete(*d.first, d.second);
+      lock.lock();
+      for (auto&& d : done) {
+        std::unique_ptr<Op> op{d.first};
+        if (op->type == Op::kWrite) m_queuedBytes -= op->size;
+        --m_inFlight;
+      }
+      // make room for any operations that didn't fit
+      while (!m_pending.empty() && m_ring->Push(m_pending.front().get())) {
+        m_pending.front().release();
+        m_pending.pop_front();
+        ++m_inFlight;
+      }
+      m_ring->Submit();
+    }
+    return;
+  }
+#endif
+#ifndef _WIN32
+  // Writer thread: perform operations in order
+  for (;;) {
+    m_cond.wait(lock, [&] { return !m_pending.empty() || m_stopping; });
+    if (m_pending.empty()) break;
+    std::unique_ptr<Op> op = std::move(m_pending.front());
+    m_pending.pop_front();
+    lock.unlock();
+    int64_t result = 0;
+    switch (op->type) {
+      case Op::kWrite:
+        result = WritePieces(op->fd, op->offset, op->pieces, 0);
+        break;
+      case Op::kSync:
+        if (::fdatasync(op->fd) < 0) result = -errno;
+        break;
+      case Op::kFinish:
+        break;  // done by Complete()
+    }
+    Complete(*op, result);
+    lock.lock();
+    if (op->type == Op::kWrite) m_queuedBytes -= op->size;
+  }
+#endif
+}
@@ -0,0 +1,84 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_ASYNCFILEWRITER_H_
+#define CS_ASYNCFILEWRITER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "llvm/StringRef.h"
+
+namespace cs {
+
+// Writes files in the background, so callers never block on the disk.
+// Uses io_uring on Linux when available, otherwise a writer thread.
+//
+// Writes are at explicit offsets and may complete in any order.  Finish()
+// waits for all earlier operations on any file.
+class AsyncFileWriter {
+ public:
+  AsyncFileWriter();
+  ~AsyncFileWriter();
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  // Start the writer.
+  // @param useRing Use io_uring if available; false always uses the writer
+  //     thread (e.g. for testing)
+  // @return False if no backend is available (e.g. on Windows)
+  bool Start(bool useRing = true);
+
+  // Wait for all queued operations to complete and stop.
+  void Stop();
+
+  // Queue a write of pieces (in order) at offset.  The pieces must stay
+  // valid until the write completes; keepalive is released then.
+  // @return False if too much data is already queued (nothing is queued)
+  bool Write(int fd, uint64_t offset, std::vector<llvm::StringRef> pieces,
+             std::shared_ptr<void> keepalive);
+
+  // Queue a flush of the data written so far to disk.
+  void Sync(int fd);
+
+  // After all earlier operations complete: truncate the file to size
+  // (dropping unused preallocated space), sync and close it.
+  void Finish(int fd, uint64_t size);
+
+  // Backend in use ("io_uring" or "thread").
+  const char* GetBackendName() const;
+
+ private:
+  struct Op;
+  class Ring;
+
+  void Queue(std::unique_ptr<Op> op);
+  void Complete(Op& op, int64_t result);
+
+  void ThreadMain();
+
+  std::unique_ptr<Ring> m_ring;  // null if using the writer thread
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;  // signaled when ops queue or complete
+  std::deque<std::unique_ptr<Op>> m_pending;  // not yet submitted
+  std::size_t m_inFlight{0};                  // submitted to the ring
+  std::size_t m_queuedBytes{0};
+  bool m_started{false};
+  bool m_stopping{false};
+  std::thread m_thread;
+};
+
+}  // namespace cs
+
+#endif  // CS_ASYNCFILEWRITER_H_
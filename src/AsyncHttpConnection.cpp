@@ -0,0 +1,385 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "AsyncHttpConnection.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "llvm/SmallString.h"
+#include "llvm/raw_ostream.h"
+
+#include "Log.h"
+
+using namespace cs;
+
+#ifdef _WIN32
+static bool WouldBlock() {
+  int err = WSAGetLastError();
+  return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+}
+static void CloseSocket(int fd) { ::closesocket(fd); }
+static bool SetNonBlocking(int fd) {
+  u_long nonblocking = 1;
+  return ::ioctlsocket(fd, FIONBIO, &nonblocking) == 0;
+}
+static const int kSendFlags = 0;
+#else
+static bool WouldBlock() {
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS;
+}
+static void CloseSocket(int fd) { ::close(fd); }
+static bool SetNonBlocking(int fd) {
+  int flags = ::fcntl(fd, F_GETFL);
+  return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+#endif
+
+AsyncHttpConnection::AsyncHttpConnection(llvm::StringRef name)
+    : m_name{name}, m_alive{std::make_shared<char>()} {}
+
+AsyncHttpConnection::~AsyncHttpConnection() { Shutdown(); }
+
+void AsyncHttpConnection::Start(const HttpRequest& request, double timeout) {
+  Shutdown();
+
+  m_host = request.host.str();
+  m_port = request.port;
+  m_timeout = timeout;
+  m_request.clear();
+  llvm::raw_string_ostream os{m_request};
+  WriteHttpGet(os, request);
+  os.flush();
+  m_sent = 0;
+  m_pending = 1;
+  m_response.Reset();
+
+  auto& reactor = HttpReactor::GetInstance();
+  m_lastActivity = std::chrono::steady_clock::now();
+  m_timer = reactor.AddTimer(m_timeout, [=] { OnTimer(); });
+
+  // Numeric addresses (the common case for cameras) need no lookup
+  struct in_addr addr;
+  if (::inet_pton(AF_INET, m_host.c_str(), &addr) == 1) {
+    Connect(addr.s_addr);
+    return;
+  }
+
+  // Name lookups can block, so do them on another thread
+  m_state = kResolving;
+  auto result = std::make_shared<std::pair<bool, uint32_t>>(false, 0);
+  std::string host = m_host;
+  std::weak_ptr<char> alive = m_alive;
+  unsigned int generation = m_generation;
+  reactor.RunInBackground(
+      [=] {
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* res = nullptr;
+        if (::getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res)
+          return;
+        result->first = true;
+        auto addr = reinterpret_cast<struct sockaddr_in*>(res->ai_addr);
+        result->second = addr->sin_addr.s_addr;
+        ::freeaddrinfo(res);
+      },
+      [=] {
+        // we may have been closed or destroyed in the meantime
+        if (alive.expired() || generation != m_generation) return;
+        if (!result->first) {
+          Fail("could not resolve host name");
+          return;
+        }
+        Connect(result->second);
+      });
+}
+
+void AsyncHttpConnection::Connect(uint32_t addr) {
+  m_fd = static_cast<int>(::socket(AF_INET, SOCK_STREAM, 0));
+  if (m_fd < 0 || !SetNonBlocking(m_fd)) {
+    Fail("could not create socket");
+    return;
+  }
+
+  struct sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = addr;
+  address.sin_port = htons(m_port);
+  if (::connect(m_fd, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) != 0 &&
+      !WouldBlock()) {
+    Fail("connect() failed");
+    return;
+  }
+
+  // Connected (or in progress); writable once the connection completes
+  m_state = kConnecting;
+  HttpReactor::GetInstance().Add(m_fd, HttpReactor::kWrite,
+                                 [=](int events) { OnEvent(events); });
+}
+
+bool AsyncHttpConnection::Send(const HttpRequest& request) {
+  if (m_state == kClosed) return false;
+
+  llvm::raw_string_ostream os{m_request};
+  WriteHttpGet(os, request);
+  os.flush();
+  ++m_pending;
+
+  if (m_state == kIdle) {
+    m_state = kHeaders;
+    m_lastActivity = std::chrono::steady_clock::now();
+  }
+  auto& reactor = HttpReactor::GetInstance();
+  if (m_timer == 0)
+    m_timer = reactor.AddTimer(m_timeout, [=] { OnTimer(); });
+  if (m_fd >= 0 && m_state != kConnecting)
+    reactor.Modify(m_fd, HttpReactor::kRead | HttpReactor::kWrite);
+  return true;
+}
+
+void AsyncHttpConnection::Close() { Shutdown(); }
+
+void AsyncHttpConnection::Shutdown() {
+  ++m_generation;
+  if (m_state == kClosed) return;
+  m_state = kClosed;
+  m_pending = 0;
+  // The reactor may already be gone at program exit
+  if (!HttpReactor::destroyed()) {
+    auto& reactor = HttpReactor::GetInstance();
+    if (m_timer != 0) reactor.CancelTimer(m_timer);
+    if (m_fd >= 0) reactor.Remove(m_fd);
+  }
+  m_timer = 0;
+  if (m_fd >= 0) {
+    CloseSocket(m_fd);
+    m_fd = -1;
+  }
+}
+
+void AsyncHttpConnection::Fail(llvm::StringRef msg) {
+  WARNING(m_name << ": \"" << m_host << "\": " << msg);
+  Shutdown();
+  OnClosed();
+}
+
+void AsyncHttpConnection::OnTimer() {
+  m_timer = 0;
+  if (m_state == kIdle) return;  // no timeout while nothing is requested
+  auto now = std::chrono::steady_clock::now();
+  auto idle = std::chrono::duration<double>(now - m_lastActivity).count();
+  if (idle >= m_timeout) {
+    Fail(m_state == kBody ? "timed out waiting for data"
+                          : "timed out waiting for response");
+    return;
+  }
+  m_timer = HttpReactor::GetInstance().AddTimer(m_timeout - idle,
+                                                [=] { OnTimer(); });
+}
+
+void AsyncHttpConnection::OnEvent(int events) {
+  if (m_state == kConnecting) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_ERROR,
+                     reinterpret_cast<char*>(&err), &len) != 0 ||
+        err != 0) {
+      Fail("could not connect");
+      return;
+    }
+    m_lastActivity = std::chrono::steady_clock::now();
+    m_state = kHeaders;
+    HttpReactor::GetInstance().Modify(
+        m_fd, HttpReactor::kRead | HttpReactor::kWrite);
+  }
+  if ((events & HttpReactor::kWrite) && !DoSend()) return;
+  if (events & HttpReactor::kRead) DoReceive();
+}
+
+bool AsyncHttpConnection::DoSend() {
+  while (m_sent < m_request.size()) {
+    auto n = ::send(m_fd, m_request.data() + m_sent,
+                    m_request.size() - m_sent, kSendFlags);
+    if (n < 0) {
+      if (WouldBlock()) return true;  // wait for writable
+      Fail("disconnected before response");
+      return false;
+    }
+    m_sent += n;
+  }
+  m_request.clear();
+  m_sent = 0;
+  HttpReactor::GetInstance().Modify(m_fd, HttpReactor::kRead);
+  return true;
+}
+
+bool AsyncHttpConnection::DoReceive() {
+  // Read a few times while data keeps filling the buffer, then go back to
+  // the reactor so other connections get a turn.
+  for (int i = 0; i < 4; ++i) {
+    char buf[4096];
+    llvm::MutableArrayRef<char> dest{buf};
+    if (m_state == kBody) {
+      // Receive straight into the body buffer, but not past the body
+      dest = GetBodyBuffer();
+      if (m_bodyLeft >= 0 && dest.size() > static_cast<std::size_t>(m_bodyLeft))
+        dest = dest.slice(0, m_bodyLeft);
+    }
+
+    auto n = ::recv(m_fd, dest.data(), dest.size(), 0);
+    if (n < 0 && WouldBlock()) return true;
+    if (n < 0) {
+      Fail("disconnected");
+      return false;
+    }
+    if (n == 0) {
+      if (m_state == kIdle || (m_state == kBody && m_bodyLeft < 0)) {
+        // end of response, or an idle keep-alive connection was closed
+        Shutdown();
+        OnClosed();
+      } else {
+        Fail(m_state == kBody ? "disconnected"
+                              : "disconnected before response");
+      }
+      return false;
+    }
+    m_lastActivity = std::chrono::steady_clock::now();
+
+    if (dest.data() == buf) {
+      if (!ProcessData(buf, n)) return false;
+    } else {
+      if (!BodyReceived(n)) return false;
+    }
+    if (static_cast<std::size_t>(n) < dest.size()) break;
+  }
+  return true;
+}
+
+// Process data received outside of the body buffer: response headers, and
+// anything received with them.
+bool AsyncHttpConnection::ProcessData(const char* data, std::size_t len) {
+  while (len > 0) {
+    if (m_state == kHeaders) {
+      std::size_t consumed = m_response.Execute(llvm::StringRef(data, len));
+      data += consumed;
+      len -= consumed;
+      if (m_response.HasError()) {
+        Fail("did not receive HTTP response");
+        return false;
+      }
+      if (!m_response.IsComplete()) return true;
+      if (!StartBody()) return false;
+    } else if (m_state == kBody) {
+      auto dest = GetBodyBuffer();
+      std::size_t count = std::min(len, dest.size());
+      if (m_bodyLeft >= 0)
+        count = std::min(count, static_cast<std::size_t>(m_bodyLeft));
+      std::memcpy(dest.data(), data, count);
+      data += count;
+      len -= count;
+      if (!BodyReceived(count)) return false;
+    } else {
+      Fail("received data without a request");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AsyncHttpConnection::StartBody() {
+  // see if we got a HTTP 200 response
+  if (m_response.GetStatusCode() != 200) {
+    llvm::SmallString<64> msg;
+    llvm::raw_svector_ostream oss{msg};
+    oss << "received " << m_response.GetStatusCode() << ' '
+        << m_response.GetStatusText() << " response";
+    Fail(oss.str());
+    return false;
+  }
+
+  // Without a Content-Length, the body continues until the server closes
+  m_bodyLeft = m_response.GetContentLength();
+  m_keepAlive = m_bodyLeft >= 0 && m_response.ShouldKeepAlive();
+  m_state = kBody;
+
+  unsigned int generation = m_generation;
+  if (!OnResponse(m_response)) {
+    if (generation == m_generation) {
+      Shutdown();
+      OnClosed();
+    }
+    return false;
+  }
+  if (generation != m_generation) return false;  // closed by callback
+
+  if (m_bodyLeft == 0) return EndResponse();
+  return true;
+}
+
+bool AsyncHttpConnection::BodyReceived(std::size_t len) {
+  unsigned int generation = m_generation;
+  if (!OnBody(len)) {
+    if (generation == m_generation) {
+      Shutdown();
+      OnClosed();
+    }
+    return false;
+  }
+  if (generation != m_generation) return false;  // closed by callback
+
+  if (m_bodyLeft < 0) return true;
+  m_bodyLeft -= len;
+  if (m_bodyLeft == 0) return EndResponse();
+  return true;
+}
+
+bool AsyncHttpConnection::EndResponse() {
+  --m_pending;
+  unsigned int generation = m_generation;
+  OnResponseDone();
+  if (generation != m_generation) return false;  // closed by callback
+
+  if (!m_keepAlive) {
+    Shutdown();
+    OnClosed();
+    return false;
+  }
+
+  // Wait for the next pipelined response, or for another request
+  m_response.Reset();
+  if (m_pending > 0) {
+    m_state = kHeaders;
+  } else {
+    m_state = kIdle;
+    if (m_timer != 0) {
+      HttpReactor::GetInstance().CancelTimer(m_timer);
+      m_timer = 0;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,124 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_ASYNCHTTPCONNECTION_H_
+#define CS_ASYNCHTTPCONNECTION_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "llvm/ArrayRef.h"
+#include "llvm/StringRef.h"
+
+#include "HttpParser.h"
+#include "HttpReactor.h"
+#include "HttpUtil.h"
+
+namespace cs {
+
+// A HTTP GET request driven by the HttpReactor: connects with a
+// non-blocking socket, sends the request, parses the response headers, and
+// then passes the body to the derived class as it arrives.
+//
+// If the server keeps the connection alive, further requests can be sent on
+// it with Send(), including while earlier requests are still outstanding
+// (pipelining).  Responses without a Content-Length continue until the
+// server closes the connection.
+//
+// All functions (including the callbacks) run on the reactor thread, and
+// the object must also be destroyed there.  The object can be reused for
+// another request once closed.
+class AsyncHttpConnection {
+ public:
+  // @param name Name to use in log messages (e.g. the camera name)
+  explicit AsyncHttpConnection(llvm::StringRef name);
+  virtual ~AsyncHttpConnection();
+
+  AsyncHttpConnection(const AsyncHttpConnection&) = delete;
+  AsyncHttpConnection& operator=(const AsyncHttpConnection&) = delete;
+
+  // Connect and send a GET request.
+  // @param timeout Time (in seconds) allowed to connect, and without
+  //     receiving data once connected
+  void Start(const HttpRequest& request, double timeout);
+
+  // Send another request on the open connection, to the same host.
+  // @return False if the connection is closed (use Start() instead)
+  bool Send(const HttpRequest& request);
+
+  // Close the connection.  OnClosed() is not called.
+  void Close();
+
+  bool IsOpen() const { return m_state != kClosed; }
+  llvm::StringRef GetHost() const { return m_host; }
+  int GetPort() const { return m_port; }
+
+  // Number of requests sent that haven't had a complete response
+  std::size_t GetNumPending() const { return m_pending; }
+
+ protected:
+  // Response headers received (status 200 only).
+  // @return False to close the connection
+  virtual bool OnResponse(const HttpParser& response) = 0;
+
+  // Space to receive body data into.  Must not be empty.
+  virtual llvm::MutableArrayRef<char> GetBodyBuffer() = 0;
+
+  // len bytes of body data were received into the last GetBodyBuffer().
+  // @return False to close the connection
+  virtual bool OnBody(std::size_t len) = 0;
+
+  // The whole body of a response with a Content-Length was received.
+  virtual void OnResponseDone() {}
+
+  // Called when the connection closes for any reason other than Close():
+  // errors, timeouts, the end of the response, or a callback returning
+  // false.  May call Start() again.
+  virtual void OnClosed() = 0;
+
+ private:
+  // Receive state (requests are sent independently once connected)
+  enum State { kClosed, kResolving, kConnecting, kHeaders, kBody, kIdle };
+
+  void Connect(uint32_t addr);
+  void OnEvent(int events);
+  void OnTimer();
+  bool DoSend();
+  bool DoReceive();
+  bool ProcessData(const char* data, std::size_t len);
+  bool StartBody();
+  bool BodyReceived(std::size_t len);
+  bool EndResponse();
+  void Fail(llvm::StringRef msg);
+  void Shutdown();
+
+  std::string m_name;
+  State m_state{kClosed};
+  int m_fd{-1};
+  unsigned int m_generation{0};  // incremented on every Start()/Shutdown()
+  std::shared_ptr<char> m_alive;  // for callbacks that may outlive us
+
+  std::string m_host;
+  int m_port{0};
+  std::string m_request;  // unsent requests
+  std::size_t m_sent{0};
+  std::size_t m_pending{0};
+  HttpParser m_response{HttpParser::kResponse};
+  long long m_bodyLeft{-1};  // -1 if until the connection closes
+  bool m_keepAlive{false};
+
+  double m_timeout{1.0};
+  std::chrono::steady_clock::time_point m_lastActivity;
+  HttpReactor::TimerId m_timer{0};
+};
+
+}  // namespace cs
+
+#endif  // CS_ASYNCHTTPCONNECTION_H_
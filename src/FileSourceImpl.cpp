@@ -0,0 +1,401 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "FileSourceImpl.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "llvm/STLExtras.h"
+#include "llvm/SmallString.h"
+#include "llvm/raw_ostream.h"
+#include "support/timestamp.h"
+
+#include "cscore_recording.h"
+#include "c_util.h"
+#include "Handle.h"
+#include "Log.h"
+#include "Notifier.h"
+
+using namespace cs;
+
+struct FileSourceImpl::Mapping {
+#ifndef _WIN32
+  ~Mapping() {
+    if (data) ::munmap(data, size);
+  }
+#endif
+
+  void* data{nullptr};
+  std::size_t size{0};
+  std::vector<CS_RecIndexEntry> index;
+  int fps{0};  // recorded frame rate
+};
+
+FileSourceImpl::FileSourceImpl(llvm::StringRef name, llvm::StringRef path,
+                               CS_FilePlaybackMode mode, int fps)
+    : SourceImpl{name}, m_path{path}, m_playbackMode{mode}, m_fps{fps} {
+  llvm::SmallString<128> descBuf;
+  llvm::raw_svector_ostream desc{descBuf};
+  desc << "File " << m_path;
+  SetDescription(desc.str());
+
+  if (m_playbackMode == CS_FILE_PLAYBACK_FIXED_RATE && m_fps <= 0) {
+    SWARNING("invalid fps " << m_fps << ", playing at recorded rate");
+    m_playbackMode = CS_FILE_PLAYBACK_REALTIME;
+  }
+}
+
+FileSourceImpl::~FileSourceImpl() {
+  m_active = false;
+
+  // force wakeup of camera thread in case it's waiting on cv
+  m_sinkEnabledCond.notify_one();
+
+  // join camera thread
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void FileSourceImpl::Start() {
+  m_thread = std::thread(&FileSourceImpl::ThreadMain, this);
+}
+
+std::unique_ptr<PropertyImpl> FileSourceImpl::CreateEmptyProperty(
+    llvm::StringRef name) const {
+  return llvm::make_unique<PropertyImpl>(name);
+}
+
+bool FileSourceImpl::CacheProperties(CS_Status* status) const {
+  // Doesn't need to do anything.
+  m_properties_cached = true;
+  return true;
+}
+
+// Frames are played back as recorded, so there are no properties and the
+// video mode can't be changed.
+
+void FileSourceImpl::SetProperty(int property, int value, CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void FileSourceImpl::SetStringProperty(int property, llvm::StringRef value,
+                                       CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void FileSourceImpl::SetBrightness(int brightness, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+int FileSourceImpl::GetBrightness(CS_Status* status) const {
+  *status = CS_INVALID_HANDLE;
+  return 0;
+}
+
+void FileSourceImpl::SetWhiteBalanceAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void FileSourceImpl::SetWhiteBalanceHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void FileSourceImpl::SetWhiteBalanceManual(int value, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void FileSourceImpl::SetExposureAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void FileSourceImpl::SetExposureHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void FileSourceImpl::SetExposureManual(int value, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+bool FileSourceImpl::SetVideoMode(const VideoMode& mode, CS_Status* status) {
+  return false;
+}
+
+void FileSourceImpl::NumSinksChanged() {
+  // ignore
+}
+
+void FileSourceImpl::NumSinksEnabledChanged() {
+  m_sinkEnabledCond.notify_one();
+}
+
+// Waits until the given time (wpi::Now() units), or until there are no
+// enabled sinks or the source is being destroyed.
+// @return True if the time was reached
+bool FileSourceImpl::WaitUntil(uint64_t time) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    if (!m_active || m_numSinksEnabled == 0) return false;
+    uint64_t now = wpi::Now();
+    if (now >= time) return true;
+    m_sinkEnabledCond.wait_for(lock,
+                               std::chrono::microseconds((time - now) / 10));
+  }
+}
+
+#ifdef _WIN32
+
+std::shared_ptr<FileSourceImpl::Mapping> FileSourceImpl::Open() {
+  return nullptr;
+}
+
+void FileSourceImpl::PutRecordedFrame(const std::shared_ptr<Mapping>& mapping,
+                                      std::size_t i) {}
+
+void FileSourceImpl::ThreadMain() {
+  SERROR("file sources are not supported on this platform");
+}
+
+#else
+
+std::shared_ptr<FileSourceImpl::Mapping> FileSourceImpl::Open() {
+  int fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    SERROR("could not open " << m_path << ": " << std::strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || st.st_size < 0) {
+    SERROR("could not stat " << m_path << ": " << std::strerror(errno));
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto mapping = std::make_shared<Mapping>();
+  std::size_t size = st.st_size;
+  if (size < sizeof(CS_RecFileHeader)) {
+    SERROR(m_path << " is not a recording");
+    ::close(fd);
+    return nullptr;
+  }
+  // Fault in the whole file now, so playback timing doesn't depend on the
+  // page cache (the mapping is shared with the page cache, not copied)
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void* data = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    SERROR("could not map " << m_path << ": " << std::strerror(errno));
+    return nullptr;
+  }
+  mapping->data = data;
+  mapping->size = size;
+
+  auto base = static_cast<const char*>(data);
+  CS_RecFileHeader fileHeader;
+  std::memcpy(&fileHeader, base, sizeof(fileHeader));
+  if (fileHeader.magic != CS_REC_FILE_MAGIC ||
+      fileHeader.version != CS_REC_VERSION) {
+    SERROR(m_path << " is not a recording (or has a different version)");
+    return nullptr;
+  }
+
+  // Use the index if the segment was finished
+  auto& index = mapping->index;
+  CS_RecFooter footer;
+  if (size >= sizeof(CS_RecFileHeader) + sizeof(footer)) {
+    std::memcpy(&footer, base + size - sizeof(footer), sizeof(footer));
+    if (footer.magic == CS_REC_INDEX_MAGIC &&
+        footer.indexOffset <= size - sizeof(footer) &&
+        footer.count <= (size - sizeof(footer) - footer.indexOffset) /
+                            sizeof(CS_RecIndexEntry)) {
+      index.resize(footer.count);
+      std::memcpy(index.data(), base + footer.indexOffset,
+                  footer.count * sizeof(CS_RecIndexEntry));
+    }
+  }
+
+  // Otherwise (e.g. the recorder crashed) walk the frame headers
+  if (index.empty()) {
+    SINFO(m_path << " has no index, scanning frames");
+    std::size_t offset = sizeof(CS_RecFileHeader);
+    CS_RecFrameHeader header;
+    while (offset + sizeof(header) <= size) {
+      std::memcpy(&header, base + offset, sizeof(header));
+      if (header.magic != CS_REC_FRAME_MAGIC ||
+          header.size > size - offset - sizeof(header))
+        break;
+      index.push_back(CS_RecIndexEntry{header.time, offset});
+      offset += sizeof(header) + header.size;
+    }
+  }
+
+  if (index.empty()) {
+    SERROR(m_path << " has no frames");
+    return nullptr;
+  }
+
+  uint64_t duration = index.back().time - index.front().time;
+  if (duration != 0)
+    mapping->fps = (index.size() - 1) * 10000000ull / duration;
+
+#ifdef MADV_SEQUENTIAL
+  ::madvise(data, size, MADV_SEQUENTIAL);
+#endif
+  SINFO("playing " << m_path << " (" << index.size() << " frames)");
+  return mapping;
+}
+
+void FileSourceImpl::PutRecordedFrame(const std::shared_ptr<Mapping>& mapping,
+                                      std::size_t i) {
+  auto base = static_cast<const char*>(mapping->data);
+  uint64_t offset = mapping->index[i].offset;
+  CS_RecFrameHeader header;
+  if (offset > mapping->size - sizeof(header)) return;
+  std::memcpy(&header, base + offset, sizeof(header));
+  if (header.magic != CS_REC_FRAME_MAGIC ||
+      header.size > mapping->size - offset - sizeof(header) ||
+      header.width == 0 || header.height == 0) {
+    SWARNING("skipping invalid frame at offset " << offset);
+    return;
+  }
+
+  // Update the video mode if the recording changed resolution
+  int fps =
+      m_playbackMode == CS_FILE_PLAYBACK_FIXED_RATE ? m_fps : mapping->fps;
+  VideoMode mode{VideoMode::kMJPEG, header.width, header.height, fps};
+  bool modeChanged = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_mode.pixelFormat != mode.pixelFormat || m_mode.width != mode.width ||
+        m_mode.height != mode.height || m_mode.fps != mode.fps) {
+      m_mode = mode;
+      m_videoModes.assign(1, mode);
+      modeChanged = true;
+    }
+  }
+  if (modeChanged) {
+    auto& notifier = Notifier::GetInstance();
+    notifier.NotifySource(*this, CS_SOURCE_VIDEOMODES_UPDATED);
+    notifier.NotifySourceVideoMode(*this, mode);
+  }
+
+  // Alias the mapping, which is held until the last reference to the frame
+  // is dropped
+  std::unique_ptr<Image> image{new Image{
+      llvm::StringRef{base + offset + sizeof(header), header.size},
+      [mapping]() {}}};
+  image->pixelFormat = VideoMode::kMJPEG;
+  image->width = header.width;
+  image->height = header.height;
+  PutFrame(std::move(image), wpi::Now());
+}
+
+void FileSourceImpl::ThreadMain() {
+  std::shared_ptr<Mapping> mapping;
+  std::size_t next = 0;
+  uint64_t startTime = 0;  // when frame 0 was (or would have been) played
+
+  while (m_active) {
+    // sleep here until at least one sink is enabled
+    if (m_numSinksEnabled == 0) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_sinkEnabledCond.wait(
+          lock, [=] { return !m_active || m_numSinksEnabled != 0; });
+      if (!m_active) break;
+      // timing restarts from the current frame
+      startTime = 0;
+    }
+
+    // open, retrying once a second (e.g. until the file is written)
+    if (!mapping) {
+      mapping = Open();
+      if (!mapping) {
+        PutError("could not open recording", wpi::Now());
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sinkEnabledCond.wait_for(lock, std::chrono::seconds(1),
+                                   [=] { return !m_active.load(); });
+        continue;
+      }
+      next = 0;
+      startTime = 0;
+      SetConnected(true);
+    }
+
+    // loop at the end, restarting the timing
+    auto& index = mapping->index;
+    if (next >= index.size()) {
+      next = 0;
+      startTime = 0;
+    }
+
+    if (m_playbackMode != CS_FILE_PLAYBACK_FAST) {
+      uint64_t now = wpi::Now();
+      uint64_t elapsed;
+      if (m_playbackMode == CS_FILE_PLAYBACK_FIXED_RATE)
+        elapsed = next * 10000000ull / m_fps;
+      else
+        elapsed = index[next].time - index.front().time;
+      if (startTime == 0) startTime = now - elapsed;
+      if (!WaitUntil(startTime + elapsed)) continue;
+    }
+
+    PutRecordedFrame(mapping, next);
+    ++next;
+  }
+
+  SetConnected(false);
+}
+
+#endif  // _WIN32
+
+namespace cs {
+
+CS_Source CreateFileSource(llvm::StringRef name, llvm::StringRef path,
+                           CS_FilePlaybackMode mode, int fps,
+                           CS_Status* status) {
+  auto source = std::make_shared<FileSourceImpl>(name, path, mode, fps);
+  auto handle = Sources::GetInstance().Allocate(CS_SOURCE_FILE, source);
+  Notifier::GetInstance().NotifySource(name, handle, CS_SOURCE_CREATED);
+  source->Start();
+  return handle;
+}
+
+std::string GetFileSourcePath(CS_Source source, CS_Status* status) {
+  auto data = Sources::GetInstance().Get(source);
+  if (!data || data->kind != CS_SOURCE_FILE) {
+    *status = CS_INVALID_HANDLE;
+    return std::string{};
+  }
+  return static_cast<FileSourceImpl&>(*data->source).GetPath();
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Source CS_CreateFileSource(const char* name, const char* path,
+                              enum CS_FilePlaybackMode mode, int fps,
+                              CS_Status* status) {
+  return cs::CreateFileSource(name, path, mode, fps, status);
+}
+
+char* CS_GetFileSourcePath(CS_Source source, CS_Status* status) {
+  return ConvertToC(cs::GetFileSourcePath(source, status));
+}
+
+}  // extern "C"
@@ -0,0 +1,87 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_FILESOURCEIMPL_H_
+#define CS_FILESOURCEIMPL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "cscore_c.h"
+#include "SourceImpl.h"
+
+namespace cs {
+
+// Plays back a recording (as written by a recording sink; see
+// cscore_recording.h) from a memory-mapped file.  Frames alias the mapping
+// rather than being copied.  Playback loops at the end of the file.
+class FileSourceImpl : public SourceImpl {
+ public:
+  FileSourceImpl(llvm::StringRef name, llvm::StringRef path,
+                 CS_FilePlaybackMode mode, int fps);
+  ~FileSourceImpl() override;
+
+  void Start();
+
+  // Property functions
+  void SetProperty(int property, int value, CS_Status* status) override;
+  void SetStringProperty(int property, llvm::StringRef value,
+                         CS_Status* status) override;
+
+  // Standard common camera properties
+  void SetBrightness(int brightness, CS_Status* status) override;
+  int GetBrightness(CS_Status* status) const override;
+  void SetWhiteBalanceAuto(CS_Status* status) override;
+  void SetWhiteBalanceHoldCurrent(CS_Status* status) override;
+  void SetWhiteBalanceManual(int value, CS_Status* status) override;
+  void SetExposureAuto(CS_Status* status) override;
+  void SetExposureHoldCurrent(CS_Status* status) override;
+  void SetExposureManual(int value, CS_Status* status) override;
+
+  bool SetVideoMode(const VideoMode& mode, CS_Status* status) override;
+
+  void NumSinksChanged() override;
+  void NumSinksEnabledChanged() override;
+
+  std::string GetPath() const { return m_path; }
+
+ protected:
+  std::unique_ptr<PropertyImpl> CreateEmptyProperty(
+      llvm::StringRef name) const override;
+
+  bool CacheProperties(CS_Status* status) const override;
+
+ private:
+  struct Mapping;
+
+  std::shared_ptr<Mapping> Open();
+  void PutRecordedFrame(const std::shared_ptr<Mapping>& mapping,
+                        std::size_t i);
+  bool WaitUntil(uint64_t time);
+
+  void ThreadMain();
+
+  // Never changed, so not protected by mutex
+  std::string m_path;
+  CS_FilePlaybackMode m_playbackMode;
+  int m_fps;
+
+  std::atomic_bool m_active{true};  // set to false to terminate thread
+  std::thread m_thread;
+
+  // Protected by m_mutex
+  std::condition_variable m_sinkEnabledCond;
+};
+
+}  // namespace cs
+
+#endif  // CS_FILESOURCEIMPL_H_
@@ -7,20 +7,44 @@
 
 #include "Frame.h"
 
+#include <algorithm>
+
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
+#include "support/timestamp.h"
 
+#include "JpegBandDecoder.h"
+#include "JpegUtil.h"
 #include "Log.h"
 #include "SourceImpl.h"
 
 using namespace cs;
 
+// Quality used when a JPEG must be compressed and none was requested
+static const int kDefaultJpegQuality = 80;
+
+// Decode a JPEG into dst, in parallel if it has restart markers.
+static void DecodeJpeg(Image& image, int flags, cv::Mat& dst) {
+  const JpegInfo* info = image.GetJpegInfo();
+  if (info && info->restartInterval != 0) {
+    JpegBandDecoder decoder{image, *info, flags, dst};
+    if (decoder.Init(cv::getNumThreads())) {
+      cv::parallel_for_(cv::Range(0, decoder.GetNumBands()), decoder);
+      if (!decoder.Failed()) return;
+    }
+  }
+  // No restart markers (or they can't be used); decode as a whole
+  cv::imdecode(image.AsInputArray(), flags, &dst);
+}
+
 Frame::Frame(SourceImpl& source, llvm::StringRef error, Time time)
     : m_impl{source.AllocFrameImpl().release()} {
   m_impl->refcount = 1;
   m_impl->error = error;
   m_impl->time = time;
+  m_impl->putTime = wpi::Now();
+  m_impl->convertTime = 0;
 }
 
 Frame::Frame(SourceImpl& source, std::unique_ptr<Image> image, Time time)
@@ -28,6 +52,8 @@ Frame::Frame(SourceImpl& source, std::unique_ptr<Image> image, Time time)
   m_impl->refcount = 1;
   m_impl->error.resize(0);
   m_impl->time = time;
+  m_impl->putTime = wpi::Now();
+  m_impl->convertTime = 0;
   m_impl->images.push_back(image.release());
 }
 
@@ -53,8 +79,21 @@ Image* Frame::GetNearestImage(int width, int height) const {
   return m_impl->images.empty() ? nullptr : m_impl->images[0];
 }
 
+// Determine if a JPEG can be used for a requested quality (negative for the
+// default).  JPEGs we compressed ourselves must match it exactly; camera
+// JPEGs are used as-is unless a lower quality than their (estimated) quality
+// is requested.
+static bool IsJpegQuality(const Image& image, int jpegQuality) {
+  if (image.jpegQuality >= 0) {
+    return image.jpegQuality ==
+           (jpegQuality < 0 ? kDefaultJpegQuality : jpegQuality);
+  }
+  return jpegQuality < 0 || image.GetJpegQuality() <= jpegQuality;
+}
+
 Image* Frame::GetNearestImage(int width, int height,
-                              VideoMode::PixelFormat pixelFormat) const {
+                              VideoMode::PixelFormat pixelFormat,
+                              int jpegQuality) const {
   if (!m_impl) return nullptr;
   std::lock_guard<std::recursive_mutex> lock(m_impl->mutex);
   Image* found = nullptr;
@@ -67,9 +106,12 @@ Image* Frame::GetNearestImage(int width, int height,
   // image processing to come, so it's worth spending a little extra time
   // looking for the most efficient conversion.
 
-  // 1) Same width, height, and pixelFormat (e.g. exactly what we want)
+  // 1) Same width, height, and pixelFormat (e.g. exactly what we want).
+  //    JPEGs must also be of the requested quality (see IsJpegQuality).
   for (auto i : m_impl->images) {
-    if (i->Is(width, height, pixelFormat)) return i;
+    if (i->Is(width, height, pixelFormat) &&
+        (pixelFormat != VideoMode::kMJPEG || IsJpegQuality(*i, jpegQuality)))
+      return i;
   }
 
   // 2) Same width, height, different (but non-JPEG) pixelFormat (color conv)
@@ -212,6 +254,19 @@ Image* Frame::Convert(Image* image, VideoMode::PixelFormat pixelFormat,
       }
       break;
     case VideoMode::kYUYV:
+      // If source is RGB565 or Gray, need to convert to BGR first
+      if (cur->width % 2 != 0) return nullptr;  // pixels are in pairs
+      if (cur->pixelFormat != VideoMode::kBGR) {
+        // Check to see if BGR version already exists...
+        if (Image* newImage =
+                GetExistingImage(cur->width, cur->height, VideoMode::kBGR))
+          cur = newImage;
+        else if (cur->pixelFormat == VideoMode::kRGB565)
+          cur = ConvertRGB565ToBGR(cur);
+        else
+          cur = ConvertGrayToBGR(cur);
+      }
+      return ConvertBGRToYUYV(cur);
     default:
       return nullptr;  // Unsupported
   }
@@ -233,7 +288,7 @@ Image* Frame::ConvertMJPEGToBGR(Image* image) {
 
   // Decode
   cv::Mat newMat = newImage->AsMat();
-  cv::imdecode(image->AsInputArray(), cv::IMREAD_COLOR, &newMat);
+  DecodeJpeg(*image, cv::IMREAD_COLOR, newMat);
 
   // Save the result
   Image* rv = newImage.release();
@@ -254,7 +309,7 @@ Image* Frame::ConvertMJPEGToGray(Image* image) {
 
   // Decode
   cv::Mat newMat = newImage->AsMat();
-  cv::imdecode(image->AsInputArray(), cv::IMREAD_GRAYSCALE, &newMat);
+  DecodeJpeg(*image, cv::IMREAD_GRAYSCALE, newMat);
 
   // Save the result
   Image* rv = newImage.release();
@@ -325,6 +380,40 @@ Image* Frame::ConvertRGB565ToBGR(Image* image) {
   return rv;
 }
 
+Image* Frame::ConvertBGRToYUYV(Image* image) {
+  if (!image || image->pixelFormat != VideoMode::kBGR) return nullptr;
+
+  // Allocate a YUYV image
+  auto newImage =
+      m_impl->source.AllocImage(VideoMode::kYUYV, image->width, image->height,
+                                image->width * image->height * 2);
+
+  // Convert.  OpenCV only goes the other way, so do this by hand (BT.601,
+  // studio swing, as produced by cameras); chroma is averaged over each pair
+  // of pixels.
+  const uchar* src = reinterpret_cast<const uchar*>(image->data());
+  uchar* dst = reinterpret_cast<uchar*>(newImage->data());
+  for (int row = 0; row < image->height; ++row) {
+    for (int col = 0; col < image->width; col += 2, src += 6, dst += 4) {
+      int b0 = src[0], g0 = src[1], r0 = src[2];
+      int b1 = src[3], g1 = src[4], r1 = src[5];
+      int b = b0 + b1, g = g0 + g1, r = r0 + r1;
+      dst[0] = ((66 * r0 + 129 * g0 + 25 * b0 + 128) >> 8) + 16;
+      dst[1] = ((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128;
+      dst[2] = ((66 * r1 + 129 * g1 + 25 * b1 + 128) >> 8) + 16;
+      dst[3] = ((112 * r - 94 * g - 18 * b + 256) >> 9) + 128;
+    }
+  }
+
+  // Save the result
+  Image* rv = newImage.release();
+  if (m_impl) {
+    std::lock_guard<std::recursive_mutex> lock(m_impl->mutex);
+    m_impl->images.push_back(rv);
+  }
+  return rv;
+}
+
 Image* Frame::ConvertBGRToGray(Image* image) {
   if (!image || image->pixelFormat != VideoMode::kBGR) return nullptr;
 
@@ -346,7 +435,7 @@ Image* Frame::ConvertBGRToGray(Image* image) {
 }
 
 Image* Frame::ConvertGrayToBGR(Image* image) {
-  if (!image || image->pixelFormat != VideoMode::kBGR) return nullptr;
+  if (!image || image->pixelFormat != VideoMode::kGray) return nullptr;
 
   // Allocate a BGR image
   auto newImage =
@@ -389,6 +478,7 @@ Image* Frame::ConvertBGRToMJPEG(Image* image, int quality) {
   }
   cv::imencode(".jpg", image->AsMat(), newImage->vec(),
                m_impl->compressionParams);
+  newImage->jpegQuality = quality;
 
   // Save the result
   Image* rv = newImage.release();
@@ -420,6 +510,32 @@ Image* Frame::ConvertGrayToMJPEG(Image* image, int quality) {
   }
   cv::imencode(".jpg", image->AsMat(), newImage->vec(),
                m_impl->compressionParams);
+  newImage->jpegQuality = quality;
+
+  // Save the result
+  Image* rv = newImage.release();
+  m_impl->images.push_back(rv);
+  return rv;
+}
+
+Image* Frame::ConvertMJPEGToMJPEG(Image* image, int width, int height,
+                                  int quality) {
+  if (!image || image->pixelFormat != VideoMode::kMJPEG) return nullptr;
+  if (!m_impl) return nullptr;
+  std::lock_guard<std::recursive_mutex> lock(m_impl->mutex);
+
+  // Allocate a JPEG image.  The result has the same or fewer coefficients
+  // at the same or a coarser quantization, so it's normally no larger.
+  auto newImage = m_impl->source.AllocImage(VideoMode::kMJPEG, width, height,
+                                            image->size());
+
+  // Transcode
+  if (!m_impl->transcoder.Transcode(*image, width, height, quality,
+                                    newImage.get())) {
+    m_impl->source.ReleaseImage(std::move(newImage));
+    return nullptr;
+  }
+  newImage->jpegQuality = std::min(std::max(quality, 1), 100);
 
   // Save the result
   Image* rv = newImage.release();
@@ -431,19 +547,53 @@ Image* Frame::GetImage(int width, int height,
                        VideoMode::PixelFormat pixelFormat, int jpegQuality) {
   if (!m_impl) return nullptr;
   std::lock_guard<std::recursive_mutex> lock(m_impl->mutex);
-  Image* cur = GetNearestImage(width, height, pixelFormat);
-  if (!cur || cur->Is(width, height, pixelFormat)) return cur;
+  Image* cur = GetNearestImage(width, height, pixelFormat, jpegQuality);
+  if (!cur) return cur;
+  // JPEGs of the right size can still have the wrong quality
+  if (cur->Is(width, height, pixelFormat) &&
+      (pixelFormat != VideoMode::kMJPEG || IsJpegQuality(*cur, jpegQuality)))
+    return cur;
+  Image* orig = cur;
+  if (jpegQuality < 0) jpegQuality = kDefaultJpegQuality;
 
   DEBUG4("converting image from "
          << cur->width << "x" << cur->height << " type " << cur->pixelFormat
          << " to " << width << "x" << height << " type " << pixelFormat);
 
+  // JPEG to a lower quality and/or half or quarter size JPEG: transcode in
+  // the DCT domain rather than decoding and compressing again.  This is
+  // also cheaper than compressing an existing BGR image.
+  if (pixelFormat == VideoMode::kMJPEG) {
+    for (auto i : m_impl->images) {
+      if (i->pixelFormat != VideoMode::kMJPEG) continue;
+      // At the same size, only requantize to a lower quality
+      if (i->Is(width, height)) {
+        int quality = i->GetJpegQuality();
+        if (quality < 0 || jpegQuality >= quality) continue;
+      }
+      if (Image* newImage =
+              ConvertMJPEGToMJPEG(i, width, height, jpegQuality)) {
+        m_impl->convertTime = wpi::Now();
+        return newImage;
+      }
+    }
+  }
+
   // If the source image is a JPEG, we need to decode it before we can do
   // anything else with it.  Note that if the destination format is JPEG, we
   // still need to do this (unless the width/height were the same, in which
   // case we already returned the existing JPEG above).
   if (cur->pixelFormat == VideoMode::kMJPEG) cur = ConvertMJPEGToBGR(cur);
 
+  // YUYV can't be resampled directly as chroma is shared between pixels
+  if (cur->pixelFormat == VideoMode::kYUYV && !cur->Is(width, height)) {
+    if (Image* newImage =
+            GetExistingImage(cur->width, cur->height, VideoMode::kBGR))
+      cur = newImage;
+    else
+      cur = ConvertYUYVToBGR(cur);
+  }
+
   // Resize
   if (!cur->Is(width, height)) {
     // Allocate an image.
@@ -461,7 +611,9 @@ Image* Frame::GetImage(int width, int height,
   }
 
   // Convert to output format
-  return Convert(cur, pixelFormat, jpegQuality);
+  cur = Convert(cur, pixelFormat, jpegQuality);
+  if (cur && cur != orig) m_impl->convertTime = wpi::Now();
+  return cur;
 }
 
 bool Frame::GetCv(cv::Mat& image, int width, int height) {
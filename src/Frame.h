@@ -16,6 +16,7 @@
 
 #include "cscore_cpp.h"
 #include "Image.h"
+#include "JpegTranscoder.h"
 
 namespace cs {
 
@@ -34,10 +35,13 @@ class Frame {
     std::recursive_mutex mutex;
     std::atomic_int refcount{0};
     Time time{0};
+    Time putTime{0};      // when the source handed the frame to its sinks
+    Time convertTime{0};  // when the most recent conversion finished
     SourceImpl& source;
     std::string error;
     llvm::SmallVector<Image*, 4> images;
     std::vector<int> compressionParams;
+    JpegTranscoder transcoder;
   };
 
  public:
@@ -69,6 +73,16 @@ class Frame {
 
   Time GetTime() const { return m_impl ? m_impl->time : 0; }
 
+  // Per-stage timestamps (same units as GetTime()), used to attribute
+  // latency between capture and a sink sending the frame.  The convert time
+  // is 0 if no sink has needed a conversion.
+  Time GetPutTime() const { return m_impl ? m_impl->putTime : 0; }
+  Time GetConvertTime() const {
+    if (!m_impl) return 0;
+    std::lock_guard<std::recursive_mutex> lock(m_impl->mutex);
+    return m_impl->convertTime;
+  }
+
   llvm::StringRef GetError() const {
     if (!m_impl) return llvm::StringRef{};
     return m_impl->error;
@@ -123,7 +137,8 @@ class Frame {
 
   Image* GetNearestImage(int width, int height) const;
   Image* GetNearestImage(int width, int height,
-                         VideoMode::PixelFormat pixelFormat) const;
+                         VideoMode::PixelFormat pixelFormat,
+                         int jpegQuality = -1) const;
 
   Image* Convert(Image* image, VideoMode::PixelFormat pixelFormat,
                  int jpegQuality = 80);
@@ -132,13 +147,20 @@ class Frame {
   Image* ConvertYUYVToBGR(Image* image);
   Image* ConvertBGRToRGB565(Image* image);
   Image* ConvertRGB565ToBGR(Image* image);
+  Image* ConvertBGRToYUYV(Image* image);
   Image* ConvertBGRToGray(Image* image);
   Image* ConvertGrayToBGR(Image* image);
   Image* ConvertBGRToMJPEG(Image* image, int quality);
   Image* ConvertGrayToMJPEG(Image* image, int quality);
+  Image* ConvertMJPEGToMJPEG(Image* image, int width, int height,
+                             int quality);
 
+  // Get an image of the given size and format, converting if required.
+  // @param jpegQuality Quality of JPEG images: JPEGs of a higher quality
+  //     (including camera images) are requantized to it.  If negative, camera
+  //     JPEGs are used as-is and others are compressed at a default quality.
   Image* GetImage(int width, int height, VideoMode::PixelFormat pixelFormat,
-                  int jpegQuality = 80);
+                  int jpegQuality = -1);
 
   bool GetCv(cv::Mat& image) {
     return GetCv(image, GetOriginalWidth(), GetOriginalHeight());
@@ -7,7 +7,15 @@
 
 #include "Handle.h"
 
+#include "SourceImpl.h"
+
 using namespace cs;
 
 ATOMIC_STATIC_INIT(Sources)
 ATOMIC_STATIC_INIT(Sinks)
+
+std::pair<CS_Source, std::shared_ptr<SourceData>> Sources::FindByName(
+    llvm::StringRef name) {
+  return FindIf(
+      [&](const SourceData& data) { return data.source->GetName() == name; });
+}
@@ -93,6 +93,9 @@ class Sources
         [&](const SourceData& data) { return data.source.get() == &source; });
   }
 
+  std::pair<CS_Source, std::shared_ptr<SourceData>> FindByName(
+      llvm::StringRef name);
+
  private:
   Sources() = default;
 
@@ -7,147 +7,382 @@
 
 #include "HttpCameraImpl.h"
 
+#include <algorithm>
+
 #include "llvm/STLExtras.h"
 #include "support/timestamp.h"
-#include "tcpsockets/TCPConnector.h"
 
+#include "AsyncHttpConnection.h"
 #include "c_util.h"
 #include "Handle.h"
 #include "JpegUtil.h"
 #include "Log.h"
+#include "MjpegStreamParser.h"
 #include "Notifier.h"
 
 using namespace cs;
 
+// Time allowed to connect, and without receiving data once connected
+static const double kTimeout = 1.0;
+
+// Maximum number of pipelined settings requests; further changes are
+// coalesced until a response arrives
+static const std::size_t kMaxSettingsInFlight = 2;
+
+// Delay between stream connection attempts; doubles after each failure
+static const double kRetryDelay = 0.25;
+static const double kMaxRetryDelay = 4.0;
+
+// How long sinks must need less before the stream is reduced to match, so
+// clients coming and going don't cause constant reconnects
+static const double kReduceDelay = 5.0;
+
+// Resolutions supported by Axis cameras, largest first
+static const struct {
+  int width;
+  int height;
+} kAxisResolutions[] = {{640, 480}, {480, 360}, {320, 240},
+                        {240, 180}, {176, 144}, {160, 120}};
+
+// Polling rate for cameras that only serve single images, if the video mode
+// doesn't set one
+static const int kDefaultPollFps = 30;
+
+// Polling requests in flight: the current one, and one ahead of it
+static const std::size_t kMaxPollsInFlight = 2;
+
+class HttpCameraImpl::StreamConnection : public AsyncHttpConnection {
+ public:
+  StreamConnection(HttpCameraImpl& camera, std::size_t location)
+      : AsyncHttpConnection{camera.GetName()},
+        m_camera(camera),
+        m_location{location} {}
+
+ protected:
+  bool OnResponse(const HttpParser& response) override {
+    return m_camera.StreamResponse(m_location, response);
+  }
+  llvm::MutableArrayRef<char> GetBodyBuffer() override {
+    return m_camera.StreamBuffer();
+  }
+  bool OnBody(std::size_t len) override { return m_camera.StreamBody(len); }
+  void OnResponseDone() override { m_camera.StreamResponseDone(); }
+  void OnClosed() override { m_camera.StreamClosed(m_location); }
+
+ private:
+  HttpCameraImpl& m_camera;
+  std::size_t m_location;
+};
+
+// Settings are sent via GET parameters, so only the response status matters
+// and the body is discarded.  The connection is kept alive between requests.
+class HttpCameraImpl::SettingsConnection : public AsyncHttpConnection {
+ public:
+  explicit SettingsConnection(HttpCameraImpl& camera)
+      : AsyncHttpConnection{camera.GetName()}, m_camera(camera) {}
+
+ protected:
+  bool OnResponse(const HttpParser& response) override { return true; }
+  llvm::MutableArrayRef<char> GetBodyBuffer() override { return m_discard; }
+  bool OnBody(std::size_t len) override { return true; }
+  void OnResponseDone() override { m_camera.SettingsDone(); }
+  void OnClosed() override { m_camera.SettingsClosed(); }
+
+ private:
+  HttpCameraImpl& m_camera;
+  char m_discard[1024];
+};
+
 HttpCameraImpl::HttpCameraImpl(llvm::StringRef name, CS_HttpCameraKind kind)
-    : SourceImpl{name}, m_kind{kind} {}
+    : SourceImpl{name},
+      m_settingsConn{llvm::make_unique<SettingsConnection>(*this)},
+      m_kind{kind} {}
 
 HttpCameraImpl::~HttpCameraImpl() {
-  m_active = false;
+  if (HttpReactor::destroyed()) return;
 
-  // Close file if it's open
-  {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_streamConn) m_streamConn->stream->close();
-    if (m_settingsConn) m_settingsConn->stream->close();
-  }
+  // Close the connections on the reactor thread.  This also waits for any
+  // functions we've already posted to it.
+  auto& reactor = HttpReactor::GetInstance();
+  reactor.Call([&] {
+    if (m_retryTimer != 0) reactor.CancelTimer(m_retryTimer);
+    if (m_pollTimer != 0) reactor.CancelTimer(m_pollTimer);
+    if (m_reduceTimer != 0) reactor.CancelTimer(m_reduceTimer);
+    m_streamConns.clear();
+    m_settingsConn.reset();
+    m_parser.reset();
+  });
+}
 
-  // force wakeup of camera thread in case it's waiting on cv
-  m_sinkEnabledCond.notify_one();
+void HttpCameraImpl::Start() {
+  // Kick off the stream and settings connections
+  HttpReactor::GetInstance().Post([=] {
+    UpdateStream();
+    SendSettings();
+  });
+}
 
-  // join camera thread
-  if (m_streamThread.joinable()) m_streamThread.join();
+void HttpCameraImpl::UpdateStream() {
+  auto& reactor = HttpReactor::GetInstance();
 
-  // force wakeup of settings thread
-  m_settingsCond.notify_one();
+  // disconnect if no one is listening
+  if (m_numSinksEnabled == 0) {
+    if (m_retryTimer != 0) {
+      reactor.CancelTimer(m_retryTimer);
+      m_retryTimer = 0;
+    }
+    for (auto& conn : m_streamConns) conn->Close();
+    if (m_streamLocation != -1) ResetStream();
+    return;
+  }
 
-  // join settings thread
-  if (m_settingsThread.joinable()) m_settingsThread.join();
-}
+  // Match the stream to what the sinks need; reconnect if it changed
+  if (NegotiateStream() && m_streamLocation != -1) {
+    StopStream();
+    return;
+  }
 
-void HttpCameraImpl::Start() {
-  // Kick off the stream and settings threads
-  m_streamThread = std::thread(&HttpCameraImpl::StreamThreadMain, this);
-  m_settingsThread = std::thread(&HttpCameraImpl::SettingsThreadMain, this);
-}
+  // already streaming, connecting, or waiting to retry (or to poll again)
+  if (m_retryTimer != 0 || m_streamLocation != -1) return;
+  for (auto& conn : m_streamConns) {
+    if (conn->IsOpen()) return;
+  }
 
-#ifndef _WIN32
-static inline void DoFdSet(int fd, fd_set* set, int* nfds) {
-  if (fd >= 0) {
-    FD_SET(fd, set);
-    if ((fd + 1) > *nfds) *nfds = fd + 1;
+  // Build the requests
+  m_streamRequests.clear();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& location : m_locations)
+      m_streamRequests.emplace_back(location, m_streamSettings);
+    m_streamGeneration = m_locationsGeneration;
+    m_streamSettingsUpdated = false;
   }
+  if (m_streamRequests.empty()) {
+    SERROR("locations array is empty!?");
+    RetryStream();
+    return;
+  }
+
+  // Try all the locations at once; the first to respond wins
+  std::size_t count = m_streamRequests.size();
+  while (m_streamConns.size() < count)
+    m_streamConns.emplace_back(
+        llvm::make_unique<StreamConnection>(*this, m_streamConns.size()));
+  m_streamConns.resize(count);
+  m_streamStartTime = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < count; ++i)
+    m_streamConns[i]->Start(m_streamRequests[i], kTimeout);
+}
+
+// Drop the stream and any connection attempts (which may be to old URLs),
+// and connect again straight away.
+void HttpCameraImpl::RestartStream() {
+  if (m_retryTimer != 0) {
+    HttpReactor::GetInstance().CancelTimer(m_retryTimer);
+    m_retryTimer = 0;
+  }
+  for (auto& conn : m_streamConns) conn->Close();
+  if (m_streamLocation != -1) ResetStream();
+  m_retryDelay = kRetryDelay;
+  UpdateStream();
 }
-#endif
 
-void HttpCameraImpl::StreamThreadMain() {
-  while (m_active) {
-    SetConnected(false);
+// Returns whether a needs more than b (0 is more than anything)
+static bool Exceeds(int a, int b) { return b != 0 && (a == 0 || a > b); }
 
-    // sleep between retries
-    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+// Returns the smaller of a and b (0 is more than anything)
+static int Smaller(int a, int b) { return Exceeds(a, b) ? b : a; }
 
-    // disconnect if no one is listening
-    if (m_numSinksEnabled == 0) {
-      std::unique_lock<std::mutex> lock(m_mutex);
-      if (m_streamConn) m_streamConn->stream->close();
-      // Wait for a sink to enable
-      m_sinkEnabledCond.wait(
-          lock, [=] { return !m_active || m_numSinksEnabled != 0; });
-      if (!m_active) return;
-    }
+bool HttpCameraImpl::NegotiateStream() {
+  // Only Axis cameras take resolution and fps stream parameters
+  if (m_kind != CS_HTTP_AXIS) return false;
 
-    // connect
-    llvm::SmallString<64> boundary;
-    HttpConnection* conn = DeviceStreamConnect(boundary);
-
-    if (!m_active) break;
+  // The most the sinks need, limited to the configured video mode
+  VideoMode demand = GetSinkDemand();
+  VideoMode want;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    want.width = Smaller(demand.width, m_mode.width);
+    want.height = Smaller(demand.height, m_mode.height);
+    want.fps = Smaller(demand.fps, m_mode.fps);
+  }
 
-    // keep retrying
-    if (!conn) continue;
+  // Round up to the smallest of the camera's resolutions with exactly the
+  // same aspect ratio.  If there's none (including when the sinks need more
+  // than the camera lists), leave the resolution to the camera rather than
+  // clamp or stretch the picture.
+  if (want.width != 0 && want.height != 0) {
+    CS_Status status = 0;
+    const VideoMode* best = nullptr;
+    auto modes = EnumerateVideoModes(&status);
+    for (const auto& mode : modes) {
+      if (mode.pixelFormat != VideoMode::kMJPEG ||
+          mode.width * want.height != want.width * mode.height ||
+          mode.width < want.width || mode.height < want.height)
+        continue;
+      if (!best || mode.width < best->width) best = &mode;
+    }
+    want.width = best ? best->width : 0;
+    want.height = best ? best->height : 0;
+  } else {
+    want.width = 0;
+    want.height = 0;
+  }
 
-    // update connected since we're actually connected
-    SetConnected(true);
+  auto& reactor = HttpReactor::GetInstance();
+  bool more = Exceeds(want.width, m_negotiated.width) ||
+              Exceeds(want.height, m_negotiated.height) ||
+              Exceeds(want.fps, m_negotiated.fps);
+  bool same = want.width == m_negotiated.width &&
+              want.height == m_negotiated.height &&
+              want.fps == m_negotiated.fps;
+  if (more || same) {
+    if (m_reduceTimer != 0) {
+      reactor.CancelTimer(m_reduceTimer);
+      m_reduceTimer = 0;
+    }
+    m_reduceDue = false;
+    if (same) return false;
+  } else if (!m_reduceDue && m_streamLocation != -1) {
+    // Only reduce (and reconnect) once sinks have needed less for a while
+    if (m_reduceTimer == 0) {
+      m_reduceTimer = reactor.AddTimer(kReduceDelay, [=] {
+        m_reduceTimer = 0;
+        m_reduceDue = true;
+        UpdateStream();
+      });
+    }
+    return false;
+  }
+  m_reduceDue = false;
 
-    // stream
-    DeviceStream(conn->is, boundary);
+  m_negotiated = want;
+  SDEBUG("requesting " << want.width << 'x' << want.height << " at "
+                       << want.fps << " fps to match sinks");
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (want.width != 0) {
+    llvm::SmallString<16> str;
+    llvm::raw_svector_ostream oss{str};
+    oss << want.width << 'x' << want.height;
+    m_streamSettings["resolution"] = oss.str();
+  } else {
+    m_streamSettings.erase("resolution");
+  }
+  if (want.fps != 0) {
+    llvm::SmallString<16> str;
+    llvm::raw_svector_ostream oss{str};
+    oss << want.fps;
+    m_streamSettings["fps"] = oss.str();
+  } else {
+    m_streamSettings.erase("fps");
   }
+  m_streamSettingsUpdated = true;
+  return true;
+}
 
-  SDEBUG("Camera Thread exiting");
+void HttpCameraImpl::RetryStream() {
+  m_retryTimer = HttpReactor::GetInstance().AddTimer(m_retryDelay, [=] {
+    m_retryTimer = 0;
+    UpdateStream();
+  });
+  m_retryDelay = std::min(m_retryDelay * 2, kMaxRetryDelay);
+}
+
+void HttpCameraImpl::ResetStream() {
+  m_streamLocation = -1;
+  m_parser.reset();
+  m_polling = false;
+  m_pollImage.reset();
+  m_pollAnswered = false;
+  m_pollSent.clear();
+  if (m_pollTimer != 0) {
+    HttpReactor::GetInstance().CancelTimer(m_pollTimer);
+    m_pollTimer = 0;
+  }
   SetConnected(false);
 }
 
-HttpConnection* HttpCameraImpl::DeviceStreamConnect(
-    llvm::SmallVectorImpl<char>& boundary) {
-  // Build the request
-  HttpRequest req;
-  {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_locations.empty()) {
-      SERROR("locations array is empty!?");
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      return nullptr;
+void HttpCameraImpl::StopStream() {
+  m_streamConns[m_streamLocation]->Close();
+  ResetStream();
+  RetryStream();
+}
+
+void HttpCameraImpl::StreamClosed(std::size_t location) {
+  if (static_cast<int>(location) == m_streamLocation) {
+    // When polling, the camera may close the connection after each image
+    // (HTTP/1.0 or "Connection: close"); that's not an error, so just
+    // connect again for the next one.  Any pipelined requests are lost.
+    if (m_polling && m_pollAnswered && !m_pollImage) {
+      m_pollSent.clear();
+      SchedulePoll();
+      return;
+    }
+    ResetStream();
+  } else {
+    // wait for the rest of the attempts
+    for (auto& conn : m_streamConns) {
+      if (conn->IsOpen()) return;
     }
-    if (m_nextLocation >= m_locations.size()) m_nextLocation = 0;
-    req = HttpRequest{m_locations[m_nextLocation++], m_streamSettings};
-    m_streamSettingsUpdated = false;
   }
 
-  // Try to connect
-  auto stream = wpi::TCPConnector::connect(req.host.c_str(), req.port,
-                                           Logger::GetInstance(), 1);
-
-  if (!m_active || !stream) return nullptr;
-
-  auto connPtr = llvm::make_unique<HttpConnection>(std::move(stream), 1);
-  HttpConnection* conn = connPtr.get();
+  // wait a bit before reconnecting
+  RetryStream();
+}
 
-  // update m_streamConn
+void HttpCameraImpl::WinStream(std::size_t location) {
+  // Drop the other attempts and remember the location for settings
+  for (auto& conn : m_streamConns) {
+    if (conn.get() != m_streamConns[location].get()) conn->Close();
+  }
+  m_streamLocation = location;
   {
+    // Unless the URLs have changed since the connections were started
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_streamConn = std::move(connPtr);
+    if (m_streamGeneration == m_locationsGeneration &&
+        location < m_locations.size())
+      m_prefLocation = location;
   }
+  SendSettings();  // any waiting for a location
 
-  if (!conn->Handshake(req, GetName())) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_streamConn = nullptr;
-    return nullptr;
-  }
+  m_numErrors = 0;
+
+  // update connected since we're actually connected
+  SetConnected(true);
+}
+
+bool HttpCameraImpl::StreamResponse(std::size_t location,
+                                    const HttpParser& response) {
+  // Each polled image is a separate response
+  if (m_polling) return StartSnapshot(location, response);
 
   // Parse Content-Type header to get the boundary
   llvm::StringRef mediaType, contentType;
-  std::tie(mediaType, contentType) = conn->contentType.str().split(';');
+  std::tie(mediaType, contentType) =
+      response.GetHeader("Content-Type").split(';');
   mediaType = mediaType.trim();
+  if (mediaType == "image/jpeg") {
+    // A single image (e.g. /jpg/image.jpg), so we need to poll
+    if (!StartSnapshot(location, response)) return false;
+    WinStream(location);
+    m_polling = true;
+    auto now = std::chrono::steady_clock::now();
+    m_pollSent.push_back(m_streamStartTime);
+    m_pollNext = now;
+    m_pollStatsStart = now;
+    m_pollFrames = 0;
+    m_pollRttSum = 0;
+    SchedulePoll();  // get the next request going
+    return true;
+  }
   if (mediaType != "multipart/x-mixed-replace") {
-    SWARNING("\"" << req.host << "\": unrecognized Content-Type \"" << mediaType
-                  << "\"");
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_streamConn = nullptr;
-    return nullptr;
+    SWARNING("\"" << m_streamConns[location]->GetHost()
+                  << "\": unrecognized Content-Type \"" << mediaType << "\"");
+    return false;
   }
 
   // media parameters
-  boundary.clear();
+  llvm::SmallString<64> boundary;
   while (!contentType.empty()) {
     llvm::StringRef keyvalue;
     std::tie(keyvalue, contentType) = contentType.split(';');
@@ -161,137 +396,208 @@ HttpConnection* HttpCameraImpl::DeviceStreamConnect(
   }
 
   if (boundary.empty()) {
-    SWARNING("\"" << req.host
+    SWARNING("\"" << m_streamConns[location]->GetHost()
                   << "\": empty multi-part boundary or no Content-Type");
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_streamConn = nullptr;
-    return nullptr;
+    return false;
   }
 
-  return conn;
+  WinStream(location);
+  m_parser = llvm::make_unique<MjpegStreamParser>(*this, boundary);
+  return true;
 }
 
-void HttpCameraImpl::DeviceStream(wpi::raw_istream& is,
-                                  llvm::StringRef boundary) {
-  // Stored here so we reuse it from frame to frame
-  std::string imageBuf;
-
-  // keep track of number of bad images received; if we receive 3 bad images
-  // in a row, we reconnect
-  int numErrors = 0;
+bool HttpCameraImpl::StartSnapshot(std::size_t location,
+                                   const HttpParser& response) {
+  // Without a length we couldn't keep the connection open between images
+  long long len = response.GetContentLength();
+  if (len < 0) {
+    SWARNING("\"" << m_streamConns[location]->GetHost()
+                  << "\": image without Content-Length; can't poll");
+    return false;
+  }
 
-  // streaming loop
-  while (m_active && !is.has_error() && m_numSinksEnabled > 0 &&
-         numErrors < 3 && !m_streamSettingsUpdated) {
-    if (!FindMultipartBoundary(is, boundary, nullptr)) break;
+  // Receive directly into a pooled image
+  m_pollKeepAlive = response.ShouldKeepAlive();
+  m_pollImage = AllocImage(VideoMode::kMJPEG, 0, 0, len);
+  m_pollImagePos = 0;
+  return true;
+}
 
-    // Read the next two characters after the boundary (normally \r\n)
-    char eol[2];
-    is.read(eol, 2);
-    if (!m_active || is.has_error()) break;
-    // End-of-stream is indicated with trailing --
-    if (eol[0] == '-' && eol[1] == '-') break;
+void HttpCameraImpl::SchedulePoll() {
+  if (m_pollTimer != 0 || m_pollSent.size() >= kMaxPollsInFlight) return;
 
-    if (!DeviceStreamFrame(is, imageBuf))
-      ++numErrors;
-    else
-      numErrors = 0;
-  }
-}
+  // If the camera closes the connection after each image, wait for that
+  // rather than pipelining a request that would be lost
+  auto& conn = m_streamConns[m_streamLocation];
+  if (!m_pollKeepAlive && conn->IsOpen()) return;
 
-bool HttpCameraImpl::DeviceStreamFrame(wpi::raw_istream& is,
-                                       std::string& imageBuf) {
-  // Read the headers
-  llvm::SmallString<64> contentTypeBuf;
-  llvm::SmallString<64> contentLengthBuf;
-  if (!ParseHttpHeaders(is, &contentTypeBuf, &contentLengthBuf)) {
-    SWARNING("disconnected during headers");
-    PutError("disconnected during headers", wpi::Now());
-    return false;
+  auto now = std::chrono::steady_clock::now();
+  if (m_pollNext > now) {
+    m_pollTimer = HttpReactor::GetInstance().AddTimer(
+        std::chrono::duration<double>(m_pollNext - now).count(), [=] {
+          m_pollTimer = 0;
+          SchedulePoll();
+        });
+    return;
   }
 
-  // Check the content type (if present)
-  if (!contentTypeBuf.str().empty() &&
-      !contentTypeBuf.str().startswith("image/jpeg")) {
-    llvm::SmallString<64> errBuf;
-    llvm::raw_svector_ostream errMsg{errBuf};
-    errMsg << "received unknown Content-Type \"" << contentTypeBuf << "\"";
-    SWARNING(errMsg.str());
-    PutError(errMsg.str(), wpi::Now());
-    return false;
+  int fps;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fps = m_mode.fps > 0 ? m_mode.fps : kDefaultPollFps;
   }
-
-  unsigned int contentLength = 0;
-  if (contentLengthBuf.str().getAsInteger(10, contentLength)) {
-    // Ugh, no Content-Length?  Read the blocks of the JPEG file.
-    int width, height;
-    if (!ReadJpeg(is, imageBuf, &width, &height)) {
-      SWARNING("did not receive a JPEG image");
-      PutError("did not receive a JPEG image", wpi::Now());
-      return false;
-    }
-    PutFrame(VideoMode::PixelFormat::kMJPEG, width, height, imageBuf,
-             wpi::Now());
-    return true;
+  m_pollNext += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / fps));
+  if (m_pollNext < now) m_pollNext = now;  // don't try to catch up
+
+  // Pipelined on the connection, behind the request in progress, or on a
+  // new connection if the camera closed the last one
+  const auto& req = m_streamRequests[m_streamLocation];
+  if (!conn->Send(req)) {
+    m_pollAnswered = false;
+    conn->Start(req, kTimeout);
   }
- 
-  // We know how big it is!  Just get a frame of the right size and read
-  // the data directly into it.
-  auto image = AllocImage(VideoMode::PixelFormat::kMJPEG, 0, 0, contentLength);
-  is.read(image->data(), contentLength);
-  if (!m_active || is.has_error()) return false;
-  int width, height;
-  if (!GetJpegSize(image->str(), &width, &height)) {
+  m_pollSent.push_back(now);
+  SchedulePoll();
+}
+
+void HttpCameraImpl::StreamResponseDone() {
+  if (!m_polling) return;
+
+  auto now = std::chrono::steady_clock::now();
+  m_pollRttSum +=
+      std::chrono::duration<double>(now - m_pollSent.front()).count();
+  m_pollSent.pop_front();
+  m_pollAnswered = true;
+
+  if (const JpegInfo* info = m_pollImage->GetJpegInfo()) {
+    m_pollImage->width = info->width;
+    m_pollImage->height = info->height;
+    PutFrame(std::move(m_pollImage), wpi::Now());
+    m_numErrors = 0;
+    m_retryDelay = kRetryDelay;
+  } else {
+    m_pollImage.reset();
     SWARNING("did not receive a JPEG image");
     PutError("did not receive a JPEG image", wpi::Now());
-    return false;
+    // if we receive 3 bad images in a row, we reconnect
+    if (++m_numErrors >= 3) {
+      StopStream();
+      return;
+    }
+  }
+  ++m_pollFrames;
+
+  double elapsed =
+      std::chrono::duration<double>(now - m_pollStatsStart).count();
+  if (elapsed >= 1.0) {
+    SDEBUG("polling at " << (m_pollFrames / elapsed) << " fps, round trip "
+                         << (m_pollRttSum * 1000 / m_pollFrames) << " ms");
+    m_pollStatsStart = now;
+    m_pollFrames = 0;
+    m_pollRttSum = 0;
   }
-  image->width = width;
-  image->height = height;
-  PutFrame(std::move(image), wpi::Now());
-  return true;
-}
 
-void HttpCameraImpl::SettingsThreadMain() {
-  for (;;) {
-    HttpRequest req;
-    {
-      std::unique_lock<std::mutex> lock(m_mutex);
-      m_settingsCond.wait(lock, [=] {
-        return !m_active || (m_prefLocation != -1 && !m_settings.empty());
-      });
-      if (!m_active) break;
+  // reconnect with the new settings, or disconnect if no one is listening
+  if (m_numSinksEnabled == 0 || m_streamSettingsUpdated) {
+    StopStream();
+    return;
+  }
 
-      // Build the request
-      req = HttpRequest{m_locations[m_prefLocation], m_settings};
-    }
+  SchedulePoll();
+}
+
+llvm::MutableArrayRef<char> HttpCameraImpl::StreamBuffer() {
+  if (m_polling)
+    return llvm::MutableArrayRef<char>(m_pollImage->data() + m_pollImagePos,
+                                       m_pollImage->size() - m_pollImagePos);
+  return m_parser->GetBuffer();
+}
 
-    DeviceSendSettings(req);
+bool HttpCameraImpl::StreamBody(std::size_t len) {
+  if (m_polling) {
+    m_pollImagePos += len;
+    return true;
   }
 
-  SDEBUG("Settings Thread exiting");
-}
+  m_parser->Commit(len);
 
-void HttpCameraImpl::DeviceSendSettings(HttpRequest& req) {
-  // Try to connect
-  auto stream = wpi::TCPConnector::connect(req.host.c_str(), req.port,
-                                           Logger::GetInstance(), 1);
+  for (;;) {
+    auto result = m_parser->Process();
+    if (result == MjpegStreamParser::kNeedData) break;
+    if (result == MjpegStreamParser::kEnd) return false;
+    if (result == MjpegStreamParser::kFrame) {
+      PutFrame(m_parser->TakeImage(), wpi::Now());
+      m_numErrors = 0;
+      m_retryDelay = kRetryDelay;
+    } else {
+      SWARNING(m_parser->GetError());
+      PutError(m_parser->GetError(), wpi::Now());
+      // if we receive 3 bad images in a row, we reconnect
+      if (++m_numErrors >= 3) return false;
+    }
+  }
 
-  if (!m_active || !stream) return;
+  // reconnect with the new settings, or disconnect if no one is listening
+  return m_numSinksEnabled > 0 && !m_streamSettingsUpdated;
+}
 
-  auto connPtr = llvm::make_unique<HttpConnection>(std::move(stream), 1);
-  HttpConnection* conn = connPtr.get();
+void HttpCameraImpl::SendSettings() {
+  // Limit the requests in flight so rapid changes (e.g. dragging a slider)
+  // are coalesced in m_settings, where only the latest value is kept.
+  if (m_settingsInFlight.size() >= kMaxSettingsInFlight) return;
 
-  // update m_settingsConn
+  HttpRequest req;
+  llvm::StringMap<llvm::SmallString<16>> params;
   {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_settingsConn = std::move(connPtr);
+    if (m_prefLocation < 0 ||
+        static_cast<std::size_t>(m_prefLocation) >= m_locations.size() ||
+        m_settings.empty())
+      return;
+
+    // Build the request
+    req = HttpRequest{m_locations[m_prefLocation], m_settings};
+    params.swap(m_settings);
   }
 
-  // Just need a handshake as settings are sent via GET parameters
-  conn->Handshake(req, GetName());
+  // Reconnect if the preferred location has changed
+  if (m_settingsConn->IsOpen() && (m_settingsConn->GetHost() != req.host ||
+                                   m_settingsConn->GetPort() != req.port)) {
+    m_settingsConn->Close();
+    m_settingsInFlight.clear();
+  }
 
-  conn->stream->close();
+  // Pipeline on the open connection, or open a new one
+  if (!m_settingsConn->Send(req)) {
+    m_settingsInFlight.clear();
+    m_settingsAnswered = false;
+    m_settingsConn->Start(req, kTimeout);
+  }
+  m_settingsInFlight.emplace_back(std::move(params));
+}
+
+void HttpCameraImpl::SettingsDone() {
+  m_settingsInFlight.pop_front();
+  m_settingsAnswered = true;
+  SendSettings();
+}
+
+void HttpCameraImpl::SettingsClosed() {
+  // If the camera closed the connection after answering earlier requests,
+  // resend the unanswered ones on a new connection (unless superseded).
+  // Otherwise the error has already been logged and they're dropped.
+  if (m_settingsAnswered && !m_settingsInFlight.empty()) {
+    // newest first, as insert() doesn't replace
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto i = m_settingsInFlight.rbegin(); i != m_settingsInFlight.rend();
+         ++i) {
+      for (const auto& param : *i)
+        m_settings.insert(std::make_pair(param.getKey(), param.getValue()));
+    }
+  }
+  m_settingsInFlight.clear();
+  SendSettings();
 }
 
 CS_HttpCameraKind HttpCameraImpl::GetKind() const {
@@ -311,9 +617,16 @@ bool HttpCameraImpl::SetUrls(llvm::ArrayRef<std::string> urls,
     }
   }
 
-  std::lock_guard<std::mutex> lock(m_mutex);
-  m_locations.swap(locations);
-  m_nextLocation = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_locations.swap(locations);
+    ++m_locationsGeneration;
+    m_prefLocation = -1;
+  }
+
+  // Reconnect to the new locations
+  if (!HttpReactor::destroyed())
+    HttpReactor::GetInstance().Post([=] { RestartStream(); });
   return true;
 }
 
@@ -379,12 +692,71 @@ bool HttpCameraImpl::CacheProperties(CS_Status* status) const {
 }
 
 void HttpCameraImpl::SetProperty(int property, int value, CS_Status* status) {
-  // TODO
+  bool viaSettings;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto prop = static_cast<PropertyData*>(GetProperty(property));
+    if (!prop) {
+      *status = CS_INVALID_PROPERTY;
+      return;
+    }
+    if ((prop->propKind & (CS_PROP_BOOLEAN | CS_PROP_INTEGER | CS_PROP_ENUM)) ==
+        0) {
+      *status = CS_WRONG_PROPERTY_TYPE;
+      return;
+    }
+
+    // Enums are sent as the choice name
+    llvm::SmallString<16> str;
+    if (prop->propKind == CS_PROP_ENUM && value >= 0 &&
+        static_cast<std::size_t>(value) < prop->enumChoices.size()) {
+      str = prop->enumChoices[value];
+    } else {
+      llvm::raw_svector_ostream oss{str};
+      oss << value;
+    }
+    viaSettings = QueueSetting(*prop, str);
+
+    UpdatePropertyValue(property, false, value, llvm::StringRef{});
+  }
+  if (viaSettings) HttpReactor::GetInstance().Post([=] { SendSettings(); });
 }
 
 void HttpCameraImpl::SetStringProperty(int property, llvm::StringRef value,
                                        CS_Status* status) {
-  // TODO
+  bool viaSettings;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto prop = static_cast<PropertyData*>(GetProperty(property));
+    if (!prop) {
+      *status = CS_INVALID_PROPERTY;
+      return;
+    }
+    if (prop->propKind != CS_PROP_STRING) {
+      *status = CS_WRONG_PROPERTY_TYPE;
+      return;
+    }
+    viaSettings = QueueSetting(*prop, value);
+
+    UpdatePropertyValue(property, true, 0, value);
+  }
+  if (viaSettings) HttpReactor::GetInstance().Post([=] { SendSettings(); });
+}
+
+// Must be called with m_mutex held.
+// @return True if a settings request needs to be sent
+bool HttpCameraImpl::QueueSetting(const PropertyData& prop,
+                                  llvm::StringRef value) {
+  if (prop.httpParam.empty()) return false;
+  if (!prop.viaSettings) {
+    // reconnect the stream with the new parameter
+    m_streamSettings[prop.httpParam] = value;
+    m_streamSettingsUpdated = true;
+    return false;
+  }
+  // replaces any value not yet sent
+  m_settings[prop.httpParam] = value;
+  return true;
 }
 
 void HttpCameraImpl::SetBrightness(int brightness, CS_Status* status) {
@@ -433,7 +805,8 @@ void HttpCameraImpl::NumSinksChanged() {
 }
 
 void HttpCameraImpl::NumSinksEnabledChanged() {
-  m_sinkEnabledCond.notify_one();
+  if (HttpReactor::destroyed()) return;
+  HttpReactor::GetInstance().Post([=] { UpdateStream(); });
 }
 
 bool AxisCameraImpl::CacheProperties(CS_Status* status) const {
@@ -453,12 +826,8 @@ bool AxisCameraImpl::CacheProperties(CS_Status* status) const {
   // TODO: get video modes from device
   std::lock_guard<std::mutex> lock(m_mutex);
   m_videoModes.clear();
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 640, 480, 30);
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 480, 360, 30);
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 320, 240, 30);
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 240, 180, 30);
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 176, 144, 30);
-  m_videoModes.emplace_back(VideoMode::kMJPEG, 160, 120, 30);
+  for (const auto& res : kAxisResolutions)
+    m_videoModes.emplace_back(VideoMode::kMJPEG, res.width, res.height, 30);
 
   m_properties_cached = true;
   return true;
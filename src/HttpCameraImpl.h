@@ -9,22 +9,26 @@
 #define CS_HTTPCAMERAIMPL_H_
 
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <initializer_list>
-#include <thread>
+#include <memory>
 #include <vector>
 
 #include "llvm/SmallString.h"
 #include "llvm/StringMap.h"
-#include "support/raw_istream.h"
 
 #include "cscore_cpp.h"
+#include "HttpReactor.h"
 #include "HttpUtil.h"
 #include "SourceImpl.h"
 
 namespace cs {
 
+class HttpParser;
+class MjpegStreamParser;
+
 class HttpCameraImpl : public SourceImpl {
  public:
   HttpCameraImpl(llvm::StringRef name, CS_HttpCameraKind kind);
@@ -94,41 +98,75 @@ class HttpCameraImpl : public SourceImpl {
                           std::initializer_list<T> choices) const;
 
  private:
-  // The camera streaming thread
-  void StreamThreadMain();
-
-  // Functions used by StreamThreadMain()
-  HttpConnection* DeviceStreamConnect(llvm::SmallVectorImpl<char>& boundary);
-  void DeviceStream(wpi::raw_istream& is, llvm::StringRef boundary);
-  bool DeviceStreamFrame(wpi::raw_istream& is, std::string& imageBuf);
-
-  // The camera settings thread
-  void SettingsThreadMain();
-  void DeviceSendSettings(HttpRequest& req);
-
-  std::atomic_bool m_connected{false};
-  std::atomic_bool m_active{true};  // set to false to terminate thread
-  std::thread m_streamThread;
-  std::thread m_settingsThread;
+  class StreamConnection;
+  class SettingsConnection;
+  friend class StreamConnection;
+  friend class SettingsConnection;
+
+  // The stream and settings connections are driven by the shared
+  // HttpReactor thread; these functions only run on that thread.
+  void UpdateStream();
+  void RestartStream();
+  bool NegotiateStream();
+  void RetryStream();
+  void ResetStream();
+  void StopStream();
+  void StreamClosed(std::size_t location);
+  void WinStream(std::size_t location);
+  bool StreamResponse(std::size_t location, const HttpParser& response);
+  llvm::MutableArrayRef<char> StreamBuffer();
+  bool StreamBody(std::size_t len);
+  void StreamResponseDone();
+  bool StartSnapshot(std::size_t location, const HttpParser& response);
+  void SchedulePoll();
+  bool QueueSetting(const PropertyData& prop, llvm::StringRef value);
+  void SendSettings();
+  void SettingsDone();
+  void SettingsClosed();
+
+  // Only accessed from the reactor thread
+  std::vector<std::unique_ptr<StreamConnection>> m_streamConns;  // per location
+  std::vector<HttpRequest> m_streamRequests;  // per location
+  unsigned int m_streamGeneration{0};  // of the locations requests are for
+  std::chrono::steady_clock::time_point m_streamStartTime;
+  int m_streamLocation{-1};  // connection being streamed from
+  std::unique_ptr<SettingsConnection> m_settingsConn;
+  std::deque<llvm::StringMap<llvm::SmallString<16>>> m_settingsInFlight;
+  bool m_settingsAnswered{false};
+  std::unique_ptr<MjpegStreamParser> m_parser;
+  int m_numErrors{0};
+  HttpReactor::TimerId m_retryTimer{0};
+  double m_retryDelay{0.25};
+
+  // Stream parameters chosen to match the sinks (Axis only)
+  VideoMode m_negotiated;
+  HttpReactor::TimerId m_reduceTimer{0};
+  bool m_reduceDue{false};
+
+  // Polling mode, for cameras that only serve single images
+  bool m_polling{false};
+  std::unique_ptr<Image> m_pollImage;
+  std::size_t m_pollImagePos{0};
+  bool m_pollKeepAlive{false};  // camera keeps the connection open
+  bool m_pollAnswered{false};   // image received on this connection
+  std::deque<std::chrono::steady_clock::time_point> m_pollSent;
+  std::chrono::steady_clock::time_point m_pollNext;  // next request due
+  HttpReactor::TimerId m_pollTimer{0};
+  std::chrono::steady_clock::time_point m_pollStatsStart;
+  int m_pollFrames{0};
+  double m_pollRttSum{0};
 
   //
   // Variables protected by m_mutex
   //
 
-  // The camera connections
-  std::unique_ptr<HttpConnection> m_streamConn;
-  std::unique_ptr<HttpConnection> m_settingsConn;
-
   CS_HttpCameraKind m_kind;
 
   std::vector<HttpLocation> m_locations;
-  std::size_t m_nextLocation{0};
-  int m_prefLocation{-1};  // preferred location
-
-  std::condition_variable m_sinkEnabledCond;
+  unsigned int m_locationsGeneration{0};  // incremented by SetUrls()
+  int m_prefLocation{-1};  // preferred location (last to stream)
 
-  llvm::StringMap<llvm::SmallString<16>> m_settings;
-  std::condition_variable m_settingsCond;
+  llvm::StringMap<llvm::SmallString<16>> m_settings;  // not yet sent
 
   llvm::StringMap<llvm::SmallString<16>> m_streamSettings;
   std::atomic_bool m_streamSettingsUpdated{false};
@@ -0,0 +1,181 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "HttpParser.h"
+
+#include <cctype>
+#include <cstring>
+
+using namespace cs;
+
+// Limits to protect against misbehaving peers
+static const std::size_t kMaxHeaderSize = 16384;
+static const std::size_t kMaxHeaders = 64;
+
+void HttpParser::Reset() {
+  m_state = m_type == kPart ? kHeaders : kStartLine;
+  m_line.clear();
+  m_totalSize = 0;
+  m_error.clear();
+  m_method.clear();
+  m_url.clear();
+  m_statusCode = 0;
+  m_statusText.clear();
+  m_major = 0;
+  m_minor = 0;
+  m_numHeaders = 0;
+}
+
+void HttpParser::SetError(llvm::StringRef error) {
+  m_state = kError;
+  m_error = error;
+}
+
+std::size_t HttpParser::Execute(llvm::StringRef data) {
+  std::size_t consumed = 0;
+  while (consumed < data.size() && m_state != kComplete &&
+         m_state != kError) {
+    const char* start = data.data() + consumed;
+    std::size_t avail = data.size() - consumed;
+    const char* eol =
+        static_cast<const char*>(std::memchr(start, '\n', avail));
+    std::size_t len = eol ? (eol - start + 1) : avail;
+    consumed += len;
+    m_totalSize += len;
+    if (m_totalSize > kMaxHeaderSize) {
+      SetError("headers too large");
+      break;
+    }
+
+    if (!eol) {
+      // incomplete line; wait for more data
+      m_line.append(start, len);
+      break;
+    }
+
+    // complete line; avoid the copy if we have the whole thing
+    llvm::StringRef line;
+    if (m_line.empty()) {
+      line = llvm::StringRef(start, len - 1);
+    } else {
+      m_line.append(start, len - 1);
+      line = m_line;
+    }
+    if (line.endswith("\r")) line = line.drop_back();
+
+    if (m_state == kStartLine) {
+      // ignore leading empty lines (RFC 7230 section 3.5)
+      if (!line.empty() && ParseStartLine(line)) {
+        // HTTP/0.9 requests don't have headers
+        m_state = (m_major == 0) ? kComplete : kHeaders;
+      }
+    } else if (line.empty()) {
+      m_state = kComplete;
+    } else {
+      ParseHeaderLine(line);
+    }
+    m_line.clear();
+  }
+  return consumed;
+}
+
+bool HttpParser::ParseStartLine(llvm::StringRef line) {
+  llvm::StringRef first, second, third;
+  std::tie(first, line) = line.split(' ');
+  std::tie(second, third) = line.ltrim().split(' ');
+  third = third.trim();
+
+  llvm::StringRef version = (m_type == kRequest) ? third : first;
+  if (version.empty() && m_type == kRequest) {
+    m_major = 0;
+    m_minor = 9;
+  } else if (version.size() == 8 && version.startswith("HTTP/") &&
+             std::isdigit(version[5]) && version[6] == '.' &&
+             std::isdigit(version[7])) {
+    m_major = version[5] - '0';
+    m_minor = version[7] - '0';
+  } else {
+    SetError("invalid HTTP version");
+    return false;
+  }
+
+  if (m_type == kRequest) {
+    if (first.empty() || second.empty()) {
+      SetError("invalid request line");
+      return false;
+    }
+    m_method = first;
+    m_url = second;
+  } else {
+    if (second.getAsInteger(10, m_statusCode)) {
+      SetError("invalid status code");
+      return false;
+    }
+    m_statusText = third;
+  }
+  return true;
+}
+
+bool HttpParser::ParseHeaderLine(llvm::StringRef line) {
+  // continuation of previous header
+  if (line[0] == ' ' || line[0] == '\t') {
+    if (m_numHeaders == 0) {
+      SetError("unexpected header continuation");
+      return false;
+    }
+    auto& value = m_headers[m_numHeaders - 1].second;
+    value += ' ';
+    value += line.trim();
+    return true;
+  }
+
+  llvm::StringRef field, value;
+  std::tie(field, value) = line.split(':');
+  field = field.rtrim();
+  if (field.empty() || field.size() == line.size()) {
+    SetError("invalid header");
+    return false;
+  }
+  if (m_numHeaders >= kMaxHeaders) {
+    SetError("too many headers");
+    return false;
+  }
+  if (m_numHeaders >= m_headers.size()) m_headers.emplace_back();
+  auto& header = m_headers[m_numHeaders++];
+  header.first = field;
+  header.second = value.trim();
+  return true;
+}
+
+llvm::StringRef HttpParser::GetHeader(llvm::StringRef name) const {
+  for (std::size_t i = 0; i < m_numHeaders; ++i) {
+    if (llvm::StringRef(m_headers[i].first).equals_lower(name))
+      return m_headers[i].second;
+  }
+  return llvm::StringRef{};
+}
+
+long long HttpParser::GetContentLength() const {
+  llvm::StringRef str = GetHeader("Content-Length");
+  unsigned long long len;
+  if (str.empty() || str.getAsInteger(10, len)) return -1;
+  return len;
+}
+
+bool HttpParser::ShouldKeepAlive() const {
+  // Connection is a comma-separated list of options
+  llvm::StringRef options = GetHeader("Connection");
+  while (!options.empty()) {
+    llvm::StringRef option;
+    std::tie(option, options) = options.split(',');
+    option = option.trim();
+    if (option.equals_lower("close")) return false;
+    if (option.equals_lower("keep-alive")) return true;
+  }
+  // HTTP/1.1 defaults to persistent connections
+  return m_major > 1 || (m_major == 1 && m_minor >= 1);
+}
@@ -0,0 +1,91 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_HTTPPARSER_H_
+#define CS_HTTPPARSER_H_
+
+#include <string>
+#include <utility>
+
+#include "llvm/SmallVector.h"
+#include "llvm/StringRef.h"
+
+namespace cs {
+
+// Incremental parser for the start line and headers of a HTTP request or
+// response, or just the headers of a MIME multipart body part.  Data can be
+// fed in arbitrary pieces as it's received; parsing stops at the end of the
+// headers so any following data (a body or a pipelined request) is left for
+// the caller.
+class HttpParser {
+ public:
+  enum Type { kRequest, kResponse, kPart };
+
+  explicit HttpParser(Type type)
+      : m_type{type}, m_state{type == kPart ? kHeaders : kStartLine} {}
+
+  // Prepare to parse another message.
+  void Reset();
+
+  // Parse data.
+  // @return Number of bytes consumed; less than data.size() only if the
+  //         headers are complete or an error occurred.
+  std::size_t Execute(llvm::StringRef data);
+
+  bool IsComplete() const { return m_state == kComplete; }
+  bool HasError() const { return m_state == kError; }
+  llvm::StringRef GetError() const { return m_error; }
+
+  // Request line (requests only)
+  llvm::StringRef GetMethod() const { return m_method; }
+  llvm::StringRef GetUrl() const { return m_url; }
+
+  // Status line (responses only)
+  int GetStatusCode() const { return m_statusCode; }
+  llvm::StringRef GetStatusText() const { return m_statusText; }
+
+  // HTTP version; 0.9 for requests without a version
+  int GetMajor() const { return m_major; }
+  int GetMinor() const { return m_minor; }
+
+  // Get the value of a header (case insensitive).  Returns an empty string
+  // if the header is not present.
+  llvm::StringRef GetHeader(llvm::StringRef name) const;
+
+  // Get the Content-Length header value, or -1 if not present or invalid.
+  long long GetContentLength() const;
+
+  // Determine if the connection should be kept open after this message,
+  // based on the HTTP version and the Connection header.
+  bool ShouldKeepAlive() const;
+
+ private:
+  bool ParseStartLine(llvm::StringRef line);
+  bool ParseHeaderLine(llvm::StringRef line);
+  void SetError(llvm::StringRef error);
+
+  enum State { kStartLine, kHeaders, kComplete, kError };
+
+  Type m_type;
+  State m_state;
+  std::string m_line;  // partial line
+  std::size_t m_totalSize{0};
+  std::string m_error;
+
+  std::string m_method;
+  std::string m_url;
+  int m_statusCode{0};
+  std::string m_statusText;
+  int m_major{0};
+  int m_minor{0};
+  llvm::SmallVector<std::pair<std::string, std::string>, 16> m_headers;
+  std::size_t m_numHeaders{0};  // m_headers is reused between messages
+};
+
+}  // namespace cs
+
+#endif  // CS_HTTPPARSER_H_
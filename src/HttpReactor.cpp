@@ -0,0 +1,347 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "HttpReactor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "Log.h"
+
+using namespace cs;
+
+ATOMIC_STATIC_INIT(HttpReactor)
+bool HttpReactor::s_destroyed = false;
+
+#ifdef _WIN32
+#define poll WSAPoll
+#endif
+
+#ifdef __linux__
+static uint32_t ToEpollEvents(int events) {
+  uint32_t rv = 0;
+  if (events & HttpReactor::kRead) rv |= EPOLLIN;
+  if (events & HttpReactor::kWrite) rv |= EPOLLOUT;
+  return rv;
+}
+#endif
+
+HttpReactor::HttpReactor() {
+  s_destroyed = false;
+
+#if defined(__linux__)
+  m_wakeFd = m_wakeWriteFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (m_wakeFd < 0 || m_epollFd < 0) {
+    ERROR("HttpReactor: could not create epoll: " << strerror(errno));
+  } else {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeFd;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+  }
+#elif defined(_WIN32)
+  // Windows can only poll sockets, so wake with a datagram sent to ourself
+  SOCKET sd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int addrLen = sizeof(addr);
+  if (sd == INVALID_SOCKET ||
+      ::bind(sd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ||
+      ::getsockname(sd, reinterpret_cast<struct sockaddr*>(&addr),
+                    &addrLen) ||
+      ::connect(sd, reinterpret_cast<struct sockaddr*>(&addr), addrLen)) {
+    ERROR("HttpReactor: could not create wakeup socket");
+  } else {
+    u_long nonblocking = 1;
+    ::ioctlsocket(sd, FIONBIO, &nonblocking);
+    m_wakeFd = m_wakeWriteFd = static_cast<int>(sd);
+  }
+#else
+  int fds[2];
+  if (::pipe(fds) < 0) {
+    ERROR("HttpReactor: could not create pipe: " << strerror(errno));
+  } else {
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    ::fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    m_wakeFd = fds[0];
+    m_wakeWriteFd = fds[1];
+  }
+#endif
+
+  m_thread = std::thread(&HttpReactor::ThreadMain, this);
+}
+
+HttpReactor::~HttpReactor() {
+  s_destroyed = true;
+  m_active = false;
+  Wake();
+  if (m_thread.joinable()) m_thread.join();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& worker : m_workers) worker.first.join();
+    m_workers.clear();
+  }
+
+#ifdef _WIN32
+  if (m_wakeFd >= 0) ::closesocket(m_wakeFd);
+#else
+  if (m_wakeWriteFd >= 0 && m_wakeWriteFd != m_wakeFd) ::close(m_wakeWriteFd);
+  if (m_wakeFd >= 0) ::close(m_wakeFd);
+#endif
+#ifdef __linux__
+  if (m_epollFd >= 0) ::close(m_epollFd);
+#endif
+}
+
+void HttpReactor::Post(std::function<void()> func) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_posted.emplace_back(std::move(func));
+  }
+  Wake();
+}
+
+void HttpReactor::Call(std::function<void()> func) {
+  // Nothing else can be running if the reactor has stopped
+  if (IsReactorThread() || !m_active) {
+    func();
+    return;
+  }
+  std::promise<void> done;
+  Post([&] {
+    func();
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+void HttpReactor::RunInBackground(std::function<void()> work,
+                                  std::function<void()> done) {
+  ReapWorkers();
+  auto finished = std::make_shared<std::atomic_bool>(false);
+  std::thread thr([=] {
+    work();
+    Post(done);
+    *finished = true;
+  });
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_workers.emplace_back(std::move(thr), finished);
+}
+
+void HttpReactor::ReapWorkers() {
+  std::vector<std::thread> finished;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto i = m_workers.begin(); i != m_workers.end();) {
+      if (*i->second) {
+        finished.emplace_back(std::move(i->first));
+        i = m_workers.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+  for (auto& thr : finished) thr.join();
+}
+
+void HttpReactor::Wake() {
+  if (m_wakeWriteFd < 0) return;
+#if defined(__linux__)
+  eventfd_write(m_wakeWriteFd, 1);
+#elif defined(_WIN32)
+  char c = 0;
+  ::send(m_wakeWriteFd, &c, 1, 0);
+#else
+  char c = 0;
+  if (::write(m_wakeWriteFd, &c, 1) < 0) {
+    // pipe full; the reactor is awake anyway
+  }
+#endif
+}
+
+void HttpReactor::Add(int fd, int events, Handler handler) {
+  m_sockets[fd] =
+      Socket{events, std::make_shared<Handler>(std::move(handler))};
+#ifdef __linux__
+  struct epoll_event ev;
+  ev.events = ToEpollEvents(events);
+  ev.data.fd = fd;
+  ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev);
+#endif
+}
+
+void HttpReactor::Modify(int fd, int events) {
+  auto it = m_sockets.find(fd);
+  if (it == m_sockets.end() || it->second.events == events) return;
+  it->second.events = events;
+#ifdef __linux__
+  struct epoll_event ev;
+  ev.events = ToEpollEvents(events);
+  ev.data.fd = fd;
+  ::epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev);
+#endif
+}
+
+void HttpReactor::Remove(int fd) {
+  if (m_sockets.erase(fd) == 0) return;
+#ifdef __linux__
+  ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+HttpReactor::TimerId HttpReactor::AddTimer(double delay,
+                                           std::function<void()> func) {
+  auto when = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(delay));
+  TimerId id = m_nextTimer++;
+  m_timers.emplace(id, std::make_pair(when, std::move(func)));
+  return id;
+}
+
+void HttpReactor::CancelTimer(TimerId id) { m_timers.erase(id); }
+
+int HttpReactor::GetTimeout() {
+  if (m_timers.empty()) return -1;
+  auto next = m_timers.begin()->second.first;
+  for (const auto& timer : m_timers) next = std::min(next, timer.second.first);
+  auto now = Clock::now();
+  if (next <= now) return 0;
+  // round up so we don't wake just before the timer is due
+  return static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(next - now)
+          .count() + 1);
+}
+
+void HttpReactor::RunTimers() {
+  // There are only a few timers per camera, so a linear scan is fine.
+  auto now = Clock::now();
+  std::vector<TimerId> due;
+  for (const auto& timer : m_timers) {
+    if (timer.second.first <= now) due.push_back(timer.first);
+  }
+  // A timer callback may cancel another due timer, so look each one up again
+  for (auto id : due) {
+    auto it = m_timers.find(id);
+    if (it == m_timers.end()) continue;
+    auto func = std::move(it->second.second);
+    m_timers.erase(it);
+    func();
+  }
+}
+
+void HttpReactor::Dispatch(int fd, int events) {
+  auto it = m_sockets.find(fd);
+  if (it == m_sockets.end()) return;  // removed by an earlier handler
+  // Only report events the handler is waiting for (errors come as kRead)
+  events &= it->second.events | kRead;
+  if (events == 0) return;
+  auto handler = it->second.handler;  // may remove itself
+  (*handler)(events);
+}
+
+void HttpReactor::Wait(int timeout) {
+#ifdef __linux__
+  struct epoll_event events[64];
+  int n = ::epoll_wait(m_epollFd, events, 64, timeout);
+  if (n < 0 && errno != EINTR)
+    ERROR("HttpReactor: epoll_wait(): " << strerror(errno));
+  for (int i = 0; i < n && m_active; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == m_wakeFd) {
+      eventfd_t val;
+      eventfd_read(m_wakeFd, &val);
+      continue;
+    }
+    int ev = 0;
+    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) ev |= kRead;
+    if (events[i].events & EPOLLOUT) ev |= kWrite;
+    Dispatch(fd, ev);
+  }
+#else
+  std::vector<struct pollfd> fds;
+  fds.reserve(m_sockets.size() + 1);
+  struct pollfd wake;
+  wake.fd = m_wakeFd;
+  wake.events = POLLIN;
+  wake.revents = 0;
+  fds.push_back(wake);
+  for (const auto& socket : m_sockets) {
+    struct pollfd pfd;
+    pfd.fd = socket.first;
+    pfd.events = ((socket.second.events & kRead) ? POLLIN : 0) |
+                 ((socket.second.events & kWrite) ? POLLOUT : 0);
+    pfd.revents = 0;
+    fds.push_back(pfd);
+  }
+  int n = ::poll(fds.data(), fds.size(), timeout);
+  if (n <= 0) return;
+  if (fds[0].revents != 0) {
+    char buf[64];
+#ifdef _WIN32
+    while (::recv(m_wakeFd, buf, sizeof(buf), 0) > 0) {
+    }
+#else
+    while (::read(m_wakeFd, buf, sizeof(buf)) > 0) {
+    }
+#endif
+  }
+  for (std::size_t i = 1; i < fds.size() && m_active; ++i) {
+    int ev = 0;
+    if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) ev |= kRead;
+    if (fds[i].revents & POLLOUT) ev |= kWrite;
+    if (ev != 0) Dispatch(static_cast<int>(fds[i].fd), ev);
+  }
+#endif
+}
+
+void HttpReactor::ThreadMain() {
+  std::vector<std::function<void()>> posted;
+  while (m_active) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      posted.swap(m_posted);
+    }
+    for (auto& func : posted) func();
+    posted.clear();
+
+    RunTimers();
+    if (!m_active) break;
+
+    // Don't sleep if something was posted by a callback
+    int timeout;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      timeout = m_posted.empty() ? GetTimeout() : 0;
+    }
+    Wait(timeout);
+  }
+
+  // Run anything still posted (e.g. a Call() waiting for completion)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    posted.swap(m_posted);
+  }
+  for (auto& func : posted) func();
+}
@@ -0,0 +1,119 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_HTTPREACTOR_H_
+#define CS_HTTPREACTOR_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "support/atomic_static.h"
+
+namespace cs {
+
+// A single thread that drives the non-blocking sockets of all HTTP cameras,
+// so cameras don't each need threads blocked on their connections.  Uses
+// epoll on Linux and poll() elsewhere.
+//
+// Socket and timer functions may only be called on the reactor thread (from
+// a callback or a posted function); other threads use Post() or Call().
+class HttpReactor {
+ public:
+  static HttpReactor& GetInstance() {
+    ATOMIC_STATIC(HttpReactor, instance);
+    return instance;
+  }
+  ~HttpReactor();
+
+  static bool destroyed() { return s_destroyed; }
+
+  // Socket events.  Errors and hangups are reported as kRead so the handler
+  // finds them when it reads.
+  enum { kRead = 1, kWrite = 2 };
+  typedef std::function<void(int events)> Handler;
+  typedef uint64_t TimerId;
+
+  // Run func on the reactor thread.  Thread-safe.
+  void Post(std::function<void()> func);
+
+  // Run func on the reactor thread and wait for it to finish.  Thread-safe;
+  // runs func immediately if called on the reactor thread.
+  void Call(std::function<void()> func);
+
+  // Run work on a separate thread (for blocking calls such as name
+  // resolution), then run done on the reactor thread.  Thread-safe.
+  void RunInBackground(std::function<void()> work, std::function<void()> done);
+
+  bool IsReactorThread() const {
+    return std::this_thread::get_id() == m_thread.get_id();
+  }
+
+  // Watch a socket for events (kRead | kWrite).
+  void Add(int fd, int events, Handler handler);
+  void Modify(int fd, int events);
+  void Remove(int fd);
+
+  // Call func once after delay seconds.
+  TimerId AddTimer(double delay, std::function<void()> func);
+  void CancelTimer(TimerId id);
+
+ private:
+  HttpReactor();
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Socket {
+    int events;
+    std::shared_ptr<Handler> handler;  // copied while called
+  };
+
+  void ThreadMain();
+  int GetTimeout();  // until the next timer, in ms (-1 if none)
+  void RunTimers();
+  void Wait(int timeout);
+  void Dispatch(int fd, int events);
+  void Wake();
+  void ReapWorkers();
+
+  std::atomic_bool m_active{true};
+  std::thread m_thread;
+
+  // Wakeup (eventfd on Linux, a pipe or loopback socket elsewhere)
+  int m_wakeFd{-1};
+  int m_wakeWriteFd{-1};
+#ifdef __linux__
+  int m_epollFd{-1};
+#endif
+
+  // Protected by m_mutex
+  std::mutex m_mutex;
+  std::vector<std::function<void()>> m_posted;
+  std::vector<std::pair<std::thread, std::shared_ptr<std::atomic_bool>>>
+      m_workers;  // with "finished" flags
+
+  // Only accessed from the reactor thread
+  std::unordered_map<int, Socket> m_sockets;
+  std::map<TimerId, std::pair<Clock::time_point, std::function<void()>>>
+      m_timers;
+  TimerId m_nextTimer{1};
+
+  ATOMIC_STATIC_DECL(HttpReactor)
+  static bool s_destroyed;
+};
+
+}  // namespace cs
+
+#endif  // CS_HTTPREACTOR_H_
@@ -306,14 +306,18 @@ void HttpRequest::SetAuth(const HttpLocation& loc) {
   }
 }
 
-bool HttpConnection::Handshake(const HttpRequest& request,
-                               llvm::StringRef cameraName) {
-  // send GET request
+void WriteHttpGet(llvm::raw_ostream& os, const HttpRequest& request) {
   os << "GET /" << request.path << " HTTP/1.1\r\n";
   os << "Host: " << request.host << "\r\n";
   if (!request.auth.empty())
     os << "Authorization: Basic " << request.auth << "\r\n";
   os << "\r\n";
+}
+
+bool HttpConnection::Handshake(const HttpRequest& request,
+                               llvm::StringRef cameraName) {
+  // send GET request
+  WriteHttpGet(os, request);
   os.flush();
 
   // read first line of response
@@ -125,6 +125,9 @@ class HttpRequest {
   static llvm::StringRef GetSecond(const T& elem) { return elem.second; }
 };
 
+// Write a GET request (including the terminating blank line).
+void WriteHttpGet(llvm::raw_ostream& os, const HttpRequest& request);
+
 class HttpConnection {
  public:
   HttpConnection(std::unique_ptr<wpi::NetworkStream> stream_, int timeout)
@@ -8,6 +8,8 @@
 #ifndef CS_IMAGE_H_
 #define CS_IMAGE_H_
 
+#include <functional>
+#include <mutex>
 #include <vector>
 
 #include "llvm/StringRef.h"
@@ -16,6 +18,7 @@
 
 #include "cscore_cpp.h"
 #include "default_init_allocator.h"
+#include "JpegUtil.h"
 
 namespace cs {
 
@@ -37,6 +40,17 @@ class Image {
   }
 #endif
 
+  // Creates an image that refers to memory owned by someone else (e.g. a
+  // shared memory mapping) rather than its own buffer.  release is called
+  // when the image is destroyed.  The data must not be modified, and the
+  // image is never returned to the source's image pool.
+  Image(llvm::StringRef alias, std::function<void()> release)
+      : m_alias{alias}, m_release{std::move(release)} {}
+
+  ~Image() {
+    if (m_release) m_release();
+  }
+
   Image(const Image&) = delete;
   Image& operator=(const Image&) = delete;
 
@@ -45,16 +59,51 @@ class Image {
   llvm::StringRef str() const { return llvm::StringRef(data(), size()); }
   std::size_t capacity() const { return m_data.capacity(); }
   const char* data() const {
+    if (m_alias.data()) return m_alias.data();
     return reinterpret_cast<const char*>(m_data.data());
   }
-  char* data() { return reinterpret_cast<char*>(m_data.data()); }
-  std::size_t size() const { return m_data.size(); }
+  char* data() {
+    if (m_alias.data()) return const_cast<char*>(m_alias.data());
+    return reinterpret_cast<char*>(m_data.data());
+  }
+  std::size_t size() const {
+    return m_alias.data() ? m_alias.size() : m_data.size();
+  }
+  bool IsAlias() const { return m_alias.data() != nullptr; }
 
   const std::vector<uchar>& vec() const { return m_data; }
   std::vector<uchar>& vec() { return m_data; }
 
-  void resize(std::size_t size) { m_data.resize(size); }
-  void SetSize(std::size_t size) { m_data.resize(size); }
+  void resize(std::size_t size) {
+    m_data.resize(size);
+    m_jpegParsed = false;
+  }
+  void SetSize(std::size_t size) {
+    m_data.resize(size);
+    m_jpegParsed = false;
+  }
+
+  // Gets the marker index of a JPEG image, parsing it on first use.  The
+  // data must not be modified afterwards (other than by resizing).
+  // @return nullptr if the image is not a valid JPEG
+  const JpegInfo* GetJpegInfo() const {
+    std::lock_guard<std::mutex> lock(m_jpegMutex);
+    if (!m_jpegParsed) {
+      m_jpegValid = ParseJpeg(str(), &m_jpegInfo);
+      m_jpegParsed = true;
+    }
+    return m_jpegValid ? &m_jpegInfo : nullptr;
+  }
+
+  // Gets the quality of a JPEG image: the quality we compressed it with, or
+  // else (e.g. for camera images) estimated from its quantization tables.
+  // @return -1 if unknown or not a JPEG
+  int GetJpegQuality() const {
+    if (pixelFormat != VideoMode::kMJPEG) return -1;
+    if (jpegQuality >= 0) return jpegQuality;
+    const JpegInfo* info = GetJpegInfo();
+    return info ? info->quality : -1;
+  }
 
   cv::Mat AsMat() {
     int type;
@@ -72,10 +121,15 @@ class Image {
         type = CV_8UC1;
         break;
     }
-    return cv::Mat{height, width, type, m_data.data()};
+    return cv::Mat{height, width, type, data()};
   }
 
-  cv::_InputArray AsInputArray() { return cv::_InputArray{m_data}; }
+  cv::_InputArray AsInputArray() {
+    if (IsAlias())
+      return cv::_InputArray{reinterpret_cast<const uchar*>(m_alias.data()),
+                             static_cast<int>(m_alias.size())};
+    return cv::_InputArray{m_data};
+  }
 
   bool Is(int width_, int height_) {
     return width == width_ && height == height_;
@@ -94,11 +148,22 @@ class Image {
 
  private:
   std::vector<uchar> m_data;
+  llvm::StringRef m_alias;
+  std::function<void()> m_release;
+
+  // Cached by GetJpegInfo()
+  mutable std::mutex m_jpegMutex;
+  mutable JpegInfo m_jpegInfo;
+  mutable bool m_jpegParsed{false};
+  mutable bool m_jpegValid{false};
 
  public:
   VideoMode::PixelFormat pixelFormat{VideoMode::kUnknown};
   int width{0};
   int height{0};
+  // JPEG quality the image was encoded with; -1 if not encoded by us (e.g.
+  // compressed by the camera) or not a JPEG
+  int jpegQuality{-1};
 };
 
 }  // namespace cs
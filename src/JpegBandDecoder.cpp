@@ -0,0 +1,124 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "JpegBandDecoder.h"
+
+#include <algorithm>
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include "Image.h"
+#include "JpegUtil.h"
+
+using namespace cs;
+
+JpegBandDecoder::JpegBandDecoder(const Image& image, const JpegInfo& info,
+                                 int flags, cv::Mat& dst)
+    : m_data{image.str().bytes_begin()},
+      m_size{image.size()},
+      m_info(info),
+      m_flags{flags},
+      m_dst(dst) {}
+
+bool JpegBandDecoder::Init(int maxBands) {
+  // Only sequential images have a single scan, which must be followed by EOI
+  if (m_info.sofType != 0xc0 && m_info.sofType != 0xc1) return false;
+  if (m_info.restarts.empty() || m_info.mcuWidth == 0) return false;
+  if (m_info.scanEnd + 2 > m_size || m_data[m_info.scanEnd + 1] != 0xd9)
+    return false;
+  if (m_dst.rows != m_info.height || m_dst.cols != m_info.width) return false;
+
+  // Check the markers account for the whole image
+  std::size_t interval = m_info.restartInterval;
+  std::size_t rowMcus = (m_info.width + m_info.mcuWidth - 1) / m_info.mcuWidth;
+  std::size_t numMcus =
+      rowMcus * ((m_info.height + m_info.mcuHeight - 1) / m_info.mcuHeight);
+  m_numIntervals = m_info.restarts.size() + 1;
+  if (m_numIntervals != (numMcus + interval - 1) / interval) return false;
+
+  // Bands must start at both a restart marker and a MCU row; this happens
+  // every lcm(interval, rowMcus) MCUs
+  std::size_t a = interval, b = rowMcus;
+  while (b != 0) {
+    std::size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  m_unitIntervals = rowMcus / a;
+  m_numUnits = (m_numIntervals + m_unitIntervals - 1) / m_unitIntervals;
+  m_unitRows = (m_unitIntervals * interval / rowMcus) * m_info.mcuHeight;
+  // Chroma may be subsampled vertically if the MCU is taller than a block
+  m_context = m_flags != cv::IMREAD_GRAYSCALE && m_info.mcuHeight > 8;
+  m_numBands = static_cast<int>(
+      std::min(m_numUnits, static_cast<std::size_t>(maxBands)));
+  return m_numBands >= 2;
+}
+
+void JpegBandDecoder::operator()(const cv::Range& range) const {
+  std::vector<uchar> buf;
+  for (int band = range.start; band < range.end; ++band) {
+    if (!DecodeBand(band, buf)) m_failed = true;
+  }
+}
+
+bool JpegBandDecoder::DecodeBand(int band, std::vector<uchar>& buf) const {
+  std::size_t firstUnit = band * m_numUnits / m_numBands;
+  std::size_t lastUnit = (band + 1) * m_numUnits / m_numBands;
+  int startRow = static_cast<int>(firstUnit) * m_unitRows;
+  int endRow = std::min(static_cast<int>(lastUnit) * m_unitRows, m_dst.rows);
+  cv::Mat rows = m_dst.rowRange(startRow, endRow);
+
+  // Upsampling vertically subsampled chroma blends in the neighboring rows,
+  // so also decode a unit either side of the band for them
+  std::size_t decodeFirst = firstUnit;
+  std::size_t decodeLast = lastUnit;
+  if (m_context) {
+    if (decodeFirst > 0) --decodeFirst;
+    if (decodeLast < m_numUnits) ++decodeLast;
+  }
+  int decodeStart = static_cast<int>(decodeFirst) * m_unitRows;
+  int decodeEnd =
+      std::min(static_cast<int>(decodeLast) * m_unitRows, m_dst.rows);
+  MakeBandJpeg(decodeFirst * m_unitIntervals,
+               std::min(decodeLast * m_unitIntervals, m_numIntervals),
+               decodeEnd - decodeStart, buf);
+
+  if (decodeStart == startRow && decodeEnd == endRow) {
+    // Decode directly into the band (a failed decode releases it)
+    uchar* data = rows.data;
+    cv::imdecode(buf, m_flags, &rows);
+    return rows.data == data;
+  }
+  cv::Mat decoded = cv::imdecode(buf, m_flags);
+  if (decoded.rows != decodeEnd - decodeStart || decoded.cols != rows.cols ||
+      decoded.type() != rows.type())
+    return false;
+  decoded.rowRange(startRow - decodeStart, endRow - decodeStart).copyTo(rows);
+  return true;
+}
+
+// Make a JPEG of restart intervals [first, last) with the given height.
+void JpegBandDecoder::MakeBandJpeg(std::size_t first, std::size_t last,
+                                   int height, std::vector<uchar>& buf) const {
+  // Entropy-coded data from after the RST marker preceding the first
+  // interval to the marker following the last one
+  std::size_t begin =
+      first == 0 ? m_info.dataPos : m_info.restarts[first - 1] + 2;
+  std::size_t end =
+      last == m_numIntervals ? m_info.scanEnd : m_info.restarts[last - 1];
+
+  std::size_t headerLen = m_info.dataPos;
+  buf.resize(headerLen + (end - begin) + 2);
+  std::copy(m_data, m_data + headerLen, buf.begin());
+  std::copy(m_data + begin, m_data + end, buf.begin() + headerLen);
+  buf[m_info.sofPos + 5] = height >> 8;
+  buf[m_info.sofPos + 6] = height & 0xff;
+  for (std::size_t i = first; i + 1 < last; ++i)
+    buf[headerLen + m_info.restarts[i] - begin + 1] = 0xd0 + (i - first) % 8;
+  buf[buf.size() - 2] = 0xff;
+  buf[buf.size() - 1] = 0xd9;  // EOI
+}
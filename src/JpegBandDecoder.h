@@ -0,0 +1,64 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_JPEGBANDDECODER_H_
+#define CS_JPEGBANDDECODER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+namespace cs {
+
+class Image;
+struct JpegInfo;
+
+// Decodes a JPEG split into row bands at restart markers.  Each band is
+// decoded (in parallel) as a JPEG of its own, made of the image headers
+// with the height changed, and the band's restart intervals renumbered to
+// start from RST0.
+class JpegBandDecoder : public cv::ParallelLoopBody {
+ public:
+  // @param info Marker index of the image (see Image::GetJpegInfo())
+  // @param flags cv::imdecode() flags
+  // @param dst Image to decode into; must already have the image's size
+  JpegBandDecoder(const Image& image, const JpegInfo& info, int flags,
+                  cv::Mat& dst);
+
+  // Plan the bands.
+  // @return False if the image can't be split
+  bool Init(int maxBands);
+  int GetNumBands() const { return m_numBands; }
+  bool Failed() const { return m_failed; }
+
+  void operator()(const cv::Range& range) const override;
+
+ private:
+  bool DecodeBand(int band, std::vector<uchar>& buf) const;
+  void MakeBandJpeg(std::size_t first, std::size_t last, int height,
+                    std::vector<uchar>& buf) const;
+
+  const unsigned char* m_data;
+  std::size_t m_size;
+  const JpegInfo& m_info;
+  int m_flags;
+  cv::Mat& m_dst;
+
+  std::size_t m_numIntervals{0};
+  std::size_t m_unitIntervals{0};  // restart intervals per unit
+  std::size_t m_numUnits{0};       // smallest splittable pieces
+  int m_unitRows{0};
+  int m_numBands{0};
+  bool m_context{false};  // decode neighboring units too
+  mutable std::atomic_bool m_failed{false};
+};
+
+}  // namespace cs
+
+#endif  // CS_JPEGBANDDECODER_H_
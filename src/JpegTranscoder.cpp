@@ -0,0 +1,660 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "JpegTranscoder.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "Image.h"
+#include "JpegUtil.h"
+
+namespace cs {
+
+// Natural (row-major) index of each zigzag position
+static const int kZigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+namespace {
+
+// Huffman table as stored in a DHT segment
+struct HuffSpec {
+  const unsigned char* bits{nullptr};  // number of codes of each length
+  const unsigned char* vals{nullptr};  // symbols in code order
+};
+
+// Huffman decoding table (JPEG spec F.2.2.3), with an 8-bit lookahead for
+// the common short codes.
+class HuffDecoder {
+ public:
+  bool Init(const HuffSpec& spec);
+  bool IsValid() const { return m_valid; }
+
+  template <typename Reader>
+  int Decode(Reader& reader) const {
+    int look = reader.Peek(8);
+    if (m_lookBits[look] != 0) {
+      reader.Skip(m_lookBits[look]);
+      return m_lookSym[look];
+    }
+    int code = reader.Peek(16);
+    for (int len = 9; len <= 16; ++len) {
+      int c = code >> (16 - len);
+      if (c <= m_maxCode[len]) {
+        reader.Skip(len);
+        return m_vals[c + m_valOffset[len]];
+      }
+    }
+    return -1;  // corrupt data
+  }
+
+ private:
+  bool m_valid{false};
+  int m_maxCode[17];
+  int m_valOffset[17];
+  unsigned char m_vals[256];
+  unsigned char m_lookBits[256];
+  unsigned char m_lookSym[256];
+};
+
+// Huffman encoding table
+struct HuffEncoder {
+  void Init(const HuffSpec& spec);
+
+  uint16_t code[256];
+  unsigned char size[256];
+};
+
+// Reads the entropy-coded data of a scan, removing byte stuffing.  Reading
+// past a marker returns zero bits.
+class BitReader {
+ public:
+  BitReader(const unsigned char* data, const unsigned char* end)
+      : m_data{data}, m_end{end} {}
+
+  // Continue after a restart marker at data.
+  void Restart(const unsigned char* data) {
+    m_data = data;
+    m_buf = 0;
+    m_bits = 0;
+  }
+
+  int Peek(int n) {
+    if (m_bits < n) Fill();
+    return static_cast<int>(m_buf >> (64 - n));
+  }
+  void Skip(int n) {
+    m_buf <<= n;
+    m_bits -= n;
+  }
+  int Get(int n) {
+    int val = Peek(n);
+    Skip(n);
+    return val;
+  }
+
+ private:
+  void Fill() {
+    while (m_bits <= 56) {
+      uint64_t byte = 0;
+      if (m_data < m_end && *m_data != 0xff) {
+        byte = *m_data++;
+      } else if (m_data + 1 < m_end && m_data[1] == 0x00) {
+        byte = 0xff;
+        m_data += 2;
+      }
+      m_buf |= byte << (56 - m_bits);
+      m_bits += 8;
+    }
+  }
+
+  const unsigned char* m_data;
+  const unsigned char* m_end;
+  uint64_t m_buf{0};  // MSB-aligned
+  int m_bits{0};
+};
+
+// Writes entropy-coded data, adding byte stuffing.
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uchar>& out) : m_out(out) {}
+
+  // Write the low n bits (n <= 32).
+  void Put(uint32_t bits, int n) {
+    m_buf = (m_buf << n) | bits;
+    m_bits += n;
+    while (m_bits >= 8) {
+      m_bits -= 8;
+      uchar byte = static_cast<uchar>(m_buf >> m_bits);
+      m_out.push_back(byte);
+      if (byte == 0xff) m_out.push_back(0x00);
+    }
+  }
+
+  // Pad the last byte with 1 bits.
+  void Flush() {
+    if (m_bits > 0) Put((1u << (8 - m_bits)) - 1, 8 - m_bits);
+  }
+
+ private:
+  std::vector<uchar>& m_out;
+  uint64_t m_buf{0};  // the low m_bits bits are unwritten
+  int m_bits{0};
+};
+
+struct Component {
+  int id;
+  int h, v;  // sampling factors
+  int quant;
+  int dcTable, acTable;
+  int blocksWide, blocksHigh;
+  int16_t* coefs;          // 64 per block, natural order, quantized
+  unsigned char* counts;   // zigzag positions up to the last nonzero one
+};
+
+}  // namespace
+
+bool HuffDecoder::Init(const HuffSpec& spec) {
+  m_valid = false;
+  std::fill(m_lookBits, m_lookBits + 256, 0);
+  int code = 0;
+  int k = 0;
+  for (int len = 1; len <= 16; ++len) {
+    int count = spec.bits[len - 1];
+    m_valOffset[len] = k - code;
+    for (int i = 0; i < count; ++i, ++code, ++k) {
+      if (k >= 256) return false;
+      m_vals[k] = spec.vals[k];
+      if (len <= 8) {
+        // all lookahead values starting with this code
+        int shift = 8 - len;
+        for (int j = 0; j < (1 << shift); ++j) {
+          m_lookBits[(code << shift) | j] = len;
+          m_lookSym[(code << shift) | j] = spec.vals[k];
+        }
+      }
+    }
+    m_maxCode[len] = count ? code - 1 : -1;
+    if (code > (1 << len)) return false;  // too many codes
+    code <<= 1;
+  }
+  m_valid = true;
+  return true;
+}
+
+void HuffEncoder::Init(const HuffSpec& spec) {
+  std::fill(size, size + 256, 0);
+  int code = 0;
+  int k = 0;
+  for (int len = 1; len <= 16; ++len) {
+    for (int i = 0; i < spec.bits[len - 1]; ++i, ++code, ++k) {
+      this->code[spec.vals[k]] = code;
+      size[spec.vals[k]] = len;
+    }
+    code <<= 1;
+  }
+}
+
+// Read the tables from a DHT segment (without the marker and length).
+static bool ParseDHT(const unsigned char* data, std::size_t len,
+                     HuffSpec dc[4], HuffSpec ac[4]) {
+  while (len > 0) {
+    if (len < 17) return false;
+    int cls = data[0] >> 4;
+    int id = data[0] & 0x0f;
+    if (cls > 1 || id > 3) return false;
+    std::size_t count = 0;
+    for (int i = 1; i <= 16; ++i) count += data[i];
+    if (count > 256 || len < 17 + count) return false;
+    HuffSpec& spec = cls == 0 ? dc[id] : ac[id];
+    spec.bits = data + 1;
+    spec.vals = data + 17;
+    data += 17 + count;
+    len -= 17 + count;
+  }
+  return true;
+}
+
+// Basis for downscaling by a factor of s in the DCT domain: the n = 8/s
+// lowest frequencies of each of s adjacent blocks are a n-point DCT of the
+// block downsampled; taking the inverse n-point DCT and then the 8-point
+// DCT of the s pieces together gives the combined block.  Piece k
+// contributes basis[k] (8 x n) times its coefficients.
+static void MakeScaleBasis(int s, double basis[4][8][4]) {
+  int n = 8 / s;
+  const double pi = 3.14159265358979323846;
+  auto dct = [&](int size, int u, int x) {
+    double c = u == 0 ? std::sqrt(1.0 / size) : std::sqrt(2.0 / size);
+    return c * std::cos((2 * x + 1) * u * pi / (2 * size));
+  };
+  for (int k = 0; k < s; ++k) {
+    for (int u = 0; u < 8; ++u) {
+      for (int j = 0; j < n; ++j) {
+        double sum = 0;
+        for (int x = 0; x < n; ++x) sum += dct(8, u, k * n + x) * dct(n, j, x);
+        basis[k][u][j] = sum / std::sqrt(static_cast<double>(s));
+      }
+    }
+  }
+}
+
+// Round a (quantized) coefficient, limited to what the standard tables can
+// encode.
+static inline int16_t Round(float val) {
+  int rounded = static_cast<int>(val + (val < 0 ? -0.5f : 0.5f));
+  return static_cast<int16_t>(std::min(std::max(rounded, -1023), 1023));
+}
+
+// Decode the coefficients of the (single) scan.
+static bool DecodeScan(const unsigned char* data, const unsigned char* end,
+                       const JpegInfo& info,
+                       const HuffDecoder dc[4], const HuffDecoder ac[4],
+                       int mcusWide, int mcusHigh,
+                       std::vector<Component>& comps) {
+  // The reader stops at the marker ending the scan
+  BitReader reader{data + info.dataPos, end};
+  int pred[4] = {0, 0, 0, 0};
+  int interval = info.restartInterval;
+  int toRestart = interval;
+  std::size_t restart = 0;
+  for (int my = 0; my < mcusHigh; ++my) {
+    for (int mx = 0; mx < mcusWide; ++mx) {
+      if (interval != 0 && toRestart-- == 0) {
+        if (restart >= info.restarts.size()) return false;
+        reader.Restart(data + info.restarts[restart++] + 2);
+        std::fill(pred, pred + 4, 0);
+        toRestart = interval - 1;
+      }
+      for (std::size_t c = 0; c < comps.size(); ++c) {
+        Component& comp = comps[c];
+        const HuffDecoder& dcTable = dc[comp.dcTable];
+        const HuffDecoder& acTable = ac[comp.acTable];
+        for (int v = 0; v < comp.v; ++v) {
+          for (int h = 0; h < comp.h; ++h) {
+            int index =
+                (my * comp.v + v) * comp.blocksWide + mx * comp.h + h;
+            int16_t* block = &comp.coefs[index * 64];
+            std::fill(block, block + 64, 0);
+            int t = dcTable.Decode(reader);
+            if (t < 0 || t > 11) return false;
+            int diff = t == 0 ? 0 : reader.Get(t);
+            if (t != 0 && diff < (1 << (t - 1))) diff -= (1 << t) - 1;
+            pred[c] += diff;
+            block[0] = pred[c];
+            int count = 1;
+            for (int k = 1; k < 64;) {
+              int rs = acTable.Decode(reader);
+              if (rs < 0) return false;
+              int r = rs >> 4;
+              int size = rs & 0x0f;
+              if (size == 0) {
+                if (r != 15) break;  // EOB
+                k += 16;
+                continue;
+              }
+              k += r;
+              if (k > 63 || size > 10) return false;
+              int val = reader.Get(size);
+              if (val < (1 << (size - 1))) val -= (1 << size) - 1;
+              block[kZigzag[k++]] = val;
+              count = k;
+            }
+            comp.counts[index] = count;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Encode a block (natural order) into the scan.  Zigzag positions from
+// count on are zero.
+static void EncodeBlock(BitWriter& writer, const int16_t* block, int count,
+                        int* pred, const HuffEncoder& dc,
+                        const HuffEncoder& ac) {
+  // The code and the value bits together are at most 27 bits
+  auto put = [&](const HuffEncoder& table, int sym, int val, int size) {
+    if (val < 0) val += (1 << size) - 1;
+    uint32_t bits = (static_cast<uint32_t>(table.code[sym]) << size) |
+                    (val & ((1 << size) - 1));
+    writer.Put(bits, table.size[sym] + size);
+  };
+  auto bitSize = [](int val) {
+    val = std::abs(val);
+    int size = 0;
+    if (val >= 16) {
+      val >>= 4;
+      size = 4;
+    }
+    while (val != 0) {
+      val >>= 1;
+      ++size;
+    }
+    return size;
+  };
+
+  int diff = block[0] - *pred;
+  *pred = block[0];
+  int size = bitSize(diff);
+  put(dc, size, diff, size);
+
+  int run = 0;
+  for (int k = 1; k < count; ++k) {
+    int val = block[kZigzag[k]];
+    if (val == 0) {
+      ++run;
+      continue;
+    }
+    for (; run >= 16; run -= 16) put(ac, 0xf0, 0, 0);  // ZRL
+    size = bitSize(val);
+    put(ac, (run << 4) | size, val, size);
+    run = 0;
+  }
+  if (run > 0 || count < 64) put(ac, 0x00, 0, 0);  // EOB
+}
+
+static void PutMarker(std::vector<uchar>& out, uchar marker, int len) {
+  out.push_back(0xff);
+  out.push_back(marker);
+  if (len > 0) {
+    out.push_back(len >> 8);
+    out.push_back(len & 0xff);
+  }
+}
+
+bool JpegTranscoder::Transcode(const Image& image, int width, int height,
+                               int quality, Image* out) {
+  const JpegInfo* info = image.GetJpegInfo();
+  if (!info || (info->sofType != 0xc0 && info->sofType != 0xc1)) return false;
+  if (info->components != 1 && info->components != 3) return false;
+
+  // Only exact scales (rounding either way)
+  int scale = 0;
+  for (int s : {1, 2, 4}) {
+    if ((width == info->width / s || width == (info->width + s - 1) / s) &&
+        (height == info->height / s ||
+         height == (info->height + s - 1) / s)) {
+      scale = s;
+      break;
+    }
+  }
+  if (scale == 0 || width <= 0 || height <= 0) return false;
+  quality = std::min(std::max(quality, 1), 100);
+
+  // Read the tables, and check the scan has all the components
+  const unsigned char* data = image.str().bytes_begin();
+  int quant[4][64];
+  bool haveQuant[4] = {false, false, false, false};
+  HuffSpec dcSpec[4], acSpec[4];
+  std::vector<Component> comps(info->components);
+  for (std::size_t pos = 2; pos < info->dataPos;) {
+    if (data[pos + 1] == 0xff) {
+      // fill byte
+      ++pos;
+      continue;
+    }
+    unsigned char code = data[pos + 1];
+    std::size_t len = data[pos + 2] * 256 + data[pos + 3] - 2;
+    const unsigned char* seg = data + pos + 4;
+    if (code == 0xdb) {
+      // DQT
+      for (std::size_t i = 0; i < len;) {
+        int precision = seg[i] >> 4;
+        int id = seg[i] & 0x0f;
+        if (id > 3 || i + 1 + 64 * (precision + 1) > len) return false;
+        for (int k = 0; k < 64; ++k) {
+          quant[id][kZigzag[k]] =
+              precision ? seg[i + 1 + 2 * k] * 256 + seg[i + 2 + 2 * k]
+                        : seg[i + 1 + k];
+        }
+        haveQuant[id] = true;
+        i += 1 + 64 * (precision + 1);
+      }
+    } else if (code == 0xc4) {
+      // DHT
+      if (!ParseDHT(seg, len, dcSpec, acSpec)) return false;
+    } else if (code == 0xc0 || code == 0xc1) {
+      // SOF
+      if (seg[0] != 8) return false;  // 8-bit samples only
+      for (int c = 0; c < info->components; ++c) {
+        comps[c].id = seg[6 + 3 * c];
+        comps[c].h = seg[7 + 3 * c] >> 4;
+        comps[c].v = seg[7 + 3 * c] & 0x0f;
+        comps[c].quant = seg[8 + 3 * c] & 0x03;
+        if (comps[c].h < 1 || comps[c].h > 4 || comps[c].v < 1 ||
+            comps[c].v > 4)
+          return false;
+      }
+    } else if (code == 0xda) {
+      // SOS
+      if (seg[0] != info->components) return false;
+      for (int c = 0; c < info->components; ++c) {
+        if (seg[1 + 2 * c] != comps[c].id) return false;
+        comps[c].dcTable = seg[2 + 2 * c] >> 4;
+        comps[c].acTable = seg[2 + 2 * c] & 0x0f;
+        if (comps[c].dcTable > 3 || comps[c].acTable > 3) return false;
+      }
+    }
+    pos += 4 + len;
+  }
+
+  // Images without DHT (e.g. from USB cameras) use the standard tables
+  llvm::StringRef stdDHT = JpegGetDHT();
+  auto stdData = stdDHT.bytes_begin();
+  HuffSpec stdDC[4], stdAC[4];
+  if (!ParseDHT(stdData + 4, stdDHT.size() - 4, stdDC, stdAC)) return false;
+  HuffDecoder dc[4], ac[4];
+  for (int i = 0; i < 4; ++i) {
+    if (!dcSpec[i].bits && i < 2) dcSpec[i] = stdDC[i];
+    if (!acSpec[i].bits && i < 2) acSpec[i] = stdAC[i];
+    if (dcSpec[i].bits && !dc[i].Init(dcSpec[i])) return false;
+    if (acSpec[i].bits && !ac[i].Init(acSpec[i])) return false;
+  }
+
+  // A single component is not interleaved, so its MCU is one block
+  if (info->components == 1) comps[0].h = comps[0].v = 1;
+  int mcusWide = (info->width + info->mcuWidth - 1) / info->mcuWidth;
+  int mcusHigh = (info->height + info->mcuHeight - 1) / info->mcuHeight;
+  for (std::size_t c = 0; c < comps.size(); ++c) {
+    Component& comp = comps[c];
+    if (!haveQuant[comp.quant] || !dc[comp.dcTable].IsValid() ||
+        !ac[comp.acTable].IsValid())
+      return false;
+    // DecodeScan() clears each block, so the buffers are just resized
+    comp.blocksWide = mcusWide * comp.h;
+    comp.blocksHigh = mcusHigh * comp.v;
+    std::size_t numBlocks = comp.blocksWide * comp.blocksHigh;
+    m_in[c].coefs.resize(numBlocks * 64);
+    m_in[c].counts.resize(numBlocks);
+    comp.coefs = m_in[c].coefs.data();
+    comp.counts = m_in[c].counts.data();
+  }
+  if (!DecodeScan(data, data + image.size(), *info, dc, ac, mcusWide,
+                  mcusHigh, comps))
+    return false;
+
+  // New quantization tables: luma and chroma
+  int newQuant[2][64];
+  JpegScaleQuant(quality, false, newQuant[0]);
+  JpegScaleQuant(quality, true, newQuant[1]);
+
+  // Requantize (and scale) each component into the new block layout
+  int outMcusWide = (width + info->mcuWidth - 1) / info->mcuWidth;
+  int outMcusHigh = (height + info->mcuHeight - 1) / info->mcuHeight;
+  int n = 8 / scale;
+  float fbasis[4][8][4];
+  if (scale > 1) {
+    double basis[4][8][4];
+    MakeScaleBasis(scale, basis);
+    for (int k = 0; k < scale; ++k) {
+      for (int u = 0; u < 8; ++u) {
+        for (int j = 0; j < n; ++j) fbasis[k][u][j] = basis[k][u][j];
+      }
+    }
+  }
+  std::vector<Component> outComps(comps);
+  for (std::size_t c = 0; c < comps.size(); ++c) {
+    const Component& comp = comps[c];
+    Component& outComp = outComps[c];
+    outComp.quant = c == 0 ? 0 : 1;
+    const int* q = quant[comp.quant];
+    const int* newQ = newQuant[outComp.quant];
+
+    if (scale == 1) {
+      // Same block layout, so requantize in place
+      float requant[64];  // old to new quantization
+      for (int k = 0; k < 64; ++k)
+        requant[k] = static_cast<float>(q[k]) / newQ[k];
+      int numBlocks = comp.blocksWide * comp.blocksHigh;
+      for (int b = 0; b < numBlocks; ++b) {
+        int16_t* block = &comp.coefs[b * 64];
+        for (int k = 0; k < comp.counts[b]; ++k) {
+          int16_t& coef = block[kZigzag[k]];
+          if (coef != 0) coef = Round(coef * requant[kZigzag[k]]);
+        }
+      }
+      continue;
+    }
+
+    outComp.blocksWide = outMcusWide * comp.h;
+    outComp.blocksHigh = outMcusHigh * comp.v;
+    std::size_t numBlocks = outComp.blocksWide * outComp.blocksHigh;
+    m_out[c].coefs.resize(numBlocks * 64);
+    m_out[c].counts.resize(numBlocks);
+    outComp.coefs = m_out[c].coefs.data();
+    outComp.counts = m_out[c].counts.data();
+    float invQ[64];
+    for (int k = 0; k < 64; ++k) invQ[k] = 1.0f / newQ[k];
+    for (int by = 0; by < outComp.blocksHigh; ++by) {
+      for (int bx = 0; bx < outComp.blocksWide; ++bx) {
+        // Combine the top-left n x n coefficients of s x s blocks (the edge
+        // blocks are repeated past the end of the image)
+        float sum[8][8] = {};
+        for (int i = 0; i < scale; ++i) {
+          int y = std::min(by * scale + i, comp.blocksHigh - 1);
+          // tmp = sum over j of coefs[j] * basis[j]^T
+          float tmp[4][8] = {};
+          for (int j = 0; j < scale; ++j) {
+            int x = std::min(bx * scale + j, comp.blocksWide - 1);
+            const int16_t* block = &comp.coefs[(y * comp.blocksWide + x) * 64];
+            for (int r = 0; r < n; ++r) {
+              for (int k = 0; k < n; ++k) {
+                if (block[r * 8 + k] == 0) continue;
+                float deq = static_cast<float>(block[r * 8 + k] * q[r * 8 + k]);
+                for (int u = 0; u < 8; ++u) tmp[r][u] += deq * fbasis[j][u][k];
+              }
+            }
+          }
+          // sum += basis[i] * tmp
+          for (int v = 0; v < 8; ++v) {
+            for (int r = 0; r < n; ++r) {
+              float b = fbasis[i][v][r];
+              for (int u = 0; u < 8; ++u) sum[v][u] += b * tmp[r][u];
+            }
+          }
+        }
+        int index = by * outComp.blocksWide + bx;
+        int16_t* outBlock = &outComp.coefs[index * 64];
+        int count = 1;
+        for (int k = 0; k < 64; ++k) {
+          int z = kZigzag[k];
+          int16_t coef = Round(sum[z / 8][z % 8] * invQ[z]);
+          outBlock[z] = coef;
+          if (coef != 0) count = k + 1;
+        }
+        outComp.counts[index] = count;
+      }
+    }
+  }
+
+  // Write the headers
+  std::vector<uchar>& buf = out->vec();
+  buf.clear();
+  buf.reserve(image.size() / (scale * scale) + stdDHT.size() + 1024);
+  PutMarker(buf, 0xd8, 0);  // SOI
+  int numQuant = comps.size() == 1 ? 1 : 2;
+  PutMarker(buf, 0xdb, 2 + 65 * numQuant);  // DQT
+  for (int i = 0; i < numQuant; ++i) {
+    buf.push_back(i);
+    for (int k = 0; k < 64; ++k) buf.push_back(newQuant[i][kZigzag[k]]);
+  }
+  PutMarker(buf, 0xc0, 8 + 3 * comps.size());  // SOF0
+  buf.push_back(8);
+  buf.push_back(height >> 8);
+  buf.push_back(height & 0xff);
+  buf.push_back(width >> 8);
+  buf.push_back(width & 0xff);
+  buf.push_back(comps.size());
+  for (const auto& comp : outComps) {
+    buf.push_back(comp.id);
+    buf.push_back((comp.h << 4) | comp.v);
+    buf.push_back(comp.quant);
+  }
+  buf.insert(buf.end(), stdData, stdData + stdDHT.size());  // DHT
+  int interval = info->restartInterval;
+  if (interval != 0) {
+    PutMarker(buf, 0xdd, 4);  // DRI
+    buf.push_back(interval >> 8);
+    buf.push_back(interval & 0xff);
+  }
+  PutMarker(buf, 0xda, 6 + 2 * comps.size());  // SOS
+  buf.push_back(comps.size());
+  for (const auto& comp : outComps) {
+    buf.push_back(comp.id);
+    buf.push_back(comp.quant == 0 ? 0x00 : 0x11);
+  }
+  buf.push_back(0);   // Ss
+  buf.push_back(63);  // Se
+  buf.push_back(0);   // Ah/Al
+
+  // Encode the scan with the standard tables
+  HuffEncoder dcEnc[2], acEnc[2];
+  for (int i = 0; i < 2; ++i) {
+    dcEnc[i].Init(stdDC[i]);
+    acEnc[i].Init(stdAC[i]);
+  }
+  BitWriter writer{buf};
+  int pred[4] = {0, 0, 0, 0};
+  int toRestart = interval;
+  int restart = 0;
+  for (int my = 0; my < outMcusHigh; ++my) {
+    for (int mx = 0; mx < outMcusWide; ++mx) {
+      if (interval != 0 && toRestart-- == 0) {
+        writer.Flush();
+        PutMarker(buf, 0xd0 + (restart++ & 7), 0);  // RSTn
+        std::fill(pred, pred + 4, 0);
+        toRestart = interval - 1;
+      }
+      for (std::size_t c = 0; c < outComps.size(); ++c) {
+        const Component& comp = outComps[c];
+        int table = comp.quant;
+        for (int v = 0; v < comp.v; ++v) {
+          for (int h = 0; h < comp.h; ++h) {
+            int index =
+                (my * comp.v + v) * comp.blocksWide + mx * comp.h + h;
+            EncodeBlock(writer, &comp.coefs[index * 64], comp.counts[index],
+                        &pred[c], dcEnc[table], acEnc[table]);
+          }
+        }
+      }
+    }
+  }
+  writer.Flush();
+  PutMarker(buf, 0xd9, 0);  // EOI
+  out->SetSize(buf.size());  // invalidates any cached marker index
+  return true;
+}
+
+}  // namespace cs
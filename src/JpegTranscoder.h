@@ -0,0 +1,50 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_JPEGTRANSCODER_H_
+#define CS_JPEGTRANSCODER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace cs {
+
+class Image;
+
+// Transcodes baseline JPEGs without decoding them to pixels: the DCT
+// coefficients are requantized to the new quality and, if the new size is
+// half or a quarter of the image size, downscaled in the DCT domain.  The
+// result is encoded with the standard Huffman tables and keeps the image's
+// chroma subsampling and restart interval.
+//
+// The coefficient buffers are kept between calls, so one object should be
+// reused for a stream of images.  Not thread safe.
+class JpegTranscoder {
+ public:
+  // @param out Image to write the JPEG into (its width, height, and
+  //     jpegQuality are not changed)
+  // @return False if the image can't be transcoded (e.g. not baseline, or
+  //     not an exact scale)
+  bool Transcode(const Image& image, int width, int height, int quality,
+                 Image* out);
+
+ private:
+  // Coefficients of one component: 64 per block in natural order, and per
+  // block the number of zigzag positions up to the last nonzero one
+  struct Blocks {
+    std::vector<int16_t> coefs;
+    std::vector<unsigned char> counts;
+  };
+
+  Blocks m_in[3];
+  Blocks m_out[3];
+};
+
+}  // namespace cs
+
+#endif  // CS_JPEGTRANSCODER_H_
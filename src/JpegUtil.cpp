@@ -7,7 +7,10 @@
 
 #include "JpegUtil.h"
 
-#include "support/raw_istream.h"
+#include <algorithm>
+#include <cstring>
+
+#include "Image.h"
 
 namespace cs {
 
@@ -49,6 +52,35 @@ static const unsigned char dhtData[] = {
     0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
     0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
 
+// Standard (IJG) quantization tables for quality 50, in natural order
+static const int kLumaQuant[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+static const int kChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Estimate the IJG quality of a luma quantization table from the sum of its
+// entries.  This is exact (up to rounding) for IJG-derived encoders, and a
+// reasonable equivalent for other tables.
+static int EstimateQuality(int sum) {
+  int baseSum = 0;
+  for (int i = 0; i < 64; ++i) baseSum += kLumaQuant[i];
+  int scale = (sum * 100 + baseSum / 2) / baseSum;  // percent
+  int quality;
+  if (scale <= 0)
+    quality = 100;
+  else if (scale <= 100)
+    quality = (200 - scale + 1) / 2;
+  else
+    quality = (5000 + scale / 2) / scale;
+  return std::min(std::max(quality, 1), 100);
+}
+
 bool IsJpeg(llvm::StringRef data) {
   if (data.size() < 11) return false;
 
@@ -66,55 +98,135 @@ bool IsJpeg(llvm::StringRef data) {
   return true;
 }
 
-bool GetJpegSize(llvm::StringRef data, int* width, int* height) {
+bool ParseJpeg(llvm::StringRef data, JpegInfo* info) {
+  info->width = 0;
+  info->height = 0;
+  info->components = 0;
+  info->mcuWidth = 0;
+  info->mcuHeight = 0;
+  info->sofType = 0;
+  info->sofPos = 0;
+  info->sosPos = 0;
+  info->dataPos = 0;
+  info->hasDHT = false;
+  info->hasDQT = false;
+  info->quality = -1;
+  info->restartInterval = 0;
+  info->restarts.clear();  // keeps capacity for pooled images
+  info->scanEnd = 0;
+
   if (!IsJpeg(data)) return false;
 
+  // Walk the header segments up to the first SOS
+  int quantSums[4] = {0, 0, 0, 0};
+  int lumaQuant = 0;
   auto bytes = data.bytes_begin();
-  size_t blockLength = bytes[4] * 256 + bytes[5] + 4;
+  std::size_t size = data.size();
+  std::size_t pos = 2;
   for (;;) {
-    data = data.substr(blockLength);    // Get to the next block
-    if (data.size() < 4) return false;  // EOF
-    bytes = data.bytes_begin();
-    if (bytes[0] != 0xff) return false;  // not a tag
-    if (bytes[1] == 0xc0) {
-      // SOF contains the file size
-      if (data.size() < 9) return false;
-      *height = bytes[5] * 256 + bytes[6];
-      *width = bytes[7] * 256 + bytes[8];
-      return true;
+    if (pos + 4 > size) return false;    // EOF
+    if (bytes[pos] != 0xff) return false;  // not a tag
+    unsigned char code = bytes[pos + 1];
+    if (code == 0xff) {
+      // fill byte
+      ++pos;
+      continue;
+    }
+    std::size_t len = bytes[pos + 2] * 256 + bytes[pos + 3];
+    if (len < 2 || pos + 2 + len > size) return false;
+    const unsigned char* seg = bytes + pos + 4;
+    switch (code) {
+      case 0xc4:  // DHT
+        info->hasDHT = true;
+        break;
+      case 0xdb:  // DQT
+        info->hasDQT = true;
+        for (std::size_t i = 0; i < len - 2;) {
+          int precision = seg[i] >> 4;
+          int id = seg[i] & 0x0f;
+          std::size_t tableLen = 1 + 64 * (precision + 1);
+          if (id > 3 || i + tableLen > len - 2) break;
+          int sum = 0;
+          for (int k = 0; k < 64; ++k) {
+            sum += precision ? seg[i + 1 + 2 * k] * 256 + seg[i + 2 + 2 * k]
+                             : seg[i + 1 + k];
+          }
+          quantSums[id] = sum;
+          i += tableLen;
+        }
+        break;
+      case 0xdd:  // DRI
+        if (len < 4) return false;
+        info->restartInterval = seg[0] * 256 + seg[1];
+        break;
+      case 0xda:  // SOS
+        if (info->sofPos == 0) return false;
+        info->sosPos = pos;
+        info->dataPos = pos + 2 + len;
+        break;
+      default:
+        // SOFn (0xc4, 0xc8, and 0xcc are other markers in the same range)
+        if (code >= 0xc0 && code <= 0xcf && code != 0xc8 && code != 0xcc) {
+          if (len < 8) return false;
+          info->sofType = code;
+          info->sofPos = pos;
+          info->height = seg[1] * 256 + seg[2];
+          info->width = seg[3] * 256 + seg[4];
+          info->components = seg[5];
+          if (len < 8u + 3 * info->components) return false;
+          if (info->components > 0) lumaQuant = seg[8] & 0x03;
+          // A MCU covers the largest sampling factors (one block if there
+          // is a single component, as its scan is not interleaved)
+          int maxH = 1, maxV = 1;
+          if (info->components > 1) {
+            for (int i = 0; i < info->components; ++i) {
+              maxH = std::max(maxH, seg[7 + 3 * i] >> 4);
+              maxV = std::max(maxV, seg[7 + 3 * i] & 0x0f);
+            }
+          }
+          info->mcuWidth = 8 * maxH;
+          info->mcuHeight = 8 * maxV;
+        }
+        break;
     }
-    // Go to the next block
-    blockLength = bytes[2] * 256 + bytes[3] + 2;
+    if (info->sosPos != 0) break;
+    pos += 2 + len;
   }
-}
 
-bool JpegNeedsDHT(const char* data, std::size_t* size, std::size_t* locSOF) {
-  llvm::StringRef sdata(data, *size);
-  if (!IsJpeg(sdata)) return false;
-
-  *locSOF = *size;
-
-  // Search until SOS for DHT tag
-  auto bytes = sdata.bytes_begin();
-  size_t blockLength = bytes[4] * 256 + bytes[5] + 4;
-  for (;;) {
-    sdata = sdata.substr(blockLength);   // Get to the next block
-    if (sdata.size() < 4) return false;  // EOF
-    bytes = sdata.bytes_begin();
-    if (bytes[0] != 0xff) return false;                   // not a tag
-    if (bytes[1] == 0xda) break;                          // SOS
-    if (bytes[1] == 0xc4) return false;                   // DHT
-    if (bytes[1] == 0xc0) *locSOF = sdata.data() - data;  // SOF
-    // Go to the next block
-    blockLength = bytes[2] * 256 + bytes[3] + 2;
+  if (quantSums[lumaQuant] != 0)
+    info->quality = EstimateQuality(quantSums[lumaQuant]);
+
+  if (info->restartInterval == 0) return true;
+
+  // Find the restart markers; byte stuffing (FF 00) means any other FF is
+  // a marker, and anything but RSTn ends the scan.
+  pos = info->dataPos;
+  info->scanEnd = size;
+  while (pos < size) {
+    auto ff = static_cast<const unsigned char*>(
+        std::memchr(bytes + pos, 0xff, size - pos));
+    if (!ff || ff + 1 >= bytes + size) break;
+    pos = ff - bytes;
+    unsigned char code = ff[1];
+    if (code >= 0xd0 && code <= 0xd7) {
+      info->restarts.push_back(pos);
+    } else if (code != 0x00 && code != 0xff) {
+      info->scanEnd = pos;
+      break;
+    }
+    pos += (code == 0xff) ? 1 : 2;
   }
+  return true;
+}
 
-  // Only add DHT if we also found SOF (insertion point)
-  if (*locSOF != *size) {
-    *size += sizeof(dhtData);
-    return true;
-  }
-  return false;
+bool JpegNeedsDHT(const Image& image, std::size_t* size,
+                  std::size_t* locSOF) {
+  // The standard tables only apply to baseline images
+  const JpegInfo* info = image.GetJpegInfo();
+  if (!info || info->hasDHT || info->sofType != 0xc0) return false;
+  *locSOF = info->sofPos;
+  *size += sizeof(dhtData);
+  return true;
 }
 
 llvm::StringRef JpegGetDHT() {
@@ -122,79 +234,12 @@ llvm::StringRef JpegGetDHT() {
                          sizeof(dhtData));
 }
 
-static inline void ReadInto(wpi::raw_istream& is, std::string& buf,
-                            size_t len) {
-  size_t oldSize = buf.size();
-  buf.resize(oldSize + len);
-  is.read(&(*buf.begin()) + oldSize, len);
-}
-
-bool ReadJpeg(wpi::raw_istream& is, std::string& buf, int* width,
-              int* height) {
-  // in case we don't get a SOF
-  *width = 0;
-  *height = 0;
-
-  // read the header
-  buf.resize(4 + 7);
-  is.read(&(*buf.begin()), 4 + 7);
-  if (is.has_error()) return false;
-  if (!IsJpeg(buf)) return false;
-
-  auto bytes = reinterpret_cast<const unsigned char*>(buf.data());
-  size_t pos = 4;
-  size_t blockLength = bytes[4] * 256 + bytes[5];
-  bool sofBlock = false;
-  for (;;) {
-    // Read to the next block + marker
-    ReadInto(is, buf, blockLength + 2);
-    if (is.has_error()) return false;
-
-    // Process any blocks we just read
-    if (sofBlock) {
-      // SOF contains the file size; make sure we actually read enough bytes
-      if (blockLength >= 7) {
-        *height = bytes[5] * 256 + bytes[6];
-        *width = bytes[7] * 256 + bytes[8];
-      }
-      sofBlock = false;
-    }
-
-    pos += blockLength;
-
-    bytes = reinterpret_cast<const unsigned char*>(buf.data() + pos);
-    if (bytes[0] != 0xff) return false;     // not a tag
-    if (bytes[1] == 0xda) {
-      // SOS: need to keep reading until we reach a normal marker.
-      // Byte stuffing ensures we don't get false markers.
-      bool maybeMarker = false;
-      for (;;) {
-        ReadInto(is, buf, 1);
-        if (is.has_error()) return false;
-        ++pos;
-        bytes = reinterpret_cast<const unsigned char*>(buf.data() + pos);
-        if (maybeMarker) {
-          if (bytes[0] != 0x00 && bytes[0] != 0xff &&
-              (bytes[0] < 0xd0 || bytes[0] > 0xd7))
-            break;
-          maybeMarker = false;
-        } else if (bytes[0] == 0xff)
-          maybeMarker = true;
-      }
-      // Point back to the start of the block
-      --pos;
-      bytes = reinterpret_cast<const unsigned char*>(buf.data() + pos);
-    }
-    if (bytes[0] != 0xff) return false;     // not a tag
-    if (bytes[1] == 0xd9) return true;      // EOI, we're done
-    if (bytes[1] == 0xc0) sofBlock = true;  // SOF
-
-    // Go to the next block
-    ReadInto(is, buf, 2);  // read length
-    if (is.has_error()) return false;
-    pos += 2;
-    blockLength = bytes[2] * 256 + bytes[3];
-  }
+void JpegScaleQuant(int quality, bool chroma, int* table) {
+  const int* base = chroma ? kChromaQuant : kLumaQuant;
+  quality = std::min(std::max(quality, 1), 100);
+  int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+  for (int i = 0; i < 64; ++i)
+    table[i] = std::min(std::max((base[i] * scale + 50) / 100, 1), 255);
 }
 
 }  // namespace cs
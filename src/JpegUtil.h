@@ -8,23 +8,54 @@
 #ifndef CS_JPEGUTIL_H_
 #define CS_JPEGUTIL_H_
 
-#include "llvm/StringRef.h"
+#include <vector>
 
-namespace wpi {
-class raw_istream;
-}
+#include "llvm/StringRef.h"
 
 namespace cs {
 
+class Image;
+
+// Index of the markers in a JPEG image, built in a single pass by
+// ParseJpeg().  Images cache this (see Image::GetJpegInfo()) so the
+// headers are only walked once per frame no matter how many sinks use it.
+struct JpegInfo {
+  int width{0};
+  int height{0};
+  int components{0};
+  int mcuWidth{0};           // size of a MCU in pixels
+  int mcuHeight{0};
+  unsigned char sofType{0};  // SOFn marker code (0xc0 for baseline)
+  std::size_t sofPos{0};     // offset of the SOF marker
+  std::size_t sosPos{0};     // offset of the first SOS marker
+  std::size_t dataPos{0};    // offset of the entropy-coded data after it
+  bool hasDHT{false};        // DHT before the first SOS
+  bool hasDQT{false};        // DQT before the first SOS
+  int quality{-1};           // estimated from the luma DQT (-1 if none)
+  int restartInterval{0};    // MCUs per restart interval (0 if none)
+  // Offsets of the RSTn markers in the first scan, and of the marker that
+  // ends it (only if restartInterval)
+  std::vector<std::size_t> restarts;
+  std::size_t scanEnd{0};
+};
+
 bool IsJpeg(llvm::StringRef data);
 
-bool GetJpegSize(llvm::StringRef data, int* width, int* height);
+// Parse the markers of a JPEG image up to its first scan.  If it has a
+// restart interval, the scan is also searched for its restart markers.
+// @return False if the image is not a valid JPEG
+bool ParseJpeg(llvm::StringRef data, JpegInfo* info);
 
-bool JpegNeedsDHT(const char* data, std::size_t* size, std::size_t* locSOF);
+// Determine if a baseline image lacks the DHT, using its cached marker
+// index.  If so, size is increased by the DHT size and locSOF is set to
+// where it should be inserted.
+bool JpegNeedsDHT(const Image& image, std::size_t* size, std::size_t* locSOF);
 
 llvm::StringRef JpegGetDHT();
 
-bool ReadJpeg(wpi::raw_istream& is, std::string& buf, int* width, int* height);
+// Get a standard (IJG) quantization table scaled to a quality (1-100) the
+// same way libjpeg does, in natural (not zigzag) order.
+void JpegScaleQuant(int quality, bool chroma, int* table);
 
 }  // namespace cs
 
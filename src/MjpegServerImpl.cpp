@@ -8,28 +8,63 @@
 #include "MjpegServerImpl.h"
 
 #include <chrono>
+#include <map>
 
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
+#include "llvm/Format.h"
 #include "llvm/SmallString.h"
-#include "support/raw_socket_istream.h"
 #include "support/raw_socket_ostream.h"
+#include "support/timestamp.h"
 #include "tcpsockets/TCPAcceptor.h"
 
 #include "c_util.h"
 #include "cscore_cpp.h"
+#include "cscore_raw.h"
 #include "Handle.h"
+#include "HttpParser.h"
 #include "HttpUtil.h"
 #include "JpegUtil.h"
 #include "Log.h"
 #include "Notifier.h"
 #include "SourceImpl.h"
+#include "StreamRateController.h"
+#include "UnixAcceptor.h"
+#include "WebSocketUtil.h"
 
 using namespace cs;
 
+#ifdef _WIN32
+#define poll WSAPoll
+#endif
 
 // The boundary used for the M-JPEG stream.
 // It separates the multipart stream of pictures
 #define BOUNDARY "boundarydonotcross"
 
+// Time (in seconds) to wait for the next request on a kept-alive connection
+static const int kKeepAliveTimeout = 5;
+
+// Time (in seconds) to wait for a fresh frame for a snapshot
+static const double kSnapshotTimeout = 1.5;
+
+// Size of the header preceding the JPEG data in WebSocket stream messages:
+// frame time (uint64), width (uint16), height (uint16), quality (uint8; 0 if
+// unknown), and 3 reserved bytes.  All values are big-endian.
+static const std::size_t kWsFrameHeaderSize = 16;
+
+// Largest number of unacknowledged frames a WebSocket client can request
+static const int kMaxWsWindow = 32;
+
 // A bare-bones HTML webpage for user friendliness.
 static const char* emptyRootPage =
     "<html><head><title>CameraServer</title></head><body>"
@@ -66,50 +101,177 @@ static const char* startRootPage = "<html><head>\n"
     "<a href=\"/settings.json\">Settings JSON</a>\n";
 static const char* endRootPage ="</body></html>";
 
+// Rendered settings.json and root page for each source.  Rendering takes the
+// source mutex once per property attribute, so documents are kept until a
+// property or video mode event for the source invalidates them.
+class MjpegServerImpl::DocCache {
+ public:
+  enum Doc { kJSON = 0, kHTML, kNumDocs };
+
+  // Get a document, calling render(os) to produce it if not cached.
+  template <typename F>
+  std::shared_ptr<const std::string> Get(
+      const std::shared_ptr<SourceImpl>& source, Doc doc, F render) {
+    unsigned int generation;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto& entry = GetEntry(source);
+      if (entry.docs[doc]) return entry.docs[doc];
+      generation = entry.generation;
+    }
+
+    // render without holding the lock, as it takes the source mutex
+    auto str = std::make_shared<std::string>();
+    llvm::raw_string_ostream os{*str};
+    render(os);
+    os.flush();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& entry = GetEntry(source);
+    // don't cache if the source changed while rendering
+    if (entry.generation == generation) entry.docs[doc] = str;
+    return str;
+  }
+
+  // Called from the notifier thread.
+  void Invalidate(CS_Source handle) {
+    auto data = Sources::GetInstance().Get(handle);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+      auto cur = it++;
+      if (cur->second.source.expired())
+        m_entries.erase(cur);
+      else if (data && cur->first == data->source.get())
+        cur->second.Clear();
+    }
+  }
+
+ private:
+  struct Entry {
+    // sources are keyed by address, so keep a weak reference to detect reuse
+    std::weak_ptr<SourceImpl> source;
+    unsigned int generation = 0;
+    std::shared_ptr<const std::string> docs[kNumDocs];
+
+    void Clear() {
+      ++generation;
+      for (auto& doc : docs) doc.reset();
+    }
+  };
+
+  Entry& GetEntry(const std::shared_ptr<SourceImpl>& source) {
+    auto& entry = m_entries[source.get()];
+    if (entry.source.lock() != source) {
+      entry.Clear();
+      entry.source = source;
+    }
+    return entry;
+  }
+
+  std::mutex m_mutex;
+  std::map<SourceImpl*, Entry> m_entries;
+};
+
 class MjpegServerImpl::ConnThread : public wpi::SafeThread {
  public:
-  ConnThread(llvm::StringRef name) : m_name(name) {}
+  ConnThread(llvm::StringRef name, bool routed,
+             std::shared_ptr<DocCache> docCache)
+      : m_name(name), m_routed(routed), m_docCache(std::move(docCache)) {}
 
   void Main();
 
   bool ProcessCommand(llvm::raw_ostream& os, SourceImpl& source,
                       llvm::StringRef parameters, bool respond);
-  void SendJSON(llvm::raw_ostream& os, SourceImpl& source, bool header);
-  void SendHTML(llvm::raw_ostream& os, SourceImpl& source, bool header);
+  void SendJSON(llvm::raw_ostream& os, SourceImpl& source);
+  void SendHTML(llvm::raw_ostream& os, SourceImpl& source);
+  void SendSourceList(llvm::raw_ostream& os);
   void SendStream(wpi::raw_socket_ostream& os);
-  void ProcessRequest();
+  void SendWebSocketStream(wpi::raw_socket_ostream& os);
+  void SendRawStream(wpi::raw_socket_ostream& os);
+  bool SendSnapshot(wpi::raw_socket_ostream& os, llvm::StringRef ifNoneMatch,
+                    bool keepAlive);
+  bool ReadRequest(int timeout);
+  bool SkipRequestBody(unsigned long long len);
+  bool ProcessRequest(wpi::raw_socket_ostream& os);
+  void ProcessConnection();
+
+  // What the client asked for, so the source needn't get more
+  VideoMode GetDemand() const {
+    return VideoMode{VideoMode::kUnknown, m_width, m_height, m_fps};
+  }
 
   std::unique_ptr<wpi::NetworkStream> m_stream;
   std::shared_ptr<SourceImpl> m_source;
+  // Source selected by name for the current request (routed mode only).
+  // Unlike m_source, this is not changed by SetSource().
+  std::shared_ptr<SourceImpl> m_routedSource;
   bool m_streaming = false;
   bool m_noStreaming = false;
 
  private:
+  // Source kept enabled for snapshots for the life of the connection
+  std::shared_ptr<SourceImpl> m_snapshotSource;
+
   std::string m_name;
+  bool m_routed;
+  std::shared_ptr<DocCache> m_docCache;
 
   llvm::StringRef GetName() { return m_name; }
 
   std::shared_ptr<SourceImpl> GetSource() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return m_source;
+    return m_routedSource ? m_routedSource : m_source;
+  }
+
+  void SetRoutedSource(std::shared_ptr<SourceImpl> source) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_routedSource = source;
   }
 
   void StartStream() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_source->EnableSink();
+    if (m_routedSource)
+      m_routedSource->EnableSink(GetDemand());
+    else if (m_source)
+      m_source->EnableSink(GetDemand());
     m_streaming = true;
   }
 
   void StopStream() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_source->DisableSink();
+    if (m_routedSource)
+      m_routedSource->DisableSink(GetDemand());
+    else if (m_source)
+      m_source->DisableSink(GetDemand());
     m_streaming = false;
   }
 
   int m_width{0};
   int m_height{0};
-  int m_compression{80};
+  int m_compression{-1};  // -1 to send camera JPEGs as-is
   int m_fps{0};
+
+  // adaptive streaming
+  bool m_adaptive{false};
+  int m_targetLatency{250};  // ms
+  int m_targetBitrate{0};    // kbit/s; 0 = unlimited
+
+  // WebSocket streaming: maximum number of frames in flight
+  int m_window{2};
+
+  // send per-stage frame timestamps with each MJPEG stream part
+  bool m_timing{false};
+
+  // raw streaming: pixel format to send
+  VideoMode::PixelFormat m_rawFormat{VideoMode::kBGR};
+
+  // Request parsing.  Data is received in blocks; anything after the end
+  // of a request is kept for the next (pipelined) request.
+  HttpParser m_parser{HttpParser::kRequest};
+  char m_recvBuf[4096];
+  std::size_t m_recvPos{0};
+  std::size_t m_recvLen{0};
+  bool m_keepAlive{false};  // keep connection open after current response
 };
 
 // Standard header to send along with other header information like mimetype.
@@ -133,11 +295,38 @@ static void SendHeader(llvm::raw_ostream& os, int code,
   os << "\r\n";  // header ends with a blank line
 }
 
+// Send a complete response (header and body) with a single write.
+// Unlike SendHeader, the body length is sent, so the connection can be kept
+// open for further requests.
+// @param keepAlive If true, the client is told the connection stays open
+static void SendResponse(llvm::raw_ostream& os, int code,
+                         llvm::StringRef codeText, llvm::StringRef contentType,
+                         llvm::StringRef body, bool keepAlive,
+                         llvm::StringRef extra = llvm::StringRef{}) {
+  llvm::SmallString<4096> buf;
+  llvm::raw_svector_ostream oss{buf};
+  oss << "HTTP/1.1 " << code << ' ' << codeText << "\r\n";
+  oss << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n";
+  oss << "Server: CameraServer/1.0\r\n"
+         "Cache-Control: no-store, no-cache, must-revalidate, pre-check=0, "
+         "post-check=0, max-age=0\r\n"
+         "Pragma: no-cache\r\n"
+         "Expires: Mon, 3 Jan 2000 12:34:56 GMT\r\n";
+  oss << "Content-Type: " << contentType << "\r\n";
+  oss << "Content-Length: " << body.size() << "\r\n";
+  if (!extra.empty()) oss << extra << "\r\n";
+  oss << "\r\n";  // header ends with a blank line
+  oss << body;
+  os << oss.str();
+  os.flush();
+}
+
 // Send error header and message
 // @param code HTTP error code (e.g. 404)
 // @param message Additional message text
-static void SendError(llvm::raw_ostream& os, int code,
-                      llvm::StringRef message) {
+// @param keepAlive If true, the connection stays open after the error
+static void SendError(llvm::raw_ostream& os, int code, llvm::StringRef message,
+                      bool keepAlive = false) {
   llvm::StringRef codeText, extra, baseMessage;
   switch (code) {
     case 401:
@@ -171,8 +360,10 @@ static void SendError(llvm::raw_ostream& os, int code,
       baseMessage = "501: Not Implemented!";
       break;
   }
-  SendHeader(os, code, codeText, "text/plain", extra);
-  os << baseMessage << "\r\n" << message;
+  llvm::SmallString<256> body{baseMessage};
+  body += "\r\n";
+  body += message;
+  SendResponse(os, code, codeText, "text/plain", body, keepAlive, extra);
 }
 
 // Perform a command specified by HTTP GET parameters.
@@ -201,7 +392,7 @@ bool MjpegServerImpl::ConnThread::ProcessCommand(llvm::raw_ostream& os,
       llvm::SmallString<128> error;
       llvm::raw_svector_ostream oss{error};
       oss << "could not unescape parameter \"" << rawParam << "\"";
-      SendError(os, 500, error.str());
+      SendError(os, 500, error.str(), m_keepAlive);
       SDEBUG(error.str());
       return false;
     }
@@ -213,7 +404,7 @@ bool MjpegServerImpl::ConnThread::ProcessCommand(llvm::raw_ostream& os,
       llvm::SmallString<128> error;
       llvm::raw_svector_ostream oss{error};
       oss << "could not unescape value \"" << rawValue << "\"";
-      SendError(os, 500, error.str());
+      SendError(os, 500, error.str(), m_keepAlive);
       SDEBUG(error.str());
       return false;
     }
@@ -270,6 +461,72 @@ bool MjpegServerImpl::ConnThread::ProcessCommand(llvm::raw_ostream& os,
       continue;
     }
 
+    // Adaptive streaming: "adaptive=1" enables, "latency" (ms) and "bitrate"
+    // (kbit/s) set the targets.
+    if (param == "adaptive" || param == "latency" || param == "bitrate") {
+      int val;
+      if (value.getAsInteger(10, val) || val < 0) {
+        response << param << ": \"invalid integer\"\r\n";
+        SWARNING("HTTP parameter \"" << param << "\" value \"" << value
+                                     << "\" is not an integer");
+        continue;
+      }
+      if (param == "adaptive")
+        m_adaptive = val != 0;
+      else if (param == "latency")
+        m_targetLatency = val;
+      else
+        m_targetBitrate = val;
+      response << param << ": \"ok\"\r\n";
+      continue;
+    }
+
+    // Latency probing: "timing=1" adds an X-Frame-Times header to each
+    // stream part.
+    if (param == "timing") {
+      int val;
+      if (value.getAsInteger(10, val)) {
+        response << param << ": \"invalid integer\"\r\n";
+        SWARNING("HTTP parameter \"" << param << "\" value \"" << value
+                                     << "\" is not an integer");
+        continue;
+      }
+      m_timing = val != 0;
+      response << param << ": \"ok\"\r\n";
+      continue;
+    }
+
+    if (param == "window") {
+      int window;
+      if (value.getAsInteger(10, window) || window < 1 ||
+          window > kMaxWsWindow) {
+        response << param << ": \"invalid integer\"\r\n";
+        SWARNING("HTTP parameter \"" << param << "\" value \"" << value
+                                     << "\" is not a valid window size");
+        continue;
+      }
+      m_window = window;
+      response << param << ": \"ok\"\r\n";
+      continue;
+    }
+
+    if (param == "format") {
+      if (value == "gray") {
+        m_rawFormat = VideoMode::kGray;
+      } else if (value == "bgr") {
+        m_rawFormat = VideoMode::kBGR;
+      } else if (value == "yuyv") {
+        m_rawFormat = VideoMode::kYUYV;
+      } else {
+        response << param << ": \"unknown format\"\r\n";
+        SWARNING("HTTP parameter \"" << param << "\" value \"" << value
+                                     << "\" is not a raw format");
+        continue;
+      }
+      response << param << ": \"ok\"\r\n";
+      continue;
+    }
+
     // ignore name parameter
     if (param == "name") continue;
 
@@ -312,8 +569,8 @@ bool MjpegServerImpl::ConnThread::ProcessCommand(llvm::raw_ostream& os,
 
   // Send HTTP response
   if (respond) {
-    SendHeader(os, 200, "OK", "text/plain");
-    os << response.str() << "\r\n";
+    response << "\r\n";
+    SendResponse(os, 200, "OK", "text/plain", response.str(), m_keepAlive);
   }
 
   return true;
@@ -321,9 +578,7 @@ bool MjpegServerImpl::ConnThread::ProcessCommand(llvm::raw_ostream& os,
 
 // Send the root html file with controls for all the settable properties.
 void MjpegServerImpl::ConnThread::SendHTML(llvm::raw_ostream& os,
-                                           SourceImpl& source, bool header) {
-  if (header) SendHeader(os, 200, "OK", "application/x-javascript");
-
+                                           SourceImpl& source) {
   os << startRootPage;
   llvm::SmallVector<int, 32> properties_vec;
   CS_Status status = 0;
@@ -418,11 +673,28 @@ void MjpegServerImpl::ConnThread::SendHTML(llvm::raw_ostream& os,
   os.flush();
 }
 
+// Send an html page listing all sources (routed mode).
+void MjpegServerImpl::ConnThread::SendSourceList(llvm::raw_ostream& os) {
+  os << "<html><head><title>CameraServer</title></head><body>\n"
+        "<table>\n";
+  Sources::GetInstance().ForEach([&](CS_Source, const SourceData& data) {
+    llvm::SmallString<64> nameBuf;
+    auto escaped = EscapeURI(data.source->GetName(), nameBuf, false);
+    os << "<tr><td>" << data.source->GetName() << "</td>"
+       << "<td><a href=\"/stream/" << escaped << ".mjpg\">stream</a></td>"
+       << "<td><a href=\"/snapshot/" << escaped
+       << ".jpg\">snapshot</a></td>"
+       << "<td><a href=\"/settings/" << escaped
+       << ".json\">settings</a></td></tr>\n";
+  });
+  os << "</table>\n";
+  os << endRootPage << "\r\n";
+  os.flush();
+}
+
 // Send a JSON file which is contains information about the source parameters.
 void MjpegServerImpl::ConnThread::SendJSON(llvm::raw_ostream& os,
-                                           SourceImpl& source, bool header) {
-  if (header) SendHeader(os, 200, "OK", "application/x-javascript");
-
+                                           SourceImpl& source) {
   os << "{\n\"controls\": [\n";
   llvm::SmallVector<int, 32> properties_vec;
   bool first = true;
@@ -509,16 +781,33 @@ void MjpegServerImpl::ConnThread::SendJSON(llvm::raw_ostream& os,
 
 MjpegServerImpl::MjpegServerImpl(llvm::StringRef name,
                                  llvm::StringRef listenAddress, int port,
-                                 std::unique_ptr<wpi::NetworkAcceptor> acceptor)
+                                 std::unique_ptr<wpi::NetworkAcceptor> acceptor,
+                                 bool routed)
     : SinkImpl{name},
       m_listenAddress(listenAddress),
       m_port(port),
-      m_acceptor{std::move(acceptor)} {
+      m_routed(routed),
+      m_acceptor{std::move(acceptor)},
+      m_docCache{std::make_shared<DocCache>()} {
   m_active = true;
 
+  // drop cached documents when anything they show changes
+  std::weak_ptr<DocCache> weakCache = m_docCache;
+  m_docListener = Notifier::GetInstance().AddListener(
+      [weakCache](const RawEvent& event) {
+        if (auto cache = weakCache.lock())
+          cache->Invalidate(event.sourceHandle);
+      },
+      CS_SOURCE_CREATED | CS_SOURCE_DESTROYED | CS_SOURCE_CONNECTED |
+          CS_SOURCE_DISCONNECTED | CS_SOURCE_VIDEOMODES_UPDATED |
+          CS_SOURCE_VIDEOMODE_CHANGED | CS_SOURCE_PROPERTY_CREATED |
+          CS_SOURCE_PROPERTY_VALUE_UPDATED |
+          CS_SOURCE_PROPERTY_CHOICES_UPDATED);
+
   llvm::SmallString<128> descBuf;
   llvm::raw_svector_ostream desc{descBuf};
   desc << "HTTP Server on port " << port;
+  if (routed) desc << " (all sources)";
   SetDescription(desc.str());
 
   m_serverThread = std::thread(&MjpegServerImpl::ServerThreadMain, this);
@@ -529,6 +818,11 @@ MjpegServerImpl::~MjpegServerImpl() { Stop(); }
 void MjpegServerImpl::Stop() {
   m_active = false;
 
+  if (m_docListener != 0) {
+    Notifier::GetInstance().RemoveListener(m_docListener);
+    m_docListener = 0;
+  }
+
   // wake up server thread by shutting down the socket
   m_acceptor->shutdown();
 
@@ -548,6 +842,30 @@ void MjpegServerImpl::Stop() {
     source->Wakeup();
 }
 
+// Write a JPEG image, inserting the DHT data immediately before SOF if
+// required (as determined by JpegNeedsDHT).
+static void WriteJpeg(llvm::raw_ostream& os, const Image& image, bool addDHT,
+                      std::size_t locSOF) {
+  if (addDHT) {
+    os << llvm::StringRef(image.data(), locSOF);
+    os << JpegGetDHT();
+    os << llvm::StringRef(image.data() + locSOF, image.size() - locSOF);
+  } else {
+    os << image.str();
+  }
+}
+
+// Get the number of bytes in the socket send queue that have not yet been
+// acknowledged by the peer.  Only available on Linux; returns 0 elsewhere.
+static std::size_t GetSendQueueBytes(wpi::NetworkStream& stream) {
+#ifdef __linux__
+  int queued = 0;
+  if (::ioctl(stream.getNativeHandle(), SIOCOUTQ, &queued) == 0 && queued > 0)
+    return queued;
+#endif
+  return 0;
+}
+
 // Send HTTP response and a stream of JPG-frames
 void MjpegServerImpl::ConnThread::SendStream(wpi::raw_socket_ostream& os) {
   if (m_noStreaming) {
@@ -567,6 +885,16 @@ void MjpegServerImpl::ConnThread::SendStream(wpi::raw_socket_ostream& os) {
 
   SDEBUG("Headers send, sending stream now");
 
+  std::unique_ptr<StreamRateController> rate;
+  if (m_adaptive) {
+    SDEBUG("adaptive streaming, target latency " << m_targetLatency
+                                                 << " ms, bitrate "
+                                                 << m_targetBitrate << " kbps");
+    rate.reset(new StreamRateController{m_compression,
+                                        m_targetLatency / 1000.0,
+                                        m_targetBitrate * 1000.0});
+  }
+
   StartStream();
   while (m_active && !os.has_error()) {
     auto source = GetSource();
@@ -588,15 +916,19 @@ void MjpegServerImpl::ConnThread::SendStream(wpi::raw_socket_ostream& os) {
 
     int width = m_width != 0 ? m_width : frame.GetOriginalWidth();
     int height = m_height != 0 ? m_height : frame.GetOriginalHeight();
-    Image* image =
-        frame.GetImage(width, height, VideoMode::kMJPEG, m_compression);
+    int quality = m_compression;
+    if (rate) {
+      width = rate->GetWidth(width);
+      height = rate->GetHeight(height);
+      quality = rate->GetQuality();
+    }
+    Image* image = frame.GetImage(width, height, VideoMode::kMJPEG, quality);
     if (!image) {
       // Shouldn't happen, but just in case...
       std::this_thread::sleep_for(std::chrono::milliseconds(20));
       continue;
     }
 
-    const char* data = image->data();
     std::size_t size = image->size();
     bool addDHT = false;
     std::size_t locSOF = size;
@@ -604,7 +936,7 @@ void MjpegServerImpl::ConnThread::SendStream(wpi::raw_socket_ostream& os) {
       case VideoMode::kMJPEG:
         // Determine if we need to add DHT to it, and allocate enough space
         // for adding it if required.
-        addDHT = JpegNeedsDHT(data, &size, &locSOF);
+        addDHT = JpegNeedsDHT(*image, &size, &locSOF);
         break;
       case VideoMode::kYUYV:
       case VideoMode::kRGB565:
@@ -624,128 +956,637 @@ void MjpegServerImpl::ConnThread::SendStream(wpi::raw_socket_ostream& os) {
     oss << "\r\n--" BOUNDARY "\r\n"
         << "Content-Type: image/jpeg\r\n"
         << "Content-Length: " << size << "\r\n"
-        << "X-Timestamp: " << timestamp << "\r\n"
-        << "\r\n";
-    os << oss.str();
-    if (addDHT) {
-      // Insert DHT data immediately before SOF
-      os << llvm::StringRef(data, locSOF);
-      os << JpegGetDHT();
-      os << llvm::StringRef(data + locSOF, image->size() - locSOF);
-    } else {
-      os << llvm::StringRef(data, size);
+        << "X-Timestamp: " << timestamp << "\r\n";
+    // Quality of the frame actually sent; camera JPEGs may not follow the
+    // requested quality
+    int sentQuality = image->GetJpegQuality();
+    if (rate) {
+      if (sentQuality >= 0) oss << "X-Quality: " << sentQuality << "\r\n";
+      oss << "X-Resolution: " << image->width << 'x' << image->height
+          << "\r\n";
     }
+    if (m_timing) {
+      // Stage times in microseconds on the wpi::Now() clock, so a client on
+      // the same host can attribute latency (see examples/latencyprobe).
+      oss << "X-Frame-Times: capture=" << frame.GetTime() / 10
+          << ";put=" << frame.GetPutTime() / 10
+          << ";convert=" << frame.GetConvertTime() / 10
+          << ";send=" << wpi::Now() / 10 << "\r\n";
+    }
+    oss << "\r\n";
+    auto sendStart = std::chrono::steady_clock::now();
+    os << oss.str();
+    WriteJpeg(os, *image, addDHT, locSOF);
     // os.flush();
+
+    if (rate) {
+      auto sendEnd = std::chrono::steady_clock::now();
+      rate->Update(header.size() + size,
+                   std::chrono::duration<double>(sendEnd - sendStart).count(),
+                   GetSendQueueBytes(*m_stream),
+                   std::chrono::duration<double>(sendEnd.time_since_epoch())
+                       .count(),
+                   sentQuality);
+      SDEBUG4("adaptive: latency " << rate->GetLatency() << " s, bitrate "
+                                   << rate->GetBitrate() << " bps, quality "
+                                   << rate->GetQuality());
+    }
   }
   StopStream();
 }
 
-void MjpegServerImpl::ConnThread::ProcessRequest() {
-  wpi::raw_socket_istream is{*m_stream};
-  wpi::raw_socket_ostream os{*m_stream, true};
+// Wait for data to be available to read.
+// @param timeout Time (in seconds) to wait; 0 polls without waiting
+// @return True if data (or a close) is available
+static bool WaitReadable(wpi::NetworkStream& stream, double timeout) {
+  struct pollfd pfd;
+  pfd.fd = stream.getNativeHandle();
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return ::poll(&pfd, 1, static_cast<int>(timeout * 1000)) > 0;
+}
 
-  // Reset per-request settings
-  m_width = 0;
-  m_height = 0;
-  m_compression = 80;
-  m_fps = 0;
+// Accept a WebSocket upgrade and send each frame as a single binary message.
+// Unlike the MJPEG stream, the client acknowledges frames: it starts with a
+// window of m_window credits and each message it sends returns one (or, for
+// a text message containing a number, that many).  Frames are only fetched
+// from the source while a credit is available, so a slow client receives
+// fewer, fresher frames rather than a growing backlog in the kernel.
+void MjpegServerImpl::ConnThread::SendWebSocketStream(
+    wpi::raw_socket_ostream& os) {
+  llvm::StringRef key = m_parser.GetHeader("Sec-WebSocket-Key");
+  if (!m_parser.GetHeader("Upgrade").equals_lower("websocket") ||
+      key.empty()) {
+    SendError(os, 400, "WebSocket upgrade required");
+    return;
+  }
+  if (m_parser.GetHeader("Sec-WebSocket-Version") != "13") {
+    SendResponse(os, 426, "Upgrade Required", "text/plain",
+                 "Unsupported WebSocket version\r\n", false,
+                 "Sec-WebSocket-Version: 13");
+    return;
+  }
+  if (m_noStreaming) {
+    SERROR("Too many simultaneous client streams");
+    SendError(os, 503, "Too many simultaneous streams");
+    return;
+  }
+
+  os.SetUnbuffered();
+
+  llvm::SmallString<256> header;
+  llvm::raw_svector_ostream oss{header};
+  oss << "HTTP/1.1 101 Switching Protocols\r\n"
+      << "Upgrade: websocket\r\n"
+      << "Connection: Upgrade\r\n"
+      << "Sec-WebSocket-Accept: " << WebSocketAcceptKey(key) << "\r\n"
+      << "Server: CameraServer/1.0\r\n"
+      << "\r\n";
+  os << oss.str();
+
+  SDEBUG("WebSocket open, window " << m_window);
+
+  int credits = m_window;
+  bool closing = false;
+  WebSocketParser parser;
+  auto onMessage = [&](int opcode, llvm::StringRef payload) {
+    switch (opcode) {
+      case kWsText: {
+        unsigned int n;
+        if (payload.trim().getAsInteger(10, n)) n = 1;
+        credits += std::min<unsigned int>(n, m_window);
+        if (credits > m_window) credits = m_window;
+        break;
+      }
+      case kWsBinary:
+        credits = std::min(credits + 1, m_window);
+        break;
+      case kWsPing:
+        WebSocketWriteFrame(os, kWsPong, payload);
+        break;
+      case kWsClose:
+        // echo the status code back
+        WebSocketWriteFrame(os, kWsClose, payload.substr(0, 2));
+        closing = true;
+        break;
+      default:
+        break;
+    }
+  };
+
+  // Process client messages.  Any data received after the handshake request
+  // is already in the receive buffer.
+  // @return False if the connection should be closed
+  auto readMessages = [&](double timeout) {
+    while (m_recvPos < m_recvLen || WaitReadable(*m_stream, timeout)) {
+      if (m_recvPos == m_recvLen) {
+        wpi::NetworkStream::Error err;
+        m_recvPos = 0;
+        m_recvLen = m_stream->receive(m_recvBuf, sizeof(m_recvBuf), &err);
+        if (m_recvLen == 0) return false;
+      }
+      bool ok = parser.Execute(
+          llvm::StringRef(m_recvBuf + m_recvPos, m_recvLen - m_recvPos),
+          onMessage);
+      m_recvPos = m_recvLen;
+      if (!ok) {
+        SDEBUG("WebSocket protocol error: " << parser.GetError());
+        WebSocketWriteFrame(os, kWsClose, llvm::StringRef("\x03\xea", 2));
+        return false;
+      }
+      if (closing) return false;
+      timeout = 0;
+    }
+    return !os.has_error();
+  };
+
+  StartStream();
+  while (m_active && !os.has_error()) {
+    // Wait for a credit rather than a frame; frames produced in the meantime
+    // are simply not sent.
+    if (!readMessages(credits > 0 ? 0 : 0.2)) break;
+    if (credits <= 0) continue;
+
+    auto source = GetSource();
+    if (!source) {
+      // Source disconnected; sleep so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+    Frame frame = source->GetNextFrame(0.225);  // blocks
+    if (!m_active) break;
+    if (!frame) {
+      // Bad frame; sleep for 20 ms so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+
+    int width = m_width != 0 ? m_width : frame.GetOriginalWidth();
+    int height = m_height != 0 ? m_height : frame.GetOriginalHeight();
+    Image* image =
+        frame.GetImage(width, height, VideoMode::kMJPEG, m_compression);
+    if (!image || image->pixelFormat != VideoMode::kMJPEG) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+
+    std::size_t size = image->size();
+    std::size_t locSOF = size;
+    bool addDHT = JpegNeedsDHT(*image, &size, &locSOF);
+
+    uint64_t time = frame.GetTime();
+    // As for X-Quality, the quality of the frame actually sent (0 if unknown)
+    int quality = image->GetJpegQuality();
+    if (quality < 0) quality = 0;
+    char frameHeader[kWsFrameHeaderSize] = {0};
+    for (int i = 0; i < 8; ++i)
+      frameHeader[i] = static_cast<char>(time >> ((7 - i) * 8));
+    frameHeader[8] = static_cast<char>(image->width >> 8);
+    frameHeader[9] = static_cast<char>(image->width);
+    frameHeader[10] = static_cast<char>(image->height >> 8);
+    frameHeader[11] = static_cast<char>(image->height);
+    frameHeader[12] = static_cast<char>(quality);
+
+    SDEBUG4("sending WebSocket frame size=" << size << " credits="
+                                            << credits);
+    header.clear();
+    WebSocketWriteHeader(oss, kWsBinary, kWsFrameHeaderSize + size);
+    oss << llvm::StringRef(frameHeader, kWsFrameHeaderSize);
+    os << oss.str();
+    WriteJpeg(os, *image, addDHT, locSOF);
+    --credits;
+  }
+  StopStream();
+}
 
-  // Read the request string from the stream
-  bool error = false;
-  llvm::SmallString<128> reqBuf;
-  llvm::StringRef req = ReadLine(is, reqBuf, 4096, &error);
-  if (error) {
-    SDEBUG("error getting request string");
+// Send HTTP response and a stream of uncompressed frames, each preceded by a
+// CS_RawFrameHeader (see cscore_raw.h).  Intended for local consumers, where
+// bandwidth is cheap but JPEG compression and decompression are not.
+void MjpegServerImpl::ConnThread::SendRawStream(wpi::raw_socket_ostream& os) {
+  if (m_noStreaming) {
+    SERROR("Too many simultaneous client streams");
+    SendError(os, 503, "Too many simultaneous streams");
     return;
   }
 
-  enum { kCommand, kStream, kGetSettings, kRootPage } kind;
+  os.SetUnbuffered();
+
+  llvm::SmallString<256> header;
+  llvm::raw_svector_ostream oss{header};
+
+  SendHeader(oss, 200, "OK", "application/octet-stream",
+             "Access-Control-Allow-Origin: *");
+  os << oss.str();
+
+  SDEBUG("Headers send, sending raw stream now");
+
+  StartStream();
+  while (m_active && !os.has_error()) {
+    auto source = GetSource();
+    if (!source) {
+      // Source disconnected; sleep so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+    SDEBUG4("waiting for frame");
+    Frame frame = source->GetNextFrame(0.225);  // blocks
+    if (!m_active) break;
+    if (!frame) {
+      // Bad frame; sleep for 20 ms so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+
+    int width = m_width != 0 ? m_width : frame.GetOriginalWidth();
+    int height = m_height != 0 ? m_height : frame.GetOriginalHeight();
+    if (m_rawFormat == VideoMode::kYUYV) width &= ~1;
+    if (width <= 0 || height <= 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+    Image* image = frame.GetImage(width, height, m_rawFormat);
+    if (!image || image->pixelFormat != m_rawFormat || image->width <= 0 ||
+        image->height <= 0) {
+      // Shouldn't happen, but just in case...
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+
+    int bytesPerPixel;
+    switch (image->pixelFormat) {
+      case VideoMode::kGray:
+        bytesPerPixel = 1;
+        break;
+      case VideoMode::kYUYV:
+      case VideoMode::kRGB565:
+        bytesPerPixel = 2;
+        break;
+      default:
+        bytesPerPixel = 3;
+        break;
+    }
+
+    CS_RawFrameHeader rawHeader;
+    rawHeader.magic = CS_RAW_FRAME_MAGIC;
+    rawHeader.headerSize = sizeof(rawHeader);
+    rawHeader.time = frame.GetTime();
+    rawHeader.pixelFormat = image->pixelFormat;
+    rawHeader.width = image->width;
+    rawHeader.height = image->height;
+    rawHeader.stride = image->width * bytesPerPixel;
+    rawHeader.dataSize = image->size();
+    rawHeader.reserved = 0;
+
+    SDEBUG4("sending raw frame size=" << image->size());
+    os << llvm::StringRef(reinterpret_cast<const char*>(&rawHeader),
+                          sizeof(rawHeader));
+    os << image->str();
+  }
+  StopStream();
+}
+
+// Send the most recent frame as a single JPEG image.
+// @return True if the connection can be kept alive
+bool MjpegServerImpl::ConnThread::SendSnapshot(wpi::raw_socket_ostream& os,
+                                               llvm::StringRef ifNoneMatch,
+                                               bool keepAlive) {
+  auto source = GetSource();
+  if (!source) {
+    SendError(os, 404, "Resource not found");
+    return false;
+  }
+
+  // If nothing else is streaming from the source, its current frame may be
+  // stale or missing, so enable it and wait for a new one.  The source stays
+  // enabled for the rest of the connection, so clients polling over a
+  // kept-alive connection don't restart the camera on every request.
+  Frame frame;
+  if (m_snapshotSource != source) {
+    if (m_snapshotSource) m_snapshotSource->DisableSink();
+    m_snapshotSource = source;
+    bool running = source->GetNumSinksEnabled() > 0;
+    source->EnableSink();
+    if (!running) frame = source->GetNextFrame(kSnapshotTimeout);
+  }
+  if (!frame) frame = source->GetCurFrame();
+  if (!frame) {
+    SendError(os, 503, "No frame available");
+    return false;
+  }
+
+  int width = m_width != 0 ? m_width : frame.GetOriginalWidth();
+  int height = m_height != 0 ? m_height : frame.GetOriginalHeight();
+
+  // The entity tag identifies both the frame and the requested encoding
+  llvm::SmallString<64> etag;
+  llvm::raw_svector_ostream etagOs{etag};
+  etagOs << '"' << llvm::format_hex_no_prefix(frame.GetTime(), 1) << '-'
+         << width << 'x' << height << '-' << m_compression << '"';
+
+  llvm::SmallString<256> header;
+  llvm::raw_svector_ostream oss{header};
+  if (ifNoneMatch == etagOs.str()) {
+    oss << "HTTP/1.1 304 Not Modified\r\n"
+        << "ETag: " << etagOs.str() << "\r\n"
+        << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n"
+        << "\r\n";
+    os << oss.str();
+    return keepAlive;
+  }
+
+  // Uses the encoded image already produced for stream clients if available
+  Image* image = frame.GetImage(width, height, VideoMode::kMJPEG,
+                                m_compression);
+  if (!image || image->pixelFormat != VideoMode::kMJPEG) {
+    SendError(os, 500, "Could not encode image");
+    return false;
+  }
+
+  std::size_t size = image->size();
+  std::size_t locSOF = size;
+  bool addDHT = JpegNeedsDHT(*image, &size, &locSOF);
+
+  oss << "HTTP/1.1 200 OK\r\n"
+      << "Server: CameraServer/1.0\r\n"
+      << "Content-Type: image/jpeg\r\n"
+      << "Content-Length: " << size << "\r\n"
+      << "ETag: " << etagOs.str() << "\r\n"
+      << "Cache-Control: no-cache\r\n"
+      << "Access-Control-Allow-Origin: *\r\n"
+      << "X-Timestamp: " << (frame.GetTime() / 10000000.0) << "\r\n"
+      << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n"
+      << "\r\n";
+  os << oss.str();
+  WriteJpeg(os, *image, addDHT, locSOF);
+  os.flush();
+  return keepAlive && !os.has_error();
+}
+
+// Read the next request from the connection into m_parser.  Requests are
+// parsed from data already buffered before reading from the socket.
+// @param timeout Time (in seconds) to wait for data; 0 waits forever
+// @return False on error, timeout, or close
+bool MjpegServerImpl::ConnThread::ReadRequest(int timeout) {
+  m_parser.Reset();
+  for (;;) {
+    if (m_recvPos < m_recvLen) {
+      m_recvPos += m_parser.Execute(
+          llvm::StringRef(m_recvBuf + m_recvPos, m_recvLen - m_recvPos));
+      if (m_parser.HasError()) {
+        SDEBUG("error parsing request: " << m_parser.GetError());
+        return false;
+      }
+      if (m_parser.IsComplete()) return true;
+    }
+
+    // everything buffered has been consumed; get more
+    wpi::NetworkStream::Error err;
+    std::size_t len =
+        m_stream->receive(m_recvBuf, sizeof(m_recvBuf), &err, timeout);
+    if (len == 0) return false;
+    m_recvPos = 0;
+    m_recvLen = len;
+  }
+}
+
+// Discard a request body so the next pipelined request can be read.
+bool MjpegServerImpl::ConnThread::SkipRequestBody(unsigned long long len) {
+  while (len > 0) {
+    if (m_recvPos == m_recvLen) {
+      wpi::NetworkStream::Error err;
+      m_recvPos = 0;
+      m_recvLen = m_stream->receive(m_recvBuf, sizeof(m_recvBuf), &err,
+                                    kKeepAliveTimeout);
+      if (m_recvLen == 0) return false;
+    }
+    std::size_t skip = std::min<unsigned long long>(len, m_recvLen - m_recvPos);
+    m_recvPos += skip;
+    len -= skip;
+  }
+  return true;
+}
+
+// Process a single HTTP request (already read into m_parser).
+// @return True if the connection should be kept alive for another request
+bool MjpegServerImpl::ConnThread::ProcessRequest(wpi::raw_socket_ostream& os) {
+  // Reset per-request settings
+  m_width = 0;
+  m_height = 0;
+  m_compression = -1;
+  m_fps = 0;
+  m_adaptive = false;
+  m_targetLatency = 250;
+  m_targetBitrate = 0;
+  m_window = 2;
+  m_timing = false;
+  m_rawFormat = VideoMode::kBGR;
+  m_keepAlive = m_parser.ShouldKeepAlive();
+
+  llvm::StringRef method = m_parser.GetMethod();
+  llvm::StringRef path, query;
+  std::tie(path, query) = m_parser.GetUrl().split('?');
+
+  SDEBUG("HTTP request: '" << method << ' ' << m_parser.GetUrl() << "'");
+
+  // Skip any request body so pipelined requests stay in sync
+  long long bodyLen = m_parser.GetContentLength();
+  if (bodyLen > 0 && !SkipRequestBody(bodyLen)) return false;
+
+  enum {
+    kCommand,
+    kStream,
+    kWebSocketStream,
+    kRawStream,
+    kSnapshot,
+    kGetSettings,
+    kRootPage
+  } kind;
   llvm::StringRef parameters;
-  size_t pos;
 
-  SDEBUG("HTTP request: '" << req << "'\n");
+  // In routed mode, the source can be named in the path.
+  SetRoutedSource(nullptr);
+  llvm::StringRef routedName;
+  if (m_routed && method == "GET") {
+    if (path.startswith("/stream/") && path.endswith(".mjpg")) {
+      kind = kStream;
+      routedName = path.slice(8, path.size() - 5);
+      parameters = query;
+    } else if (path.startswith("/ws/stream/")) {
+      kind = kWebSocketStream;
+      routedName = path.substr(11);
+      parameters = query;
+    } else if (path.startswith("/raw/") && path.endswith(".stream")) {
+      kind = kRawStream;
+      routedName = path.slice(5, path.size() - 7);
+      parameters = query;
+    } else if (path.startswith("/snapshot/") && path.endswith(".jpg")) {
+      kind = kSnapshot;
+      routedName = path.slice(10, path.size() - 4);
+      parameters = query;
+    } else if (path.startswith("/settings/") && path.endswith(".json")) {
+      kind = kGetSettings;
+      routedName = path.slice(10, path.size() - 5);
+    }
+  }
 
   // Determine request kind.  Most of these are for mjpgstreamer
   // compatibility, others are for Axis camera compatibility.
-  if ((pos = req.find("POST /stream")) != llvm::StringRef::npos) {
+  if (!routedName.empty()) {
+    bool error = false;
+    llvm::SmallString<64> nameBuf;
+    auto name = UnescapeURI(routedName, nameBuf, &error);
+    auto data = Sources::GetInstance().FindByName(name).second;
+    if (error || !data) {
+      SDEBUG("HTTP request for unknown source '" << routedName << "'");
+      SendError(os, 404, "Source not found", m_keepAlive);
+      return m_keepAlive;
+    }
+    SetRoutedSource(data->source);
+  } else if (method == "POST" && path.startswith("/stream")) {
     kind = kStream;
-    parameters = req.substr(req.find('?', pos + 12)).substr(1);
-  } else if ((pos = req.find("GET /?action=stream")) != llvm::StringRef::npos) {
+    parameters = query;
+  } else if (method != "GET") {
+    SDEBUG("HTTP method not implemented");
+    SendError(os, 501, "Method not implemented");
+    return false;
+  } else if (path == "/" && query.startswith("action=stream")) {
     kind = kStream;
-    parameters = req.substr(req.find('&', pos + 19)).substr(1);
-  } else if ((pos = req.find("GET /stream.mjpg")) != llvm::StringRef::npos) {
+    parameters = query.split('&').second;
+  } else if (path == "/stream.mjpg") {
     kind = kStream;
-    parameters = req.substr(req.find('?', pos + 16)).substr(1);
-  } else if (req.find("GET /settings") != llvm::StringRef::npos &&
-             req.find(".json") != llvm::StringRef::npos) {
+    parameters = query;
+  } else if (path == "/ws/stream") {
+    kind = kWebSocketStream;
+    parameters = query;
+  } else if (path == "/raw.stream") {
+    kind = kRawStream;
+    parameters = query;
+  } else if (path == "/snapshot.jpg") {
+    kind = kSnapshot;
+    parameters = query;
+  } else if ((path.startswith("/settings") || path.startswith("/input") ||
+              path.startswith("/output")) &&
+             path.endswith(".json")) {
     kind = kGetSettings;
-  } else if (req.find("GET /input") != llvm::StringRef::npos &&
-             req.find(".json") != llvm::StringRef::npos) {
-    kind = kGetSettings;
-  } else if (req.find("GET /output") != llvm::StringRef::npos &&
-             req.find(".json") != llvm::StringRef::npos) {
-    kind = kGetSettings;
-  } else if ((pos = req.find("GET /?action=command")) !=
-             llvm::StringRef::npos) {
+  } else if (path == "/" && query.startswith("action=command")) {
     kind = kCommand;
-    parameters = req.substr(req.find('&', pos + 20)).substr(1);
-  } else if (req.find("GET / ") != llvm::StringRef::npos || req == "GET /\n") {
+    parameters = query.split('&').second;
+  } else if (path == "/") {
     kind = kRootPage;
   } else {
     SDEBUG("HTTP request resource not found");
-    SendError(os, 404, "Resource not found");
-    return;
+    SendError(os, 404, "Resource not found", m_keepAlive);
+    return m_keepAlive;
   }
 
-  // Parameter can only be certain characters.  This also strips the EOL.
-  pos = parameters.find_first_not_of(
+  // Parameter can only be certain characters.
+  std::size_t pos = parameters.find_first_not_of(
       "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_"
       "-=&1234567890%./");
   parameters = parameters.substr(0, pos);
   SDEBUG("command parameters: \"" << parameters << "\"");
 
-  // Read the rest of the HTTP request.
-  // The end of the request is marked by a single, empty line
-  llvm::SmallString<128> lineBuf;
-  for (;;) {
-    if (ReadLine(is, lineBuf, 4096, &error).startswith("\n")) break;
-    if (error) return;
-  }
+  // Streams never end with a complete response, so can't be kept alive
+  if (kind == kStream || kind == kWebSocketStream || kind == kRawStream)
+    m_keepAlive = false;
 
   // Send response
   switch (kind) {
     case kStream:
       if (auto source = GetSource()) {
         SDEBUG("request for stream " << source->GetName());
-        if (!ProcessCommand(os, *source, parameters, false)) return;
+        if (!ProcessCommand(os, *source, parameters, false)) return false;
       }
       SendStream(os);
       break;
+    case kWebSocketStream:
+      if (auto source = GetSource()) {
+        SDEBUG("request for WebSocket stream " << source->GetName());
+        if (!ProcessCommand(os, *source, parameters, false)) return false;
+      }
+      SendWebSocketStream(os);
+      break;
+    case kRawStream:
+      if (auto source = GetSource()) {
+        SDEBUG("request for raw stream " << source->GetName());
+        if (!ProcessCommand(os, *source, parameters, false)) return false;
+      }
+      SendRawStream(os);
+      break;
+    case kSnapshot:
+      if (auto source = GetSource()) {
+        SDEBUG("request for snapshot " << source->GetName());
+        if (!ProcessCommand(os, *source, parameters, false)) return m_keepAlive;
+      }
+      m_keepAlive = SendSnapshot(os, m_parser.GetHeader("If-None-Match"),
+                                 m_keepAlive);
+      break;
     case kCommand:
       if (auto source = GetSource()) {
         ProcessCommand(os, *source, parameters, true);
       } else {
-        SendHeader(os, 200, "OK", "text/plain");
-        os << "Ignored due to no connected source." << "\r\n";
+        SendResponse(os, 200, "OK", "text/plain",
+                     "Ignored due to no connected source.\r\n", m_keepAlive);
         SDEBUG("Ignored due to no connected source.");
       }
       break;
     case kGetSettings:
       SDEBUG("request for JSON file");
-      if (auto source = GetSource())
-        SendJSON(os, *source, true);
-      else
-        SendError(os, 404, "Resource not found");
+      if (auto source = GetSource()) {
+        auto doc = m_docCache->Get(
+            source, DocCache::kJSON,
+            [&](llvm::raw_ostream& oss) { SendJSON(oss, *source); });
+        SendResponse(os, 200, "OK", "application/x-javascript", *doc,
+                     m_keepAlive);
+      } else {
+        SendError(os, 404, "Resource not found", m_keepAlive);
+      }
       break;
-    case kRootPage:
+    case kRootPage: {
       SDEBUG("request for root page");
-      SendHeader(os, 200, "OK", "text/html");
       if (auto source = GetSource()) {
-        SendHTML(os, *source, false);
+        auto doc = m_docCache->Get(
+            source, DocCache::kHTML,
+            [&](llvm::raw_ostream& oss) { SendHTML(oss, *source); });
+        SendResponse(os, 200, "OK", "text/html", *doc, m_keepAlive);
+        break;
+      }
+      llvm::SmallString<4096> body;
+      llvm::raw_svector_ostream oss{body};
+      if (m_routed) {
+        SendSourceList(oss);
       } else {
-        os << emptyRootPage << "\r\n";
+        oss << emptyRootPage << "\r\n";
       }
+      SendResponse(os, 200, "OK", "text/html", oss.str(), m_keepAlive);
+      break;
+    }
+  }
+
+  SetRoutedSource(nullptr);
+  return m_keepAlive && !os.has_error();
+}
+
+// Serve requests until the client or a response closes the connection.
+// Requests may be pipelined; connections kept alive between requests are
+// dropped if idle too long.
+void MjpegServerImpl::ConnThread::ProcessConnection() {
+  wpi::raw_socket_ostream os{*m_stream, true};
+  m_recvPos = 0;
+  m_recvLen = 0;
+  int timeout = 0;
+  while (m_active && !os.has_error()) {
+    if (!ReadRequest(timeout)) {
+      if (m_parser.HasError()) SendError(os, 400, m_parser.GetError());
       break;
+    }
+    if (!ProcessRequest(os)) break;
+    timeout = kKeepAliveTimeout;
+  }
+
+  if (m_snapshotSource) {
+    m_snapshotSource->DisableSink();
+    m_snapshotSource.reset();
   }
 
   SDEBUG("leaving HTTP client thread");
@@ -760,7 +1601,7 @@ void MjpegServerImpl::ConnThread::Main() {
       if (!m_active) return;
     }
     lock.unlock();
-    ProcessRequest();
+    ProcessConnection();
     lock.lock();
     m_stream = nullptr;
   }
@@ -801,7 +1642,7 @@ void MjpegServerImpl::ServerThreadMain() {
     // Start it if not already started
     {
       auto thr = it->GetThread();
-      if (!thr) it->Start(new ConnThread{GetName()});
+      if (!thr) it->Start(new ConnThread{GetName(), m_routed, m_docCache});
     }
 
     auto nstreams =
@@ -827,10 +1668,12 @@ void MjpegServerImpl::SetSourceImpl(std::shared_ptr<SourceImpl> source) {
   for (auto& connThread : m_connThreads) {
     if (auto thr = connThread.GetThread()) {
       if (thr->m_source != source) {
-        bool streaming = thr->m_streaming;
-        if (thr->m_source && streaming) thr->m_source->DisableSink();
+        // streams of a routed source aren't affected
+        bool streaming = thr->m_streaming && !thr->m_routedSource;
+        if (thr->m_source && streaming)
+          thr->m_source->DisableSink(thr->GetDemand());
         thr->m_source = source;
-        if (source && streaming) thr->m_source->EnableSink();
+        if (source && streaming) thr->m_source->EnableSink(thr->GetDemand());
       }
     }
   }
@@ -850,6 +1693,35 @@ CS_Sink CreateMjpegServer(llvm::StringRef name, llvm::StringRef listenAddress,
   return handle;
 }
 
+CS_Sink CreateMjpegServerRouted(llvm::StringRef name,
+                                llvm::StringRef listenAddress, int port,
+                                CS_Status* status) {
+  llvm::SmallString<128> str{listenAddress};
+  auto sink = std::make_shared<MjpegServerImpl>(
+      name, listenAddress, port,
+      std::unique_ptr<wpi::NetworkAcceptor>(
+          new wpi::TCPAcceptor(port, str.c_str(), Logger::GetInstance())),
+      true);
+  auto handle = Sinks::GetInstance().Allocate(CS_SINK_MJPEG, sink);
+  Notifier::GetInstance().NotifySink(name, handle, CS_SINK_CREATED);
+  return handle;
+}
+
+CS_Sink CreateMjpegServerUnix(llvm::StringRef name, llvm::StringRef path,
+                              bool routed, CS_Status* status) {
+  auto sink = std::make_shared<MjpegServerImpl>(
+      name, path, 0,
+      std::unique_ptr<wpi::NetworkAcceptor>(new UnixAcceptor(path)), routed);
+  llvm::SmallString<128> descBuf;
+  llvm::raw_svector_ostream desc{descBuf};
+  desc << "HTTP Server on " << path;
+  if (routed) desc << " (all sources)";
+  sink->SetDescription(desc.str());
+  auto handle = Sinks::GetInstance().Allocate(CS_SINK_MJPEG, sink);
+  Notifier::GetInstance().NotifySink(name, handle, CS_SINK_CREATED);
+  return handle;
+}
+
 std::string GetMjpegServerListenAddress(CS_Sink sink, CS_Status* status) {
   auto data = Sinks::GetInstance().Get(sink);
   if (!data || data->kind != CS_SINK_MJPEG) {
@@ -877,6 +1749,16 @@ CS_Sink CS_CreateMjpegServer(const char* name, const char* listenAddress,
   return cs::CreateMjpegServer(name, listenAddress, port, status);
 }
 
+CS_Sink CS_CreateMjpegServerRouted(const char* name, const char* listenAddress,
+                                   int port, CS_Status* status) {
+  return cs::CreateMjpegServerRouted(name, listenAddress, port, status);
+}
+
+CS_Sink CS_CreateMjpegServerUnix(const char* name, const char* path,
+                                 CS_Bool routed, CS_Status* status) {
+  return cs::CreateMjpegServerUnix(name, path, routed, status);
+}
+
 char* CS_GetMjpegServerListenAddress(CS_Sink sink, CS_Status* status) {
   return ConvertToC(cs::GetMjpegServerListenAddress(sink, status));
 }
@@ -31,12 +31,14 @@ class SourceImpl;
 class MjpegServerImpl : public SinkImpl {
  public:
   MjpegServerImpl(llvm::StringRef name, llvm::StringRef listenAddress, int port,
-                  std::unique_ptr<wpi::NetworkAcceptor> acceptor);
+                  std::unique_ptr<wpi::NetworkAcceptor> acceptor,
+                  bool routed = false);
   ~MjpegServerImpl() override;
 
   void Stop();
   std::string GetListenAddress() { return m_listenAddress; }
   int GetPort() { return m_port; }
+  bool IsRouted() const { return m_routed; }
 
  private:
   void SetSourceImpl(std::shared_ptr<SourceImpl> source) override;
@@ -44,16 +46,22 @@ class MjpegServerImpl : public SinkImpl {
   void ServerThreadMain();
 
   class ConnThread;
+  class DocCache;
 
   // Never changed, so not protected by mutex
   std::string m_listenAddress;
   int m_port;
+  bool m_routed;  // serve any source by name (/stream/<name>.mjpg etc)
 
   std::unique_ptr<wpi::NetworkAcceptor> m_acceptor;
   std::atomic_bool m_active;  // set to false to terminate threads
   std::thread m_serverThread;
 
   std::vector<wpi::SafeThreadOwner<ConnThread>> m_connThreads;
+
+  // Rendered settings.json and root pages, shared by all connections
+  std::shared_ptr<DocCache> m_docCache;
+  int m_docListener{0};
 };
 
 }  // namespace cs
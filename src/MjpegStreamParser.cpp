@@ -0,0 +1,322 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "MjpegStreamParser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "JpegUtil.h"
+#include "SourceImpl.h"
+
+using namespace cs;
+
+// Socket receive size; large enough that a typical frame takes a handful of
+// reads.
+static const std::size_t kBufferSize = 65536;
+
+// Limit on a JPEG without a Content-Length, in case the stream is garbage
+static const std::size_t kMaxJpegSize = 16 * 1024 * 1024;
+
+// Find needle in data.  memchr is vectorized by the C library, so scan for
+// the first character and only then compare the rest.
+static std::size_t Find(llvm::StringRef data, llvm::StringRef needle) {
+  const char* p = data.data();
+  const char* end = data.end();
+  while (static_cast<std::size_t>(end - p) >= needle.size()) {
+    p = static_cast<const char*>(
+        std::memchr(p, needle[0], end - p - needle.size() + 1));
+    if (!p) break;
+    if (std::memcmp(p + 1, needle.data() + 1, needle.size() - 1) == 0)
+      return p - data.data();
+    ++p;
+  }
+  return llvm::StringRef::npos;
+}
+
+MjpegStreamParser::MjpegStreamParser(SourceImpl& source,
+                                     llvm::StringRef boundary)
+    : m_source(source), m_boundary{"--"}, m_buf(kBufferSize) {
+  m_boundary += boundary;
+}
+
+llvm::MutableArrayRef<char> MjpegStreamParser::GetBuffer() {
+  // Receive the rest of a known-length image in place
+  if (m_state == kBody && m_start == m_end) {
+    m_direct = true;
+    return llvm::MutableArrayRef<char>(m_image->data() + m_imagePos,
+                                       m_image->size() - m_imagePos);
+  }
+
+  // Receive an image of unknown length in place too, growing it as needed.
+  // Limit the read to what the buffer can hold, as anything past the end of
+  // the image is moved there.
+  if (m_state == kJpeg && m_start == m_end) {
+    if (m_image->size() < m_imagePos + kBufferSize)
+      m_image->resize(m_imagePos + kBufferSize);
+    m_direct = true;
+    return llvm::MutableArrayRef<char>(m_image->data() + m_imagePos,
+                                       kBufferSize);
+  }
+
+  m_direct = false;
+  if (m_start == m_end) {
+    m_start = m_end = 0;
+  } else if (m_end == m_buf.size()) {
+    // Move the unprocessed tail (normally short) to the front
+    std::memmove(m_buf.data(), m_buf.data() + m_start, m_end - m_start);
+    m_end -= m_start;
+    m_start = 0;
+  }
+  return llvm::MutableArrayRef<char>(m_buf.data() + m_end,
+                                     m_buf.size() - m_end);
+}
+
+void MjpegStreamParser::Commit(std::size_t len) {
+  if (m_direct)
+    m_imagePos += len;
+  else
+    m_end += len;
+}
+
+MjpegStreamParser::Result MjpegStreamParser::Process() {
+  for (;;) {
+    llvm::StringRef data = Buffered();
+    switch (m_state) {
+      case kBoundary: {
+        std::size_t pos = Find(data, m_boundary);
+        if (pos == llvm::StringRef::npos) {
+          // Keep just enough to match a boundary split across reads
+          if (data.size() >= m_boundary.size())
+            m_start = m_end - (m_boundary.size() - 1);
+          return kNeedData;
+        }
+        m_start += pos + m_boundary.size();
+        m_state = kBoundaryEnd;
+        break;
+      }
+      case kBoundaryEnd:
+        // Normally \r\n; end-of-stream is indicated with a trailing --
+        if (data.size() < 2) return kNeedData;
+        if (data.startswith("--")) return kEnd;
+        if (data.startswith("\r\n"))
+          m_start += 2;
+        else if (data[0] == '\n')
+          ++m_start;
+        m_headers.Reset();
+        m_state = kHeaders;
+        break;
+      case kHeaders: {
+        m_start += m_headers.Execute(data);
+        if (m_headers.HasError()) return BadFrame(m_headers.GetError());
+        if (!m_headers.IsComplete()) return kNeedData;
+        Result result = StartPart();
+        if (result != kNeedData) return result;
+        break;
+      }
+      case kBody: {
+        std::size_t len =
+            std::min(data.size(), m_image->size() - m_imagePos);
+        std::memcpy(m_image->data() + m_imagePos, data.data(), len);
+        m_imagePos += len;
+        m_start += len;
+        if (m_imagePos < m_image->size()) return kNeedData;
+        return EndPart();
+      }
+      case kJpeg: {
+        std::size_t consumed;
+        bool done;
+        bool ok;
+        if (m_scanPos < m_imagePos) {
+          // Received directly into the image
+          ok = ScanJpeg(llvm::StringRef(m_image->data() + m_scanPos,
+                                        m_imagePos - m_scanPos),
+                        &consumed, &done);
+          m_scanPos += consumed;
+          if (done || !ok) {
+            // Move whatever followed the image to the (empty) buffer
+            m_end = m_imagePos - m_scanPos;
+            m_start = 0;
+            std::memcpy(m_buf.data(), m_image->data() + m_scanPos, m_end);
+            m_imagePos = m_scanPos;
+          }
+        } else {
+          // Scan what's left in the buffer and append the image part
+          ok = ScanJpeg(data, &consumed, &done);
+          if (m_image->size() < m_imagePos + consumed)
+            m_image->resize(m_imagePos + consumed);
+          std::memcpy(m_image->data() + m_imagePos, data.data(), consumed);
+          m_imagePos += consumed;
+          m_scanPos = m_imagePos;
+          m_start += consumed;
+        }
+        if (!ok) {
+          m_image.reset();
+          return BadFrame("did not receive a JPEG image");
+        }
+        if (m_imagePos > kMaxJpegSize) {
+          m_image.reset();
+          return BadFrame("JPEG too large");
+        }
+        if (!done) return kNeedData;
+        m_image->SetSize(m_imagePos);
+        m_lastJpegSize = m_imagePos;
+        return EndPart();
+      }
+    }
+  }
+}
+
+MjpegStreamParser::Result MjpegStreamParser::StartPart() {
+  // Check the content type (if present)
+  llvm::StringRef contentType = m_headers.GetHeader("Content-Type");
+  if (!contentType.empty() && !contentType.startswith("image/jpeg")) {
+    m_error = "received unknown Content-Type \"";
+    m_error += contentType;
+    m_error += '"';
+    m_state = kBoundary;
+    return kBadFrame;
+  }
+
+  long long contentLength = m_headers.GetContentLength();
+  if (contentLength < 0) {
+    // No Content-Length; scan the JPEG structure to find its end.  Start
+    // with room for a frame a bit larger than the last one so the image
+    // rarely needs to grow.
+    m_image = m_source.AllocImage(VideoMode::kMJPEG, 0, 0,
+                                  m_lastJpegSize + m_lastJpegSize / 4 +
+                                      kBufferSize);
+    m_imagePos = 0;
+    m_scanPos = 0;
+    m_jpegState = kJpegSOI;
+    m_count = 0;
+    m_state = kJpeg;
+    return kNeedData;
+  }
+  if (static_cast<unsigned long long>(contentLength) > kMaxJpegSize)
+    return BadFrame("JPEG too large");
+
+  // We know how big it is!  Get a frame of the right size and receive the
+  // data directly into it.
+  m_image = m_source.AllocImage(VideoMode::kMJPEG, 0, 0, contentLength);
+  m_imagePos = 0;
+  m_state = kBody;
+  return kNeedData;
+}
+
+MjpegStreamParser::Result MjpegStreamParser::EndPart() {
+  m_state = kBoundary;
+  // Index the markers now; sinks then use the cached result
+  const JpegInfo* info = m_image->GetJpegInfo();
+  if (!info) {
+    m_image.reset();
+    return BadFrame("did not receive a JPEG image");
+  }
+  m_image->width = info->width;
+  m_image->height = info->height;
+  return kFrame;
+}
+
+MjpegStreamParser::Result MjpegStreamParser::BadFrame(llvm::StringRef error) {
+  m_error = error;
+  m_state = kBoundary;
+  return kBadFrame;
+}
+
+// Scan a JPEG for its EOI marker, following the segment lengths so data
+// inside segments can't be mistaken for a marker.
+// @param consumed Set to the number of bytes that belong to the image (on
+//     error, the number before the invalid byte)
+// @param done Set to true if the EOI marker was reached
+// @return False if the data is not a valid JPEG
+bool MjpegStreamParser::ScanJpeg(llvm::StringRef data, std::size_t* consumed,
+                                 bool* done) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data.data());
+  std::size_t size = data.size();
+  std::size_t i = 0;
+  *done = false;
+  while (i < size && !*done) {
+    *consumed = i;  // in case of error
+    switch (m_jpegState) {
+      case kJpegSOI:
+        if (bytes[i++] != (m_count == 0 ? 0xff : 0xd8)) return false;
+        if (++m_count == 2) m_jpegState = kJpegMarker;
+        break;
+      case kJpegMarker:
+        if (bytes[i++] != 0xff) return false;
+        m_jpegState = kJpegCode;
+        break;
+      case kJpegCode: {
+        unsigned char code = bytes[i++];
+        if (code == 0xff) break;  // fill byte
+        if (!JpegMarker(code, done)) return false;
+        break;
+      }
+      case kJpegLength:
+        m_skip = (m_skip << 8) | bytes[i++];
+        if (++m_count < 2) break;
+        if (m_skip < 2) return false;
+        m_skip -= 2;
+        m_jpegState = kJpegSkip;
+        // Handle an empty segment immediately
+        // fall through
+      case kJpegSkip: {
+        std::size_t len = std::min(m_skip, size - i);
+        i += len;
+        m_skip -= len;
+        if (m_skip == 0)
+          m_jpegState = m_marker == 0xda ? kJpegEntropy : kJpegMarker;
+        break;
+      }
+      case kJpegEntropy: {
+        // Bulk of the image; skip to the next FF with (vectorized) memchr
+        auto ff = static_cast<const unsigned char*>(
+            std::memchr(bytes + i, 0xff, size - i));
+        if (!ff) {
+          i = size;
+        } else {
+          i = ff - bytes + 1;
+          m_jpegState = kJpegEntropyFF;
+        }
+        break;
+      }
+      case kJpegEntropyFF: {
+        // Byte stuffing (FF 00) and restart markers stay in entropy-coded
+        // data; anything else is a real marker.
+        unsigned char code = bytes[i++];
+        if (code == 0x00 || (code >= 0xd0 && code <= 0xd7))
+          m_jpegState = kJpegEntropy;
+        else if (code != 0xff && !JpegMarker(code, done))
+          return false;
+        break;
+      }
+    }
+  }
+  *consumed = i;
+  return true;
+}
+
+// Handle a marker code.
+// @return False if the marker is not valid here
+bool MjpegStreamParser::JpegMarker(unsigned char code, bool* done) {
+  if (code == 0xd9) {
+    // EOI
+    *done = true;
+    return true;
+  }
+  if (code == 0x00 || code == 0xd8) return false;
+  if ((code >= 0xd0 && code <= 0xd7) || code == 0x01) {
+    // standalone markers have no length
+    m_jpegState = kJpegMarker;
+    return true;
+  }
+  m_marker = code;
+  m_skip = 0;
+  m_count = 0;
+  m_jpegState = kJpegLength;
+  return true;
+}
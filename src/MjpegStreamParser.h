@@ -0,0 +1,113 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_MJPEGSTREAMPARSER_H_
+#define CS_MJPEGSTREAMPARSER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ArrayRef.h"
+#include "llvm/StringRef.h"
+
+#include "HttpParser.h"
+#include "Image.h"
+
+namespace cs {
+
+class SourceImpl;
+
+// Incremental parser for a multipart/x-mixed-replace MJPEG stream (the body
+// of the HTTP response).  The caller receives directly into GetBuffer(),
+// calls Commit() with the number of bytes received, and then calls
+// Process() until it needs more data.
+//
+// Socket reads are large: data is buffered and scanned in bulk rather than
+// read a byte or line at a time.  When a part has a Content-Length, its
+// image is allocated from the source's pool as soon as the part headers are
+// parsed, and GetBuffer() then points into the image so the payload is
+// received in place.  Parts without a Content-Length are received into a
+// growing pooled image in the same way, with the JPEG scanned as it
+// arrives to find its end.
+class MjpegStreamParser {
+ public:
+  enum Result {
+    kNeedData,  // receive more data
+    kFrame,     // a frame is ready; call TakeImage()
+    kBadFrame,  // a part was not a valid JPEG; see GetError()
+    kEnd        // the closing boundary was received
+  };
+
+  MjpegStreamParser(SourceImpl& source, llvm::StringRef boundary);
+
+  // Space to receive into.  Never empty.
+  llvm::MutableArrayRef<char> GetBuffer();
+
+  // Indicate that len bytes were received into the last GetBuffer().
+  void Commit(std::size_t len);
+
+  // Process received data.
+  Result Process();
+
+  std::unique_ptr<Image> TakeImage() { return std::move(m_image); }
+
+  llvm::StringRef GetError() const { return m_error; }
+
+ private:
+  enum State { kBoundary, kBoundaryEnd, kHeaders, kBody, kJpeg };
+
+  // Scan state for a JPEG without a Content-Length
+  enum JpegState {
+    kJpegSOI,       // expecting the FF D8 start of image
+    kJpegMarker,    // expecting the FF starting a marker
+    kJpegCode,      // expecting the marker code (or FF fill bytes)
+    kJpegLength,    // expecting the 2-byte segment length
+    kJpegSkip,      // skipping the rest of a segment
+    kJpegEntropy,   // in entropy-coded data after SOS
+    kJpegEntropyFF  // entropy-coded data, previous byte was FF
+  };
+
+  Result StartPart();
+  Result EndPart();
+  Result BadFrame(llvm::StringRef error);
+  bool ScanJpeg(llvm::StringRef data, std::size_t* consumed, bool* done);
+  bool JpegMarker(unsigned char code, bool* done);
+
+  llvm::StringRef Buffered() const {
+    return llvm::StringRef(m_buf.data() + m_start, m_end - m_start);
+  }
+
+  SourceImpl& m_source;
+  std::string m_boundary;  // including the leading "--"
+
+  State m_state{kBoundary};
+  std::vector<char> m_buf;
+  std::size_t m_start{0};     // first unprocessed byte
+  std::size_t m_end{0};       // end of received data
+  bool m_direct{false};       // last GetBuffer() was into m_image
+
+  HttpParser m_headers{HttpParser::kPart};
+
+  // kBody, kJpeg: image being received
+  std::unique_ptr<Image> m_image;
+  std::size_t m_imagePos{0};  // bytes received into the image
+
+  // kJpeg: scan state
+  std::size_t m_scanPos{0};   // bytes of the image scanned
+  std::size_t m_lastJpegSize{0};
+  JpegState m_jpegState{kJpegSOI};
+  unsigned char m_marker{0};  // code of the segment being read
+  int m_count{0};             // bytes of SOI or length read
+  std::size_t m_skip{0};      // segment length, then bytes left to skip
+
+  std::string m_error;
+};
+
+}  // namespace cs
+
+#endif  // CS_MJPEGSTREAMPARSER_H_
@@ -0,0 +1,380 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "RecordingSinkImpl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "support/timestamp.h"
+
+#include "c_util.h"
+#include "Frame.h"
+#include "Handle.h"
+#include "JpegUtil.h"
+#include "Log.h"
+#include "Notifier.h"
+#include "SourceImpl.h"
+
+using namespace cs;
+
+// A batch is written once it holds this much data or is this old
+static const std::size_t kBatchBytes = 256 * 1024;
+static const uint64_t kBatchInterval = 1000000;  // 100 ms
+
+// Pieces per batch (AsyncFileWriter limit); each frame takes up to 4
+static const std::size_t kBatchPieces = 64;
+
+// How often written data is flushed to disk
+static const uint64_t kSyncInterval = 10000000;  // 1 second
+
+// How often to retry creating a segment file after a failure
+static const uint64_t kRetryInterval = 10000000;  // 1 second
+
+// Initial (and minimum) preallocation; later segments are sized from the
+// previous one
+static const uint64_t kMinPrealloc = 32 * 1024 * 1024;
+
+// Frames waiting to be written.  Holding the frames keeps their images
+// alive, so the JPEG data is written without being copied.
+struct RecordingSinkImpl::Batch {
+  CS_RecFileHeader fileHeader;            // written if at start of file
+  std::deque<CS_RecFrameHeader> headers;  // deque so pieces stay valid
+  std::vector<llvm::StringRef> pieces;
+  std::vector<Frame> frames;
+  std::size_t size{0};
+};
+
+RecordingSinkImpl::RecordingSinkImpl(llvm::StringRef name,
+                                     llvm::StringRef directory,
+                                     int segmentSeconds)
+    : SinkImpl{name},
+      m_directory(directory),
+      m_segmentLength(static_cast<uint64_t>(std::max(segmentSeconds, 1)) *
+                      10000000),
+      m_preallocSize(kMinPrealloc) {
+  SetDescription("Recording to " + m_directory);
+
+  m_active = true;
+  if (!m_writer.Start()) return;
+  SDEBUG("writing with " << m_writer.GetBackendName());
+  m_thread = std::thread(&RecordingSinkImpl::ThreadMain, this);
+}
+
+RecordingSinkImpl::~RecordingSinkImpl() { Stop(); }
+
+void RecordingSinkImpl::Stop() {
+  m_active = false;
+
+  // wake up any waiters by forcing an empty frame to be sent
+  if (auto source = GetSource())
+    source->Wakeup();
+
+  // join thread
+  if (m_thread.joinable()) m_thread.join();
+
+  // wait for queued writes
+  m_writer.Stop();
+}
+
+#ifdef _WIN32
+
+bool RecordingSinkImpl::OpenSegment(Segment& segment, uint32_t number) {
+  SERROR("recording sinks are not supported on this platform");
+  return false;
+}
+
+void RecordingSinkImpl::DiscardSegment(Segment& segment) {}
+
+#else
+
+bool RecordingSinkImpl::OpenSegment(Segment& segment, uint32_t number) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "-%04u.csrec",
+                static_cast<unsigned int>(number));
+  std::string path = m_basePath + suffix;
+
+  int fd =
+      ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    SERROR("could not create " << path << ": " << std::strerror(errno));
+    return false;
+  }
+#ifdef __linux__
+  // Allocate the blocks up front, so writes and syncs don't have to update
+  // file system metadata.  Not all file systems support this.
+  if (::fallocate(fd, 0, 0, m_preallocSize) < 0 && errno != EOPNOTSUPP)
+    SWARNING("could not preallocate " << path << ": " << std::strerror(errno));
+#endif
+  segment.fd = fd;
+  segment.number = number;
+  segment.path = path;
+  return true;
+}
+
+void RecordingSinkImpl::DiscardSegment(Segment& segment) {
+  if (segment.fd < 0) return;
+  ::close(segment.fd);
+  ::unlink(segment.path.c_str());
+  segment.fd = -1;
+}
+
+#endif  // _WIN32
+
+bool RecordingSinkImpl::StartSegment(uint64_t frameTime) {
+  uint32_t number = 0;
+  if (m_current.fd >= 0) {
+    number = m_current.number + 1;
+    EndSegment();
+  } else if (m_basePath.empty()) {
+    // Name the recording after the sink and when it started
+    std::time_t now = std::time(nullptr);
+    char timeBuf[32];
+    std::strftime(timeBuf, sizeof(timeBuf), "%Y%m%d-%H%M%S",
+                  std::localtime(&now));
+    std::string name = GetName().str();
+    std::replace(name.begin(), name.end(), '/', '_');
+    m_basePath = m_directory + '/' + name + '-' + timeBuf;
+  } else {
+    // Retrying after a failure
+    if (wpi::Now() - m_lastOpenTime < kRetryInterval) return false;
+    number = m_current.number;
+  }
+
+  if (m_next.fd >= 0 && m_next.number == number) {
+    m_current = std::move(m_next);
+    m_next = Segment{};
+  } else {
+    DiscardSegment(m_next);
+    m_lastOpenTime = wpi::Now();
+    if (!OpenSegment(m_current, number)) {
+      m_current.number = number;
+      return false;
+    }
+  }
+
+  m_segmentStartTime = frameTime;
+  m_offset = 0;
+  m_index.clear();
+  SINFO("recording to " << m_current.path);
+
+  // Create the next one now rather than when it's needed
+  OpenSegment(m_next, number + 1);
+  return true;
+}
+
+void RecordingSinkImpl::EndSegment() {
+  Flush();
+
+  // Append the index and footer
+  auto index = std::make_shared<std::vector<CS_RecIndexEntry>>();
+  index->swap(m_index);
+  auto footer = std::make_shared<CS_RecFooter>();
+  footer->magic = CS_REC_INDEX_MAGIC;
+  footer->count = index->size();
+  footer->indexOffset = m_offset;
+  llvm::StringRef indexData{reinterpret_cast<const char*>(index->data()),
+                            index->size() * sizeof(CS_RecIndexEntry)};
+  llvm::StringRef footerData{reinterpret_cast<const char*>(footer.get()),
+                             sizeof(CS_RecFooter)};
+  uint64_t size = m_offset;
+  std::vector<llvm::StringRef> pieces;
+  if (!indexData.empty()) pieces.push_back(indexData);
+  pieces.push_back(footerData);
+  auto keepalive = std::make_shared<std::pair<decltype(index),
+                                              decltype(footer)>>(index, footer);
+  if (m_writer.Write(m_current.fd, m_offset, std::move(pieces), keepalive))
+    size += indexData.size() + footerData.size();
+  else
+    SWARNING("could not write index for " << m_current.path);
+
+  // Size the next preallocation from this segment
+  m_preallocSize = std::max(size + size / 4, kMinPrealloc);
+
+  // Trims the unused preallocated space
+  m_writer.Finish(m_current.fd, size);
+  m_current.fd = -1;
+}
+
+void RecordingSinkImpl::RecordFrame(Frame& frame) {
+  uint64_t time = frame.GetTime();
+  if (m_current.fd < 0 || time - m_segmentStartTime >= m_segmentLength) {
+    if (!StartSegment(time)) return;
+  }
+
+  int width = frame.GetOriginalWidth();
+  int height = frame.GetOriginalHeight();
+  Image* image = frame.GetImage(width, height, VideoMode::kMJPEG);
+  if (!image) {
+    SDEBUG("could not get JPEG image");
+    return;
+  }
+
+  if (!m_batch) {
+    m_batch = std::make_shared<Batch>();
+    m_batchStartTime = wpi::Now();
+  }
+
+  // Insert the Huffman tables if the camera left them out (see
+  // MjpegServerImpl); the image itself is referenced, not copied
+  std::size_t size = image->size();
+  std::size_t locSOF = size;
+  bool addDHT = JpegNeedsDHT(*image, &size, &locSOF);
+
+  CS_RecFrameHeader header;
+  header.magic = CS_REC_FRAME_MAGIC;
+  header.size = size;
+  header.time = time;
+  header.width = width;
+  header.height = height;
+  header.reserved = 0;
+  m_batch->headers.push_back(header);
+  m_batch->pieces.emplace_back(
+      reinterpret_cast<const char*>(&m_batch->headers.back()),
+      sizeof(CS_RecFrameHeader));
+  if (addDHT) {
+    m_batch->pieces.emplace_back(image->data(), locSOF);
+    m_batch->pieces.push_back(JpegGetDHT());
+    m_batch->pieces.emplace_back(image->data() + locSOF,
+                                 image->size() - locSOF);
+  } else {
+    m_batch->pieces.push_back(image->str());
+  }
+  m_batch->frames.push_back(frame);
+  m_batch->size += sizeof(CS_RecFrameHeader) + size;
+
+  if (m_batch->size >= kBatchBytes ||
+      m_batch->pieces.size() + 5 > kBatchPieces)
+    Flush();
+}
+
+void RecordingSinkImpl::Flush() {
+  if (!m_batch) return;
+  auto batch = std::move(m_batch);
+  m_batch.reset();
+  if (m_current.fd < 0) return;
+
+  std::vector<llvm::StringRef> pieces;
+  pieces.reserve(batch->pieces.size() + 1);
+  uint64_t offset = m_offset;
+  if (offset == 0) {
+    // First write to the segment
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    CS_RecFileHeader& fileHeader = batch->fileHeader;
+    fileHeader.magic = CS_REC_FILE_MAGIC;
+    fileHeader.version = CS_REC_VERSION;
+    fileHeader.startTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    fileHeader.startFrameTime = wpi::Now();
+    fileHeader.segment = m_current.number;
+    fileHeader.reserved = 0;
+    pieces.emplace_back(reinterpret_cast<const char*>(&fileHeader),
+                        sizeof(CS_RecFileHeader));
+    offset += sizeof(CS_RecFileHeader);
+  }
+  pieces.insert(pieces.end(), batch->pieces.begin(), batch->pieces.end());
+  uint64_t size = offset - m_offset + batch->size;
+
+  // The batch's frames are released once the write completes
+  std::size_t numFrames = batch->frames.size();
+  std::vector<CS_RecIndexEntry> index;
+  index.reserve(numFrames);
+  for (auto&& header : batch->headers) {
+    index.push_back(CS_RecIndexEntry{header.time, offset});
+    offset += sizeof(CS_RecFrameHeader) + header.size;
+  }
+  if (!m_writer.Write(m_current.fd, m_offset, std::move(pieces),
+                      std::move(batch))) {
+    // The disk isn't keeping up; drop these frames rather than wait
+    m_dropped += numFrames;
+    SDEBUG("write queue full, dropped " << numFrames << " frames");
+    return;
+  }
+  m_offset += size;
+  m_index.insert(m_index.end(), index.begin(), index.end());
+}
+
+void RecordingSinkImpl::ThreadMain() {
+  Enable();
+  while (m_active) {
+    auto source = GetSource();
+    if (!source) {
+      // Source disconnected; sleep so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+    SDEBUG4("waiting for frame");
+    Frame frame = source->GetNextFrame(0.225);  // blocks
+    if (!m_active) break;
+    if (frame) RecordFrame(frame);
+
+    uint64_t now = wpi::Now();
+    if (m_batch && now - m_batchStartTime >= kBatchInterval) Flush();
+    if (m_current.fd >= 0 && now - m_lastSyncTime >= kSyncInterval) {
+      m_writer.Sync(m_current.fd);
+      m_lastSyncTime = now;
+      if (m_dropped > 0) {
+        SWARNING("disk too slow, dropped " << m_dropped << " frames");
+        m_dropped = 0;
+      }
+    }
+
+    if (!frame) {
+      // Bad frame; sleep for 20 ms so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  Disable();
+
+  if (m_current.fd >= 0) EndSegment();
+  DiscardSegment(m_next);
+}
+
+namespace cs {
+
+CS_Sink CreateRecordingSink(llvm::StringRef name, llvm::StringRef directory,
+                            int segmentSeconds, CS_Status* status) {
+  auto sink =
+      std::make_shared<RecordingSinkImpl>(name, directory, segmentSeconds);
+  auto handle = Sinks::GetInstance().Allocate(CS_SINK_RECORDING, sink);
+  Notifier::GetInstance().NotifySink(name, handle, CS_SINK_CREATED);
+  return handle;
+}
+
+std::string GetRecordingSinkDirectory(CS_Sink sink, CS_Status* status) {
+  auto data = Sinks::GetInstance().Get(sink);
+  if (!data || data->kind != CS_SINK_RECORDING) {
+    *status = CS_INVALID_HANDLE;
+    return std::string{};
+  }
+  return static_cast<RecordingSinkImpl&>(*data->sink).GetDirectory();
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Sink CS_CreateRecordingSink(const char* name, const char* directory,
+                               int segmentSeconds, CS_Status* status) {
+  return cs::CreateRecordingSink(name, directory, segmentSeconds, status);
+}
+
+char* CS_GetRecordingSinkDirectory(CS_Sink sink, CS_Status* status) {
+  return ConvertToC(cs::GetRecordingSinkDirectory(sink, status));
+}
+
+}  // extern "C"
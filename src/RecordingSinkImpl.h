@@ -0,0 +1,86 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_RECORDINGSINKIMPL_H_
+#define CS_RECORDINGSINKIMPL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/StringRef.h"
+
+#include "cscore_recording.h"
+#include "AsyncFileWriter.h"
+#include "SinkImpl.h"
+
+namespace cs {
+
+class Frame;
+
+// Records frames as JPEG to a series of segment files (see
+// cscore_recording.h for the format).  Frames are batched and written in
+// the background into preallocated files, so a slow disk drops frames
+// rather than stalling the sink.
+class RecordingSinkImpl : public SinkImpl {
+ public:
+  RecordingSinkImpl(llvm::StringRef name, llvm::StringRef directory,
+                    int segmentSeconds);
+  ~RecordingSinkImpl() override;
+
+  void Stop();
+
+  std::string GetDirectory() const { return m_directory; }
+
+ private:
+  struct Batch;
+  struct Segment {
+    int fd{-1};
+    uint32_t number{0};
+    std::string path;
+  };
+
+  void RecordFrame(Frame& frame);
+  bool StartSegment(uint64_t frameTime);
+  void EndSegment();
+  bool OpenSegment(Segment& segment, uint32_t number);
+  void DiscardSegment(Segment& segment);
+  void Flush();
+
+  void ThreadMain();
+
+  // Never changed, so not protected by mutex
+  std::string m_directory;
+  uint64_t m_segmentLength;  // in frame time units
+
+  AsyncFileWriter m_writer;
+
+  // Only accessed from the thread
+  std::string m_basePath;  // directory/name-date-time
+  Segment m_current;
+  Segment m_next;  // created ahead of time so rollover doesn't wait on it
+  uint64_t m_preallocSize;
+  uint64_t m_segmentStartTime{0};  // frame time of first frame
+  uint64_t m_offset{0};            // bytes accepted by the writer
+  std::vector<CS_RecIndexEntry> m_index;
+  std::shared_ptr<Batch> m_batch;
+  uint64_t m_batchStartTime{0};
+  uint64_t m_lastSyncTime{0};
+  uint64_t m_lastOpenTime{0};
+  std::size_t m_dropped{0};
+
+  std::atomic_bool m_active;  // set to false to terminate thread
+  std::thread m_thread;
+};
+
+}  // namespace cs
+
+#endif  // CS_RECORDINGSINKIMPL_H_
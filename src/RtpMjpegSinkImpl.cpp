@@ -0,0 +1,315 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "RtpMjpegSinkImpl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "llvm/SmallString.h"
+#include "llvm/raw_ostream.h"
+#include "support/timestamp.h"
+
+#include "c_util.h"
+#include "Frame.h"
+#include "Handle.h"
+#include "Log.h"
+#include "Notifier.h"
+#include "SourceImpl.h"
+
+using namespace cs;
+
+// Quality used when a frame has to be re-encoded to be sent
+static const int kDefaultQuality = 80;
+
+// How often quantization tables are resent for receivers that joined late
+static const uint64_t kTablesInterval = 10000000;  // 1 second
+
+// How often RTCP sender reports are sent (RFC 3550 minimum)
+static const uint64_t kReportInterval = 50000000;  // 5 seconds
+
+// Number of Q values available for in-band tables (128-254; 255 means the
+// tables can't be cached)
+static const std::size_t kNumQ = 127;
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+RtpMjpegSinkImpl::RtpMjpegSinkImpl(llvm::StringRef name,
+                                   llvm::StringRef address, int port)
+    : SinkImpl{name}, m_address(address), m_port(port) {
+  llvm::SmallString<128> descBuf;
+  llvm::raw_svector_ostream desc{descBuf};
+  desc << "RTP " << m_address << ':' << m_port;
+  SetDescription(desc.str());
+
+  m_active = true;
+  // RTCP uses the next port up
+  if (m_port <= 0 || m_port >= 65535) {
+    SERROR("invalid port " << m_port);
+    return;
+  }
+  if (!Open()) return;
+  m_thread = std::thread(&RtpMjpegSinkImpl::ThreadMain, this);
+}
+
+RtpMjpegSinkImpl::~RtpMjpegSinkImpl() { Stop(); }
+
+void RtpMjpegSinkImpl::Stop() {
+  m_active = false;
+
+  // wake up any waiters by forcing an empty frame to be sent
+  if (auto source = GetSource())
+    source->Wakeup();
+
+  // join thread
+  if (m_thread.joinable()) m_thread.join();
+
+  Close();
+}
+
+#ifdef _WIN32
+
+bool RtpMjpegSinkImpl::Open() {
+  SERROR("RTP sinks are not supported on this platform");
+  return false;
+}
+
+void RtpMjpegSinkImpl::Close() {}
+
+bool RtpMjpegSinkImpl::SendPacket(llvm::ArrayRef<llvm::StringRef> pieces,
+                                  int port) {
+  return false;
+}
+
+#else
+
+bool RtpMjpegSinkImpl::Open() {
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo* result = nullptr;
+  int rv = ::getaddrinfo(m_address.c_str(), nullptr, &hints, &result);
+  if (rv != 0 || !result) {
+    SERROR("could not resolve " << m_address << ": " << ::gai_strerror(rv));
+    return false;
+  }
+  m_ipAddress =
+      reinterpret_cast<struct sockaddr_in*>(result->ai_addr)->sin_addr.s_addr;
+  ::freeaddrinfo(result);
+
+  m_sd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (m_sd < 0) {
+    SERROR("could not create socket: " << std::strerror(errno));
+    return false;
+  }
+  ::fcntl(m_sd, F_SETFD, FD_CLOEXEC);
+
+  // Frames are sent in bursts; a bigger buffer avoids dropping packets
+  int sndbuf = 1024 * 1024;
+  ::setsockopt(m_sd, SOL_SOCKET, SO_SNDBUF,
+               reinterpret_cast<const char*>(&sndbuf), sizeof(sndbuf));
+
+  if (IN_MULTICAST(ntohl(m_ipAddress))) {
+    // Stay on the local network, and deliver to receivers on this host too
+    unsigned char ttl = 1;
+    unsigned char loop = 1;
+    ::setsockopt(m_sd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    ::setsockopt(m_sd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  }
+
+  SINFO("sending RTP to " << m_address << ':' << m_port);
+  return true;
+}
+
+void RtpMjpegSinkImpl::Close() {
+  if (m_sd >= 0) ::close(m_sd);
+  m_sd = -1;
+}
+
+bool RtpMjpegSinkImpl::SendPacket(llvm::ArrayRef<llvm::StringRef> pieces,
+                                  int port) {
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = m_ipAddress;
+
+  // Send the headers and the payload (which points into the image) without
+  // copying them into one buffer
+  struct iovec iov[8];
+  std::size_t count = std::min(pieces.size(), sizeof(iov) / sizeof(iov[0]));
+  for (std::size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<char*>(pieces[i].data());
+    iov[i].iov_len = pieces[i].size();
+  }
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &addr;
+  msg.msg_namelen = sizeof(addr);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  for (;;) {
+    if (::sendmsg(m_sd, &msg, kSendFlags) >= 0) return true;
+    if (errno == EINTR) continue;
+    // The receiver drops incomplete frames, so just give up on this one
+    SDEBUG("sendmsg() failed: " << std::strerror(errno));
+    return false;
+  }
+}
+
+#endif  // _WIN32
+
+void RtpMjpegSinkImpl::SendFrame(Frame& frame) {
+  // RTP/JPEG can't describe images larger than 2040x2040
+  int width = frame.GetOriginalWidth();
+  int height = frame.GetOriginalHeight();
+  while (width > 2040 || height > 2040) {
+    width /= 2;
+    height /= 2;
+  }
+
+  Image* image = frame.GetImage(width, height, VideoMode::kMJPEG);
+  RtpJpegInfo info;
+  if (!image || !ParseRtpJpeg(*image, &info)) {
+    // Re-encode JPEGs that can't be sent as is (e.g. grayscale, progressive,
+    // or with optimized Huffman tables)
+    SDEBUG4("re-encoding frame for RTP");
+    image = frame.ConvertBGRToMJPEG(
+        frame.GetImage(width, height, VideoMode::kBGR), kDefaultQuality);
+    if (!image || !ParseRtpJpeg(*image, &info)) {
+      SDEBUG("could not packetize frame");
+      return;
+    }
+  }
+
+  // Assign each distinct set of quantization tables a Q value, so the tables
+  // only need to be sent when they change (and periodically for receivers
+  // that joined late).  Cameras normally use a single set.
+  uint64_t now = wpi::Now();
+  std::size_t index = 0;
+  for (; index < m_qtables.size(); ++index) {
+    llvm::StringRef tables = m_qtables[index];
+    if (tables.substr(0, 64) == info.qtables[0] &&
+        tables.substr(64) == info.qtables[1])
+      break;
+  }
+  bool sendTables = now - m_lastTablesTime >= kTablesInterval;
+  if (index == m_qtables.size()) {
+    if (m_qtables.size() >= kNumQ) {
+      m_qtables.clear();
+      index = 0;
+    }
+    m_qtables.push_back(info.qtables[0].str() + info.qtables[1].str());
+    sendTables = true;
+  }
+  int q = 128 + index;
+  if (sendTables) m_lastTablesTime = now;
+
+  m_packetizer.Packetize(
+      info, q, sendTables, frame.GetTime(),
+      [&](llvm::ArrayRef<llvm::StringRef> pieces) {
+        return SendPacket(pieces, m_port);
+      });
+}
+
+void RtpMjpegSinkImpl::SendReport() {
+  uint64_t now = wpi::Now();
+  if (m_lastReportTime != 0 && now - m_lastReportTime < kReportInterval)
+    return;
+  m_lastReportTime = now;
+
+  llvm::SmallString<64> buf;
+  m_packetizer.WriteSenderReport(buf, now, GetName());
+  SendPacket(llvm::StringRef{buf}, m_port + 1);
+}
+
+void RtpMjpegSinkImpl::ThreadMain() {
+  Enable();
+  while (m_active) {
+    auto source = GetSource();
+    if (!source) {
+      // Source disconnected; sleep so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+    SDEBUG4("waiting for frame");
+    Frame frame = source->GetNextFrame(0.225);  // blocks
+    if (!m_active) break;
+    if (frame) SendFrame(frame);
+    SendReport();
+    if (!frame) {
+      // Bad frame; sleep for 20 ms so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  Disable();
+}
+
+namespace cs {
+
+CS_Sink CreateRtpSink(llvm::StringRef name, llvm::StringRef address,
+                      int port, CS_Status* status) {
+  auto sink = std::make_shared<RtpMjpegSinkImpl>(name, address, port);
+  auto handle = Sinks::GetInstance().Allocate(CS_SINK_RTP, sink);
+  Notifier::GetInstance().NotifySink(name, handle, CS_SINK_CREATED);
+  return handle;
+}
+
+std::string GetRtpSinkAddress(CS_Sink sink, CS_Status* status) {
+  auto data = Sinks::GetInstance().Get(sink);
+  if (!data || data->kind != CS_SINK_RTP) {
+    *status = CS_INVALID_HANDLE;
+    return std::string{};
+  }
+  return static_cast<RtpMjpegSinkImpl&>(*data->sink).GetAddress();
+}
+
+int GetRtpSinkPort(CS_Sink sink, CS_Status* status) {
+  auto data = Sinks::GetInstance().Get(sink);
+  if (!data || data->kind != CS_SINK_RTP) {
+    *status = CS_INVALID_HANDLE;
+    return 0;
+  }
+  return static_cast<RtpMjpegSinkImpl&>(*data->sink).GetPort();
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Sink CS_CreateRtpSink(const char* name, const char* address, int port,
+                         CS_Status* status) {
+  return cs::CreateRtpSink(name, address, port, status);
+}
+
+char* CS_GetRtpSinkAddress(CS_Sink sink, CS_Status* status) {
+  return ConvertToC(cs::GetRtpSinkAddress(sink, status));
+}
+
+int CS_GetRtpSinkPort(CS_Sink sink, CS_Status* status) {
+  return cs::GetRtpSinkPort(sink, status);
+}
+
+}  // extern "C"
@@ -0,0 +1,67 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_RTPMJPEGSINKIMPL_H_
+#define CS_RTPMJPEGSINKIMPL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/StringRef.h"
+
+#include "RtpUtil.h"
+#include "SinkImpl.h"
+
+namespace cs {
+
+class Frame;
+
+// Sends frames as RTP/JPEG (RFC 2435) over UDP, to a unicast or multicast
+// address.  Unlike the HTTP stream, a lost packet only costs the frame it
+// belongs to.  RTCP sender reports are sent to the next port up.
+class RtpMjpegSinkImpl : public SinkImpl {
+ public:
+  RtpMjpegSinkImpl(llvm::StringRef name, llvm::StringRef address, int port);
+  ~RtpMjpegSinkImpl() override;
+
+  void Stop();
+
+  std::string GetAddress() const { return m_address; }
+  int GetPort() const { return m_port; }
+
+ private:
+  bool Open();
+  void Close();
+  void SendFrame(Frame& frame);
+  void SendReport();
+  bool SendPacket(llvm::ArrayRef<llvm::StringRef> pieces, int port);
+
+  void ThreadMain();
+
+  // Never changed, so not protected by mutex
+  std::string m_address;
+  int m_port;
+
+  // Only accessed from the thread
+  int m_sd{-1};
+  uint32_t m_ipAddress{0};  // network byte order
+  RtpJpegPacketizer m_packetizer;
+  std::vector<std::string> m_qtables;  // tables for Q values 128 and up
+  uint64_t m_lastTablesTime{0};
+  uint64_t m_lastReportTime{0};
+
+  std::atomic_bool m_active;  // set to false to terminate thread
+  std::thread m_thread;
+};
+
+}  // namespace cs
+
+#endif  // CS_RTPMJPEGSINKIMPL_H_
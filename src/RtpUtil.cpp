@@ -0,0 +1,281 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "RtpUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "JpegUtil.h"
+
+using namespace cs;
+
+// Static payload type for JPEG (RFC 3551)
+static const int kPayloadType = 26;
+
+// Largest dimension expressible in the JPEG header (255 * 8)
+static const int kMaxDimension = 2040;
+
+// Seconds between the NTP (1900) and Unix (1970) epochs
+static const uint64_t kNtpEpochOffset = 2208988800ull;
+
+static inline void Write16(unsigned char* p, unsigned int v) {
+  p[0] = static_cast<unsigned char>(v >> 8);
+  p[1] = static_cast<unsigned char>(v);
+}
+
+static inline void Write32(unsigned char* p, uint32_t v) {
+  p[0] = static_cast<unsigned char>(v >> 24);
+  p[1] = static_cast<unsigned char>(v >> 16);
+  p[2] = static_cast<unsigned char>(v >> 8);
+  p[3] = static_cast<unsigned char>(v);
+}
+
+// Receivers rebuild the Huffman tables from the standard ones (ITU T.81
+// Annex K), so any tables in the JPEG must match those.
+static bool IsStandardHuffmanTable(llvm::StringRef table) {
+  llvm::StringRef dht = JpegGetDHT().substr(4);  // skip marker and length
+  while (dht.size() >= 17) {
+    std::size_t len = 17;
+    for (int i = 1; i <= 16; ++i) len += dht.bytes_begin()[i];
+    if (dht[0] == table[0]) return dht.substr(0, len) == table;
+    dht = dht.substr(len);
+  }
+  return false;
+}
+
+bool cs::ParseRtpJpeg(llvm::StringRef data, RtpJpegInfo* info) {
+  auto bytes = data.bytes_begin();
+  std::size_t size = data.size();
+  if (size < 4 || bytes[0] != 0xff || bytes[1] != 0xd8) return false;
+
+  llvm::StringRef dqt[4];
+  int lumaTable = -1;
+  int chromaTable = -1;
+  info->restartInterval = 0;
+
+  std::size_t pos = 2;
+  for (;;) {
+    if (pos + 4 > size || bytes[pos] != 0xff) return false;
+    unsigned char marker = bytes[pos + 1];
+    if (marker == 0xff) {
+      // fill byte
+      ++pos;
+      continue;
+    }
+    std::size_t len = bytes[pos + 2] * 256 + bytes[pos + 3];
+    if (len < 2 || pos + 2 + len > size) return false;
+    const unsigned char* seg = bytes + pos + 4;
+    std::size_t segLen = len - 2;
+
+    switch (marker) {
+      case 0xdb:  // DQT
+        while (segLen > 0) {
+          // only 8-bit tables can be sent
+          if (segLen < 65 || (seg[0] >> 4) != 0) return false;
+          dqt[seg[0] & 3] =
+              llvm::StringRef(reinterpret_cast<const char*>(seg + 1), 64);
+          seg += 65;
+          segLen -= 65;
+        }
+        break;
+      case 0xc4:  // DHT
+        while (segLen > 0) {
+          if (segLen < 17) return false;
+          std::size_t tableLen = 17;
+          for (int i = 1; i <= 16; ++i) tableLen += seg[i];
+          if (segLen < tableLen ||
+              !IsStandardHuffmanTable(llvm::StringRef(
+                  reinterpret_cast<const char*>(seg), tableLen)))
+            return false;
+          seg += tableLen;
+          segLen -= tableLen;
+        }
+        break;
+      case 0xc0:  // SOF0 (baseline)
+        // 8-bit, 3 components, Y at 2x1 or 2x2 and 1x1 chroma sharing a
+        // quantization table
+        if (segLen < 15 || seg[0] != 8 || seg[5] != 3) return false;
+        info->height = seg[1] * 256 + seg[2];
+        info->width = seg[3] * 256 + seg[4];
+        if (seg[7] == 0x21)
+          info->type = 0;
+        else if (seg[7] == 0x22)
+          info->type = 1;
+        else
+          return false;
+        if (seg[10] != 0x11 || seg[13] != 0x11 || seg[11] != seg[14])
+          return false;
+        lumaTable = seg[8] & 3;
+        chromaTable = seg[11] & 3;
+        break;
+      case 0xc1: case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+      case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf:
+        // other SOF (progressive, arithmetic, etc)
+        return false;
+      case 0xdd:  // DRI
+        if (segLen < 2) return false;
+        info->restartInterval = seg[0] * 256 + seg[1];
+        break;
+      case 0xda: {  // SOS
+        // one interleaved baseline scan, with luma using table 0 and chroma
+        // table 1 as receivers assume
+        if (lumaTable < 0 || segLen < 10 || seg[0] != 3 || seg[2] != 0x00 ||
+            seg[4] != 0x11 || seg[6] != 0x11 || seg[7] != 0 ||
+            seg[8] != 63 || seg[9] != 0)
+          return false;
+        if (dqt[lumaTable].empty() || dqt[chromaTable].empty()) return false;
+        if (info->width <= 0 || info->height <= 0 ||
+            info->width > kMaxDimension || info->height > kMaxDimension)
+          return false;
+        info->qtables[0] = dqt[lumaTable];
+        info->qtables[1] = dqt[chromaTable];
+        if (info->restartInterval != 0) info->type += 64;
+
+        // The scan runs to EOI, which may be followed by padding
+        llvm::StringRef scan = data.substr(pos + 2 + len);
+        std::size_t tail = std::min<std::size_t>(scan.size(), 1024);
+        std::size_t eoi = scan.substr(scan.size() - tail).rfind("\xff\xd9");
+        if (eoi != llvm::StringRef::npos)
+          scan = scan.substr(0, scan.size() - tail + eoi);
+        info->scan = scan;
+        return true;
+      }
+      default:
+        // APPn, COM etc aren't sent
+        break;
+    }
+    pos += 2 + len;
+  }
+}
+
+RtpJpegPacketizer::RtpJpegPacketizer(std::size_t maxPacketSize)
+    : m_maxPacketSize{std::max<std::size_t>(maxPacketSize, 512)} {
+  // Random initial values (RFC 3550 section 5.1)
+  std::random_device rd;
+  m_ssrc = rd();
+  m_seq = static_cast<uint16_t>(rd());
+  m_timestampOffset = rd();
+}
+
+uint32_t RtpJpegPacketizer::GetTimestamp(uint64_t time) const {
+  // 90 kHz clock; time is in 100 ns units
+  return static_cast<uint32_t>(time * 9 / 1000) + m_timestampOffset;
+}
+
+bool RtpJpegPacketizer::Packetize(const RtpJpegInfo& info, int q,
+                                  bool sendTables, uint64_t time,
+                                  const SendFunc& send) {
+  uint32_t timestamp = GetTimestamp(time);
+  bool restart = info.type >= 64;
+  std::size_t scanSize = info.scan.size();
+  std::size_t offset = 0;
+
+  unsigned char rtpHeader[12];
+  unsigned char jpegHeader[8];
+  unsigned char restartHeader[4];
+  unsigned char qtableHeader[4];
+
+  // Fixed parts
+  rtpHeader[0] = 0x80;  // version 2
+  Write32(rtpHeader + 4, timestamp);
+  Write32(rtpHeader + 8, m_ssrc);
+  jpegHeader[0] = 0;  // type-specific
+  jpegHeader[4] = info.type;
+  jpegHeader[5] = q;
+  jpegHeader[6] = (info.width + 7) / 8;
+  jpegHeader[7] = (info.height + 7) / 8;
+  Write16(restartHeader, info.restartInterval);
+  // F=1, L=1, count=0x3fff: packets aren't aligned to restart intervals
+  restartHeader[2] = 0xff;
+  restartHeader[3] = 0xff;
+  qtableHeader[0] = 0;  // MBZ
+  qtableHeader[1] = 0;  // precision: 8-bit tables
+  Write16(qtableHeader + 2, sendTables ? 128 : 0);
+
+  llvm::SmallVector<llvm::StringRef, 8> pieces;
+  do {
+    pieces.clear();
+    pieces.emplace_back(reinterpret_cast<char*>(rtpHeader), 12);
+    pieces.emplace_back(reinterpret_cast<char*>(jpegHeader), 8);
+    if (restart)
+      pieces.emplace_back(reinterpret_cast<char*>(restartHeader), 4);
+    // Quantization tables go in the first packet only
+    if (offset == 0 && q >= 128) {
+      pieces.emplace_back(reinterpret_cast<char*>(qtableHeader), 4);
+      if (sendTables) {
+        pieces.push_back(info.qtables[0]);
+        pieces.push_back(info.qtables[1]);
+      }
+    }
+    std::size_t headerSize = 0;
+    for (auto&& piece : pieces) headerSize += piece.size();
+
+    std::size_t payloadSize =
+        std::min(scanSize - offset, m_maxPacketSize - headerSize);
+    bool last = offset + payloadSize == scanSize;
+    rtpHeader[1] = (last ? 0x80 : 0) | kPayloadType;  // marker on last
+    Write16(rtpHeader + 2, m_seq);
+    jpegHeader[1] = static_cast<unsigned char>(offset >> 16);
+    jpegHeader[2] = static_cast<unsigned char>(offset >> 8);
+    jpegHeader[3] = static_cast<unsigned char>(offset);
+    pieces.push_back(info.scan.substr(offset, payloadSize));
+
+    if (!send(pieces)) return false;
+
+    ++m_seq;
+    ++m_packetCount;
+    m_octetCount += headerSize - 12 + payloadSize;
+    offset += payloadSize;
+  } while (offset < scanSize);
+  return true;
+}
+
+void RtpJpegPacketizer::WriteSenderReport(llvm::SmallVectorImpl<char>& buf,
+                                          uint64_t now,
+                                          llvm::StringRef cname) const {
+  cname = cname.substr(0, 255);
+
+  // NTP timestamp of the current wallclock time
+  auto since = std::chrono::system_clock::now().time_since_epoch();
+  auto secs = std::chrono::duration_cast<std::chrono::seconds>(since);
+  auto nsecs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(since - secs);
+  uint32_t ntpSecs = static_cast<uint32_t>(secs.count() + kNtpEpochOffset);
+  uint32_t ntpFrac = static_cast<uint32_t>(
+      (static_cast<uint64_t>(nsecs.count()) << 32) / 1000000000);
+
+  // SDES chunk: SSRC, CNAME item, end of list, padded to 32 bits
+  std::size_t chunkSize = (4 + 2 + cname.size() + 1 + 3) & ~3;
+
+  std::size_t start = buf.size();
+  buf.resize(start + 28 + 4 + chunkSize);
+  unsigned char* p = reinterpret_cast<unsigned char*>(buf.data() + start);
+  std::fill(p, p + 28 + 4 + chunkSize, 0);
+
+  // Sender report without reception report blocks
+  p[0] = 0x80;
+  p[1] = 200;
+  Write16(p + 2, 6);
+  Write32(p + 4, m_ssrc);
+  Write32(p + 8, ntpSecs);
+  Write32(p + 12, ntpFrac);
+  Write32(p + 16, GetTimestamp(now));
+  Write32(p + 20, m_packetCount);
+  Write32(p + 24, m_octetCount);
+  p += 28;
+
+  // Source description
+  p[0] = 0x81;
+  p[1] = 202;
+  Write16(p + 2, chunkSize / 4);
+  Write32(p + 4, m_ssrc);
+  p[8] = 1;  // CNAME
+  p[9] = cname.size();
+  std::copy(cname.bytes_begin(), cname.bytes_end(), p + 10);
+}
@@ -0,0 +1,79 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_RTPUTIL_H_
+#define CS_RTPUTIL_H_
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "llvm/ArrayRef.h"
+#include "llvm/SmallVector.h"
+#include "llvm/StringRef.h"
+
+namespace cs {
+
+// A JPEG split into the pieces carried by the RTP payload format for JPEG
+// (RFC 2435).  Everything refers into the original JPEG data.
+struct RtpJpegInfo {
+  int type{0};             // 0 (4:2:2) or 1 (4:2:0); +64 with restart markers
+  int width{0};            // pixels
+  int height{0};           // pixels
+  int restartInterval{0};  // MCUs; 0 if no restart markers
+  llvm::StringRef qtables[2];  // luma and chroma tables (64 bytes each)
+  llvm::StringRef scan;        // entropy coded data, without EOI
+};
+
+// Split a JPEG for RTP.  Only baseline 3-component JPEGs with 2x1 or 2x2
+// luma sampling, the standard Huffman tables (or none, as sent by many
+// cameras), and dimensions up to 2040 pixels can be sent.
+// @return False if the JPEG can't be sent (and should be re-encoded)
+bool ParseRtpJpeg(llvm::StringRef data, RtpJpegInfo* info);
+
+// RTP session state for a JPEG stream (payload type 26) and its RTCP sender
+// reports.
+class RtpJpegPacketizer {
+ public:
+  // Called with the pieces of each packet, to be sent as one datagram.
+  // Returns false to abort the frame.
+  typedef std::function<bool(llvm::ArrayRef<llvm::StringRef> pieces)>
+      SendFunc;
+
+  // @param maxPacketSize Maximum datagram size (RTP headers included)
+  explicit RtpJpegPacketizer(std::size_t maxPacketSize = 1400);
+
+  // Packetize a frame.
+  // @param q Q value for the JPEG header; 128-255 means the tables are sent
+  //          in-band (or are cached by the receiver, if !sendTables)
+  // @param sendTables Send the quantization tables in the first packet
+  // @param time Frame time (wpi::Now() units)
+  // @return False if send returned false
+  bool Packetize(const RtpJpegInfo& info, int q, bool sendTables,
+                 uint64_t time, const SendFunc& send);
+
+  // Build a compound RTCP packet (sender report plus CNAME).
+  // @param now Current time (wpi::Now() units)
+  void WriteSenderReport(llvm::SmallVectorImpl<char>& buf, uint64_t now,
+                         llvm::StringRef cname) const;
+
+  uint32_t GetSsrc() const { return m_ssrc; }
+
+ private:
+  uint32_t GetTimestamp(uint64_t time) const;
+
+  std::size_t m_maxPacketSize;
+  uint32_t m_ssrc;
+  uint16_t m_seq;
+  uint32_t m_timestampOffset;
+  uint32_t m_packetCount{0};
+  uint32_t m_octetCount{0};
+};
+
+}  // namespace cs
+
+#endif  // CS_RTPUTIL_H_
@@ -0,0 +1,296 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "ShmSinkImpl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "llvm/SmallString.h"
+
+#include "c_util.h"
+#include "Frame.h"
+#include "Handle.h"
+#include "Log.h"
+#include "Notifier.h"
+#include "SourceImpl.h"
+
+using namespace cs;
+
+static std::size_t AlignUp(std::size_t size) { return (size + 63) & ~63; }
+
+static int GetBytesPerPixel(VideoMode::PixelFormat pixelFormat) {
+  switch (pixelFormat) {
+    case VideoMode::kYUYV:
+    case VideoMode::kRGB565:
+      return 2;
+    case VideoMode::kBGR:
+      return 3;
+    case VideoMode::kGray:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+ShmSinkImpl::ShmSinkImpl(llvm::StringRef name, llvm::StringRef shmName,
+                         const VideoMode& mode, int numSlots)
+    : SinkImpl{name},
+      m_shmName(shmName),
+      m_mode(mode),
+      m_numSlots(std::max(std::min(numSlots, CS_SHM_MAX_SLOTS), 2)) {
+  // Slots are a fixed size, so compressed frames can't be supported
+  auto pixelFormat = static_cast<VideoMode::PixelFormat>(m_mode.pixelFormat);
+  if (GetBytesPerPixel(pixelFormat) == 0) {
+    SWARNING("unsupported pixel format " << m_mode.pixelFormat
+                                         << "; using BGR");
+    m_mode.pixelFormat = pixelFormat = VideoMode::kBGR;
+  }
+  if (m_mode.pixelFormat == VideoMode::kYUYV) m_mode.width &= ~1;
+  m_dataSize = static_cast<std::size_t>(m_mode.width) * m_mode.height *
+               GetBytesPerPixel(pixelFormat);
+
+  llvm::SmallString<128> descBuf;
+  llvm::raw_svector_ostream desc{descBuf};
+  desc << "Shared memory " << m_shmName << " (" << m_mode.width << 'x'
+       << m_mode.height << ", " << m_numSlots << " slots)";
+  SetDescription(desc.str());
+
+  m_active = true;
+  if (m_mode.width <= 0 || m_mode.height <= 0) {
+    SERROR("invalid resolution " << m_mode.width << 'x' << m_mode.height);
+    return;
+  }
+  if (!Open()) return;
+  m_thread = std::thread(&ShmSinkImpl::ThreadMain, this);
+}
+
+ShmSinkImpl::~ShmSinkImpl() { Stop(); }
+
+void ShmSinkImpl::Stop() {
+  m_active = false;
+
+  // wake up any waiters by forcing an empty frame to be sent
+  if (auto source = GetSource())
+    source->Wakeup();
+
+  // join thread
+  if (m_thread.joinable()) m_thread.join();
+
+  Close();
+}
+
+CS_ShmSlotHeader* ShmSinkImpl::GetSlot(uint32_t slot) const {
+  return reinterpret_cast<CS_ShmSlotHeader*>(
+      reinterpret_cast<char*>(m_header) + m_header->slotOffset +
+      m_header->slotSize * slot);
+}
+
+#ifdef _WIN32
+
+bool ShmSinkImpl::Open() {
+  SERROR("shared memory sinks are not supported on this platform");
+  return false;
+}
+
+void ShmSinkImpl::Close() {}
+
+void ShmSinkImpl::PutFrame(Frame& frame) {}
+
+#else
+
+bool ShmSinkImpl::Open() {
+  std::string path = "/" + m_shmName;
+  std::size_t slotOffset = AlignUp(sizeof(CS_ShmHeader));
+  std::size_t dataOffset = AlignUp(sizeof(CS_ShmSlotHeader));
+  std::size_t slotSize = AlignUp(dataOffset + m_dataSize);
+  std::size_t size = slotOffset + slotSize * m_numSlots;
+
+  // Replace rather than resize any existing segment; readers of the old one
+  // keep their mapping and see it closed.
+  ::shm_unlink(path.c_str());
+  int fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd < 0) {
+    SERROR("could not create shared memory " << path << ": "
+                                             << std::strerror(errno));
+    return false;
+  }
+  if (::ftruncate(fd, size) != 0) {
+    SERROR("could not size shared memory " << path << ": "
+                                           << std::strerror(errno));
+    ::close(fd);
+    ::shm_unlink(path.c_str());
+    return false;
+  }
+  void* addr =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    SERROR("could not map shared memory " << path << ": "
+                                          << std::strerror(errno));
+    ::shm_unlink(path.c_str());
+    return false;
+  }
+
+  // The new segment is zero filled
+  m_header = static_cast<CS_ShmHeader*>(addr);
+  m_size = size;
+  m_header->version = CS_SHM_VERSION;
+  m_header->numSlots = m_numSlots;
+  m_header->dataOffset = dataOffset;
+  m_header->slotSize = slotSize;
+  m_header->slotOffset = slotOffset;
+  m_header->writerPid = ::getpid();
+  __atomic_store_n(&m_header->magic, CS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  SINFO("publishing frames to shared memory " << path);
+  return true;
+}
+
+void ShmSinkImpl::Close() {
+  if (!m_header) return;
+  __atomic_store_n(&m_header->closed, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&m_header->futex, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+  ::syscall(SYS_futex, &m_header->futex, FUTEX_WAKE, INT_MAX, nullptr,
+            nullptr, 0);
+#endif
+  ::munmap(m_header, m_size);
+  m_header = nullptr;
+  std::string path = "/" + m_shmName;
+  ::shm_unlink(path.c_str());
+}
+
+void ShmSinkImpl::PutFrame(Frame& frame) {
+  auto pixelFormat = static_cast<VideoMode::PixelFormat>(m_mode.pixelFormat);
+  Image* image = frame.GetImage(m_mode.width, m_mode.height, pixelFormat);
+  if (!image || image->pixelFormat != pixelFormat ||
+      image->size() > m_dataSize) {
+    // Shouldn't happen, but just in case...
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return;
+  }
+
+  // Find a slot no reader is using, preferring the oldest.  Marking the slot
+  // as being written before checking the pin count (and readers doing the
+  // reverse) ensures either we see the pin or the reader sees the write.
+  CS_ShmSlotHeader* slotHeader = nullptr;
+  uint32_t slot = 0;
+  uint32_t lock = 0;
+  for (int i = 1; i <= m_numSlots; ++i) {
+    slot = (m_lastSlot + i) % m_numSlots;
+    CS_ShmSlotHeader* s = GetSlot(slot);
+    lock = __atomic_load_n(&s->lock, __ATOMIC_RELAXED);  // only we write it
+    __atomic_store_n(&s->lock, lock + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->pins, __ATOMIC_SEQ_CST) == 0) {
+      slotHeader = s;
+      break;
+    }
+    __atomic_store_n(&s->lock, lock, __ATOMIC_SEQ_CST);
+  }
+  if (!slotHeader) {
+    SDEBUG4("all slots pinned; dropping frame");
+    return;
+  }
+
+  std::memcpy(reinterpret_cast<char*>(slotHeader) + m_header->dataOffset,
+              image->data(), image->size());
+  slotHeader->seq = ++m_seq;
+  slotHeader->time = frame.GetTime();
+  slotHeader->pixelFormat = image->pixelFormat;
+  slotHeader->width = image->width;
+  slotHeader->height = image->height;
+  slotHeader->stride = image->size() / image->height;
+  slotHeader->dataSize = image->size();
+  __atomic_store_n(&slotHeader->lock, lock + 2, __ATOMIC_RELEASE);
+  m_lastSlot = slot;
+
+  // Publish and wake readers; the syscall is skipped if nobody is waiting
+  __atomic_store_n(&m_header->latest, (m_seq << 16) | slot, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&m_header->futex, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+  if (__atomic_load_n(&m_header->waiters, __ATOMIC_SEQ_CST) != 0)
+    ::syscall(SYS_futex, &m_header->futex, FUTEX_WAKE, INT_MAX, nullptr,
+              nullptr, 0);
+#endif
+}
+
+#endif  // _WIN32
+
+void ShmSinkImpl::ThreadMain() {
+  Enable();
+  while (m_active) {
+    auto source = GetSource();
+    if (!source) {
+      // Source disconnected; sleep so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      continue;
+    }
+    SDEBUG4("waiting for frame");
+    Frame frame = source->GetNextFrame(0.225);  // blocks
+    if (!m_active) break;
+    if (!frame) {
+      // Bad frame; sleep for 20 ms so we don't consume all processor time.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      continue;
+    }
+    PutFrame(frame);
+  }
+  Disable();
+}
+
+namespace cs {
+
+CS_Sink CreateShmSink(llvm::StringRef name, llvm::StringRef shmName,
+                      const VideoMode& mode, int numSlots, CS_Status* status) {
+  auto sink = std::make_shared<ShmSinkImpl>(name, shmName, mode, numSlots);
+  auto handle = Sinks::GetInstance().Allocate(CS_SINK_SHM, sink);
+  Notifier::GetInstance().NotifySink(name, handle, CS_SINK_CREATED);
+  return handle;
+}
+
+std::string GetShmSinkName(CS_Sink sink, CS_Status* status) {
+  auto data = Sinks::GetInstance().Get(sink);
+  if (!data || data->kind != CS_SINK_SHM) {
+    *status = CS_INVALID_HANDLE;
+    return std::string{};
+  }
+  return static_cast<ShmSinkImpl&>(*data->sink).GetShmName();
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Sink CS_CreateShmSink(const char* name, const char* shmName,
+                         const CS_VideoMode* mode, int numSlots,
+                         CS_Status* status) {
+  return cs::CreateShmSink(name, shmName,
+                           static_cast<const cs::VideoMode&>(*mode), numSlots,
+                           status);
+}
+
+char* CS_GetShmSinkName(CS_Sink sink, CS_Status* status) {
+  return ConvertToC(cs::GetShmSinkName(sink, status));
+}
+
+}  // extern "C"
@@ -0,0 +1,65 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_SHMSINKIMPL_H_
+#define CS_SHMSINKIMPL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "llvm/StringRef.h"
+
+#include "cscore_cpp.h"
+#include "cscore_raw.h"
+#include "SinkImpl.h"
+
+namespace cs {
+
+class Frame;
+
+// Publishes frames into a shared memory ring (see cscore_raw.h for the
+// layout) for other processes on the same machine.  Frames are converted to
+// a fixed pixel format and resolution so the slot size is known up front.
+class ShmSinkImpl : public SinkImpl {
+ public:
+  ShmSinkImpl(llvm::StringRef name, llvm::StringRef shmName,
+              const VideoMode& mode, int numSlots);
+  ~ShmSinkImpl() override;
+
+  void Stop();
+
+  std::string GetShmName() const { return m_shmName; }
+
+ private:
+  bool Open();
+  void Close();
+  void PutFrame(Frame& frame);
+  CS_ShmSlotHeader* GetSlot(uint32_t slot) const;
+
+  void ThreadMain();
+
+  // Never changed, so not protected by mutex
+  std::string m_shmName;
+  VideoMode m_mode;
+  int m_numSlots;
+  std::size_t m_dataSize;
+
+  CS_ShmHeader* m_header{nullptr};
+  std::size_t m_size{0};
+  uint64_t m_seq{0};
+  uint32_t m_lastSlot{0};
+
+  std::atomic_bool m_active;  // set to false to terminate thread
+  std::thread m_thread;
+};
+
+}  // namespace cs
+
+#endif  // CS_SHMSINKIMPL_H_
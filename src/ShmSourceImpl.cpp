@@ -0,0 +1,338 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "ShmSourceImpl.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+
+#include "cscore_shm_reader.h"
+#else
+#include "cscore_raw.h"
+#endif
+
+#include "llvm/STLExtras.h"
+#include "llvm/SmallString.h"
+#include "llvm/raw_ostream.h"
+#include "support/timestamp.h"
+
+#include "c_util.h"
+#include "Handle.h"
+#include "Log.h"
+#include "Notifier.h"
+
+using namespace cs;
+
+#ifdef _WIN32
+struct CS_ShmFrame {};
+#endif
+
+struct ShmSourceImpl::Mapping {
+#ifndef _WIN32
+  ~Mapping() { CS_ShmReaderClose(&reader); }
+
+  CS_ShmReader reader;
+#endif
+};
+
+static int GetBytesPerPixel(VideoMode::PixelFormat pixelFormat) {
+  switch (pixelFormat) {
+    case VideoMode::kYUYV:
+    case VideoMode::kRGB565:
+      return 2;
+    case VideoMode::kBGR:
+      return 3;
+    case VideoMode::kGray:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+ShmSourceImpl::ShmSourceImpl(llvm::StringRef name, llvm::StringRef shmName)
+    : SourceImpl{name}, m_shmName{shmName} {
+  llvm::SmallString<128> descBuf;
+  llvm::raw_svector_ostream desc{descBuf};
+  desc << "Shared memory " << m_shmName;
+  SetDescription(desc.str());
+}
+
+ShmSourceImpl::~ShmSourceImpl() {
+  m_active = false;
+
+  // force wakeup of camera thread in case it's waiting on cv
+  m_sinkEnabledCond.notify_one();
+
+  // join camera thread
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void ShmSourceImpl::Start() {
+  m_thread = std::thread(&ShmSourceImpl::ThreadMain, this);
+}
+
+std::unique_ptr<PropertyImpl> ShmSourceImpl::CreateEmptyProperty(
+    llvm::StringRef name) const {
+  return llvm::make_unique<PropertyImpl>(name);
+}
+
+bool ShmSourceImpl::CacheProperties(CS_Status* status) const {
+  // Doesn't need to do anything.
+  m_properties_cached = true;
+  return true;
+}
+
+// The producer owns the camera, so there are no properties and the video mode
+// can't be changed from here.
+
+void ShmSourceImpl::SetProperty(int property, int value, CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void ShmSourceImpl::SetStringProperty(int property, llvm::StringRef value,
+                                      CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void ShmSourceImpl::SetBrightness(int brightness, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+int ShmSourceImpl::GetBrightness(CS_Status* status) const {
+  *status = CS_INVALID_HANDLE;
+  return 0;
+}
+
+void ShmSourceImpl::SetWhiteBalanceAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void ShmSourceImpl::SetWhiteBalanceHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void ShmSourceImpl::SetWhiteBalanceManual(int value, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void ShmSourceImpl::SetExposureAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void ShmSourceImpl::SetExposureHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void ShmSourceImpl::SetExposureManual(int value, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+bool ShmSourceImpl::SetVideoMode(const VideoMode& mode, CS_Status* status) {
+  return false;
+}
+
+void ShmSourceImpl::NumSinksChanged() {
+  // ignore
+}
+
+void ShmSourceImpl::NumSinksEnabledChanged() {
+  m_sinkEnabledCond.notify_one();
+}
+
+#ifdef _WIN32
+
+std::shared_ptr<ShmSourceImpl::Mapping> ShmSourceImpl::Attach() {
+  return nullptr;
+}
+
+bool ShmSourceImpl::IsWriterAlive(const Mapping& mapping) const {
+  return false;
+}
+
+void ShmSourceImpl::PutSlot(const std::shared_ptr<Mapping>& mapping,
+                            const CS_ShmFrame& frame) {}
+
+void ShmSourceImpl::ThreadMain() {
+  SERROR("shared memory sources are not supported on this platform");
+}
+
+#else
+
+std::shared_ptr<ShmSourceImpl::Mapping> ShmSourceImpl::Attach() {
+  auto mapping = std::make_shared<Mapping>();
+  int rv = CS_ShmReaderOpen(&mapping->reader, m_shmName.c_str());
+  if (rv != 0) {
+    SDEBUG("could not open shared memory " << m_shmName << ": "
+                                           << std::strerror(-rv));
+    return nullptr;
+  }
+  SINFO("attached to shared memory " << m_shmName);
+  return mapping;
+}
+
+bool ShmSourceImpl::IsWriterAlive(const Mapping& mapping) const {
+  pid_t pid = mapping.reader.header->writerPid;
+  return pid == 0 || ::kill(pid, 0) == 0 || errno == EPERM;
+}
+
+void ShmSourceImpl::PutSlot(const std::shared_ptr<Mapping>& mapping,
+                            const CS_ShmFrame& frame) {
+  const CS_ShmHeader* header = mapping->reader.header;
+  const CS_ShmSlotHeader* slot = frame.header;
+  auto pixelFormat = static_cast<VideoMode::PixelFormat>(slot->pixelFormat);
+  int width = slot->width;
+  int height = slot->height;
+  std::size_t rowSize =
+      static_cast<std::size_t>(width) * GetBytesPerPixel(pixelFormat);
+
+  // Don't trust the producer to stay within the slot
+  if (width <= 0 || height <= 0 ||
+      slot->dataSize > header->slotSize - header->dataOffset ||
+      (rowSize != 0 &&
+       (slot->stride < rowSize ||
+        static_cast<std::size_t>(slot->stride) * height > slot->dataSize))) {
+    SWARNING("ignoring frame with invalid size " << width << 'x' << height
+                                                 << " (" << slot->dataSize
+                                                 << " bytes)");
+    CS_ShmFrame copy = frame;
+    CS_ShmReaderRelease(&mapping->reader, &copy);
+    return;
+  }
+
+  // Update the video mode if the producer changed it
+  VideoMode mode{pixelFormat, width, height, 0};
+  bool modeChanged = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_mode.pixelFormat != mode.pixelFormat || m_mode.width != width ||
+        m_mode.height != height) {
+      m_mode = mode;
+      m_videoModes.assign(1, mode);
+      modeChanged = true;
+    }
+  }
+  if (modeChanged) {
+    auto& notifier = Notifier::GetInstance();
+    notifier.NotifySource(*this, CS_SOURCE_VIDEOMODES_UPDATED);
+    notifier.NotifySourceVideoMode(*this, mode);
+  }
+
+  // Images are contiguous, so padded rows have to be copied out
+  if (rowSize != 0 && slot->stride != rowSize) {
+    auto image = AllocImage(pixelFormat, width, height, rowSize * height);
+    const char* src = static_cast<const char*>(frame.data);
+    for (int y = 0; y < height; ++y)
+      std::memcpy(image->data() + y * rowSize, src + y * slot->stride,
+                  rowSize);
+    CS_ShmFrame copy = frame;
+    CS_ShmReaderRelease(&mapping->reader, &copy);
+    PutFrame(std::move(image), wpi::Now());
+    return;
+  }
+
+  // Alias the slot; the mapping (and the pin on the slot) is held until the
+  // last reference to the frame is dropped.
+  CS_ShmFrame pinned = frame;
+  std::unique_ptr<Image> image{new Image{
+      llvm::StringRef{static_cast<const char*>(frame.data), slot->dataSize},
+      [mapping, pinned]() mutable {
+        CS_ShmReaderRelease(&mapping->reader, &pinned);
+      }}};
+  image->pixelFormat = pixelFormat;
+  image->width = width;
+  image->height = height;
+  // The producer's timestamps are on its own clock, so use ours
+  PutFrame(std::move(image), wpi::Now());
+}
+
+void ShmSourceImpl::ThreadMain() {
+  std::shared_ptr<Mapping> mapping;
+  uint64_t lastSeq = 0;
+
+  while (m_active) {
+    // sleep here until at least one sink is enabled
+    if (m_numSinksEnabled == 0) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_sinkEnabledCond.wait(
+          lock, [=] { return !m_active || m_numSinksEnabled != 0; });
+      if (!m_active) break;
+    }
+
+    // attach, retrying once a second until the producer creates the segment
+    if (!mapping) {
+      mapping = Attach();
+      if (!mapping) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sinkEnabledCond.wait_for(lock, std::chrono::seconds(1),
+                                   [=] { return !m_active.load(); });
+        continue;
+      }
+      lastSeq = 0;
+      SetConnected(true);
+    }
+
+    // wait for a new frame; the timeout bounds how long shutdown takes
+    CS_ShmFrame frame;
+    int rv = CS_ShmReaderAcquire(&mapping->reader, lastSeq, 200, &frame);
+    if (rv == -ETIMEDOUT && IsWriterAlive(*mapping)) continue;
+    if (rv == -EPIPE || rv == -ETIMEDOUT) {
+      SINFO("producer closed shared memory " << m_shmName);
+      // frames still in use keep their own reference to the mapping
+      mapping.reset();
+      SetConnected(false);
+      PutError("producer closed shared memory", wpi::Now());
+      continue;
+    }
+    if (rv != 0) continue;
+
+    lastSeq = frame.seq;
+    PutSlot(mapping, frame);
+  }
+
+  SetConnected(false);
+}
+
+#endif  // _WIN32
+
+namespace cs {
+
+CS_Source CreateShmSource(llvm::StringRef name, llvm::StringRef shmName,
+                          CS_Status* status) {
+  auto source = std::make_shared<ShmSourceImpl>(name, shmName);
+  auto handle = Sources::GetInstance().Allocate(CS_SOURCE_SHM, source);
+  Notifier::GetInstance().NotifySource(name, handle, CS_SOURCE_CREATED);
+  source->Start();
+  return handle;
+}
+
+std::string GetShmSourceName(CS_Source source, CS_Status* status) {
+  auto data = Sources::GetInstance().Get(source);
+  if (!data || data->kind != CS_SOURCE_SHM) {
+    *status = CS_INVALID_HANDLE;
+    return std::string{};
+  }
+  return static_cast<ShmSourceImpl&>(*data->source).GetShmName();
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Source CS_CreateShmSource(const char* name, const char* shmName,
+                             CS_Status* status) {
+  return cs::CreateShmSource(name, shmName, status);
+}
+
+char* CS_GetShmSourceName(CS_Source source, CS_Status* status) {
+  return ConvertToC(cs::GetShmSourceName(source, status));
+}
+
+}  // extern "C"
@@ -0,0 +1,83 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_SHMSOURCEIMPL_H_
+#define CS_SHMSOURCEIMPL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "SourceImpl.h"
+
+struct CS_ShmFrame;
+
+namespace cs {
+
+// Receives frames from a shared memory ring written by another process (see
+// cscore_raw.h for the layout).  Frames alias the mapped slots rather than
+// being copied; a slot stays pinned until every sink has released the frame.
+class ShmSourceImpl : public SourceImpl {
+ public:
+  ShmSourceImpl(llvm::StringRef name, llvm::StringRef shmName);
+  ~ShmSourceImpl() override;
+
+  void Start();
+
+  // Property functions
+  void SetProperty(int property, int value, CS_Status* status) override;
+  void SetStringProperty(int property, llvm::StringRef value,
+                         CS_Status* status) override;
+
+  // Standard common camera properties
+  void SetBrightness(int brightness, CS_Status* status) override;
+  int GetBrightness(CS_Status* status) const override;
+  void SetWhiteBalanceAuto(CS_Status* status) override;
+  void SetWhiteBalanceHoldCurrent(CS_Status* status) override;
+  void SetWhiteBalanceManual(int value, CS_Status* status) override;
+  void SetExposureAuto(CS_Status* status) override;
+  void SetExposureHoldCurrent(CS_Status* status) override;
+  void SetExposureManual(int value, CS_Status* status) override;
+
+  bool SetVideoMode(const VideoMode& mode, CS_Status* status) override;
+
+  void NumSinksChanged() override;
+  void NumSinksEnabledChanged() override;
+
+  std::string GetShmName() const { return m_shmName; }
+
+ protected:
+  std::unique_ptr<PropertyImpl> CreateEmptyProperty(
+      llvm::StringRef name) const override;
+
+  bool CacheProperties(CS_Status* status) const override;
+
+ private:
+  struct Mapping;
+
+  std::shared_ptr<Mapping> Attach();
+  bool IsWriterAlive(const Mapping& mapping) const;
+  void PutSlot(const std::shared_ptr<Mapping>& mapping,
+               const CS_ShmFrame& frame);
+
+  void ThreadMain();
+
+  // Never changed, so not protected by mutex
+  std::string m_shmName;
+
+  std::atomic_bool m_active{true};  // set to false to terminate thread
+  std::thread m_thread;
+
+  // Protected by m_mutex
+  std::condition_variable m_sinkEnabledCond;
+};
+
+}  // namespace cs
+
+#endif  // CS_SHMSOURCEIMPL_H_
@@ -49,6 +49,45 @@ llvm::StringRef SourceImpl::GetDescription(
   return llvm::StringRef{buf.data(), buf.size()};
 }
 
+void SourceImpl::EnableSink(const VideoMode& demand) {
+  {
+    std::lock_guard<std::mutex> lock(m_demandMutex);
+    m_sinkDemands.push_back(demand);
+  }
+  ++m_numSinksEnabled;
+  NumSinksEnabledChanged();
+}
+
+void SourceImpl::DisableSink(const VideoMode& demand) {
+  {
+    std::lock_guard<std::mutex> lock(m_demandMutex);
+    auto it = std::find_if(
+        m_sinkDemands.begin(), m_sinkDemands.end(), [&](const VideoMode& d) {
+          return d.width == demand.width && d.height == demand.height &&
+                 d.fps == demand.fps;
+        });
+    if (it != m_sinkDemands.end()) m_sinkDemands.erase(it);
+  }
+  --m_numSinksEnabled;
+  NumSinksEnabledChanged();
+}
+
+VideoMode SourceImpl::GetSinkDemand() const {
+  std::lock_guard<std::mutex> lock(m_demandMutex);
+  if (m_sinkDemands.empty()) return VideoMode{};
+  VideoMode mode = m_sinkDemands.front();
+  for (const auto& demand : m_sinkDemands) {
+    // 0 (full) beats everything
+    if (demand.width == 0 || (mode.width != 0 && demand.width > mode.width))
+      mode.width = demand.width;
+    if (demand.height == 0 || (mode.height != 0 && demand.height > mode.height))
+      mode.height = demand.height;
+    if (demand.fps == 0 || (mode.fps != 0 && demand.fps > mode.fps))
+      mode.fps = demand.fps;
+  }
+  return mode;
+}
+
 void SourceImpl::SetConnected(bool connected) {
   bool wasConnected = m_connected.exchange(connected);
   if (wasConnected && !connected)
@@ -308,6 +347,7 @@ std::unique_ptr<Image> SourceImpl::AllocImage(
   image->pixelFormat = pixelFormat;
   image->width = width;
   image->height = height;
+  image->jpegQuality = -1;
 
   return image;
 }
@@ -377,6 +417,9 @@ void SourceImpl::UpdatePropertyValue(int property, bool setString, int value,
 }
 
 void SourceImpl::ReleaseImage(std::unique_ptr<Image> image) {
+  // Aliased images don't own a reusable buffer; destroying them releases
+  // the underlying memory back to its owner.
+  if (image->IsAlias()) return;
   std::lock_guard<std::mutex> lock{m_poolMutex};
   if (m_destroyFrames) return;
   // Return the frame to the pool.  First try to find an empty slot, otherwise
@@ -63,15 +63,16 @@ class SourceImpl {
   // to get source frames.
   int GetNumSinksEnabled() const { return m_numSinksEnabled; }
 
-  void EnableSink() {
-    ++m_numSinksEnabled;
-    NumSinksEnabledChanged();
-  }
+  // A sink that only needs a reduced resolution or frame rate can say so
+  // with demand (a width, height, or fps of 0 means full), so the source
+  // can request less from the device.  DisableSink() must be called with
+  // the same demand.
+  void EnableSink(const VideoMode& demand = VideoMode{});
+  void DisableSink(const VideoMode& demand = VideoMode{});
 
-  void DisableSink() {
-    --m_numSinksEnabled;
-    NumSinksEnabledChanged();
-  }
+  // Gets the largest resolution and frame rate needed by the enabled sinks
+  // (0 for full).
+  VideoMode GetSinkDemand() const;
 
   // Gets the current frame time (without waiting for a new one).
   uint64_t GetCurFrameTime();
@@ -150,6 +151,10 @@ class SourceImpl {
   std::atomic_int m_numSinks{0};
   std::atomic_int m_numSinksEnabled{0};
 
+  // One entry per enabled sink; protected by m_demandMutex.
+  mutable std::mutex m_demandMutex;
+  std::vector<VideoMode> m_sinkDemands;
+
  protected:
   // Get a property; must be called with m_mutex held.
   PropertyImpl* GetProperty(int property) {
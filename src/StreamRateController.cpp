@@ -0,0 +1,138 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "StreamRateController.h"
+
+#include <algorithm>
+
+using namespace cs;
+
+// Resolution scale factors, in eighths of the requested resolution
+static const int kScales[] = {8, 6, 4, 3, 2};
+static const int kNumScales = sizeof(kScales) / sizeof(kScales[0]);
+
+static const int kDefaultQuality = 80;
+static const int kMinQuality = 20;
+static const int kQualityStep = 10;
+
+// Number of consecutive frames over (or under) target before changing
+static const int kDownFrames = 3;
+static const int kUpFrames = 30;
+
+// Minimum time between changes (seconds)
+static const double kDownHoldoff = 0.25;
+static const double kUpHoldoff = 2.0;
+
+// Smoothing factor for throughput estimates
+static const double kAlpha = 0.2;
+
+StreamRateController::StreamRateController(int maxQuality,
+                                           double targetLatency,
+                                           double targetBitrate)
+    : m_maxQuality{maxQuality < 0
+                       ? kDefaultQuality
+                       : std::max(std::min(maxQuality, 100), kMinQuality)},
+      m_targetLatency{targetLatency},
+      m_targetBitrate{targetBitrate},
+      m_quality{m_maxQuality} {}
+
+int StreamRateController::GetWidth(int width) const {
+  return std::max((width * kScales[m_scale] / 8) & ~1, 2);
+}
+
+int StreamRateController::GetHeight(int height) const {
+  return std::max((height * kScales[m_scale] / 8) & ~1, 2);
+}
+
+void StreamRateController::Update(std::size_t bytes, double sendTime,
+                                  std::size_t queued, double now,
+                                  int quality) {
+  // Lowering the quality is pointless if the frames don't follow it (e.g.
+  // camera JPEGs that can't be requantized)
+  m_qualityFixed = quality < 0 || quality > m_quality;
+
+  if (m_lastTime == 0) {
+    m_lastTime = now;
+    m_lastQueued = queued;
+    m_lastChange = now;
+    m_latency = sendTime;
+    return;
+  }
+
+  double dt = now - m_lastTime;
+  if (dt < 1e-6) dt = 1e-6;
+
+  // Bytes that actually left the socket since the last frame
+  double drained = static_cast<double>(m_lastQueued) + bytes - queued;
+  if (drained < 0) drained = 0;
+  double drainRate = drained / dt;
+  double bitrate = bytes * 8.0 / dt;
+  if (m_drainRate == 0) {
+    m_drainRate = drainRate;
+    m_bitrate = bitrate;
+  } else {
+    m_drainRate += kAlpha * (drainRate - m_drainRate);
+    m_bitrate += kAlpha * (bitrate - m_bitrate);
+  }
+  m_lastTime = now;
+  m_lastQueued = queued;
+
+  // Time the last byte of this frame will spend waiting in the kernel, plus
+  // the time we were blocked handing it over.
+  m_latency = sendTime;
+  if (m_drainRate > 0) m_latency += queued / m_drainRate;
+
+  bool over = m_latency > m_targetLatency ||
+              (m_targetBitrate > 0 && m_bitrate > m_targetBitrate * 1.1);
+  bool under = m_latency < m_targetLatency * 0.5 &&
+               (m_targetBitrate <= 0 || m_bitrate < m_targetBitrate * 0.7);
+
+  if (over) {
+    m_underCount = 0;
+    if (++m_overCount >= kDownFrames && (now - m_lastChange) >= kDownHoldoff &&
+        StepDown()) {
+      m_overCount = 0;
+      m_lastChange = now;
+    }
+  } else if (under) {
+    m_overCount = 0;
+    if (++m_underCount >= kUpFrames && (now - m_lastChange) >= kUpHoldoff &&
+        StepUp()) {
+      m_underCount = 0;
+      m_lastChange = now;
+    }
+  } else {
+    m_overCount = 0;
+    m_underCount = 0;
+  }
+}
+
+bool StreamRateController::StepDown() {
+  // Reduce quality first, then resolution
+  if (!m_qualityFixed && m_quality > kMinQuality) {
+    m_quality = std::max(m_quality - kQualityStep, kMinQuality);
+    return true;
+  }
+  if (m_scale < kNumScales - 1) {
+    ++m_scale;
+    return true;
+  }
+  return false;
+}
+
+bool StreamRateController::StepUp() {
+  // Restore resolution first, then quality
+  if (m_scale > 0) {
+    --m_scale;
+    return true;
+  }
+  if (!m_qualityFixed && m_quality < m_maxQuality) {
+    m_quality = std::min(m_quality + kQualityStep, m_maxQuality);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,71 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_STREAMRATECONTROLLER_H_
+#define CS_STREAMRATECONTROLLER_H_
+
+#include <cstddef>
+
+namespace cs {
+
+// Adapts JPEG quality (first) and resolution (second) of a single stream
+// client to keep the estimated end-to-end send latency, and optionally the
+// bitrate, under a target.  Decreases are applied quickly; increases require
+// a sustained period of headroom so the stream doesn't oscillate.  If the
+// frames sent don't follow the requested quality, only the resolution is
+// adapted.
+class StreamRateController {
+ public:
+  // @param maxQuality Initial and highest JPEG quality (negative for the
+  //     default)
+  StreamRateController(int maxQuality, double targetLatency,
+                       double targetBitrate);
+
+  // Record the result of sending a frame.
+  // @param bytes Number of bytes written for the frame (including headers)
+  // @param sendTime Time (in seconds) spent blocked writing the frame
+  // @param queued Bytes still in the socket send queue after the write
+  // @param now Current time (in seconds)
+  // @param quality JPEG quality of the frame (-1 if unknown)
+  void Update(std::size_t bytes, double sendTime, std::size_t queued,
+              double now, int quality);
+
+  int GetQuality() const { return m_quality; }
+  int GetWidth(int width) const;
+  int GetHeight(int height) const;
+
+  double GetLatency() const { return m_latency; }
+  double GetBitrate() const { return m_bitrate; }
+
+ private:
+  bool StepDown();
+  bool StepUp();
+
+  int m_maxQuality;
+  double m_targetLatency;
+  double m_targetBitrate;
+
+  int m_quality;
+  int m_scale{0};  // index into scale table
+  bool m_qualityFixed{false};  // frames don't follow m_quality
+
+  // measurements
+  double m_lastTime{0};
+  std::size_t m_lastQueued{0};
+  double m_drainRate{0};  // bytes/s
+  double m_bitrate{0};    // bits/s
+  double m_latency{0};    // s
+
+  // hysteresis state
+  int m_overCount{0};
+  int m_underCount{0};
+  double m_lastChange{0};
+};
+
+}  // namespace cs
+
+#endif  // CS_STREAMRATECONTROLLER_H_
@@ -0,0 +1,163 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "TestPattern.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "cscore_stamp.h"
+
+using namespace cs;
+
+// The pattern repeats horizontally with this period (in pixels), and
+// scrolls this many pixels per frame.  Both are even so YUYV pixel pairs
+// stay aligned.
+static const int kPeriod = 256;
+static const int kScroll = 4;
+
+// Background pixel: a diagonal gradient, stripes, and hashed noise for
+// texture (so encoders see realistic entropy).  Periodic in x.
+static inline void PatternPixel(int x, int y, int height, unsigned char* bgr) {
+  x %= kPeriod;
+  unsigned int h = (x * 73856093u) ^ (y * 19349663u);
+  h = (h ^ (h >> 13)) * 0x5bd1e995u;
+  int noise = (h >> 24) & 31;
+  int stripe = ((x + y) / 16) & 1 ? 96 : 0;
+  bgr[0] = static_cast<unsigned char>(std::min(255, x + noise));
+  bgr[1] = static_cast<unsigned char>(
+      std::min(255, y * 200 / std::max(height, 1) + noise));
+  bgr[2] = static_cast<unsigned char>(std::min(255, stripe + 2 * noise +
+                                                        ((x * 7) & 63)));
+}
+
+bool TestPattern::SetMode(const VideoMode& mode, int jpegQuality) {
+  if (mode.width <= 0 || mode.height <= 0 || mode.width % 2 != 0) return false;
+  switch (mode.pixelFormat) {
+    case VideoMode::kMJPEG:
+    case VideoMode::kBGR:
+      m_bytesPerPixel = 3;
+      std::memset(m_white, 255, sizeof(m_white));
+      std::memset(m_black, 0, sizeof(m_black));
+      break;
+    case VideoMode::kGray:
+      m_bytesPerPixel = 1;
+      std::memset(m_white, 255, sizeof(m_white));
+      std::memset(m_black, 0, sizeof(m_black));
+      break;
+    case VideoMode::kRGB565:
+      m_bytesPerPixel = 2;
+      std::memset(m_white, 255, sizeof(m_white));
+      std::memset(m_black, 0, sizeof(m_black));
+      break;
+    case VideoMode::kYUYV: {
+      // studio swing luma, neutral chroma
+      m_bytesPerPixel = 2;
+      static const unsigned char white[4] = {235, 128, 235, 128};
+      static const unsigned char black[4] = {16, 128, 16, 128};
+      std::memcpy(m_white, white, 4);
+      std::memcpy(m_black, black, 4);
+      break;
+    }
+    default:
+      return false;
+  }
+  m_mode = mode;
+  m_rowSize = mode.width * m_bytesPerPixel;
+  m_stripWidth = mode.width + kPeriod;
+  m_blockSize = CS_GetStampBlockSize(mode.width, mode.height);
+
+  // Prerender the strip in the target format
+  m_strip.resize(static_cast<std::size_t>(m_stripWidth) * m_bytesPerPixel *
+                 mode.height);
+  unsigned char* dst = reinterpret_cast<unsigned char*>(m_strip.data());
+  for (int y = 0; y < mode.height; ++y) {
+    for (int x = 0; x < m_stripWidth; x += 2) {
+      unsigned char p[6];
+      PatternPixel(x, y, mode.height, p);
+      PatternPixel(x + 1, y, mode.height, p + 3);
+      switch (mode.pixelFormat) {
+        case VideoMode::kGray:
+          // BT.601 luma, full swing
+          *dst++ = (29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8;
+          *dst++ = (29 * p[3] + 150 * p[4] + 77 * p[5] + 128) >> 8;
+          break;
+        case VideoMode::kRGB565:
+          for (int i = 0; i < 6; i += 3) {
+            unsigned int v = ((p[i + 2] >> 3) << 11) | ((p[i + 1] >> 2) << 5) |
+                             (p[i] >> 3);
+            *dst++ = v & 0xff;
+            *dst++ = v >> 8;
+          }
+          break;
+        case VideoMode::kYUYV: {
+          // Same conversion as Frame::ConvertBGRToYUYV
+          int b = p[0] + p[3], g = p[1] + p[4], r = p[2] + p[5];
+          *dst++ = ((66 * p[2] + 129 * p[1] + 25 * p[0] + 128) >> 8) + 16;
+          *dst++ = ((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128;
+          *dst++ = ((66 * p[5] + 129 * p[4] + 25 * p[3] + 128) >> 8) + 16;
+          *dst++ = ((112 * r - 94 * g - 18 * b + 256) >> 9) + 128;
+          break;
+        }
+        default:
+          std::memcpy(dst, p, 6);
+          dst += 6;
+          break;
+      }
+    }
+  }
+
+  // Encode the JPEG cycle
+  m_jpegFrames.reset();
+  if (mode.pixelFormat == VideoMode::kMJPEG) {
+    auto frames = std::make_shared<std::vector<std::string>>();
+    frames->reserve(kJpegCycle);
+    std::vector<char> image(GetImageSize());
+    cv::Mat bgr(mode.height, mode.width, CV_8UC3, image.data());
+    std::vector<uchar> buf;
+    std::vector<int> params;
+    params.push_back(CV_IMWRITE_JPEG_QUALITY);
+    params.push_back(jpegQuality);
+    for (int i = 0; i < kJpegCycle; ++i) {
+      Render(i, 0, image.data());
+      cv::imencode(".jpg", bgr, buf, params);
+      frames->emplace_back(buf.begin(), buf.end());
+    }
+    m_jpegFrames = std::move(frames);
+  }
+  return true;
+}
+
+void TestPattern::Render(uint32_t count, uint64_t time, char* dst) const {
+  std::size_t stripRowSize =
+      static_cast<std::size_t>(m_stripWidth) * m_bytesPerPixel;
+  const char* src =
+      m_strip.data() + (count * kScroll % kPeriod) * m_bytesPerPixel;
+  for (int y = 0; y < m_mode.height; ++y)
+    std::memcpy(dst + y * m_rowSize, src + y * stripRowSize, m_rowSize);
+  Stamp(count, static_cast<uint32_t>(time / 10), dst);
+}
+
+void TestPattern::Stamp(uint32_t count, uint32_t time, char* dst) const {
+  if (m_blockSize == 0) return;
+  // the fill patterns cover two pixels
+  std::size_t pairSize = 2 * m_bytesPerPixel;
+  for (int row = 0; row < 2; ++row) {
+    uint32_t value = row == 0 ? count : time;
+    for (int y = row * m_blockSize; y < (row + 1) * m_blockSize; ++y) {
+      char* p = dst + y * m_rowSize;
+      for (int bit = CS_STAMP_BITS - 1; bit >= 0; --bit) {
+        const unsigned char* fill = (value >> bit) & 1 ? m_white : m_black;
+        for (int x = 0; x < m_blockSize; x += 2, p += pairSize)
+          std::memcpy(p, fill, pairSize);
+      }
+    }
+  }
+}
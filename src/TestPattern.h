@@ -0,0 +1,68 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_TESTPATTERN_H_
+#define CS_TESTPATTERN_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cscore_cpp.h"
+
+namespace cs {
+
+// Generates a scrolling, textured test pattern in any pixel format.
+//
+// Each frame is stamped with the frame count and time (see cscore_stamp.h
+// for the layout and a decoder).
+//
+// All the expensive work happens in SetMode(); raw frames are then just a
+// copy out of a prerendered strip.  MJPEG frames are encoded up front as a
+// cycle of kJpegCycle frames, so their count wraps and their time is zero.
+class TestPattern {
+ public:
+  static const int kJpegCycle = 64;
+
+  // Prepare to generate frames in the given mode.
+  // @return False if the pixel format or size is not supported
+  bool SetMode(const VideoMode& mode, int jpegQuality = 80);
+
+  const VideoMode& GetMode() const { return m_mode; }
+
+  // Size of a raw frame in bytes.
+  std::size_t GetImageSize() const {
+    return static_cast<std::size_t>(m_rowSize) * m_mode.height;
+  }
+
+  // Render a raw (non-MJPEG) frame into dst (GetImageSize() bytes).
+  void Render(uint32_t count, uint64_t time, char* dst) const;
+
+  // The encoded frames (MJPEG only); frame count uses [count % size()].
+  std::shared_ptr<const std::vector<std::string>> GetJpegFrames() const {
+    return m_jpegFrames;
+  }
+
+ private:
+  void Stamp(uint32_t count, uint32_t time, char* dst) const;
+
+  VideoMode m_mode;
+  int m_bytesPerPixel{0};
+  int m_rowSize{0};     // bytes per frame row
+  int m_stripWidth{0};  // pixels per prerendered row
+  int m_blockSize{0};   // 0 if too small to stamp
+  unsigned char m_white[6];
+  unsigned char m_black[6];
+  std::vector<char> m_strip;
+  std::shared_ptr<const std::vector<std::string>> m_jpegFrames;
+};
+
+}  // namespace cs
+
+#endif  // CS_TESTPATTERN_H_
@@ -0,0 +1,241 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "TestPatternSourceImpl.h"
+
+#include <chrono>
+
+#include "llvm/STLExtras.h"
+#include "llvm/SmallString.h"
+#include "llvm/raw_ostream.h"
+#include "support/timestamp.h"
+
+#include "c_util.h"
+#include "Handle.h"
+#include "Log.h"
+#include "Notifier.h"
+#include "TestPattern.h"
+
+using namespace cs;
+
+static bool IsValidMode(const VideoMode& mode) {
+  switch (mode.pixelFormat) {
+    case VideoMode::kMJPEG:
+    case VideoMode::kYUYV:
+    case VideoMode::kRGB565:
+    case VideoMode::kBGR:
+    case VideoMode::kGray:
+      break;
+    default:
+      return false;
+  }
+  // YUYV pixels come in pairs, so keep all widths even
+  return mode.width > 0 && mode.width % 2 == 0 && mode.height > 0 &&
+         mode.fps > 0;
+}
+
+TestPatternSourceImpl::TestPatternSourceImpl(llvm::StringRef name,
+                                             const VideoMode& mode)
+    : SourceImpl{name} {
+  SetDescription("Test pattern");
+  m_mode = mode;
+  if (!IsValidMode(m_mode)) {
+    SWARNING("unsupported video mode, using 640x480 BGR at 30 fps");
+    m_mode = VideoMode{VideoMode::kBGR, 640, 480, 30};
+  }
+  m_videoModes.push_back(m_mode);
+}
+
+TestPatternSourceImpl::~TestPatternSourceImpl() {
+  m_active = false;
+
+  // force wakeup of thread in case it's waiting on cv
+  m_sinkEnabledCond.notify_one();
+
+  // join thread
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void TestPatternSourceImpl::Start() {
+  m_thread = std::thread(&TestPatternSourceImpl::ThreadMain, this);
+}
+
+std::unique_ptr<PropertyImpl> TestPatternSourceImpl::CreateEmptyProperty(
+    llvm::StringRef name) const {
+  return llvm::make_unique<PropertyImpl>(name);
+}
+
+bool TestPatternSourceImpl::CacheProperties(CS_Status* status) const {
+  // Doesn't need to do anything.
+  m_properties_cached = true;
+  return true;
+}
+
+// There's no camera, so no properties; only the video mode can be set.
+
+void TestPatternSourceImpl::SetProperty(int property, int value,
+                                        CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void TestPatternSourceImpl::SetStringProperty(int property,
+                                              llvm::StringRef value,
+                                              CS_Status* status) {
+  *status = CS_INVALID_PROPERTY;
+}
+
+void TestPatternSourceImpl::SetBrightness(int brightness, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+int TestPatternSourceImpl::GetBrightness(CS_Status* status) const {
+  *status = CS_INVALID_HANDLE;
+  return 0;
+}
+
+void TestPatternSourceImpl::SetWhiteBalanceAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void TestPatternSourceImpl::SetWhiteBalanceHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void TestPatternSourceImpl::SetWhiteBalanceManual(int value,
+                                                  CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void TestPatternSourceImpl::SetExposureAuto(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void TestPatternSourceImpl::SetExposureHoldCurrent(CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+void TestPatternSourceImpl::SetExposureManual(int value, CS_Status* status) {
+  *status = CS_INVALID_HANDLE;
+}
+
+bool TestPatternSourceImpl::SetVideoMode(const VideoMode& mode,
+                                         CS_Status* status) {
+  if (!IsValidMode(mode)) return false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = mode;
+    m_videoModes.assign(1, mode);
+    m_modeChanged = true;
+  }
+  m_sinkEnabledCond.notify_one();
+  auto& notifier = Notifier::GetInstance();
+  notifier.NotifySource(*this, CS_SOURCE_VIDEOMODES_UPDATED);
+  notifier.NotifySourceVideoMode(*this, mode);
+  return true;
+}
+
+void TestPatternSourceImpl::NumSinksChanged() {
+  // ignore
+}
+
+void TestPatternSourceImpl::NumSinksEnabledChanged() {
+  m_sinkEnabledCond.notify_one();
+}
+
+void TestPatternSourceImpl::ThreadMain() {
+  TestPattern pattern;
+  uint32_t count = 0;
+  uint64_t nextTime = 0;  // when the next frame is due
+  SetConnected(true);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_active) {
+    // sleep here until at least one sink is enabled
+    if (m_numSinksEnabled == 0) {
+      m_sinkEnabledCond.wait(
+          lock, [=] { return !m_active || m_numSinksEnabled != 0; });
+      if (!m_active) break;
+      nextTime = 0;
+    }
+
+    // rendering the pattern is the slow part of a mode change; do it outside
+    // the lock
+    if (m_modeChanged) {
+      m_modeChanged = false;
+      VideoMode mode = m_mode;
+      lock.unlock();
+      if (!pattern.SetMode(mode)) SERROR("could not create test pattern");
+      lock.lock();
+      nextTime = 0;
+      continue;
+    }
+    const VideoMode& mode = pattern.GetMode();
+    if (mode.pixelFormat == VideoMode::kUnknown) {
+      m_sinkEnabledCond.wait(lock);
+      continue;
+    }
+
+    // pace frames from a fixed schedule, rather than sleeping for a period
+    // after each one, so the rate doesn't drift; skip ahead if we fell
+    // behind by more than a frame
+    uint64_t period = 10000000 / mode.fps;
+    uint64_t now = wpi::Now();
+    if (nextTime == 0 || now > nextTime + period) nextTime = now;
+    if (now < nextTime) {
+      m_sinkEnabledCond.wait_for(
+          lock, std::chrono::microseconds((nextTime - now) / 10));
+      continue;
+    }
+    nextTime += period;
+    lock.unlock();
+
+    auto pixelFormat = static_cast<VideoMode::PixelFormat>(mode.pixelFormat);
+    if (pixelFormat == VideoMode::kMJPEG) {
+      // Alias the pre-encoded frame; the frame set is kept alive by the
+      // image even if the mode changes
+      auto frames = pattern.GetJpegFrames();
+      const std::string& jpeg = (*frames)[count % frames->size()];
+      std::unique_ptr<Image> image{new Image{jpeg, [frames]() {}}};
+      image->pixelFormat = pixelFormat;
+      image->width = mode.width;
+      image->height = mode.height;
+      PutFrame(std::move(image), now);
+    } else {
+      auto image = AllocImage(pixelFormat, mode.width, mode.height,
+                              pattern.GetImageSize());
+      pattern.Render(count, now, image->data());
+      PutFrame(std::move(image), now);
+    }
+    ++count;
+
+    lock.lock();
+  }
+}
+
+namespace cs {
+
+CS_Source CreateTestPatternSource(llvm::StringRef name, const VideoMode& mode,
+                                  CS_Status* status) {
+  auto source = std::make_shared<TestPatternSourceImpl>(name, mode);
+  auto handle = Sources::GetInstance().Allocate(CS_SOURCE_TEST_PATTERN, source);
+  Notifier::GetInstance().NotifySource(name, handle, CS_SOURCE_CREATED);
+  source->Start();
+  return handle;
+}
+
+}  // namespace cs
+
+extern "C" {
+
+CS_Source CS_CreateTestPatternSource(const char* name,
+                                     const CS_VideoMode* mode,
+                                     CS_Status* status) {
+  return cs::CreateTestPatternSource(
+      name, static_cast<const cs::VideoMode&>(*mode), status);
+}
+
+}  // extern "C"
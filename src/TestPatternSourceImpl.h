@@ -0,0 +1,69 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_TESTPATTERNSOURCEIMPL_H_
+#define CS_TESTPATTERNSOURCEIMPL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+#include "SourceImpl.h"
+
+namespace cs {
+
+// Generates a moving test pattern (see TestPattern.h) at any resolution,
+// pixel format and frame rate, for testing without a camera.  Frames are
+// stamped with their count and time.
+class TestPatternSourceImpl : public SourceImpl {
+ public:
+  TestPatternSourceImpl(llvm::StringRef name, const VideoMode& mode);
+  ~TestPatternSourceImpl() override;
+
+  void Start();
+
+  // Property functions
+  void SetProperty(int property, int value, CS_Status* status) override;
+  void SetStringProperty(int property, llvm::StringRef value,
+                         CS_Status* status) override;
+
+  // Standard common camera properties
+  void SetBrightness(int brightness, CS_Status* status) override;
+  int GetBrightness(CS_Status* status) const override;
+  void SetWhiteBalanceAuto(CS_Status* status) override;
+  void SetWhiteBalanceHoldCurrent(CS_Status* status) override;
+  void SetWhiteBalanceManual(int value, CS_Status* status) override;
+  void SetExposureAuto(CS_Status* status) override;
+  void SetExposureHoldCurrent(CS_Status* status) override;
+  void SetExposureManual(int value, CS_Status* status) override;
+
+  bool SetVideoMode(const VideoMode& mode, CS_Status* status) override;
+
+  void NumSinksChanged() override;
+  void NumSinksEnabledChanged() override;
+
+ protected:
+  std::unique_ptr<PropertyImpl> CreateEmptyProperty(
+      llvm::StringRef name) const override;
+
+  bool CacheProperties(CS_Status* status) const override;
+
+ private:
+  void ThreadMain();
+
+  std::atomic_bool m_active{true};  // set to false to terminate thread
+  std::thread m_thread;
+
+  // Protected by m_mutex
+  std::condition_variable m_sinkEnabledCond;  // also signaled on mode change
+  bool m_modeChanged{true};
+};
+
+}  // namespace cs
+
+#endif  // CS_TESTPATTERNSOURCEIMPL_H_
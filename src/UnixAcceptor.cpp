@@ -0,0 +1,247 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "UnixAcceptor.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#endif
+
+#include "Log.h"
+
+using namespace cs;
+
+#ifdef _WIN32
+
+UnixStream::~UnixStream() {}
+
+std::size_t UnixStream::send(const char*, std::size_t, Error* err) {
+  *err = kConnectionClosed;
+  return 0;
+}
+
+std::size_t UnixStream::receive(char*, std::size_t, Error* err, int) {
+  *err = kConnectionClosed;
+  return 0;
+}
+
+void UnixStream::close() {}
+
+bool UnixStream::setBlocking(bool) { return false; }
+
+UnixAcceptor::~UnixAcceptor() {}
+
+int UnixAcceptor::start() {
+  ERROR("Unix domain sockets are not supported on this platform");
+  return -1;
+}
+
+void UnixAcceptor::shutdown() {}
+
+std::unique_ptr<wpi::NetworkStream> UnixAcceptor::accept() { return nullptr; }
+
+#else
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// Fill in the address for a path.
+// @return Address length, or 0 if the path is invalid
+static socklen_t MakeAddress(llvm::StringRef path, struct sockaddr_un* addr) {
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) return 0;
+  std::memcpy(addr->sun_path, path.data(), path.size());
+  // abstract namespace names start with a NUL instead of '@' and aren't
+  // NUL terminated, so the length must be exact
+  if (path[0] == '@') {
+    addr->sun_path[0] = '\0';
+    return offsetof(struct sockaddr_un, sun_path) + path.size();
+  }
+  return sizeof(*addr);
+}
+
+UnixStream::~UnixStream() { close(); }
+
+std::size_t UnixStream::send(const char* buffer, std::size_t len,
+                             Error* err) {
+  if (m_sd < 0) {
+    *err = kConnectionClosed;
+    return 0;
+  }
+  std::size_t pos = 0;
+  while (pos < len) {
+    ssize_t rv = ::send(m_sd, buffer + pos, len - pos, kSendFlags);
+    if (rv < 0) {
+      if (errno == EINTR) continue;
+      if (!m_blocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        *err = kWouldBlock;
+        return pos;
+      }
+      *err = kConnectionReset;
+      return 0;
+    }
+    pos += rv;
+  }
+  return len;
+}
+
+std::size_t UnixStream::receive(char* buffer, std::size_t len, Error* err,
+                                int timeout) {
+  if (m_sd < 0) {
+    *err = kConnectionClosed;
+    return 0;
+  }
+  if (timeout > 0) {
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(m_sd, &readfds);
+    struct timeval tv;
+    tv.tv_sec = timeout;
+    tv.tv_usec = 0;
+    if (::select(m_sd + 1, &readfds, nullptr, nullptr, &tv) <= 0) {
+      *err = kConnectionTimedOut;
+      return 0;
+    }
+  }
+  for (;;) {
+    ssize_t rv = ::recv(m_sd, buffer, len, 0);
+    if (rv > 0) return rv;
+    if (rv == 0) {
+      *err = kConnectionClosed;
+      return 0;
+    }
+    if (errno == EINTR) continue;
+    if (!m_blocking && (errno == EAGAIN || errno == EWOULDBLOCK))
+      *err = kWouldBlock;
+    else
+      *err = kConnectionReset;
+    return 0;
+  }
+}
+
+void UnixStream::close() {
+  if (m_sd >= 0) {
+    ::shutdown(m_sd, SHUT_RDWR);
+    ::close(m_sd);
+  }
+  m_sd = -1;
+}
+
+bool UnixStream::setBlocking(bool enabled) {
+  if (m_sd < 0) return false;
+  int flags = ::fcntl(m_sd, F_GETFL, 0);
+  if (flags < 0) return false;
+  flags = enabled ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+  if (::fcntl(m_sd, F_SETFL, flags) < 0) return false;
+  m_blocking = enabled;
+  return true;
+}
+
+UnixAcceptor::~UnixAcceptor() {
+  if (m_lsd >= 0) {
+    shutdown();
+    ::close(m_lsd);
+  }
+}
+
+int UnixAcceptor::start() {
+  if (m_listening) return 0;
+
+  struct sockaddr_un address;
+  socklen_t addrlen = MakeAddress(m_path, &address);
+  if (addrlen == 0) {
+    ERROR("invalid Unix socket path '" << m_path << "'");
+    return -1;
+  }
+
+  m_lsd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_lsd < 0) {
+    ERROR("could not create socket");
+    return -1;
+  }
+  ::fcntl(m_lsd, F_SETFD, FD_CLOEXEC);
+
+  // Remove a socket left behind by a previous server.  Anything else at the
+  // path is left alone (and bind will fail).
+  if (m_path[0] != '@') {
+    struct stat st;
+    if (::lstat(m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+      ::unlink(m_path.c_str());
+  }
+
+  if (::bind(m_lsd, reinterpret_cast<struct sockaddr*>(&address), addrlen) !=
+      0) {
+    ERROR("bind() to " << m_path << " failed: " << std::strerror(errno));
+    ::close(m_lsd);
+    m_lsd = -1;
+    return errno;
+  }
+
+  if (::listen(m_lsd, 5) != 0) {
+    ERROR("listen() on " << m_path << " failed: " << std::strerror(errno));
+    ::close(m_lsd);
+    m_lsd = -1;
+    return errno;
+  }
+  m_listening = true;
+  INFO("listening on Unix socket " << m_path);
+  return 0;
+}
+
+void UnixAcceptor::shutdown() {
+  m_shutdown = true;
+  if (m_lsd < 0) return;
+
+  // Shutdown wakes up a thread blocked in accept() on Linux; elsewhere,
+  // connect to ourselves to do the same.
+  if (::shutdown(m_lsd, SHUT_RDWR) != 0 && m_listening) {
+    struct sockaddr_un address;
+    socklen_t addrlen = MakeAddress(m_path, &address);
+    int sd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd >= 0) {
+      ::connect(sd, reinterpret_cast<struct sockaddr*>(&address), addrlen);
+      ::close(sd);
+    }
+  }
+
+  if (m_listening && m_path[0] != '@') ::unlink(m_path.c_str());
+  m_listening = false;
+}
+
+std::unique_ptr<wpi::NetworkStream> UnixAcceptor::accept() {
+  if (!m_listening || m_shutdown) return nullptr;
+
+  int sd;
+  do {
+    sd = ::accept(m_lsd, nullptr, nullptr);
+  } while (sd < 0 && errno == EINTR && !m_shutdown);
+  if (sd < 0) {
+    if (!m_shutdown) ERROR("accept() on " << m_path << " failed");
+    return nullptr;
+  }
+  if (m_shutdown) {
+    ::close(sd);
+    return nullptr;
+  }
+  ::fcntl(sd, F_SETFD, FD_CLOEXEC);
+  return std::unique_ptr<wpi::NetworkStream>(new UnixStream(sd, m_path));
+}
+
+#endif  // _WIN32
@@ -0,0 +1,71 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_UNIXACCEPTOR_H_
+#define CS_UNIXACCEPTOR_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "llvm/StringRef.h"
+#include "tcpsockets/NetworkAcceptor.h"
+#include "tcpsockets/NetworkStream.h"
+
+namespace cs {
+
+// A connection accepted by UnixAcceptor.
+class UnixStream : public wpi::NetworkStream {
+ public:
+  UnixStream(int sd, llvm::StringRef path) : m_sd{sd}, m_path(path) {}
+  ~UnixStream() override;
+
+  std::size_t send(const char* buffer, std::size_t len, Error* err) override;
+  std::size_t receive(char* buffer, std::size_t len, Error* err,
+                      int timeout = 0) override;
+  void close() override;
+
+  // Unix sockets have no peer address; the listening path is used instead
+  llvm::StringRef getPeerIP() const override { return m_path; }
+  int getPeerPort() const override { return 0; }
+  void setNoDelay() override {}
+  bool setBlocking(bool enabled) override;
+  int getNativeHandle() const override { return m_sd; }
+
+  UnixStream(const UnixStream&) = delete;
+  UnixStream& operator=(const UnixStream&) = delete;
+
+ private:
+  int m_sd;
+  std::string m_path;
+  bool m_blocking{true};
+};
+
+// Accepts connections on a Unix domain (AF_UNIX) stream socket.  Paths
+// starting with '@' are in the Linux abstract namespace and don't exist in
+// the filesystem; other paths are created on start() (replacing any stale
+// socket left by a previous process) and removed on shutdown().
+// Not supported on Windows; start() always fails.
+class UnixAcceptor : public wpi::NetworkAcceptor {
+ public:
+  explicit UnixAcceptor(llvm::StringRef path) : m_path(path) {}
+  ~UnixAcceptor() override;
+
+  int start() override;
+  void shutdown() override;
+  std::unique_ptr<wpi::NetworkStream> accept() override;
+
+ private:
+  int m_lsd{-1};
+  std::string m_path;
+  bool m_listening{false};
+  std::atomic_bool m_shutdown{false};
+};
+
+}  // namespace cs
+
+#endif  // CS_UNIXACCEPTOR_H_
@@ -0,0 +1,200 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "WebSocketUtil.h"
+
+#include "support/Base64.h"
+
+using namespace cs;
+
+// Largest (reassembled) message accepted from a client.  Clients only send
+// small acknowledgements, so anything bigger is an error.
+static const uint64_t kMaxMessageSize = 65536;
+
+// GUID appended to the key by the handshake (RFC 6455 section 1.3)
+static const char* kHandshakeGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static inline uint32_t Rotl(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+// Compute the 20-byte SHA-1 digest of data.  Only used for the handshake, so
+// this is a simple implementation rather than a fast one.
+static void Sha1(llvm::StringRef data, unsigned char digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+
+  // pad to a multiple of 64 bytes with 0x80, zeros, and the bit length
+  std::string msg = data;
+  uint64_t bitLen = static_cast<uint64_t>(data.size()) * 8;
+  msg += static_cast<char>(0x80);
+  while (msg.size() % 64 != 56) msg += '\0';
+  for (int i = 7; i >= 0; --i) msg += static_cast<char>(bitLen >> (i * 8));
+
+  for (std::size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+    auto p = reinterpret_cast<const unsigned char*>(msg.data() + chunk);
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+      w[i] = (static_cast<uint32_t>(p[i * 4]) << 24) |
+             (static_cast<uint32_t>(p[i * 4 + 1]) << 16) |
+             (static_cast<uint32_t>(p[i * 4 + 2]) << 8) |
+             static_cast<uint32_t>(p[i * 4 + 3]);
+    for (int i = 16; i < 80; ++i)
+      w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = Rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = Rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 20; ++i) digest[i] = h[i / 4] >> ((3 - i % 4) * 8);
+}
+
+std::string cs::WebSocketAcceptKey(llvm::StringRef key) {
+  std::string str = key.trim();
+  str += kHandshakeGuid;
+  unsigned char digest[20];
+  Sha1(str, digest);
+  std::string accept;
+  wpi::Base64Encode(
+      llvm::StringRef(reinterpret_cast<const char*>(digest), sizeof(digest)),
+      &accept);
+  return accept;
+}
+
+void cs::WebSocketWriteHeader(llvm::raw_ostream& os, int opcode, uint64_t len,
+                              bool fin) {
+  char header[10];
+  std::size_t headerLen = 2;
+  header[0] = static_cast<char>((fin ? 0x80 : 0x00) | (opcode & 0x0f));
+  if (len < 126) {
+    header[1] = static_cast<char>(len);
+  } else if (len <= 0xffff) {
+    header[1] = 126;
+    header[2] = static_cast<char>(len >> 8);
+    header[3] = static_cast<char>(len);
+    headerLen = 4;
+  } else {
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i)
+      header[2 + i] = static_cast<char>(len >> ((7 - i) * 8));
+    headerLen = 10;
+  }
+  os << llvm::StringRef(header, headerLen);
+}
+
+void cs::WebSocketWriteFrame(llvm::raw_ostream& os, int opcode,
+                             llvm::StringRef payload) {
+  WebSocketWriteHeader(os, opcode, payload.size());
+  os << payload;
+}
+
+bool WebSocketParser::SetError(llvm::StringRef error) {
+  m_error = error;
+  return false;
+}
+
+bool WebSocketParser::Execute(llvm::StringRef data,
+                              const MessageCallback& onMessage) {
+  if (!m_error.empty()) return false;
+  m_buf.append(data.data(), data.size());
+
+  std::size_t pos = 0;
+  for (;;) {
+    auto p = reinterpret_cast<const unsigned char*>(m_buf.data() + pos);
+    std::size_t avail = m_buf.size() - pos;
+    if (avail < 2) break;
+
+    bool fin = (p[0] & 0x80) != 0;
+    int opcode = p[0] & 0x0f;
+    bool control = (opcode & 0x08) != 0;
+    uint64_t len = p[1] & 0x7f;
+    std::size_t headerLen = 2;
+    if ((p[0] & 0x70) != 0) return SetError("reserved bits set");
+    if ((p[1] & 0x80) == 0) return SetError("client frame not masked");
+    if (len == 126) {
+      if (avail < 4) break;
+      len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+      headerLen = 4;
+    } else if (len == 127) {
+      if (avail < 10) break;
+      len = 0;
+      for (int i = 0; i < 8; ++i) len = (len << 8) | p[2 + i];
+      headerLen = 10;
+    }
+
+    switch (opcode) {
+      case kWsContinuation:
+        if (m_opcode < 0) return SetError("unexpected continuation frame");
+        break;
+      case kWsText:
+      case kWsBinary:
+        if (m_opcode >= 0) return SetError("expected continuation frame");
+        break;
+      case kWsClose:
+      case kWsPing:
+      case kWsPong:
+        if (!fin || len > 125) return SetError("invalid control frame");
+        break;
+      default:
+        return SetError("unknown opcode");
+    }
+    if (!control &&
+        (len > kMaxMessageSize || m_message.size() + len > kMaxMessageSize))
+      return SetError("message too large");
+
+    // wait for the whole frame (mask key and payload)
+    if (avail < headerLen + 4 + len) break;
+    const unsigned char* mask = p + headerLen;
+    char* payload = &m_buf[pos + headerLen + 4];
+    for (std::size_t i = 0; i < len; ++i) payload[i] ^= mask[i & 3];
+    pos += headerLen + 4 + len;
+
+    llvm::StringRef str(payload, len);
+    if (control) {
+      onMessage(opcode, str);
+    } else if (fin && m_opcode < 0) {
+      onMessage(opcode, str);
+    } else {
+      if (m_opcode < 0) m_opcode = opcode;
+      m_message.append(str.data(), str.size());
+      if (fin) {
+        onMessage(m_opcode, m_message);
+        m_message.clear();
+        m_opcode = -1;
+      }
+    }
+  }
+
+  m_buf.erase(0, pos);
+  return true;
+}
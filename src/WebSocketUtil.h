@@ -0,0 +1,70 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#ifndef CS_WEBSOCKETUTIL_H_
+#define CS_WEBSOCKETUTIL_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include "llvm/raw_ostream.h"
+#include "llvm/StringRef.h"
+
+namespace cs {
+
+// WebSocket (RFC 6455) frame opcodes
+enum WebSocketOpcode {
+  kWsContinuation = 0x0,
+  kWsText = 0x1,
+  kWsBinary = 0x2,
+  kWsClose = 0x8,
+  kWsPing = 0x9,
+  kWsPong = 0xA
+};
+
+// Compute the Sec-WebSocket-Accept handshake response for a client's
+// Sec-WebSocket-Key.
+std::string WebSocketAcceptKey(llvm::StringRef key);
+
+// Write the header of an unmasked (server to client) frame.  The payload of
+// the given length must be written immediately afterwards.
+void WebSocketWriteHeader(llvm::raw_ostream& os, int opcode, uint64_t len,
+                          bool fin = true);
+
+// Write a complete unmasked frame.
+void WebSocketWriteFrame(llvm::raw_ostream& os, int opcode,
+                         llvm::StringRef payload);
+
+// Incremental parser for (masked) client to server frames.  Fragmented
+// messages are reassembled; control frames are passed through as received.
+class WebSocketParser {
+ public:
+  // Called for each complete message.  The payload is only valid for the
+  // duration of the call.
+  typedef std::function<void(int opcode, llvm::StringRef payload)>
+      MessageCallback;
+
+  // Parse data.
+  // @return False if a protocol error occurred (see GetError())
+  bool Execute(llvm::StringRef data, const MessageCallback& onMessage);
+
+  llvm::StringRef GetError() const { return m_error; }
+
+ private:
+  bool SetError(llvm::StringRef error);
+
+  std::string m_buf;      // received but unparsed data
+  std::string m_message;  // fragments of the current message
+  int m_opcode{-1};       // opcode of fragmented message; -1 if none
+  std::string m_error;
+};
+
+}  // namespace cs
+
+#endif  // CS_WEBSOCKETUTIL_H_
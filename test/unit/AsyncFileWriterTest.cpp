@@ -0,0 +1,118 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#ifndef _WIN32
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AsyncFileWriter.h"
+
+namespace cs {
+
+// Chunks written in a scattered order; more than fit in the io_uring
+// submission queue at once
+static const int kChunks = 150;
+static const std::size_t kChunkSize = 1000;
+
+class AsyncFileWriterTest : public ::testing::Test {
+ protected:
+  AsyncFileWriterTest() {
+    char name[] = "/tmp/AsyncFileWriterTestXXXXXX";
+    fd = ::mkstemp(name);
+    path = name;
+    data = std::make_shared<std::string>();
+    for (std::size_t i = 0; i < kChunks * kChunkSize; ++i)
+      *data += static_cast<char>(i * 7 + i / 251);
+  }
+
+  ~AsyncFileWriterTest() override { ::unlink(path.c_str()); }
+
+  // Write the data in pieces, out of order, to a file with preallocated
+  // space, then check the contents and that the file was truncated.
+  void WriteAndCheck(AsyncFileWriter& writer) {
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(0, ::ftruncate(fd, 2 * data->size()));
+    llvm::StringRef all = *data;
+    for (int i = 0; i < kChunks; ++i) {
+      std::size_t chunk = (i * 37) % kChunks;
+      llvm::StringRef bytes = all.substr(chunk * kChunkSize, kChunkSize);
+      // 1 to 3 pieces
+      std::vector<llvm::StringRef> pieces;
+      std::size_t split = kChunkSize / (i % 3 + 1);
+      for (std::size_t pos = 0; pos < kChunkSize; pos += split)
+        pieces.push_back(bytes.substr(pos, split));
+      ASSERT_TRUE(
+          writer.Write(fd, chunk * kChunkSize, std::move(pieces), data));
+      if (i == kChunks / 2) writer.Sync(fd);
+    }
+    writer.Finish(fd, data->size());
+    writer.Stop();
+
+    // The data is released once written
+    EXPECT_EQ(1, data.use_count());
+
+    struct stat st;
+    ASSERT_EQ(0, ::stat(path.c_str(), &st));
+    EXPECT_EQ(static_cast<off_t>(data->size()), st.st_size);
+    std::ifstream file{path, std::ios::binary};
+    std::string contents{std::istreambuf_iterator<char>(file),
+                         std::istreambuf_iterator<char>()};
+    EXPECT_TRUE(contents == *data);
+  }
+
+  std::string path;
+  int fd;
+  std::shared_ptr<std::string> data;
+};
+
+TEST_F(AsyncFileWriterTest, Default) {
+  // io_uring if the kernel allows it, otherwise the writer thread
+  AsyncFileWriter writer;
+  ASSERT_TRUE(writer.Start());
+  SCOPED_TRACE(writer.GetBackendName());
+  WriteAndCheck(writer);
+}
+
+TEST_F(AsyncFileWriterTest, Thread) {
+  AsyncFileWriter writer;
+  ASSERT_TRUE(writer.Start(false));
+  EXPECT_STREQ("thread", writer.GetBackendName());
+  WriteAndCheck(writer);
+}
+
+TEST_F(AsyncFileWriterTest, Refused) {
+  AsyncFileWriter writer;
+  std::vector<llvm::StringRef> pieces{"data"};
+  EXPECT_FALSE(writer.Write(fd, 0, pieces, nullptr));  // not started
+  ASSERT_TRUE(writer.Start());
+  EXPECT_FALSE(writer.Write(fd, 0, std::vector<llvm::StringRef>{}, nullptr));
+  EXPECT_FALSE(writer.Write(
+      fd, 0, std::vector<llvm::StringRef>(65, llvm::StringRef{"x"}), nullptr));
+  writer.Stop();
+  EXPECT_FALSE(writer.Write(fd, 0, pieces, nullptr));
+
+  // Once stopped, files are finished immediately
+  ASSERT_EQ(0, ::ftruncate(fd, 100));
+  writer.Finish(fd, 10);
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path.c_str(), &st));
+  EXPECT_EQ(10, st.st_size);
+}
+
+}  // namespace cs
+
+#endif  // _WIN32
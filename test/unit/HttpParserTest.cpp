@@ -0,0 +1,192 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "HttpParser.h"
+
+namespace cs {
+
+static const char kRequest[] =
+    "GET /stream.mjpg?fps=10 HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Content-Length: 12\r\n"
+    "X-Folded: first\r\n"
+    "  second\r\n"
+    "\r\n";
+
+TEST(HttpParserTest, Request) {
+  HttpParser parser{HttpParser::kRequest};
+  std::string data = kRequest;
+  EXPECT_EQ(data.size(), parser.Execute(data));
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_FALSE(parser.HasError());
+  EXPECT_EQ("GET", parser.GetMethod());
+  EXPECT_EQ("/stream.mjpg?fps=10", parser.GetUrl());
+  EXPECT_EQ(1, parser.GetMajor());
+  EXPECT_EQ(1, parser.GetMinor());
+  EXPECT_EQ("localhost", parser.GetHeader("host"));
+  EXPECT_EQ("first second", parser.GetHeader("X-Folded"));
+  EXPECT_EQ("", parser.GetHeader("Missing"));
+  EXPECT_EQ(12, parser.GetContentLength());
+  EXPECT_TRUE(parser.ShouldKeepAlive());
+}
+
+TEST(HttpParserTest, SplitFeeds) {
+  // Every split point, and one byte at a time
+  std::string data = kRequest;
+  for (std::size_t split = 1; split < data.size(); ++split) {
+    HttpParser parser{HttpParser::kRequest};
+    EXPECT_EQ(split, parser.Execute(data.substr(0, split)));
+    EXPECT_FALSE(parser.IsComplete());
+    EXPECT_EQ(data.size() - split, parser.Execute(data.substr(split)));
+    ASSERT_TRUE(parser.IsComplete()) << "split at " << split;
+    EXPECT_EQ("/stream.mjpg?fps=10", parser.GetUrl());
+    EXPECT_EQ("first second", parser.GetHeader("X-Folded"));
+  }
+
+  HttpParser parser{HttpParser::kRequest};
+  for (char c : data) EXPECT_EQ(1u, parser.Execute(llvm::StringRef(&c, 1)));
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ("localhost", parser.GetHeader("Host"));
+}
+
+TEST(HttpParserTest, Pipelined) {
+  std::string second = "GET /two HTTP/1.1\r\n\r\n";
+  std::string data = std::string{kRequest} + second;
+  HttpParser parser{HttpParser::kRequest};
+  std::size_t consumed = parser.Execute(data);
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ(data.size() - second.size(), consumed);
+
+  // The parser is reused for the following request
+  parser.Reset();
+  EXPECT_EQ(second.size(), parser.Execute(data.substr(consumed)));
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ("/two", parser.GetUrl());
+  EXPECT_EQ("", parser.GetHeader("Host"));
+  EXPECT_EQ(-1, parser.GetContentLength());
+}
+
+TEST(HttpParserTest, KeepAlive) {
+  struct {
+    const char* request;
+    bool keepAlive;
+  } cases[] = {
+      {"GET / HTTP/1.1\r\n\r\n", true},
+      {"GET / HTTP/1.1\r\nConnection: close\r\n\r\n", false},
+      {"GET / HTTP/1.0\r\n\r\n", false},
+      {"GET / HTTP/1.0\r\nConnection: Upgrade, Keep-Alive\r\n\r\n", true},
+  };
+  for (const auto& c : cases) {
+    HttpParser parser{HttpParser::kRequest};
+    parser.Execute(c.request);
+    ASSERT_TRUE(parser.IsComplete()) << c.request;
+    EXPECT_EQ(c.keepAlive, parser.ShouldKeepAlive()) << c.request;
+  }
+}
+
+TEST(HttpParserTest, Http09) {
+  HttpParser parser{HttpParser::kRequest};
+  parser.Execute("GET /\r\n");
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ(0, parser.GetMajor());
+  EXPECT_EQ(9, parser.GetMinor());
+  EXPECT_FALSE(parser.ShouldKeepAlive());
+}
+
+TEST(HttpParserTest, Invalid) {
+  const char* cases[] = {
+      "GET / HTTP/x.1\r\n\r\n",
+      "GET / HTTP/1.1\r\nno colon\r\n\r\n",
+      "GET / HTTP/1.1\r\n continued\r\n\r\n",
+  };
+  for (const char* request : cases) {
+    HttpParser parser{HttpParser::kRequest};
+    parser.Execute(request);
+    EXPECT_TRUE(parser.HasError()) << request;
+    EXPECT_FALSE(parser.IsComplete()) << request;
+    EXPECT_FALSE(parser.GetError().empty()) << request;
+  }
+}
+
+TEST(HttpParserTest, Response) {
+  HttpParser parser{HttpParser::kResponse};
+  parser.Execute(
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: multipart/x-mixed-replace;boundary=frame\r\n"
+      "\r\n");
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ(200, parser.GetStatusCode());
+  EXPECT_EQ("OK", parser.GetStatusText());
+  EXPECT_EQ(0, parser.GetMinor());
+  EXPECT_EQ("multipart/x-mixed-replace;boundary=frame",
+            parser.GetHeader("Content-Type"));
+
+  parser.Reset();
+  parser.Execute("HTTP/1.1 abc OK\r\n\r\n");
+  EXPECT_TRUE(parser.HasError());
+}
+
+TEST(HttpParserTest, Part) {
+  // Multipart headers have no start line, and are parsed again after Reset
+  std::string data =
+      "Content-Type: image/jpeg\r\n"
+      "Content-Length: 1234\r\n"
+      "\r\n";
+  HttpParser parser{HttpParser::kPart};
+  for (int i = 0; i < 2; ++i) {
+    parser.Reset();
+    EXPECT_EQ(data.size(), parser.Execute(data + "\xff\xd8"));
+    ASSERT_TRUE(parser.IsComplete());
+    EXPECT_EQ("image/jpeg", parser.GetHeader("Content-Type"));
+    EXPECT_EQ(1234, parser.GetContentLength());
+  }
+
+  // Empty headers are complete immediately
+  parser.Reset();
+  EXPECT_EQ(2u, parser.Execute("\r\n\xff\xd8"));
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ(-1, parser.GetContentLength());
+}
+
+TEST(HttpParserTest, HeaderSizeLimit) {
+  // Just under 16 KB of headers is fine, in any number of pieces
+  std::string start = "GET / HTTP/1.1\r\n";
+  std::string header = "X-Big: " + std::string(16000, 'a') + "\r\n";
+  std::string end = "\r\n";
+  HttpParser parser{HttpParser::kRequest};
+  parser.Execute(start);
+  for (std::size_t i = 0; i < header.size(); i += 1000)
+    parser.Execute(llvm::StringRef(header).substr(i, 1000));
+  parser.Execute(end);
+  ASSERT_TRUE(parser.IsComplete());
+  EXPECT_EQ(16000u, parser.GetHeader("X-Big").size());
+
+  // Over it is an error, even without a complete line
+  parser.Reset();
+  parser.Execute(start);
+  parser.Execute(std::string(16384, 'a'));
+  EXPECT_TRUE(parser.HasError());
+}
+
+TEST(HttpParserTest, HeaderCountLimit) {
+  std::string data = "GET / HTTP/1.1\r\n";
+  for (int i = 0; i < 64; ++i)
+    data += "X-Header: " + std::to_string(i) + "\r\n";
+  HttpParser parser{HttpParser::kRequest};
+  parser.Execute(data + "\r\n");
+  ASSERT_TRUE(parser.IsComplete());
+
+  parser.Reset();
+  parser.Execute(data + "X-Header: 64\r\n\r\n");
+  EXPECT_TRUE(parser.HasError());
+}
+
+}  // namespace cs
@@ -0,0 +1,102 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "Image.h"
+#include "JpegBandDecoder.h"
+#include "JpegUtil.h"
+
+namespace cs {
+
+// Encode a pattern with some detail in it (so every block has coefficients)
+static std::vector<uchar> MakeJpeg(int width, int height, int channels,
+                                   int restartInterval) {
+  cv::Mat image(height, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+  for (int y = 0; y < height; ++y) {
+    uchar* row = image.ptr(y);
+    for (int x = 0; x < width * channels; ++x)
+      row[x] = static_cast<uchar>((x * 37) ^ (y * 11) ^ ((x + y) >> 3));
+  }
+  std::vector<int> params;
+  params.push_back(CV_IMWRITE_JPEG_QUALITY);
+  params.push_back(90);
+  params.push_back(CV_IMWRITE_JPEG_RST_INTERVAL);
+  params.push_back(restartInterval);
+  std::vector<uchar> jpeg;
+  cv::imencode(".jpg", image, jpeg, params);
+  return jpeg;
+}
+
+// Decode in bands and compare with decoding as a whole, which the bands
+// must match exactly.
+static void CheckBands(const std::vector<uchar>& jpeg, int flags,
+                       int maxBands, int numBands) {
+  Image image{llvm::StringRef(reinterpret_cast<const char*>(jpeg.data()),
+                              jpeg.size()),
+              nullptr};
+  const JpegInfo* info = image.GetJpegInfo();
+  ASSERT_NE(nullptr, info);
+  ASSERT_NE(0, info->restartInterval);
+
+  cv::Mat expected = cv::imdecode(jpeg, flags);
+  cv::Mat bands(expected.rows, expected.cols, expected.type());
+  JpegBandDecoder decoder{image, *info, flags, bands};
+  ASSERT_TRUE(decoder.Init(maxBands));
+  EXPECT_EQ(numBands, decoder.GetNumBands());
+  cv::parallel_for_(cv::Range(0, decoder.GetNumBands()), decoder);
+  ASSERT_FALSE(decoder.Failed());
+
+  std::size_t rowSize = expected.cols * expected.elemSize();
+  for (int y = 0; y < expected.rows; ++y) {
+    ASSERT_EQ(0, std::memcmp(expected.ptr(y), bands.ptr(y), rowSize))
+        << "row " << y;
+  }
+}
+
+TEST(JpegBandDecoderTest, Color) {
+  // 4:2:0, so bands are decoded with a MCU row of context either side
+  std::vector<uchar> jpeg = MakeJpeg(320, 240, 3, 20);  // MCU row intervals
+  for (int maxBands = 2; maxBands <= 8; ++maxBands) {
+    CheckBands(jpeg, cv::IMREAD_COLOR, maxBands, maxBands);
+    CheckBands(jpeg, cv::IMREAD_GRAYSCALE, maxBands, maxBands);
+  }
+}
+
+TEST(JpegBandDecoderTest, PartialRows) {
+  // Intervals of 8 MCUs only meet a row every other row (40 MCUs); the
+  // last row is partial and the final interval short
+  std::vector<uchar> jpeg = MakeJpeg(320, 232, 3, 8);
+  CheckBands(jpeg, cv::IMREAD_COLOR, 4, 4);
+  CheckBands(jpeg, cv::IMREAD_COLOR, 100, 8);
+}
+
+TEST(JpegBandDecoderTest, Gray) {
+  std::vector<uchar> jpeg = MakeJpeg(333, 250, 1, 7);
+  for (int maxBands = 2; maxBands <= 5; ++maxBands)
+    CheckBands(jpeg, cv::IMREAD_GRAYSCALE, maxBands, maxBands);
+}
+
+TEST(JpegBandDecoderTest, NotSplit) {
+  std::vector<uchar> jpeg = MakeJpeg(320, 240, 3, 0);
+  Image image{llvm::StringRef(reinterpret_cast<const char*>(jpeg.data()),
+                              jpeg.size()),
+              nullptr};
+  const JpegInfo* info = image.GetJpegInfo();
+  ASSERT_NE(nullptr, info);
+  cv::Mat dst(240, 320, CV_8UC3);
+  JpegBandDecoder decoder{image, *info, cv::IMREAD_COLOR, dst};
+  EXPECT_FALSE(decoder.Init(4));  // no restart markers
+}
+
+}  // namespace cs
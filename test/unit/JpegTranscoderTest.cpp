@@ -0,0 +1,144 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "Image.h"
+#include "JpegTranscoder.h"
+#include "JpegUtil.h"
+
+namespace cs {
+
+class JpegTranscoderTest : public ::testing::Test {
+ protected:
+  // Encode a smooth pattern, so downscaling it by averaging is meaningful.
+  void Encode(int width, int height, int channels, int quality,
+              int restartInterval) {
+    cv::Mat bgr(height, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+    for (int y = 0; y < height; ++y) {
+      uchar* row = bgr.ptr(y);
+      for (int x = 0; x < width; ++x) {
+        for (int c = 0; c < channels; ++c)
+          row[x * channels + c] = static_cast<uchar>(
+              128 + 100 * std::sin(x * 0.02 * (c + 1) + y * 0.013) *
+                        std::cos(y * 0.03 - x * 0.005 * c));
+      }
+    }
+    std::vector<int> params;
+    params.push_back(CV_IMWRITE_JPEG_QUALITY);
+    params.push_back(quality);
+    params.push_back(CV_IMWRITE_JPEG_RST_INTERVAL);
+    params.push_back(restartInterval);
+    std::vector<uchar> jpeg;
+    cv::imencode(".jpg", bgr, jpeg, params);
+    in.reset(new Image{jpeg.size()});
+    in->SetSize(jpeg.size());
+    std::memcpy(in->data(), jpeg.data(), jpeg.size());
+    flags = channels == 3 ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+  }
+
+  // Transcode the input, and check the result is a JPEG of that size, that
+  // it decodes to the same picture, and that it has the given quality and
+  // the input's restart interval.
+  void Check(int width, int height, int quality) {
+    Image out{0};
+    ASSERT_TRUE(transcoder.Transcode(*in, width, height, quality, &out));
+    const JpegInfo* info = out.GetJpegInfo();
+    ASSERT_NE(nullptr, info);
+    EXPECT_EQ(width, info->width);
+    EXPECT_EQ(height, info->height);
+    EXPECT_NEAR(quality, info->quality, 1);
+    EXPECT_EQ(in->GetJpegInfo()->restartInterval, info->restartInterval);
+
+    cv::Mat decoded = cv::imdecode(out.vec(), flags);
+    ASSERT_FALSE(decoded.empty());
+    ASSERT_EQ(height, decoded.rows);
+    ASSERT_EQ(width, decoded.cols);
+
+    // Compare with the input decoded and averaged down to the same size
+    // (leaving out the last row and column, which may be partial)
+    cv::Mat orig = cv::imdecode(in->vec(), flags);
+    int scale = (orig.cols + width / 2) / width;
+    int channels = decoded.channels();
+    double diff = 0;
+    int count = 0;
+    for (int y = 0; y + 1 < height; ++y) {
+      for (int x = 0; x + 1 < width; ++x) {
+        for (int c = 0; c < channels; ++c) {
+          int sum = 0;
+          for (int i = 0; i < scale; ++i) {
+            for (int j = 0; j < scale; ++j)
+              sum += orig.ptr(y * scale + i)[(x * scale + j) * channels + c];
+          }
+          diff += std::abs(decoded.ptr(y)[x * channels + c] -
+                           sum / (scale * scale));
+          ++count;
+        }
+      }
+    }
+    EXPECT_LT(diff / count, 4.0) << width << "x" << height << " q" << quality;
+  }
+
+  JpegTranscoder transcoder;
+  std::unique_ptr<Image> in;
+  int flags{cv::IMREAD_COLOR};
+};
+
+TEST_F(JpegTranscoderTest, Requantize) {
+  Encode(320, 240, 3, 95, 0);
+  for (int quality : {90, 70, 50, 30}) Check(320, 240, quality);
+}
+
+TEST_F(JpegTranscoderTest, Scale) {
+  Encode(320, 240, 3, 90, 0);
+  Check(160, 120, 70);
+  Check(80, 60, 70);
+}
+
+TEST_F(JpegTranscoderTest, OddSize) {
+  // Partial MCUs, rounding the scaled size either way
+  Encode(333, 250, 3, 90, 0);
+  Check(167, 125, 70);
+  Check(166, 125, 70);
+  Check(83, 62, 70);
+  Check(84, 63, 70);
+}
+
+TEST_F(JpegTranscoderTest, RestartInterval) {
+  Encode(320, 240, 3, 90, 7);
+  Check(320, 240, 60);
+  Check(160, 120, 60);
+}
+
+TEST_F(JpegTranscoderTest, Gray) {
+  Encode(320, 240, 1, 90, 0);
+  Check(320, 240, 50);
+  Check(80, 60, 50);
+}
+
+TEST_F(JpegTranscoderTest, Unsupported) {
+  Encode(320, 240, 3, 90, 0);
+  Image out{0};
+  EXPECT_FALSE(transcoder.Transcode(*in, 107, 80, 70, &out));  // 1/3
+  EXPECT_FALSE(transcoder.Transcode(*in, 40, 30, 70, &out));   // 1/8
+
+  Image notJpeg{16};
+  notJpeg.SetSize(16);
+  std::memset(notJpeg.data(), 0, 16);
+  EXPECT_FALSE(transcoder.Transcode(notJpeg, 320, 240, 70, &out));
+}
+
+}  // namespace cs
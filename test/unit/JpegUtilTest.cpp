@@ -0,0 +1,204 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "JpegUtil.h"
+
+namespace cs {
+
+// Builds the marker structure of a JPEG (the entropy-coded data is not
+// decodable), recording where each marker was put.
+class JpegBuilder {
+ public:
+  explicit JpegBuilder(int components = 3, int lumaSampling = 0x22)
+      : m_components{components}, m_lumaSampling{lumaSampling} {}
+
+  std::string Build(unsigned char sofType, int restartInterval,
+                    llvm::StringRef entropy) {
+    std::string jpeg{"\xff\xd8", 2};
+    Segment(&jpeg, 0xe0, std::string{"JFIF\0\x01\x01\0\0\x01\0\x01\0\0", 14});
+    if (quality < 0) {
+      Segment(&jpeg, 0xdb, std::string(1, '\0') + std::string(64, '\x10'));
+    } else {
+      // Luma and chroma tables in one segment
+      std::string dqt;
+      for (int id = 0; id < 2; ++id) {
+        int table[64];
+        JpegScaleQuant(quality, id == 1, table);
+        dqt += static_cast<char>(id);
+        for (int i = 0; i < 64; ++i) dqt += static_cast<char>(table[i]);
+      }
+      Segment(&jpeg, 0xdb, dqt);
+    }
+    if (dht) jpeg += JpegGetDHT().str();
+
+    std::string sof{"\x08\x00\x18\x00\x28", 5};  // 40x24
+    sof += static_cast<char>(m_components);
+    for (int i = 0; i < m_components; ++i) {
+      sof += static_cast<char>(i + 1);
+      sof += static_cast<char>(i == 0 ? m_lumaSampling : 0x11);
+      sof += static_cast<char>(i == 0 ? 0 : 1);
+    }
+    sofPos = jpeg.size();
+    Segment(&jpeg, sofType, sof);
+
+    if (restartInterval != 0) {
+      std::string dri{"\0", 1};
+      dri += static_cast<char>(restartInterval);
+      Segment(&jpeg, 0xdd, dri);
+    }
+
+    std::string sos(1, static_cast<char>(m_components));
+    for (int i = 0; i < m_components; ++i) {
+      sos += static_cast<char>(i + 1);
+      sos += static_cast<char>(i == 0 ? 0x00 : 0x11);
+    }
+    sos += std::string{"\x00\x3f\x00", 3};
+    sosPos = jpeg.size();
+    Segment(&jpeg, 0xda, sos);
+    dataPos = jpeg.size();
+
+    jpeg.append(entropy.data(), entropy.size());
+    scanEnd = jpeg.size();
+    jpeg += "\xff\xd9";
+    return jpeg;
+  }
+
+  bool dht{false};
+  int quality{-1};  // quality of the DQT tables (-1 for a flat table)
+  std::size_t sofPos{0};
+  std::size_t sosPos{0};
+  std::size_t dataPos{0};
+  std::size_t scanEnd{0};
+
+ private:
+  static void Segment(std::string* jpeg, unsigned char code,
+                      llvm::StringRef payload) {
+    *jpeg += '\xff';
+    *jpeg += static_cast<char>(code);
+    *jpeg += static_cast<char>((payload.size() + 2) >> 8);
+    *jpeg += static_cast<char>(payload.size() + 2);
+    jpeg->append(payload.data(), payload.size());
+  }
+
+  int m_components;
+  int m_lumaSampling;
+};
+
+TEST(JpegUtilTest, ParseBaseline) {
+  JpegBuilder builder;
+  builder.dht = true;
+  std::string jpeg = builder.Build(0xc0, 0, "\x12\x34");
+  JpegInfo info;
+  ASSERT_TRUE(ParseJpeg(jpeg, &info));
+  EXPECT_EQ(40, info.width);
+  EXPECT_EQ(24, info.height);
+  EXPECT_EQ(3, info.components);
+  EXPECT_EQ(16, info.mcuWidth);
+  EXPECT_EQ(16, info.mcuHeight);
+  EXPECT_EQ(0xc0, info.sofType);
+  EXPECT_EQ(builder.sofPos, info.sofPos);
+  EXPECT_EQ(builder.sosPos, info.sosPos);
+  EXPECT_EQ(builder.dataPos, info.dataPos);
+  EXPECT_TRUE(info.hasDHT);
+  EXPECT_TRUE(info.hasDQT);
+  EXPECT_EQ(0, info.restartInterval);
+  EXPECT_TRUE(info.restarts.empty());
+}
+
+TEST(JpegUtilTest, ParseMcuSize) {
+  struct {
+    int components;
+    int lumaSampling;
+    int mcuWidth;
+    int mcuHeight;
+  } cases[] = {
+      {3, 0x11, 8, 8},
+      {3, 0x21, 16, 8},
+      {3, 0x22, 16, 16},
+      {1, 0x22, 8, 8},  // a single component scan is not interleaved
+  };
+  for (const auto& c : cases) {
+    std::string jpeg =
+        JpegBuilder{c.components, c.lumaSampling}.Build(0xc2, 0, "");
+    JpegInfo info;
+    ASSERT_TRUE(ParseJpeg(jpeg, &info));
+    EXPECT_EQ(0xc2, info.sofType);
+    EXPECT_FALSE(info.hasDHT);
+    EXPECT_EQ(c.mcuWidth, info.mcuWidth) << c.lumaSampling;
+    EXPECT_EQ(c.mcuHeight, info.mcuHeight) << c.lumaSampling;
+  }
+}
+
+TEST(JpegUtilTest, ParseRestarts) {
+  // Stuffed FF 00 and fill bytes are skipped; the restart before a fill
+  // byte is at its marker
+  JpegBuilder builder;
+  std::string entropy{"\x11\xff\x00\x22\xff\xd0\x33\xff\xff\xd1\x44", 11};
+  std::string jpeg = builder.Build(0xc0, 5, entropy);
+  JpegInfo info;
+  ASSERT_TRUE(ParseJpeg(jpeg, &info));
+  EXPECT_EQ(5, info.restartInterval);
+  std::vector<std::size_t> restarts{builder.dataPos + 4, builder.dataPos + 8};
+  EXPECT_EQ(restarts, info.restarts);
+  EXPECT_EQ(builder.scanEnd, info.scanEnd);
+
+  // Parsing again (as for a pooled image) starts over
+  jpeg = builder.Build(0xc0, 0, entropy);
+  ASSERT_TRUE(ParseJpeg(jpeg, &info));
+  EXPECT_EQ(0, info.restartInterval);
+  EXPECT_TRUE(info.restarts.empty());
+}
+
+TEST(JpegUtilTest, ParseQuality) {
+  for (int quality : {10, 25, 50, 75, 90, 100}) {
+    JpegBuilder builder;
+    builder.quality = quality;
+    JpegInfo info;
+    ASSERT_TRUE(ParseJpeg(builder.Build(0xc0, 0, ""), &info));
+    // Low qualities are overestimated, as the table entries are limited
+    // to 255
+    if (quality >= 25)
+      EXPECT_NEAR(quality, info.quality, 1);
+    else
+      EXPECT_LE(quality, info.quality);
+  }
+}
+
+TEST(JpegUtilTest, ScaleQuant) {
+  int table[64];
+  JpegScaleQuant(50, false, table);  // the base table
+  EXPECT_EQ(16, table[0]);
+  EXPECT_EQ(99, table[63]);
+  JpegScaleQuant(100, true, table);
+  EXPECT_EQ(1, table[0]);
+  EXPECT_EQ(1, table[63]);
+  JpegScaleQuant(1, false, table);
+  EXPECT_EQ(255, table[63]);
+}
+
+TEST(JpegUtilTest, ParseInvalid) {
+  std::string jpeg = JpegBuilder{}.Build(0xc0, 0, "\x12\x34");
+  JpegInfo info;
+  EXPECT_FALSE(ParseJpeg(jpeg.substr(2), &info));       // no SOI
+  EXPECT_FALSE(ParseJpeg(jpeg.substr(0, 100), &info));  // truncated
+  EXPECT_FALSE(ParseJpeg(std::string{"\xff\xd8\xff\xda\x00\x08\x01\x01"
+                                     "\x00\x00\x3f\x00\xff\xd9",
+                                     14},
+                         &info));  // SOS without SOF
+
+  std::string badLength = jpeg;
+  badLength[4] = '\0';
+  badLength[5] = '\x01';
+  EXPECT_FALSE(ParseJpeg(badLength, &info));
+}
+
+}  // namespace cs
@@ -0,0 +1,149 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CvSourceImpl.h"
+#include "MjpegStreamParser.h"
+
+namespace cs {
+
+// The smallest JPEG the parser accepts: SOI, DQT, SOF0 (16x8, one
+// component), SOS, entropy-coded data, EOI.  Only the marker structure
+// matters, so the data is not decodable.
+static std::string MakeJpeg(llvm::StringRef entropy) {
+  std::string jpeg{"\xff\xd8\xff\xdb\x00\x43\x00", 7};
+  jpeg.append(64, '\x10');
+  jpeg.append("\xff\xc0\x00\x0b\x08\x00\x08\x00\x10\x01\x01\x11\x00", 13);
+  jpeg.append("\xff\xda\x00\x08\x01\x01\x00\x00\x3f\x00", 10);
+  jpeg.append(entropy);
+  jpeg.append("\xff\xd9", 2);
+  return jpeg;
+}
+
+static std::string MakePart(llvm::StringRef jpeg, bool contentLength) {
+  std::string part = "--boundary\r\nContent-Type: image/jpeg\r\n";
+  if (contentLength)
+    part += "Content-Length: " + std::to_string(jpeg.size()) + "\r\n";
+  part += "\r\n";
+  part += jpeg;
+  part += "\r\n";
+  return part;
+}
+
+class MjpegStreamParserTest : public ::testing::Test {
+ protected:
+  MjpegStreamParserTest()
+      : source{"test", VideoMode{VideoMode::kMJPEG, 16, 8, 30}} {}
+
+  // Feed the stream in reads of at most chunk bytes, collecting the frames
+  // received and the errors.  Returns true if the closing boundary was
+  // reached.
+  bool Feed(MjpegStreamParser& parser, llvm::StringRef stream,
+            std::size_t chunk) {
+    std::size_t pos = 0;
+    while (pos < stream.size()) {
+      auto buf = parser.GetBuffer();
+      EXPECT_FALSE(buf.empty());
+      std::size_t len =
+          std::min(std::min(buf.size(), chunk), stream.size() - pos);
+      std::memcpy(buf.data(), stream.data() + pos, len);
+      pos += len;
+      parser.Commit(len);
+      for (;;) {
+        auto result = parser.Process();
+        if (result == MjpegStreamParser::kNeedData) break;
+        if (result == MjpegStreamParser::kEnd) return true;
+        if (result == MjpegStreamParser::kBadFrame) {
+          errors.push_back(parser.GetError());
+          continue;
+        }
+        auto image = parser.TakeImage();
+        EXPECT_EQ(16, image->width);
+        EXPECT_EQ(8, image->height);
+        frames.push_back(image->str());
+      }
+    }
+    return false;
+  }
+
+  CvSourceImpl source;
+  std::vector<std::string> frames;
+  std::vector<std::string> errors;
+};
+
+TEST_F(MjpegStreamParserTest, ContentLength) {
+  std::string jpeg1 = MakeJpeg("\x12\x34\x56");
+  std::string jpeg2 = MakeJpeg(std::string(100000, '\x5a'));
+  std::string stream = "ignored preamble\r\n" + MakePart(jpeg1, true) +
+                       MakePart(jpeg2, true) + "--boundary--\r\n";
+  MjpegStreamParser parser{source, "boundary"};
+  EXPECT_TRUE(Feed(parser, stream, stream.size()));
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(jpeg1, frames[0]);
+  EXPECT_EQ(jpeg2, frames[1]);
+  EXPECT_TRUE(errors.empty());
+}
+
+TEST_F(MjpegStreamParserTest, SplitReads) {
+  // Boundaries, headers and images split across reads at every size
+  std::string jpeg1 = MakeJpeg("\x12\x34\x56");
+  std::string jpeg2 = MakeJpeg(std::string(300, '\x5a'));
+  std::string stream = MakePart(jpeg1, true) + MakePart(jpeg2, true) +
+                       MakePart(jpeg1, true) + "--boundary--\r\n";
+  for (std::size_t chunk = 1; chunk <= 64; ++chunk) {
+    MjpegStreamParser parser{source, "boundary"};
+    frames.clear();
+    EXPECT_TRUE(Feed(parser, stream, chunk)) << "chunk " << chunk;
+    ASSERT_EQ(3u, frames.size()) << "chunk " << chunk;
+    EXPECT_EQ(jpeg1, frames[0]);
+    EXPECT_EQ(jpeg2, frames[1]);
+    EXPECT_EQ(jpeg1, frames[2]);
+  }
+  EXPECT_TRUE(errors.empty());
+}
+
+TEST_F(MjpegStreamParserTest, NoContentLength) {
+  // The end of the image is found from the JPEG structure: FF D9 inside a
+  // segment, stuffed FF 00, RSTn and fill bytes don't end it
+  std::string jpeg1 = MakeJpeg(
+      llvm::StringRef("\x12\xff\x00\x34\xff\xd0\x56\xff\xff\xd1\x78", 11));
+  jpeg1.insert(2, "\xff\xfe\x00\x06\xff\xd9\xff\xd9", 8);  // COM segment
+  std::string jpeg2 = MakeJpeg(std::string(200000, '\x5a'));  // grows
+  std::string stream = MakePart(jpeg1, false) + MakePart(jpeg2, false) +
+                       MakePart(jpeg1, false) + "--boundary--\r\n";
+  for (std::size_t chunk : {1, 3, 7, 64, 5000, 100000, 1000000}) {
+    MjpegStreamParser parser{source, "boundary"};
+    frames.clear();
+    EXPECT_TRUE(Feed(parser, stream, chunk)) << "chunk " << chunk;
+    ASSERT_EQ(3u, frames.size()) << "chunk " << chunk;
+    EXPECT_EQ(jpeg1, frames[0]);
+    EXPECT_EQ(jpeg2, frames[1]);
+    EXPECT_EQ(jpeg1, frames[2]);
+  }
+  EXPECT_TRUE(errors.empty());
+}
+
+TEST_F(MjpegStreamParserTest, BadParts) {
+  std::string jpeg = MakeJpeg("\x12\x34\x56");
+  std::string stream =
+      "--boundary\r\nContent-Type: text/plain\r\n\r\nhello\r\n" +
+      MakePart("not a jpeg", true) + MakePart("not a jpeg", false) +
+      MakePart(jpeg, false) + "--boundary--\r\n";
+  MjpegStreamParser parser{source, "boundary"};
+  EXPECT_TRUE(Feed(parser, stream, stream.size()));
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(jpeg, frames[0]);
+  EXPECT_EQ(3u, errors.size());
+}
+
+}  // namespace cs
@@ -0,0 +1,268 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "llvm/SmallString.h"
+
+#include "JpegUtil.h"
+#include "RtpUtil.h"
+
+namespace cs {
+
+static void AddSegment(std::string* jpeg, unsigned char code,
+                       llvm::StringRef payload) {
+  *jpeg += '\xff';
+  *jpeg += static_cast<char>(code);
+  *jpeg += static_cast<char>((payload.size() + 2) >> 8);
+  *jpeg += static_cast<char>(payload.size() + 2);
+  jpeg->append(payload.data(), payload.size());
+}
+
+// Build the marker structure of a 3-component JPEG, with luma using
+// quantization table 0 (all 2) and chroma table 1 (all 3), followed by the
+// given entropy-coded data and EOI.
+static std::string MakeJpeg(int lumaSampling, int restartInterval,
+                            llvm::StringRef entropy,
+                            unsigned char sofType = 0xc0, int width = 64,
+                            llvm::StringRef dht = llvm::StringRef{}) {
+  std::string jpeg{"\xff\xd8", 2};
+  AddSegment(&jpeg, 0xe0, std::string{"JFIF\0\x01\x01\0\0\x01\0\x01\0\0", 14});
+  std::string dqt;
+  dqt += '\0';
+  dqt += std::string(64, '\x02');
+  dqt += '\x01';
+  dqt += std::string(64, '\x03');
+  AddSegment(&jpeg, 0xdb, dqt);
+  jpeg += dht;
+
+  std::string sof{"\x08\x00\x30", 3};  // 48 high
+  sof += static_cast<char>(width >> 8);
+  sof += static_cast<char>(width);
+  sof += std::string{"\x03\x01", 2};
+  sof += static_cast<char>(lumaSampling);
+  sof += std::string{"\x00\x02\x11\x01\x03\x11\x01", 7};
+  AddSegment(&jpeg, sofType, sof);
+
+  if (restartInterval != 0) {
+    std::string dri{"\0", 1};
+    dri += static_cast<char>(restartInterval);
+    AddSegment(&jpeg, 0xdd, dri);
+  }
+
+  AddSegment(&jpeg, 0xda,
+             std::string{"\x03\x01\x00\x02\x11\x03\x11\x00\x3f\x00", 10});
+  jpeg.append(entropy.data(), entropy.size());
+  jpeg += "\xff\xd9";
+  return jpeg;
+}
+
+static unsigned int Read16(llvm::StringRef data, std::size_t pos) {
+  auto p = data.bytes_begin() + pos;
+  return (p[0] << 8) | p[1];
+}
+
+static uint32_t Read32(llvm::StringRef data, std::size_t pos) {
+  return (Read16(data, pos) << 16) | Read16(data, pos + 2);
+}
+
+TEST(RtpUtilTest, ParseTypes) {
+  struct {
+    int lumaSampling;
+    int restartInterval;
+    int type;
+  } cases[] = {
+      {0x21, 0, 0},
+      {0x22, 0, 1},
+      {0x21, 4, 64},
+      {0x22, 4, 65},
+  };
+  std::string entropy{"\x12\xff\x00\x34\xff\xd0\x56", 7};
+  for (const auto& c : cases) {
+    std::string jpeg = MakeJpeg(c.lumaSampling, c.restartInterval, entropy);
+    RtpJpegInfo info;
+    ASSERT_TRUE(ParseRtpJpeg(jpeg, &info)) << c.type;
+    EXPECT_EQ(c.type, info.type);
+    EXPECT_EQ(c.restartInterval, info.restartInterval);
+    EXPECT_EQ(64, info.width);
+    EXPECT_EQ(48, info.height);
+    EXPECT_EQ(std::string(64, '\x02'), info.qtables[0]);
+    EXPECT_EQ(std::string(64, '\x03'), info.qtables[1]);
+    EXPECT_EQ(entropy, info.scan);
+  }
+
+  // Padding after EOI isn't part of the scan
+  std::string padded = MakeJpeg(0x21, 0, entropy) + std::string(10, '\0');
+  RtpJpegInfo info;
+  ASSERT_TRUE(ParseRtpJpeg(padded, &info));
+  EXPECT_EQ(entropy, info.scan);
+}
+
+TEST(RtpUtilTest, ParseHuffmanTables) {
+  // The standard tables can be sent, as receivers rebuild them
+  RtpJpegInfo info;
+  std::string dht = JpegGetDHT().str();
+  EXPECT_TRUE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc0, 64, dht), &info));
+
+  // Any other tables can't
+  dht.back() ^= 1;
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc0, 64, dht), &info));
+}
+
+TEST(RtpUtilTest, ParseUnsupported) {
+  RtpJpegInfo info;
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc2), &info));  // SOF2
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc1), &info));  // SOF1
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x11, 0, "x"), &info));        // 4:4:4
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc0, 2048), &info));
+  EXPECT_TRUE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x", 0xc0, 2040), &info));
+  EXPECT_FALSE(ParseRtpJpeg(MakeJpeg(0x22, 0, "x").substr(0, 40), &info));
+}
+
+class RtpJpegPacketizerTest : public ::testing::Test {
+ protected:
+  RtpJpegPacketizerTest() : packetizer{512} {
+    for (int i = 0; i < 2000; ++i) scan += static_cast<char>(i * 7);
+    info.type = 1;
+    info.width = 100;
+    info.height = 60;
+    info.qtables[0] = tables[0];
+    info.qtables[1] = tables[1];
+    info.scan = scan;
+  }
+
+  bool Packetize(int q, bool sendTables, uint64_t time) {
+    packets.clear();
+    return packetizer.Packetize(
+        info, q, sendTables, time,
+        [&](llvm::ArrayRef<llvm::StringRef> pieces) {
+          std::string packet;
+          for (auto&& piece : pieces) packet += piece;
+          packets.push_back(packet);
+          return true;
+        });
+  }
+
+  // Check the RTP and JPEG headers of each packet, and that the payloads
+  // make up the scan.
+  // @param headerSize Size of the headers after the first packet
+  // @param firstExtra Size of the extra headers in the first packet
+  void CheckPackets(std::size_t headerSize, std::size_t firstExtra) {
+    ASSERT_GT(packets.size(), 1u);
+    std::string payload;
+    for (std::size_t i = 0; i < packets.size(); ++i) {
+      const std::string& packet = packets[i];
+      std::size_t size = headerSize + (i == 0 ? firstExtra : 0);
+      ASSERT_LE(packet.size(), 512u);
+      ASSERT_GT(packet.size(), size);
+      EXPECT_EQ(0x80u, Read16(packet, 0) >> 8);
+      // Marker bit on the last packet only
+      EXPECT_EQ((i + 1 == packets.size() ? 0x80u : 0) | 26,
+                Read16(packet, 0) & 0xff)
+          << i;
+      EXPECT_EQ((Read16(packets[0], 2) + i) & 0xffff, Read16(packet, 2));
+      EXPECT_EQ(packets[0].substr(4, 8), packet.substr(4, 8));  // time, SSRC
+      // Type-specific byte, then the fragment offset
+      EXPECT_EQ(payload.size(), Read32(packet, 12)) << i;
+      EXPECT_EQ(static_cast<unsigned int>(info.type), Read16(packet, 16) >> 8);
+      EXPECT_EQ(((100 + 7) / 8 << 8) | (60 + 7) / 8, Read16(packet, 18));
+      payload += packet.substr(size);
+    }
+    EXPECT_EQ(scan, payload);
+  }
+
+  RtpJpegPacketizer packetizer;
+  std::string tables[2] = {std::string(64, 'L'), std::string(64, 'C')};
+  std::string scan;
+  RtpJpegInfo info;
+  std::vector<std::string> packets;
+};
+
+TEST_F(RtpJpegPacketizerTest, Tables) {
+  // Q-table header and both tables, in the first packet only
+  ASSERT_TRUE(Packetize(255, true, 0));
+  CheckPackets(20, 4 + 128);
+  EXPECT_EQ(255, packets[0][17] & 0xff);
+  EXPECT_EQ(std::string("\0\0\0\x80", 4), packets[0].substr(20, 4));
+  EXPECT_EQ(tables[0] + tables[1], packets[0].substr(24, 128));
+
+  // Tables cached by the receiver: the header with a length of 0
+  ASSERT_TRUE(Packetize(255, false, 0));
+  CheckPackets(20, 4);
+  EXPECT_EQ(std::string(4, '\0'), packets[0].substr(20, 4));
+
+  // Q values below 128 have no Q-table header
+  ASSERT_TRUE(Packetize(50, true, 0));
+  CheckPackets(20, 0);
+  EXPECT_EQ(50, packets[0][17]);
+}
+
+TEST_F(RtpJpegPacketizerTest, Restarts) {
+  // A restart header in every packet, after the JPEG header
+  info.type = 65;
+  info.restartInterval = 300;
+  ASSERT_TRUE(Packetize(255, true, 0));
+  CheckPackets(24, 4 + 128);
+  for (const auto& packet : packets)
+    EXPECT_EQ(std::string("\x01\x2c\xff\xff", 4), packet.substr(20, 4));
+  EXPECT_EQ(std::string("\0\0\0\x80", 4), packets[0].substr(24, 4));
+}
+
+TEST_F(RtpJpegPacketizerTest, Sequence) {
+  // Sequence numbers continue across frames; the timestamp is 90 kHz
+  ASSERT_TRUE(Packetize(50, true, 0));
+  unsigned int seq = Read16(packets.back(), 2) + 1;
+  uint32_t timestamp = Read32(packets[0], 4);
+  ASSERT_TRUE(Packetize(50, true, 10000000));  // 1 s later
+  EXPECT_EQ(seq & 0xffff, Read16(packets[0], 2));
+  EXPECT_EQ(90000u, Read32(packets[0], 4) - timestamp);
+
+  // Aborting the frame
+  int count = 0;
+  EXPECT_FALSE(packetizer.Packetize(
+      info, 50, true, 0,
+      [&](llvm::ArrayRef<llvm::StringRef>) { return ++count < 2; }));
+  EXPECT_EQ(2, count);
+}
+
+TEST_F(RtpJpegPacketizerTest, SenderReport) {
+  ASSERT_TRUE(Packetize(255, true, 0));
+  std::size_t octets = 0;
+  for (const auto& packet : packets) octets += packet.size() - 12;
+
+  llvm::SmallString<128> buf;
+  buf = "xy";  // appended to
+  packetizer.WriteSenderReport(buf, 0, "camera");
+  // SR of 28 bytes, and SDES of 4 plus a chunk padded to 16 bytes
+  ASSERT_EQ(2u + 28 + 4 + 16, buf.size());
+  llvm::StringRef sr = buf.str().substr(2, 28);
+  EXPECT_EQ(0x80u, Read16(sr, 0) >> 8);
+  EXPECT_EQ(200u, Read16(sr, 0) & 0xff);
+  EXPECT_EQ(6u, Read16(sr, 2));  // length in words, minus one
+  EXPECT_EQ(packetizer.GetSsrc(), Read32(sr, 4));
+  EXPECT_EQ(packets.size(), Read32(sr, 20));
+  EXPECT_EQ(octets, Read32(sr, 24));
+
+  llvm::StringRef sdes = buf.str().substr(30);
+  EXPECT_EQ(0x81u, Read16(sdes, 0) >> 8);
+  EXPECT_EQ(202u, Read16(sdes, 0) & 0xff);
+  EXPECT_EQ(4u, Read16(sdes, 2));
+  EXPECT_EQ(packetizer.GetSsrc(), Read32(sdes, 4));
+  EXPECT_EQ(std::string("\x01\x06" "camera\0\0\0\0", 12), sdes.substr(8));
+
+  // Long names are truncated to 255 bytes
+  buf.clear();
+  packetizer.WriteSenderReport(buf, 0, std::string(300, 'x'));
+  ASSERT_EQ(28u + 4 + 264, buf.size());
+  EXPECT_EQ(66u, Read16(buf.str(), 28 + 2));
+  EXPECT_EQ(255, buf[28 + 9] & 0xff);
+}
+
+}  // namespace cs
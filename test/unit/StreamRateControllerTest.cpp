@@ -0,0 +1,166 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include "StreamRateController.h"
+
+namespace cs {
+
+// Latencies relative to the 0.1 s target
+static const double kOver = 0.2;
+static const double kUnder = 0.01;
+static const double kOk = 0.07;
+
+class StreamRateControllerTest : public ::testing::Test {
+ protected:
+  StreamRateControllerTest() : rate{90, 0.1, 0} {
+    // The first frame only starts the measurements
+    Send(1, kOk);
+  }
+
+  // Send frames of 10 KB at 32 fps (so the holdoffs are a whole number of
+  // frames), taking sendTime each.  The frames have the requested quality
+  // unless cameraQuality is set.
+  void Send(int frames, double sendTime) {
+    for (int i = 0; i < frames; ++i) {
+      now += 1.0 / 32;
+      rate.Update(10000, sendTime, 0, now,
+                  cameraQuality == 0 ? rate.GetQuality() : cameraQuality);
+    }
+  }
+
+  StreamRateController rate;
+  double now{1};
+  int cameraQuality{0};
+};
+
+TEST_F(StreamRateControllerTest, MaxQuality) {
+  EXPECT_EQ(80, StreamRateController(-1, 0.1, 0).GetQuality());
+  EXPECT_EQ(100, StreamRateController(150, 0.1, 0).GetQuality());
+  EXPECT_EQ(20, StreamRateController(5, 0.1, 0).GetQuality());
+  EXPECT_EQ(90, rate.GetQuality());
+  EXPECT_EQ(640, rate.GetWidth(640));
+  EXPECT_EQ(480, rate.GetHeight(480));
+}
+
+TEST_F(StreamRateControllerTest, StepDown) {
+  // Three frames over, and a quarter second since the last change
+  Send(7, kOver);
+  EXPECT_EQ(90, rate.GetQuality());
+  Send(1, kOver);
+  EXPECT_EQ(80, rate.GetQuality());
+  Send(7, kOver);
+  EXPECT_EQ(80, rate.GetQuality());
+  Send(1, kOver);
+  EXPECT_EQ(70, rate.GetQuality());
+
+  // Quality goes down to 20 before the resolution goes down
+  for (int quality = 60; quality >= 20; quality -= 10) {
+    Send(8, kOver);
+    EXPECT_EQ(quality, rate.GetQuality());
+    EXPECT_EQ(640, rate.GetWidth(640));
+  }
+  for (int width : {480, 320, 240, 160, 160}) {
+    Send(8, kOver);
+    EXPECT_EQ(20, rate.GetQuality());
+    EXPECT_EQ(width, rate.GetWidth(640));
+  }
+  EXPECT_EQ(2, rate.GetWidth(10));  // even, and at least 2
+}
+
+TEST_F(StreamRateControllerTest, OverMustBeConsecutive) {
+  Send(10, kUnder);
+  for (int i = 0; i < 5; ++i) {
+    Send(2, kOver);
+    Send(1, kOk);
+  }
+  EXPECT_EQ(90, rate.GetQuality());
+  Send(3, kOver);
+  EXPECT_EQ(80, rate.GetQuality());
+}
+
+TEST_F(StreamRateControllerTest, StepUp) {
+  for (int i = 0; i < 9; ++i) Send(8, kOver);
+  EXPECT_EQ(20, rate.GetQuality());
+  EXPECT_EQ(320, rate.GetWidth(640));
+
+  // Thirty frames under, and two seconds since the last change; the
+  // resolution comes back before the quality
+  Send(63, kUnder);
+  EXPECT_EQ(320, rate.GetWidth(640));
+  Send(1, kUnder);
+  EXPECT_EQ(480, rate.GetWidth(640));
+  Send(64, kUnder);
+  EXPECT_EQ(640, rate.GetWidth(640));
+  EXPECT_EQ(20, rate.GetQuality());
+  Send(64, kUnder);
+  EXPECT_EQ(30, rate.GetQuality());
+
+  // A frame that is neither over nor under starts the count again
+  Send(40, kUnder);
+  Send(1, kOk);
+  Send(29, kUnder);
+  EXPECT_EQ(30, rate.GetQuality());
+  Send(1, kUnder);
+  EXPECT_EQ(40, rate.GetQuality());
+
+  // Never above the initial quality
+  for (int i = 0; i < 10; ++i) Send(64, kUnder);
+  EXPECT_EQ(90, rate.GetQuality());
+}
+
+TEST_F(StreamRateControllerTest, QualityFixed) {
+  // Frames of unknown quality (e.g. camera JPEGs that can't be
+  // requantized): only the resolution changes
+  cameraQuality = -1;
+  Send(8, kOver);
+  EXPECT_EQ(90, rate.GetQuality());
+  EXPECT_EQ(480, rate.GetWidth(640));
+  Send(64, kUnder);
+  EXPECT_EQ(640, rate.GetWidth(640));
+  Send(64, kUnder);
+  EXPECT_EQ(90, rate.GetQuality());
+
+  // Or a higher quality than requested
+  cameraQuality = 95;
+  Send(8, kOver);
+  EXPECT_EQ(90, rate.GetQuality());
+  EXPECT_EQ(480, rate.GetWidth(640));
+
+  // Frames already at a lower quality still follow it
+  cameraQuality = 50;
+  Send(8, kOver);
+  EXPECT_EQ(80, rate.GetQuality());
+}
+
+TEST_F(StreamRateControllerTest, Bitrate) {
+  // 10 KB at 32 fps is 2.56 Mbit/s
+  StreamRateController limited{90, 0.1, 1e6};
+  StreamRateController unlimited{90, 0.1, 5e6};
+  for (int i = 0; i < 10; ++i) {
+    now += 1.0 / 32;
+    limited.Update(10000, kUnder, 0, now, limited.GetQuality());
+    unlimited.Update(10000, kUnder, 0, now, unlimited.GetQuality());
+  }
+  EXPECT_NEAR(2.56e6, limited.GetBitrate(), 1);
+  EXPECT_EQ(80, limited.GetQuality());
+  EXPECT_EQ(90, unlimited.GetQuality());
+}
+
+TEST_F(StreamRateControllerTest, QueuedLatency) {
+  // 64 KB still queued, with 10 KB a frame draining (320 KB/s), is 0.2 s
+  // of latency
+  for (int i = 0; i < 10; ++i) {
+    now += 1.0 / 32;
+    rate.Update(10000, 0, 65536, now, rate.GetQuality());
+  }
+  EXPECT_GT(rate.GetLatency(), 0.1);
+  EXPECT_LT(rate.GetQuality(), 90);
+}
+
+}  // namespace cs
@@ -0,0 +1,153 @@
+/*----------------------------------------------------------------------------*/
+/* Copyright (c) FIRST 2016. All Rights Reserved.                             */
+/* Open Source Software - may be modified and shared by FRC teams. The code   */
+/* must be accompanied by the FIRST BSD license file in the root directory of */
+/* the project.                                                               */
+/*----------------------------------------------------------------------------*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WebSocketUtil.h"
+
+namespace cs {
+
+// Build a masked (client to server) frame.
+static std::string ClientFrame(int opcode, llvm::StringRef payload,
+                               bool fin = true) {
+  static const unsigned char mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+  std::string frame;
+  llvm::raw_string_ostream os(frame);
+  WebSocketWriteHeader(os, opcode, payload.size(), fin);
+  os.flush();
+  frame[1] |= 0x80;
+  frame.append(reinterpret_cast<const char*>(mask), 4);
+  for (std::size_t i = 0; i < payload.size(); ++i)
+    frame += static_cast<char>(payload[i] ^ mask[i & 3]);
+  return frame;
+}
+
+class WebSocketParserTest : public ::testing::Test {
+ protected:
+  bool Execute(llvm::StringRef data) {
+    return parser.Execute(data, [&](int opcode, llvm::StringRef payload) {
+      messages.emplace_back(opcode, payload);
+    });
+  }
+
+  WebSocketParser parser;
+  std::vector<std::pair<int, std::string>> messages;
+};
+
+TEST(WebSocketUtilTest, AcceptKey) {
+  // Example from RFC 6455 section 1.3
+  EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+            WebSocketAcceptKey("dGhlIHNhbXBsZSBub25jZQ=="));
+  EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+            WebSocketAcceptKey(" dGhlIHNhbXBsZSBub25jZQ== "));
+}
+
+TEST(WebSocketUtilTest, WriteHeader) {
+  struct {
+    uint64_t len;
+    const char* header;
+    std::size_t headerLen;
+  } cases[] = {
+      {125, "\x82\x7d", 2},
+      {126, "\x82\x7e\x00\x7e", 4},
+      {65535, "\x82\x7e\xff\xff", 4},
+      {65536, "\x82\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10},
+  };
+  for (const auto& c : cases) {
+    std::string header;
+    llvm::raw_string_ostream os(header);
+    WebSocketWriteHeader(os, kWsBinary, c.len);
+    os.flush();
+    EXPECT_EQ(std::string(c.header, c.headerLen), header) << c.len;
+  }
+
+  std::string frame;
+  llvm::raw_string_ostream os(frame);
+  WebSocketWriteFrame(os, kWsText, "Hello");
+  os.flush();
+  EXPECT_EQ("\x81\x05Hello", frame);
+}
+
+TEST_F(WebSocketParserTest, Masked) {
+  // Masked "Hello" from RFC 6455 section 5.7
+  EXPECT_TRUE(Execute("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58"));
+  ASSERT_EQ(1u, messages.size());
+  EXPECT_EQ(kWsText, messages[0].first);
+  EXPECT_EQ("Hello", messages[0].second);
+}
+
+TEST_F(WebSocketParserTest, SplitFeeds) {
+  // 7, 16 and 64 bit lengths, and a fragmented message
+  std::string data = ClientFrame(kWsText, "first") +
+                     ClientFrame(kWsBinary, std::string(300, 'x')) +
+                     ClientFrame(kWsBinary, std::string(65536, 'y')) +
+                     ClientFrame(kWsText, "fragmented ", false) +
+                     ClientFrame(kWsContinuation, "message");
+  for (std::size_t i = 0; i < data.size(); i += 7)
+    EXPECT_TRUE(Execute(llvm::StringRef(data).substr(i, 7)));
+  ASSERT_EQ(4u, messages.size());
+  EXPECT_EQ("first", messages[0].second);
+  EXPECT_EQ(std::string(300, 'x'), messages[1].second);
+  EXPECT_EQ(std::string(65536, 'y'), messages[2].second);
+  EXPECT_EQ("fragmented message", messages[3].second);
+}
+
+TEST_F(WebSocketParserTest, TooLarge) {
+  EXPECT_FALSE(Execute(ClientFrame(kWsBinary, std::string(65537, 'x'))));
+  EXPECT_TRUE(messages.empty());
+
+  // Including when reassembled
+  WebSocketParser fragments;
+  auto ignore = [](int, llvm::StringRef) {};
+  std::string half(40000, 'x');
+  EXPECT_TRUE(fragments.Execute(ClientFrame(kWsText, half, false), ignore));
+  EXPECT_FALSE(
+      fragments.Execute(ClientFrame(kWsContinuation, half), ignore));
+}
+
+TEST_F(WebSocketParserTest, Fragmented) {
+  // Control frames may arrive between fragments
+  EXPECT_TRUE(Execute(ClientFrame(kWsText, "Hel", false) +
+                      ClientFrame(kWsPing, "ping") +
+                      ClientFrame(kWsContinuation, "lo", false) +
+                      ClientFrame(kWsContinuation, " world")));
+  ASSERT_EQ(2u, messages.size());
+  EXPECT_EQ(kWsPing, messages[0].first);
+  EXPECT_EQ("ping", messages[0].second);
+  EXPECT_EQ(kWsText, messages[1].first);
+  EXPECT_EQ("Hello world", messages[1].second);
+}
+
+TEST_F(WebSocketParserTest, Errors) {
+  struct {
+    std::string data;
+    const char* name;
+  } cases[] = {
+      {"\x81\x05Hello", "unmasked"},
+      {std::string("\xc1\x80\0\0\0\0", 6), "reserved bits"},
+      {ClientFrame(kWsContinuation, "x"), "unexpected continuation"},
+      {ClientFrame(kWsText, "a", false) + ClientFrame(kWsText, "b"),
+       "expected continuation"},
+      {ClientFrame(kWsPing, "x", false), "fragmented control"},
+      {ClientFrame(kWsPing, std::string(126, 'x')), "long control"},
+      {ClientFrame(0x3, "x"), "unknown opcode"},
+  };
+  for (const auto& c : cases) {
+    WebSocketParser fresh;
+    auto ignore = [](int, llvm::StringRef) {};
+    EXPECT_FALSE(fresh.Execute(c.data, ignore)) << c.name;
+    EXPECT_FALSE(fresh.GetError().empty()) << c.name;
+    // Errors are sticky
+    EXPECT_FALSE(fresh.Execute(ClientFrame(kWsText, "x"), ignore));
+  }
+}
+
+}  // namespace cs